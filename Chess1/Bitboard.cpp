@@ -0,0 +1,231 @@
+//
+//  Bitboard.cpp
+//  Chess1
+//
+
+#include "Bitboard.hpp"
+
+Bitboard BETWEEN_BITS[SQUARE_COUNT][SQUARE_COUNT];
+Bitboard LINE_BITS[SQUARE_COUNT][SQUARE_COUNT];
+Magic ROOK_MAGICS[SQUARE_COUNT];
+Magic BISHOP_MAGICS[SQUARE_COUNT];
+
+static Bitboard rookTable[0x19000];
+static Bitboard bishopTable[0x1480];
+
+static const char *SQUARE_NAMES[SQUARE_COUNT] = {
+    "a1", "b1", "c1", "d1", "e1", "f1", "g1", "h1",
+    "a2", "b2", "c2", "d2", "e2", "f2", "g2", "h2",
+    "a3", "b3", "c3", "d3", "e3", "f3", "g3", "h3",
+    "a4", "b4", "c4", "d4", "e4", "f4", "g4", "h4",
+    "a5", "b5", "c5", "d5", "e5", "f5", "g5", "h5",
+    "a6", "b6", "c6", "d6", "e6", "f6", "g6", "h6",
+    "a7", "b7", "c7", "d7", "e7", "f7", "g7", "h7",
+    "a8", "b8", "c8", "d8", "e8", "f8", "g8", "h8"
+};
+
+static const int ROOK_DIRECTIONS[4][2] = {
+    { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 }
+};
+
+static const int BISHOP_DIRECTIONS[4][2] = {
+    { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 }
+};
+
+static Bitboard slidingAttacks(int square,
+                               Bitboard occupied,
+                               const int directions[4][2]);
+static void initMagics(Magic magics[],
+                       Bitboard table[],
+                       const int directions[4][2]);
+#ifndef __BMI2__
+static uint64_t nextRandom(uint64_t *state);
+#endif
+static void initLines();
+
+void initBitboards()
+{
+    initMagics(ROOK_MAGICS, rookTable, ROOK_DIRECTIONS);
+    initMagics(BISHOP_MAGICS, bishopTable, BISHOP_DIRECTIONS);
+    initLines();
+}
+
+int squareForName(const char *name)
+{
+    if (name[0] < 'a' || name[0] > 'h' ||
+        name[1] < '1' || name[1] > '8')
+    {
+        return -1;
+    }
+    
+    return (name[1] - '1') * 8 + (name[0] - 'a');
+}
+
+const char *nameForSquare(int square)
+{
+    return SQUARE_NAMES[square];
+}
+
+static Bitboard slidingAttacks(int square,
+                               Bitboard occupied,
+                               const int directions[4][2])
+{
+    Bitboard attacks = 0;
+    
+    for (int direction = 0; direction < 4; direction++)
+    {
+        int xDir = directions[direction][0];
+        int yDir = directions[direction][1];
+        
+        for (int x = (square & 7) + xDir, y = (square >> 3) + yDir;
+             x >= 0 && x < 8 && y >= 0 && y < 8;
+             x += xDir, y += yDir)
+        {
+            attacks |= squareBit(y * 8 + x);
+            
+            if (occupied & squareBit(y * 8 + x))
+            {
+                break;
+            }
+        }
+    }
+    
+    return attacks;
+}
+
+// "Fancy" magic bitboards.  Every square gets its own slice of the shared
+// table, sized by the number of relevant occupancy bits.  Magics are searched
+// for at startup with fixed per-rank seeds, which is quick enough to do on
+// every launch and always finds the same numbers.
+static void initMagics(Magic magics[],
+                       Bitboard table[],
+                       const int directions[4][2])
+{
+    static Bitboard occupancy[4096];
+    static Bitboard reference[4096];
+#ifndef __BMI2__
+    // epoch[] remembers which attempt last wrote each slot, so the table
+    // doesn't have to be cleared between candidate magics.
+    static int epoch[4096];
+    static int attempt = 0;
+    static const uint64_t seeds[8] = {
+        728, 10316, 55013, 32803, 12281, 15100, 16645, 255
+    };
+#endif
+    Bitboard *nextSlice = table;
+    
+    for (int square = 0; square < SQUARE_COUNT; square++)
+    {
+        Magic &magic = magics[square];
+        
+        // Pieces on the edge of the board never block anything, so they
+        // don't need to be part of the index.
+        Bitboard edges = ((RANK_1_BITS | RANK_8_BITS) &
+                          ~(RANK_1_BITS << (8 * (square >> 3)))) |
+                         ((FILE_A_BITS | FILE_H_BITS) &
+                          ~(FILE_A_BITS << (square & 7)));
+        
+        magic.mask = slidingAttacks(square, 0, directions) & ~edges;
+        magic.shift = 64 - popCount(magic.mask);
+        magic.attacks = nextSlice;
+        
+        // Enumerate every subset of the mask (Carry-Rippler trick).
+        int size = 0;
+        Bitboard subset = 0;
+        
+        do
+        {
+            occupancy[size] = subset;
+            reference[size] = slidingAttacks(square, subset, directions);
+            size++;
+            subset = (subset - magic.mask) & magic.mask;
+        } while (subset != 0);
+        
+        nextSlice += size;
+        
+#ifdef __BMI2__
+        magic.magic = 0;
+        
+        for (int index = 0; index < size; index++)
+        {
+            magic.attacks[magicIndex(magic, occupancy[index])] = reference[index];
+        }
+#else
+        uint64_t randomState = seeds[square >> 3];
+        
+        for (int index = 0; index < size; )
+        {
+            do
+            {
+                magic.magic = nextRandom(&randomState) &
+                              nextRandom(&randomState) &
+                              nextRandom(&randomState);
+            } while (popCount((magic.magic * magic.mask) >> 56) < 6);
+            
+            attempt++;
+            
+            for (index = 0; index < size; index++)
+            {
+                unsigned tableIndex = magicIndex(magic, occupancy[index]);
+                
+                if (epoch[tableIndex] < attempt)
+                {
+                    epoch[tableIndex] = attempt;
+                    magic.attacks[tableIndex] = reference[index];
+                }
+                else if (magic.attacks[tableIndex] != reference[index])
+                {
+                    break;
+                }
+            }
+        }
+#endif
+    }
+}
+
+// Needs the magics.  Two squares on a line see each other on an empty board,
+// and the squares between them are the ones both see with the other one
+// occupied.
+static void initLines()
+{
+    for (int from = 0; from < SQUARE_COUNT; from++)
+    {
+        for (int to = 0; to < SQUARE_COUNT; to++)
+        {
+            BETWEEN_BITS[from][to] = 0;
+            LINE_BITS[from][to] = 0;
+            
+            if (from == to)
+            {
+                continue;
+            }
+            
+            if (rookAttacks(from, 0) & squareBit(to))
+            {
+                BETWEEN_BITS[from][to] = rookAttacks(from, squareBit(to)) &
+                                         rookAttacks(to, squareBit(from));
+                LINE_BITS[from][to] = (rookAttacks(from, 0) & rookAttacks(to, 0)) |
+                                      squareBit(from) | squareBit(to);
+            }
+            else if (bishopAttacks(from, 0) & squareBit(to))
+            {
+                BETWEEN_BITS[from][to] = bishopAttacks(from, squareBit(to)) &
+                                         bishopAttacks(to, squareBit(from));
+                LINE_BITS[from][to] = (bishopAttacks(from, 0) & bishopAttacks(to, 0)) |
+                                      squareBit(from) | squareBit(to);
+            }
+        }
+    }
+}
+
+#ifndef __BMI2__
+// xorshift64*
+static uint64_t nextRandom(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    
+    return *state * 2685821657736338717ULL;
+}
+#endif
@@ -0,0 +1,207 @@
+//
+//  Bitboard.hpp
+//  Chess1
+//
+
+#ifndef Bitboard_hpp
+#define Bitboard_hpp
+
+#include <stdint.h>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+typedef uint64_t Bitboard;
+
+typedef struct
+{
+    int x, y;
+} Vector2i;
+
+typedef struct
+{
+    Bitboard mask;
+    Bitboard magic;
+    Bitboard *attacks;
+    int shift;
+} Magic;
+
+static const int SQUARE_COUNT = 64;
+
+static const Bitboard FILE_A_BITS = 0x0101010101010101ULL;
+static const Bitboard FILE_H_BITS = FILE_A_BITS << 7;
+static const Bitboard RANK_1_BITS = 0xFFULL;
+static const Bitboard RANK_8_BITS = RANK_1_BITS << 56;
+
+// A leaper's moves as { file, rank } steps.
+typedef struct
+{
+    int count;
+    int steps[8][2];
+} StepSet;
+
+typedef struct
+{
+    Bitboard bits[SQUARE_COUNT];
+} SquareTable;
+
+typedef struct
+{
+    Bitboard bits[2][SQUARE_COUNT];
+} ColorSquareTable;
+
+constexpr Bitboard squareBit(int square)
+{
+    return 1ULL << square;
+}
+
+constexpr Bitboard stepAttacks(int square, const StepSet &steps)
+{
+    Bitboard attacks = 0;
+    
+    for (int step = 0; step < steps.count; step++)
+    {
+        int x = (square & 7) + steps.steps[step][0];
+        int y = (square >> 3) + steps.steps[step][1];
+        
+        if (x >= 0 && x < 8 && y >= 0 && y < 8)
+        {
+            attacks |= squareBit(y * 8 + x);
+        }
+    }
+    
+    return attacks;
+}
+
+constexpr SquareTable stepAttackTable(const StepSet &steps)
+{
+    SquareTable table = {};
+    
+    for (int square = 0; square < SQUARE_COUNT; square++)
+    {
+        table.bits[square] = stepAttacks(square, steps);
+    }
+    
+    return table;
+}
+
+constexpr ColorSquareTable pawnAttackTable(const StepSet &whiteSteps,
+                                           const StepSet &blackSteps)
+{
+    ColorSquareTable table = {};
+    
+    for (int square = 0; square < SQUARE_COUNT; square++)
+    {
+        table.bits[0][square] = stepAttacks(square, whiteSteps);
+        table.bits[1][square] = stepAttacks(square, blackSteps);
+    }
+    
+    return table;
+}
+
+static constexpr StepSet KNIGHT_STEPS = {
+    8, { { 1, 2 }, { 2, 1 }, { 2, -1 }, { 1, -2 },
+         { -1, -2 }, { -2, -1 }, { -2, 1 }, { -1, 2 } }
+};
+static constexpr StepSet KING_STEPS = {
+    8, { { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 },
+         { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 } }
+};
+static constexpr StepSet WHITE_PAWN_STEPS = { 2, { { -1, 1 }, { 1, 1 } } };
+static constexpr StepSet BLACK_PAWN_STEPS = { 2, { { -1, -1 }, { 1, -1 } } };
+
+// The leaper tables are built by the compiler, so they need no setup and
+// every lookup is a load from a constant.
+static constexpr SquareTable KNIGHT_TABLE = stepAttackTable(KNIGHT_STEPS);
+static constexpr SquareTable KING_TABLE = stepAttackTable(KING_STEPS);
+static constexpr ColorSquareTable PAWN_TABLE = pawnAttackTable(WHITE_PAWN_STEPS,
+                                                               BLACK_PAWN_STEPS);
+
+static constexpr const Bitboard (&KNIGHT_ATTACKS)[SQUARE_COUNT] = KNIGHT_TABLE.bits;
+static constexpr const Bitboard (&KING_ATTACKS)[SQUARE_COUNT] = KING_TABLE.bits;
+static constexpr const Bitboard (&PAWN_ATTACKS)[2][SQUARE_COUNT] = PAWN_TABLE.bits;
+
+static_assert(KNIGHT_ATTACKS[0] == 0x20400ULL, "knight table");
+static_assert(KING_ATTACKS[63] == 0x40C0000000000000ULL, "king table");
+
+// BETWEEN_BITS[a][b] is the squares strictly between a and b, and
+// LINE_BITS[a][b] the whole line through both, when they share a rank, file
+// or diagonal.  Both are empty otherwise.
+extern Bitboard BETWEEN_BITS[SQUARE_COUNT][SQUARE_COUNT];
+extern Bitboard LINE_BITS[SQUARE_COUNT][SQUARE_COUNT];
+
+extern Magic ROOK_MAGICS[SQUARE_COUNT];
+extern Magic BISHOP_MAGICS[SQUARE_COUNT];
+
+// Must be called once before the slider attack tables are used.
+void initBitboards();
+
+// Algebraic square names ("e4").  squareForName returns -1 if the name isn't
+// a square.
+int squareForName(const char *name);
+const char *nameForSquare(int square);
+
+// Squares are numbered a1 == 0 through h8 == 63.  Board positions use the
+// renderer's layout instead, where { 0, 0 } is the top left corner (a8) and
+// white starts at the bottom.
+inline int squareForPosition(Vector2i position)
+{
+    return (7 - position.y) * 8 + position.x;
+}
+
+inline Vector2i positionForSquare(int square)
+{
+    return { square & 7, 7 - (square >> 3) };
+}
+
+inline int popCount(Bitboard bits)
+{
+    return __builtin_popcountll(bits);
+}
+
+inline int lowestSquare(Bitboard bits)
+{
+    return __builtin_ctzll(bits);
+}
+
+inline int popLowestSquare(Bitboard *bits)
+{
+    int square = __builtin_ctzll(*bits);
+    *bits &= *bits - 1;
+    
+    return square;
+}
+
+// With BMI2 the occupancy is compressed with PEXT, otherwise a magic
+// multiply does the same job.  The tables are filled using whichever one is
+// compiled in.
+inline unsigned magicIndex(const Magic &magic, Bitboard occupied)
+{
+#ifdef __BMI2__
+    return (unsigned)_pext_u64(occupied, magic.mask);
+#else
+    return (unsigned)(((occupied & magic.mask) * magic.magic) >> magic.shift);
+#endif
+}
+
+inline Bitboard rookAttacks(int square, Bitboard occupied)
+{
+    const Magic &magic = ROOK_MAGICS[square];
+    
+    return magic.attacks[magicIndex(magic, occupied)];
+}
+
+inline Bitboard bishopAttacks(int square, Bitboard occupied)
+{
+    const Magic &magic = BISHOP_MAGICS[square];
+    
+    return magic.attacks[magicIndex(magic, occupied)];
+}
+
+inline Bitboard queenAttacks(int square, Bitboard occupied)
+{
+    return rookAttacks(square, occupied) | bishopAttacks(square, occupied);
+}
+
+#endif /* Bitboard_hpp */
@@ -0,0 +1,56 @@
+//
+//  Book.hpp
+//  Chess1
+//
+//  Opening books in Polyglot's .bin layout: 16 byte big-endian entries of
+//  key, move, weight and learn, sorted by key.  The open book is
+//  memory-mapped and binary-searched where it lies, so opening one costs the
+//  same however big it is.
+//
+//  Keys are Polyglot's: its published number for each piece kind on each
+//  square, castling right, capturable en passant file and white to move,
+//  XORed together.  Third-party books read as they are, and `book check`
+//  compares bookKey with the keys Polyglot's documentation gives for a few
+//  positions.
+//
+
+#ifndef Book_hpp
+#define Book_hpp
+
+#include "Position.hpp"
+#include "MoveGen.hpp"
+
+typedef struct
+{
+    Move move;
+    int weight;
+} BookMove;
+
+// Replaces any open book.  Returns false, leaving no book open, if path
+// can't be mapped or isn't a whole number of entries.  Not safe while other
+// threads are probing.
+bool openBook(const char *path);
+void closeBook();
+bool bookIsOpen();
+size_t bookEntryCount();
+
+uint64_t bookKey(const Position *position);
+
+// The book's legal moves for position, with their weights.  Returns how many.
+int findBookMoves(const Position *position, BookMove moves[MAX_MOVES]);
+
+// One of the book's moves, picked with probability in proportion to its
+// weight, or NULL_MOVE if the book has nothing to say.  random is any
+// uniformly distributed number.
+Move pickBookMove(const Position *position, uint32_t random);
+
+// Builds a book at bookPath from the first maxPlies plies of every game in
+// the PGN at pgnPath, weighting each move 2 for a win and 1 for a draw by
+// the side that played it.  Returns false if either file can't be used.
+bool makeBook(const char *pgnPath,
+              const char *bookPath,
+              int maxPlies,
+              int threads,
+              size_t *entryCount);
+
+#endif /* Book_hpp */
@@ -0,0 +1,2252 @@
+//
+//  Commands.cpp
+//  Chess1
+//
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <random>
+#include <fstream>
+#include <atomic>
+#include <mutex>
+#include <iomanip>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include "Commands.hpp"
+#include "Rules.hpp"
+#include "MoveGen.hpp"
+#include "Search.hpp"
+#include "Evaluate.hpp"
+#include "TranspositionTable.hpp"
+#include "SelfPlay.hpp"
+#include "Uci.hpp"
+#include "Epd.hpp"
+#include "Pgn.hpp"
+#include "Book.hpp"
+#include "Tablebase.hpp"
+#include "Syzygy.hpp"
+#include "Nnue.hpp"
+#include "GameRecord.hpp"
+#include "GameHost.hpp"
+#include "GameServer.hpp"
+#include "LoadClient.hpp"
+#include "ThreadPool.hpp"
+
+typedef struct
+{
+    const char *name;
+    const char *usage;
+    int (*run)(int argc, const char *argv[]);
+} Command;
+
+static void initHeadless();
+static bool parseMoveText(const std::string &text,
+                          Vector2i *position,
+                          Vector2i *nextPosition);
+static int runPlay(int argc, const char *argv[]);
+static int runRulesCheck(int argc, const char *argv[]);
+static int runPerft(int argc, const char *argv[]);
+static int runSearch(int argc, const char *argv[]);
+static int runEval(int argc, const char *argv[]);
+static int checkIncrementalTotals(int steps);
+static int runNnue(int argc, const char *argv[]);
+static int checkNnue(const std::vector<Position> &positions, double *meanDifference);
+static double evalsPerSecond(const std::vector<Position> &positions, int kernel);
+static int runScaling(int argc, const char *argv[]);
+static int runAttacks(int argc, const char *argv[]);
+static int runSelfPlayCommand(int argc, const char *argv[]);
+static int runUciCommand(int argc, const char *argv[]);
+static int runEpd(int argc, const char *argv[]);
+static int runPgn(int argc, const char *argv[]);
+static int runBook(int argc, const char *argv[]);
+static int runTablebase(int argc, const char *argv[]);
+static bool probeForDisplay(const Position *position, TablebaseResult *result);
+static std::string describeTablebaseResult(const TablebaseResult &result);
+static int runGames(int argc, const char *argv[]);
+static int convertPgnGames(int argc, const char *argv[]);
+static bool checkGameRecord(const GameRecord &record);
+static int runHost(int argc, const char *argv[]);
+static uint32_t hostedRandom(uint32_t seed, int game, int round);
+static int runServe(int argc, const char *argv[]);
+static int runLoadTest(int argc, const char *argv[]);
+static std::vector<Position> randomPositions(int count);
+static double millisecondsSince(std::chrono::steady_clock::time_point start);
+static uint64_t peakResidentBytes();
+
+static const Command COMMANDS[] = {
+    { "uci", "uci                   talk UCI on stdin and stdout, for chess GUIs", runUciCommand },
+    { "play", "play                  apply moves like e2e4 read from stdin", runPlay },
+    { "rules", "rules [positions <n>]\n"
+               "                        check the click rules against the move generator on random positions", runRulesCheck },
+    { "perft", "perft <depth> [fen <fen>]\n"
+               "                        count legal move paths from the start position, or from fen", runPerft },
+    { "search", "search [depth <n>] [movetime <ms>] [threads <n>] [hash <mb>] [nnue <file>] [moves <move>...]\n"
+                "                        find the best move from the start position, or after moves", runSearch },
+    { "eval", "eval [<fen>]\n"
+              "                        break the start position's evaluation, or fen's, into terms and time them", runEval },
+    { "nnue", "nnue make <file>\n"
+              "                        write a starting network that plays like material and piece squares\n"
+              "  nnue bench <file> [positions <n>]\n"
+              "                        check a network's accumulators and kernels, and time it against eval", runNnue },
+    { "scaling", "scaling [threads <n>] [movetime <ms>]\n"
+                 "                        compare search speed from 1 up to n threads", runScaling },
+    { "attacks", "attacks [positions <n>]\n"
+                 "                        time attacked-square queries, attack maps against piece callbacks", runAttacks },
+    { "epd", "epd <file> [threads <n>] [perftdepth <n>] [depth <n>] [movetime <ms>]\n"
+             "                        check a suite's perft counts and best moves in parallel, with timings", runEpd },
+    { "pgn", "pgn <file> [threads <n>] [problems <n>]\n"
+             "                        replay a PGN archive in parallel and report illegal moves", runPgn },
+    { "book", "book make <pgn> <file> [plies <n>] [threads <n>]\n"
+              "                        build a Polyglot-layout opening book from a PGN archive\n"
+              "  book probe <file> [moves <move>...]\n"
+              "                        list the book's moves from the start position, or after moves\n"
+              "  book check\n"
+              "                        compare position keys with the ones Polyglot publishes", runBook },
+    { "tablebase", "tablebase make <dir> <material>... [threads <n>]\n"
+                   "                        build endgame tables such as KQvK, and the smaller ones they need\n"
+                   "  tablebase probe <dir> fen <fen>\n"
+                   "                        look a position and each of its moves up in dir's tables", runTablebase },
+    { "games", "games <file> [threads <n>] [show <n>]\n"
+               "                        check every recorded game in parallel, or print game n\n"
+               "  games convert <pgn> <file> [threads <n>]\n"
+               "                        append a PGN archive's games to a compact game file", runGames },
+    { "host", "host [games <n>] [rounds <n>] [threads <n>] [shards <n>] [seed <n>]\n"
+              "                        keep many games going at once, a random move in each every round", runHost },
+    { "serve", "serve <socket|port> [workers <n>]\n"
+               "                        serve games over a Unix socket or loopback port until interrupted (Linux)", runServe },
+    { "loadtest", "loadtest <socket|port> [connections <n>] [games <n>] [seconds <n>] [maxplies <n>] [seed <n>]\n"
+                  "                        play random games against a running server and time its answers", runLoadTest },
+    { "selfplay", "selfplay [games <n>] [threads <n>] [white <mover>] [black <mover>] [output <file>]\n"
+                  "         [book <file>] [tablebases <dir>] [seed <n>] [randomplies <n>] [maxplies <n>]\n"
+                  "                        play computer games in parallel; a mover is random, depth=<n> or movetime=<ms>", runSelfPlayCommand },
+};
+
+static const int COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
+// Indexed by GAME_END_*.
+static const char *GAME_END_NAMES[] = {
+    "checkmate", "stalemate", "fifty moves", "max plies", "tablebase", "other"
+};
+
+int runCommand(int argc, const char *argv[])
+{
+    if (argc < 2)
+    {
+        return -1;
+    }
+    
+    for (int commandIndex = 0; commandIndex < COMMAND_COUNT; commandIndex++)
+    {
+        if (strcmp(argv[1], COMMANDS[commandIndex].name) == 0)
+        {
+            return COMMANDS[commandIndex].run(argc - 2, argv + 2);
+        }
+    }
+    
+    return -1;
+}
+
+void printCommandUsage()
+{
+    std::cout << "Usage:" << std::endl;
+    
+    for (int commandIndex = 0; commandIndex < COMMAND_COUNT; commandIndex++)
+    {
+        std::cout << "  " << COMMANDS[commandIndex].usage << std::endl;
+    }
+}
+
+static void initHeadless()
+{
+    static bool initialized = false;
+    
+    if (!initialized)
+    {
+        initBitboards();
+        initZobrist();
+        initPieces();
+        resizeTranspositionTable(DEFAULT_HASH_MB);
+        initialized = true;
+    }
+    
+    resetGame();
+}
+
+static bool parseMoveText(const std::string &text,
+                          Vector2i *position,
+                          Vector2i *nextPosition)
+{
+    if (text.size() < 4)
+    {
+        return false;
+    }
+    
+    int square = squareForName(text.c_str());
+    int nextSquare = squareForName(text.c_str() + 2);
+    
+    if (square < 0 || nextSquare < 0)
+    {
+        return false;
+    }
+    
+    *position = positionForSquare(square);
+    *nextPosition = positionForSquare(nextSquare);
+    
+    return true;
+}
+
+// Reads one move per line and answers "ok" or "illegal" for each, so the
+// rules can be driven from a pipe.  "reset" starts a new game and "quit"
+// stops reading.
+static int runPlay(int argc, const char *argv[])
+{
+    initHeadless();
+    setPrintGameState(false);
+    
+    std::string line;
+    
+    while (std::getline(std::cin, line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+        
+        if (line == "quit")
+        {
+            break;
+        }
+        
+        if (line == "reset")
+        {
+            resetGame();
+            std::cout << "ok" << std::endl;
+            continue;
+        }
+        
+        Vector2i position;
+        Vector2i nextPosition;
+        
+        if (!parseMoveText(line, &position, &nextPosition) ||
+            !submitMove(position, nextPosition))
+        {
+            std::cout << "illegal " << line << std::endl;
+            continue;
+        }
+        
+        std::cout << "ok" << std::endl;
+        
+        if (getWinner() == COLOR_WHITE)
+        {
+            std::cout << "winner white" << std::endl;
+        }
+        else if (getWinner() == COLOR_BLACK)
+        {
+            std::cout << "winner black" << std::endl;
+        }
+        else if (getWinner() == GAME_DRAWN)
+        {
+            std::cout << "draw stalemate" << std::endl;
+        }
+    }
+    
+    return 0;
+}
+
+// Games where the click rules have been caught out before, each ending on a
+// move they must turn down.
+static const char *const RULES_REGRESSIONS[][8] = {
+    // The king walks into a bishop's diagonal; once it had, the bishop
+    // could take it.
+    { "e2e4", "e7e5", "e1e2", "f8c5", "e2e3", nullptr },
+    // A knight pinned to its king steps aside.
+    { "e2e4", "e7e5", "d2d4", "f8b4", "b1c3", "g8f6", "c3d5", nullptr },
+};
+
+// Plays the regression games through submitMove, then, on random positions,
+// offers it every from and to square of the side to move and checks that
+// it plays exactly the ordinary moves and promotions the generator finds.
+// Castling and en passant have no click path, so those squares are skipped.
+static int runRulesCheck(int argc, const char *argv[])
+{
+    int positionCount = 1000;
+    
+    if (argc >= 2 && strcmp(argv[0], "positions") == 0)
+    {
+        positionCount = std::max(atoi(argv[1]), 1);
+    }
+    
+    initHeadless();
+    setPrintGameState(false);
+    
+    int failures = 0;
+    Vector2i position;
+    Vector2i nextPosition;
+    
+    for (size_t game = 0; game < sizeof(RULES_REGRESSIONS) / sizeof(RULES_REGRESSIONS[0]); game++)
+    {
+        resetGame();
+        
+        for (int ply = 0; RULES_REGRESSIONS[game][ply] != nullptr; ply++)
+        {
+            bool last = RULES_REGRESSIONS[game][ply + 1] == nullptr;
+            bool played = parseMoveText(RULES_REGRESSIONS[game][ply], &position, &nextPosition) &&
+                          submitMove(position, nextPosition);
+            
+            if (played == last)
+            {
+                std::cout << "regression " << game + 1 << ": " << RULES_REGRESSIONS[game][ply]
+                          << (played ? " was played" : " was turned down") << std::endl;
+                failures++;
+                break;
+            }
+        }
+    }
+    
+    std::vector<Position> positions = randomPositions(positionCount);
+    MoveList list;
+    
+    for (size_t positionIndex = 0; positionIndex < positions.size(); positionIndex++)
+    {
+        const Position &start = positions[positionIndex];
+        generateLegalMoves(&start, &list);
+        
+        // Per from and to square: 0 for nothing, 1 for an ordinary move or
+        // a promotion and 2 for a move the click rules don't cover.
+        int expected[SQUARE_COUNT][SQUARE_COUNT] = {};
+        
+        for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+        {
+            Move move = list.moves[moveIndex];
+            expected[moveFrom(move)][moveTo(move)] = (moveType(move) == MOVE_NORMAL ||
+                                                      moveType(move) == MOVE_PROMOTION) ? 1 : 2;
+        }
+        
+        Bitboard pieces = start.colors[colorIndex(start.sideToMove)];
+        setGamePosition(&start);
+        
+        while (pieces != 0)
+        {
+            int from = popLowestSquare(&pieces);
+            
+            for (int to = 0; to < SQUARE_COUNT; to++)
+            {
+                if (expected[from][to] == 2)
+                {
+                    continue;
+                }
+                
+                bool played = submitMove(positionForSquare(from), positionForSquare(to));
+                
+                if (played != (expected[from][to] == 1))
+                {
+                    std::cout << formatFen(&start) << ": "
+                              << moveToString(encodeMove(from, to, MOVE_NORMAL))
+                              << (played ? " was played" : " was turned down") << std::endl;
+                    failures++;
+                }
+                
+                if (played)
+                {
+                    setGamePosition(&start);
+                }
+            }
+        }
+    }
+    
+    std::cout << failures << " failures" << std::endl;
+    
+    return (failures == 0) ? 0 : 1;
+}
+
+// Prints the node count under every root move ("divide") and the totals, so
+// a wrong count can be narrowed down one move at a time.  The FEN may be
+// given as one argument or as several.
+static int runPerft(int argc, const char *argv[])
+{
+    if (argc < 1 || atoi(argv[0]) < 1)
+    {
+        std::cout << "perft needs a depth of at least 1" << std::endl;
+        return 1;
+    }
+    
+    int depth = atoi(argv[0]);
+    
+    initHeadless();
+    
+    Position position = *getGamePosition();
+    
+    if (argc > 2 && strcmp(argv[1], "fen") == 0)
+    {
+        std::string fen;
+        
+        for (int argIndex = 2; argIndex < argc; argIndex++)
+        {
+            fen += (argIndex == 2 ? "" : " ") + std::string(argv[argIndex]);
+        }
+        
+        if (!parseFen(&position, fen.c_str()))
+        {
+            std::cout << "bad fen " << fen << std::endl;
+            return 1;
+        }
+    }
+    MoveList list;
+    generateLegalMoves(&position, &list);
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t totalNodes = 0;
+    
+    for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+    {
+        Position next = position;
+        applyMove(&next, list.moves[moveIndex]);
+        
+        uint64_t nodes = perft(&next, depth - 1);
+        totalNodes += nodes;
+        
+        std::cout << moveToString(list.moves[moveIndex]) << ": " << nodes << std::endl;
+    }
+    
+    double elapsed = millisecondsSince(start);
+    
+    std::cout << std::endl;
+    std::cout << "Moves: " << list.count << std::endl;
+    std::cout << "Nodes: " << totalNodes << std::endl;
+    std::cout << "Time: " << (uint64_t)elapsed << " ms" << std::endl;
+    std::cout << "Nodes/sec: " << (uint64_t)(totalNodes * 1000.0 / (elapsed + 1e-9)) << std::endl;
+    
+    return 0;
+}
+
+// Prints a line per completed iteration, the hash table's hit rate and then
+// the move it settled on.  With no limits given the search stops at depth 6.
+static int runSearch(int argc, const char *argv[])
+{
+    SearchLimits limits = { 0, 0, 1 };
+    
+    initHeadless();
+    
+    Position position = *getGamePosition();
+    
+    for (int argIndex = 0; argIndex < argc; argIndex++)
+    {
+        std::string arg = argv[argIndex];
+        
+        if (arg == "depth" && argIndex + 1 < argc)
+        {
+            limits.depth = atoi(argv[++argIndex]);
+        }
+        else if (arg == "movetime" && argIndex + 1 < argc)
+        {
+            limits.moveTimeMs = atoi(argv[++argIndex]);
+        }
+        else if (arg == "threads" && argIndex + 1 < argc)
+        {
+            limits.threads = atoi(argv[++argIndex]);
+        }
+        else if (arg == "hash" && argIndex + 1 < argc)
+        {
+            resizeTranspositionTable(atoi(argv[++argIndex]));
+        }
+        else if (arg == "nnue" && argIndex + 1 < argc)
+        {
+            if (!loadNnue(argv[++argIndex]))
+            {
+                std::cout << "can't load network " << argv[argIndex] << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "moves")
+        {
+            while (argIndex + 1 < argc)
+            {
+                Move move = moveFromString(&position, argv[++argIndex]);
+                
+                if (move == NULL_MOVE)
+                {
+                    std::cout << "illegal move " << argv[argIndex] << std::endl;
+                    return 1;
+                }
+                
+                applyMove(&position, move);
+            }
+        }
+        else
+        {
+            std::cout << "unknown search option " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    if (limits.depth == 0 && limits.moveTimeMs == 0)
+    {
+        limits.depth = 6;
+    }
+    
+    resetTranspositionStats();
+    
+    Move bestMove = searchPosition(&position, limits, [](const SearchReport &report) {
+        std::cout << formatSearchReport(report) << std::endl;
+    }, nullptr);
+    
+    TranspositionStats stats = getTranspositionStats();
+    
+    std::cout << "Hash: " << (transpositionTableBytes() >> 20) << " MB, "
+              << stats.probes << " probes, "
+              << stats.hits << " hits ("
+              << (uint64_t)(stats.hits * 100.0 / (stats.probes + 1e-9)) << "%), "
+              << stats.stores << " stores" << std::endl;
+    std::cout << "bestmove " << moveToString(bestMove) << std::endl;
+    
+    return 0;
+}
+
+// The terms side by side, a check that the totals Position keeps match
+// every kernel's from scratch, and how long each part takes on position.
+static int runEval(int argc, const char *argv[])
+{
+    initHeadless();
+    
+    Position position = *getGamePosition();
+    
+    if (argc > 0)
+    {
+        std::string fen;
+        
+        for (int argIndex = 0; argIndex < argc; argIndex++)
+        {
+            fen += (argIndex == 0 ? "" : " ") + std::string(argv[argIndex]);
+        }
+        
+        if (!parseFen(&position, fen.c_str()))
+        {
+            std::cout << "bad fen " << fen << std::endl;
+            return 1;
+        }
+    }
+    
+    const char *TERM_NAMES[] = { "Material", "Mobility", "King safety", "Pawns" };
+    TermScore (*const TERMS[])(const Position *position) = {
+        materialTerm, mobilityTerm, kingSafetyTerm, pawnTerm
+    };
+    const int TERM_COUNT = sizeof(TERMS) / sizeof(TERMS[0]);
+    TermScore total = { 0, 0 };
+    
+    std::cout << "Position: " << formatFen(&position) << std::endl;
+    std::cout << "Phase: " << std::min(position.phase, MAX_GAME_PHASE) << " of " << MAX_GAME_PHASE << std::endl;
+    std::cout << "Term          Middlegame   Endgame" << std::endl;
+    
+    for (int term = 0; term < TERM_COUNT; term++)
+    {
+        TermScore score = TERMS[term](&position);
+        total.middlegame += score.middlegame;
+        total.endgame += score.endgame;
+        
+        std::cout << "  " << TERM_NAMES[term] << std::string(12 - strlen(TERM_NAMES[term]), ' ')
+                  << std::setw(10) << score.middlegame << std::setw(10) << score.endgame << std::endl;
+    }
+    
+    std::cout << "  Total       " << std::setw(10) << total.middlegame
+              << std::setw(10) << total.endgame << std::endl;
+    std::cout << "Score: " << taperedScore(&position, total) << " for white, "
+              << evaluate(&position) << " for the side to move" << std::endl;
+    
+    int mismatches = checkIncrementalTotals(100000);
+    
+    std::cout << "Incremental totals: " << ((mismatches == 0) ? "match" : "DON'T match")
+              << " every kernel over 100000 made and unmade moves" << std::endl;
+    
+    // Each part run over and over on the one position; sink keeps the
+    // compiler from dropping the calls.
+    const int ITERATIONS = 1000000;
+    volatile int sink = 0;
+    std::chrono::steady_clock::time_point start;
+    
+    std::cout << "Timing (ns a call):" << std::endl;
+    
+    for (int kernel = 0; kernel < EVAL_KERNEL_COUNT; kernel++)
+    {
+        if (!evalKernelAvailable(kernel))
+        {
+            continue;
+        }
+        
+        start = std::chrono::steady_clock::now();
+        
+        for (int iteration = 0; iteration < ITERATIONS; iteration++)
+        {
+            sink = sink + pieceSquareTotals(&position, kernel).middlegame;
+        }
+        
+        std::string name = std::string("  Recomputed (") + evalKernelName(kernel) +
+                           (kernel == bestEvalKernel() ? ", best)" : ")");
+        std::cout << name << std::string(std::max(26 - (int)name.size(), 1), ' ')
+                  << millisecondsSince(start) * 1e6 / ITERATIONS << std::endl;
+    }
+    
+    for (int term = 0; term < TERM_COUNT; term++)
+    {
+        start = std::chrono::steady_clock::now();
+        
+        for (int iteration = 0; iteration < ITERATIONS; iteration++)
+        {
+            sink = sink + TERMS[term](&position).middlegame;
+        }
+        
+        std::cout << "  " << TERM_NAMES[term] << std::string(24 - strlen(TERM_NAMES[term]), ' ')
+                  << millisecondsSince(start) * 1e6 / ITERATIONS << std::endl;
+    }
+    
+    start = std::chrono::steady_clock::now();
+    
+    for (int iteration = 0; iteration < ITERATIONS; iteration++)
+    {
+        sink = sink + evaluate(&position);
+    }
+    
+    std::cout << "  Whole evaluation        " << millisecondsSince(start) * 1e6 / ITERATIONS << std::endl;
+    
+    return (mismatches == 0) ? 0 : 1;
+}
+
+// Plays random moves from the start, taking one back now and then, and
+// counts the positions where the material and piece-square totals kept by
+// makeMove and unmakeMove differ from any kernel's recomputed ones.
+static int checkIncrementalTotals(int steps)
+{
+    std::mt19937 random(20160501);
+    Position position;
+    std::vector<Move> moves;
+    std::vector<Undo> undos;
+    MoveList list;
+    int mismatches = 0;
+    
+    parseFen(&position, START_FEN);
+    
+    for (int step = 0; step < steps; step++)
+    {
+        generateLegalMoves(&position, &list);
+        
+        if (!moves.empty() && (list.count == 0 || random() % 4 == 0))
+        {
+            unmakeMove(&position, moves.back(), &undos.back());
+            moves.pop_back();
+            undos.pop_back();
+        }
+        else if (list.count == 0 || position.halfmoveClock >= 100)
+        {
+            parseFen(&position, START_FEN);
+            moves.clear();
+            undos.clear();
+        }
+        else
+        {
+            moves.push_back(list.moves[random() % list.count]);
+            undos.push_back(Undo());
+            makeMove(&position, moves.back(), &undos.back());
+        }
+        
+        for (int kernel = 0; kernel < EVAL_KERNEL_COUNT; kernel++)
+        {
+            TermScore totals = pieceSquareTotals(&position, kernel);
+            
+            if (evalKernelAvailable(kernel) &&
+                (totals.middlegame != position.middlegame || totals.endgame != position.endgame))
+            {
+                mismatches++;
+            }
+        }
+    }
+    
+    return mismatches;
+}
+
+static int runNnue(int argc, const char *argv[])
+{
+    std::string mode = (argc > 0) ? argv[0] : "";
+    
+    if (mode == "make" && argc == 2)
+    {
+        if (!makeNnue(argv[1]))
+        {
+            std::cout << "can't write " << argv[1] << std::endl;
+            return 1;
+        }
+        
+        return 0;
+    }
+    
+    if (mode != "bench" || argc < 2)
+    {
+        std::cout << "nnue needs make <file> or bench <file>" << std::endl;
+        return 1;
+    }
+    
+    int positionCount = 10000;
+    
+    for (int argIndex = 2; argIndex + 1 < argc; argIndex += 2)
+    {
+        if (strcmp(argv[argIndex], "positions") == 0)
+        {
+            positionCount = std::max(atoi(argv[argIndex + 1]), 1);
+        }
+        else
+        {
+            std::cout << "unknown nnue option " << argv[argIndex] << std::endl;
+            return 1;
+        }
+    }
+    
+    initHeadless();
+    
+    if (!loadNnue(argv[1]))
+    {
+        std::cout << "can't load network " << argv[1] << std::endl;
+        return 1;
+    }
+    
+    int bestKernel = nnueKernel();
+    std::vector<Position> positions = randomPositions(positionCount);
+    double meanDifference = 0.0;
+    int mismatches = checkNnue(positions, &meanDifference);
+    
+    std::cout << "Accumulators: " << ((mismatches == 0) ? "match" : "DON'T match")
+              << " from scratch and move by move, in every kernel, over "
+              << positionCount << " positions and their moves" << std::endl;
+    std::cout << "Mean difference from material and piece squares: "
+              << meanDifference << " cp" << std::endl;
+    std::cout << "Evals/sec, each after making a move and before taking it back:" << std::endl;
+    
+    double classical = evalsPerSecond(positions, -1);
+    std::cout << "  Classical               " << (uint64_t)classical << std::endl;
+    
+    for (int kernel = 0; kernel < NNUE_KERNEL_COUNT; kernel++)
+    {
+        if (!nnueKernelAvailable(kernel))
+        {
+            continue;
+        }
+        
+        double rate = evalsPerSecond(positions, kernel);
+        std::string name = std::string("  Network (") + nnueKernelName(kernel) +
+                           (kernel == bestKernel ? ", best)" : ")");
+        std::cout << name << std::string(std::max(26 - (int)name.size(), 1), ' ')
+                  << (uint64_t)rate << std::fixed << std::setprecision(2)
+                  << " (" << rate / classical << "x)" << std::defaultfloat << std::endl;
+    }
+    
+    setNnueKernel(bestKernel);
+    
+    return (mismatches == 0) ? 0 : 1;
+}
+
+// For every position and every move from it, the accumulator updated by the
+// move against one refreshed from scratch, in every kernel, and every
+// kernel's score against the scalar one.  Also measures how far the network
+// is from the material and middlegame piece-square term, which the starting
+// network should be within a few centipawns of.
+static int checkNnue(const std::vector<Position> &positions, double *meanDifference)
+{
+    NnueAccumulator before;
+    NnueAccumulator updated;
+    NnueAccumulator refreshed;
+    MoveList list;
+    Undo undo;
+    int mismatches = 0;
+    double totalDifference = 0.0;
+    
+    for (size_t positionIndex = 0; positionIndex < positions.size(); positionIndex++)
+    {
+        Position position = positions[positionIndex];
+        int scalarScore = 0;
+        
+        for (int kernel = 0; kernel < NNUE_KERNEL_COUNT; kernel++)
+        {
+            if (!nnueKernelAvailable(kernel))
+            {
+                continue;
+            }
+            
+            setNnueKernel(kernel);
+            refreshNnueAccumulator(&position, &before);
+            int score = nnueEvaluate(&position, &before);
+            
+            if (kernel == NNUE_KERNEL_SCALAR)
+            {
+                scalarScore = score;
+            }
+            
+            mismatches += (score != scalarScore);
+            
+            generateLegalMoves(&position, &list);
+            
+            for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+            {
+                makeMove(&position, list.moves[moveIndex], &undo);
+                updateNnueAccumulator(&position, list.moves[moveIndex], &undo, &before, &updated);
+                refreshNnueAccumulator(&position, &refreshed);
+                mismatches += (memcmp(&updated, &refreshed, sizeof(NnueAccumulator)) != 0);
+                unmakeMove(&position, list.moves[moveIndex], &undo);
+            }
+        }
+        
+        int material = materialTerm(&position).middlegame * ((position.sideToMove == COLOR_WHITE) ? 1 : -1);
+        totalDifference += abs(scalarScore - material);
+    }
+    
+    *meanDifference = totalDifference / positions.size();
+    
+    return mismatches;
+}
+
+// Makes every move from every position, evaluates and takes it back, with
+// the classical evaluation when kernel is -1 and otherwise with the
+// network, updating the accumulator the way the search does.
+static double evalsPerSecond(const std::vector<Position> &positions, int kernel)
+{
+    std::vector<Position> walked = positions;
+    std::vector<MoveList> lists(walked.size());
+    std::vector<NnueAccumulator> accumulators(walked.size());
+    NnueAccumulator next;
+    Undo undo;
+    volatile int sink = 0;
+    uint64_t evaluations = 0;
+    
+    if (kernel >= 0)
+    {
+        setNnueKernel(kernel);
+    }
+    
+    for (size_t positionIndex = 0; positionIndex < walked.size(); positionIndex++)
+    {
+        generateLegalMoves(&walked[positionIndex], &lists[positionIndex]);
+        refreshNnueAccumulator(&walked[positionIndex], &accumulators[positionIndex]);
+    }
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    for (size_t positionIndex = 0; positionIndex < walked.size(); positionIndex++)
+    {
+        Position *position = &walked[positionIndex];
+        const MoveList &list = lists[positionIndex];
+        
+        for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+        {
+            makeMove(position, list.moves[moveIndex], &undo);
+            
+            if (kernel < 0)
+            {
+                sink = sink + evaluate(position);
+            }
+            else
+            {
+                updateNnueAccumulator(position, list.moves[moveIndex], &undo,
+                                      &accumulators[positionIndex], &next);
+                sink = sink + nnueEvaluate(position, &next);
+            }
+            
+            unmakeMove(position, list.moves[moveIndex], &undo);
+            evaluations++;
+        }
+    }
+    
+    return evaluations * 1000.0 / (millisecondsSince(start) + 1e-9);
+}
+
+// Searches the start position for the same time with 1, 2, 4... threads up
+// to the given count (every core by default) and prints the nodes/sec and
+// depth reached with each.  The table is cleared between runs so they all
+// start cold.
+static int runScaling(int argc, const char *argv[])
+{
+    int maxThreads = (int)std::thread::hardware_concurrency();
+    int moveTimeMs = 5000;
+    
+    for (int argIndex = 0; argIndex + 1 < argc; argIndex += 2)
+    {
+        std::string arg = argv[argIndex];
+        
+        if (arg == "threads")
+        {
+            maxThreads = atoi(argv[argIndex + 1]);
+        }
+        else if (arg == "movetime")
+        {
+            moveTimeMs = atoi(argv[argIndex + 1]);
+        }
+    }
+    
+    if (maxThreads < 1)
+    {
+        maxThreads = 1;
+    }
+    
+    initHeadless();
+    
+    Position position = *getGamePosition();
+    uint64_t baseNodesPerSecond = 0;
+    
+    std::cout << "Threads\tDepth\tNodes/sec\tSpeedup" << std::endl;
+    
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+    {
+        SearchLimits limits = { 0, moveTimeMs, threads };
+        SearchReport last;
+        last.depth = 0;
+        last.nodesPerSecond = 0;
+        
+        clearTranspositionTable();
+        searchPosition(&position, limits, [&last](const SearchReport &report) {
+            last = report;
+        }, nullptr);
+        
+        if (threads == 1)
+        {
+            baseNodesPerSecond = last.nodesPerSecond;
+        }
+        
+        std::cout << threads << "\t"
+                  << last.depth << "\t"
+                  << last.nodesPerSecond << "\t"
+                  << (double)last.nodesPerSecond / (baseNodesPerSecond + 1e-9)
+                  << std::endl;
+        
+        if (threads == maxThreads)
+        {
+            break;
+        }
+    }
+    
+    return 0;
+}
+
+// Asks "is this square attacked" for every square and both colors, on a
+// suite of positions from random games, once through the attack maps and
+// once through the pieces' move functions the rules used to rely on.
+static int runAttacks(int argc, const char *argv[])
+{
+    int positionCount = 2000;
+    
+    if (argc >= 2 && strcmp(argv[0], "positions") == 0)
+    {
+        positionCount = atoi(argv[1]);
+    }
+    
+    initHeadless();
+    
+    std::vector<Position> suite = randomPositions(positionCount);
+    const char *names[2] = { "maps", "pieces" };
+    double elapsed[2];
+    uint64_t attacked[2];
+    uint64_t queries = 0;
+    
+    for (int path = 0; path < 2; path++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        attacked[path] = 0;
+        queries = 0;
+        
+        for (size_t positionIndex = 0; positionIndex < suite.size(); positionIndex++)
+        {
+            setGamePosition(&suite[positionIndex]);
+            
+            for (int square = 0; square < SQUARE_COUNT; square++)
+            {
+                Vector2i position = positionForSquare(square);
+                
+                for (int color = COLOR_WHITE; color <= COLOR_BLACK; color += 2)
+                {
+                    bool vulnerable = (path == 0) ?
+                                      positionIsVulnerable(color, position) :
+                                      positionIsVulnerableByPieces(color, position);
+                    attacked[path] += vulnerable;
+                    queries++;
+                }
+            }
+        }
+        
+        elapsed[path] = millisecondsSince(start);
+    }
+    
+    resetGame();
+    
+    std::cout << "Positions: " << suite.size() << std::endl;
+    std::cout << "Queries: " << queries << std::endl;
+    
+    for (int path = 0; path < 2; path++)
+    {
+        std::cout << names[path] << ": "
+                  << (uint64_t)elapsed[path] << " ms, "
+                  << (uint64_t)(elapsed[path] * 1e6 / queries) << " ns/query, "
+                  << attacked[path] << " attacked" << std::endl;
+    }
+    
+    // The counts differ because the move functions treat pawn pushes as
+    // attacks and pawn captures onto empty squares as not.
+    std::cout << "Speedup: " << elapsed[1] / (elapsed[0] + 1e-9) << std::endl;
+    
+    return 0;
+}
+
+// Plays a batch of games across the thread pool and prints the results and
+// throughput.  By default both sides move at random, which is as fast as the
+// rules themselves can go; give a mover a depth or a time to get games worth
+// learning from.
+static int runSelfPlayCommand(int argc, const char *argv[])
+{
+    SelfPlayOptions options;
+    options.games = 1000;
+    options.threads = 0;
+    options.movers[colorIndex(COLOR_WHITE)] = { MOVER_RANDOM, 0 };
+    options.movers[colorIndex(COLOR_BLACK)] = { MOVER_RANDOM, 0 };
+    options.seed = 20160501;
+    options.useBook = false;
+    options.randomPlies = 4;
+    options.maxPlies = 400;
+    options.adjudicate = false;
+    
+    std::string outputPath;
+    std::string bookPath;
+    
+    for (int argIndex = 0; argIndex + 1 < argc; argIndex += 2)
+    {
+        std::string arg = argv[argIndex];
+        const char *value = argv[argIndex + 1];
+        
+        if (arg == "games")
+        {
+            options.games = atoi(value);
+        }
+        else if (arg == "threads")
+        {
+            options.threads = atoi(value);
+        }
+        else if ((arg == "white" || arg == "black") &&
+                 parseMover(value, &options.movers[colorIndex((arg == "white") ?
+                                                              COLOR_WHITE :
+                                                              COLOR_BLACK)]))
+        {
+            continue;
+        }
+        else if (arg == "output")
+        {
+            outputPath = value;
+        }
+        else if (arg == "book")
+        {
+            bookPath = value;
+            options.useBook = true;
+        }
+        else if (arg == "tablebases")
+        {
+            if (setTablebasePath(value) < 0)
+            {
+                std::cout << "can't read " << value << std::endl;
+                return 1;
+            }
+            
+            options.adjudicate = true;
+        }
+        else if (arg == "seed")
+        {
+            options.seed = (uint32_t)strtoul(value, nullptr, 10);
+        }
+        else if (arg == "randomplies")
+        {
+            options.randomPlies = atoi(value);
+        }
+        else if (arg == "maxplies")
+        {
+            options.maxPlies = atoi(value);
+        }
+        else
+        {
+            std::cout << "bad selfplay option " << arg << " " << value << std::endl;
+            return 1;
+        }
+    }
+    
+    initHeadless();
+    
+    if (options.useBook && !openBook(bookPath.c_str()))
+    {
+        std::cout << "can't read book " << bookPath << std::endl;
+        return 1;
+    }
+    
+    GameWriter output;
+    
+    if (!outputPath.empty() && !openGameWriter(outputPath.c_str(), &output))
+    {
+        std::cout << "can't write " << outputPath << std::endl;
+        return 1;
+    }
+    
+    SelfPlayStats stats = runSelfPlay(options, outputPath.empty() ? nullptr : &output);
+    
+    if (!outputPath.empty())
+    {
+        std::cout << "Games in " << outputPath << ": " << output.games << std::endl;
+        closeGameWriter(&output);
+    }
+    
+    double seconds = stats.elapsedMs / 1000.0 + 1e-9;
+    
+    std::cout << "Games: " << stats.games << std::endl;
+    std::cout << "White wins: " << stats.whiteWins
+              << ", black wins: " << stats.blackWins
+              << ", draws: " << stats.draws << std::endl;
+    std::cout << "Plies: " << stats.plies << std::endl;
+    
+    if (options.adjudicate)
+    {
+        std::cout << "Adjudicated: " << stats.adjudicated << std::endl;
+    }
+    
+    std::cout << "Rules mismatches: " << stats.rulesMismatches << std::endl;
+    std::cout << "Time: " << (uint64_t)stats.elapsedMs << " ms" << std::endl;
+    std::cout << "Games/sec: " << stats.games / seconds << std::endl;
+    std::cout << "Positions/sec: " << (uint64_t)(stats.plies / seconds) << std::endl;
+    
+    return (stats.rulesMismatches == 0) ? 0 : 1;
+}
+
+static int runUciCommand(int argc, const char *argv[])
+{
+    initHeadless();
+    
+    return runUci();
+}
+
+// Prints a line per position, in file order, with its result, time and node
+// count, and then the totals.  Perft checks deeper than perftdepth (5 unless
+// given) are skipped so big suites stay quick; best-move positions get a
+// second each unless a depth or time is given.
+static int runEpd(int argc, const char *argv[])
+{
+    if (argc < 1)
+    {
+        std::cout << "epd needs a file" << std::endl;
+        return 1;
+    }
+    
+    EpdLimits limits = { 5, 0, 0, 0 };
+    
+    for (int argIndex = 1; argIndex + 1 < argc; argIndex += 2)
+    {
+        std::string arg = argv[argIndex];
+        int value = atoi(argv[argIndex + 1]);
+        
+        if (arg == "threads")
+        {
+            limits.threads = value;
+        }
+        else if (arg == "perftdepth")
+        {
+            limits.perftDepth = value;
+        }
+        else if (arg == "depth")
+        {
+            limits.searchDepth = value;
+        }
+        else if (arg == "movetime")
+        {
+            limits.moveTimeMs = value;
+        }
+        else
+        {
+            std::cout << "unknown epd option " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    if (limits.searchDepth == 0 && limits.moveTimeMs == 0)
+    {
+        limits.moveTimeMs = 1000;
+    }
+    
+    initHeadless();
+    
+    std::vector<EpdEntry> entries;
+    std::vector<std::string> errors;
+    
+    if (!loadEpdFile(argv[0], &entries, &errors))
+    {
+        std::cout << "can't read " << argv[0] << std::endl;
+        return 1;
+    }
+    
+    for (size_t errorIndex = 0; errorIndex < errors.size(); errorIndex++)
+    {
+        std::cout << "unreadable " << errors[errorIndex] << std::endl;
+    }
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<EpdResult> results = runEpdSuite(entries, limits);
+    double elapsed = millisecondsSince(start);
+    
+    int passed = 0;
+    int failed = 0;
+    int skipped = 0;
+    uint64_t nodes = 0;
+    double positionMs = 0;
+    
+    for (size_t entryIndex = 0; entryIndex < entries.size(); entryIndex++)
+    {
+        const EpdResult &result = results[entryIndex];
+        const char *status = result.skipped ? "skip" : (result.passed ? "ok" : "FAIL");
+        
+        skipped += result.skipped;
+        passed += !result.skipped && result.passed;
+        failed += !result.skipped && !result.passed;
+        nodes += result.nodes;
+        positionMs += result.elapsedMs;
+        
+        std::cout << status << "\t"
+                  << (uint64_t)result.elapsedMs << " ms\t"
+                  << entries[entryIndex].id << "\t"
+                  << result.detail << std::endl;
+    }
+    
+    std::cout << std::endl;
+    std::cout << "Positions: " << entries.size() << " ("
+              << passed << " passed, "
+              << failed << " failed, "
+              << skipped << " skipped)" << std::endl;
+    std::cout << "Time: " << (uint64_t)elapsed << " ms ("
+              << (uint64_t)positionMs << " ms across positions)" << std::endl;
+    std::cout << "Nodes: " << nodes << std::endl;
+    std::cout << "Nodes/sec: " << (uint64_t)(nodes * 1000.0 / (elapsed + 1e-9)) << std::endl;
+    
+    return (failed == 0 && errors.empty()) ? 0 : 1;
+}
+
+// Prints the first few problems (20 unless told otherwise) with where they
+// are, then the totals, the throughput and the process's peak memory, which
+// stays flat however big the archive is.
+static int runPgn(int argc, const char *argv[])
+{
+    if (argc < 1)
+    {
+        std::cout << "pgn needs a file" << std::endl;
+        return 1;
+    }
+    
+    int threads = 0;
+    int maxProblems = 20;
+    
+    for (int argIndex = 1; argIndex + 1 < argc; argIndex += 2)
+    {
+        std::string arg = argv[argIndex];
+        
+        if (arg == "threads")
+        {
+            threads = atoi(argv[argIndex + 1]);
+        }
+        else if (arg == "problems")
+        {
+            maxProblems = atoi(argv[argIndex + 1]);
+        }
+        else
+        {
+            std::cout << "unknown pgn option " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    initHeadless();
+    
+    PgnReplayStats stats;
+    
+    if (!replayPgnFile(argv[0], threads, (size_t)std::max(maxProblems, 0), PgnGameVisitor(), &stats))
+    {
+        std::cout << "can't read " << argv[0] << std::endl;
+        return 1;
+    }
+    
+    for (size_t problemIndex = 0; problemIndex < stats.problems.size(); problemIndex++)
+    {
+        const PgnProblem &problem = stats.problems[problemIndex];
+        std::cout << "game " << problem.game
+                  << ", line " << problem.line
+                  << ", ply " << problem.ply << ": "
+                  << problem.text << " (" << problem.reason << ")" << std::endl;
+    }
+    
+    double seconds = stats.elapsedMs / 1000.0 + 1e-9;
+    
+    std::cout << "Games: " << stats.games << " (" << stats.badGames << " bad)" << std::endl;
+    std::cout << "Plies: " << stats.plies << std::endl;
+    std::cout << "Size: " << (stats.bytes >> 20) << " MB" << std::endl;
+    std::cout << "Time: " << (uint64_t)stats.elapsedMs << " ms" << std::endl;
+    std::cout << "Games/sec: " << (uint64_t)(stats.games / seconds) << std::endl;
+    std::cout << "MB/sec: " << (uint64_t)((stats.bytes >> 20) / seconds) << std::endl;
+    std::cout << "Peak memory: " << (peakResidentBytes() >> 20) << " MB" << std::endl;
+    
+    return (stats.badGames == 0) ? 0 : 1;
+}
+
+// "make" builds a book from the first plies (20 unless told otherwise) of
+// every game in an archive; "probe" maps one and prints its moves for a
+// position with their weights and the time the lookup took.
+// The positions and keys Polyglot's documentation gives to check an
+// implementation against.
+typedef struct
+{
+    const char *moves[10];
+    uint64_t key;
+} BookKeyCheck;
+
+static const BookKeyCheck BOOK_KEY_CHECKS[] = {
+    { { nullptr }, 0x463B96181691FC9CULL },
+    { { "e2e4", nullptr }, 0x823C9B50FD114196ULL },
+    { { "e2e4", "d7d5", nullptr }, 0x0756B94461C50FB0ULL },
+    { { "e2e4", "d7d5", "e4e5", nullptr }, 0x662FAFB965DB29D4ULL },
+    { { "e2e4", "d7d5", "e4e5", "f7f5", nullptr }, 0x22A48B5A8E47FF78ULL },
+    { { "e2e4", "d7d5", "e4e5", "f7f5", "e1e2", nullptr }, 0x652A607CA3F242C1ULL },
+    { { "e2e4", "d7d5", "e4e5", "f7f5", "e1e2", "e8f7", nullptr }, 0x00FDD303C946BDD9ULL },
+    { { "a2a4", "b7b5", "h2h4", "b5b4", "c2c4", nullptr }, 0x3C8123EA7B067637ULL },
+    { { "a2a4", "b7b5", "h2h4", "b5b4", "c2c4", "b4c3", "a1a3", nullptr }, 0x5C3F9B829B279560ULL },
+};
+
+static int runBook(int argc, const char *argv[])
+{
+    std::string mode = (argc > 0) ? argv[0] : "";
+    
+    if (mode == "make" && argc >= 3)
+    {
+        int plies = 20;
+        int threads = 0;
+        
+        for (int argIndex = 3; argIndex + 1 < argc; argIndex += 2)
+        {
+            std::string arg = argv[argIndex];
+            
+            if (arg == "plies")
+            {
+                plies = atoi(argv[argIndex + 1]);
+            }
+            else if (arg == "threads")
+            {
+                threads = atoi(argv[argIndex + 1]);
+            }
+            else
+            {
+                std::cout << "unknown book option " << arg << std::endl;
+                return 1;
+            }
+        }
+        
+        initHeadless();
+        
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        size_t entryCount = 0;
+        
+        if (!makeBook(argv[1], argv[2], plies, threads, &entryCount))
+        {
+            std::cout << "can't make " << argv[2] << " from " << argv[1] << std::endl;
+            return 1;
+        }
+        
+        std::cout << "Entries: " << entryCount << std::endl;
+        std::cout << "Time: " << (uint64_t)millisecondsSince(start) << " ms" << std::endl;
+        
+        return 0;
+    }
+    
+    if (mode == "probe" && argc >= 2)
+    {
+        initHeadless();
+        
+        Position position = *getGamePosition();
+        
+        for (int argIndex = 2; argIndex < argc; argIndex++)
+        {
+            if (strcmp(argv[argIndex], "moves") == 0)
+            {
+                continue;
+            }
+            
+            Move move = moveFromString(&position, argv[argIndex]);
+            
+            if (move == NULL_MOVE)
+            {
+                move = moveFromSan(&position, argv[argIndex]);
+            }
+            
+            if (move == NULL_MOVE)
+            {
+                std::cout << "illegal move " << argv[argIndex] << std::endl;
+                return 1;
+            }
+            
+            applyMove(&position, move);
+        }
+        
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        
+        if (!openBook(argv[1]))
+        {
+            std::cout << "can't read book " << argv[1] << std::endl;
+            return 1;
+        }
+        
+        double openMs = millisecondsSince(start);
+        
+        start = std::chrono::steady_clock::now();
+        
+        BookMove moves[MAX_MOVES];
+        int count = findBookMoves(&position, moves);
+        double probeMs = millisecondsSince(start);
+        int totalWeight = 0;
+        
+        for (int moveIndex = 0; moveIndex < count; moveIndex++)
+        {
+            totalWeight += moves[moveIndex].weight;
+        }
+        
+        for (int moveIndex = 0; moveIndex < count; moveIndex++)
+        {
+            std::cout << moveToSan(&position, moves[moveIndex].move) << "\t"
+                      << moveToString(moves[moveIndex].move) << "\t"
+                      << moves[moveIndex].weight << "\t"
+                      << (uint64_t)(moves[moveIndex].weight * 100.0 / totalWeight) << "%" << std::endl;
+        }
+        
+        std::cout << "Entries: " << bookEntryCount() << std::endl;
+        std::cout << "Open: " << openMs << " ms, probe: " << probeMs << " ms" << std::endl;
+        
+        closeBook();
+        
+        return 0;
+    }
+    
+    if (mode == "check")
+    {
+        initHeadless();
+        
+        int failures = 0;
+        
+        for (size_t check = 0; check < sizeof(BOOK_KEY_CHECKS) / sizeof(BOOK_KEY_CHECKS[0]); check++)
+        {
+            Position position = *getGamePosition();
+            std::string moves;
+            
+            for (int moveIndex = 0; BOOK_KEY_CHECKS[check].moves[moveIndex] != nullptr; moveIndex++)
+            {
+                applyMove(&position, moveFromString(&position, BOOK_KEY_CHECKS[check].moves[moveIndex]));
+                moves += std::string(" ") + BOOK_KEY_CHECKS[check].moves[moveIndex];
+            }
+            
+            uint64_t key = bookKey(&position);
+            bool matches = key == BOOK_KEY_CHECKS[check].key;
+            
+            std::cout << std::hex << std::setw(16) << std::setfill('0') << key << std::dec
+                      << (matches ? "  ok  " : "  WRONG") << (moves.empty() ? " start" : moves) << std::endl;
+            failures += !matches;
+        }
+        
+        std::cout << "Failures: " << failures << std::endl;
+        
+        return (failures == 0) ? 0 : 1;
+    }
+    
+    std::cout << "book needs make <pgn> <file>, probe <file> or check" << std::endl;
+    
+    return 1;
+}
+
+// "make" builds each named table (and any it leads to) and prints a line per
+// table built; "probe" prints the position's value and then each move's,
+// best first.
+static int runTablebase(int argc, const char *argv[])
+{
+    std::string mode = (argc > 0) ? argv[0] : "";
+    
+    if (mode == "make" && argc >= 3)
+    {
+        std::vector<std::string> materials;
+        int threads = 0;
+        
+        for (int argIndex = 2; argIndex < argc; argIndex++)
+        {
+            if (strcmp(argv[argIndex], "threads") == 0 && argIndex + 1 < argc)
+            {
+                threads = atoi(argv[++argIndex]);
+            }
+            else
+            {
+                materials.push_back(argv[argIndex]);
+            }
+        }
+        
+        initHeadless();
+        
+        for (size_t materialIndex = 0; materialIndex < materials.size(); materialIndex++)
+        {
+            bool made = makeTablebase(argv[1], materials[materialIndex], threads, [](const TablebaseStats &stats) {
+                std::cout << stats.name << ": "
+                          << stats.positions << " positions ("
+                          << stats.wins << " won, "
+                          << stats.draws << " drawn, "
+                          << stats.losses << " lost), longest mate "
+                          << stats.longestMate << " plies, "
+                          << stats.passes << " passes, "
+                          << (uint64_t)stats.elapsedMs << " ms" << std::endl;
+            });
+            
+            if (!made)
+            {
+                std::cout << "can't make " << materials[materialIndex] << " in " << argv[1] << std::endl;
+                return 1;
+            }
+        }
+        
+        return 0;
+    }
+    
+    if (mode == "probe" && argc >= 4 && strcmp(argv[2], "fen") == 0)
+    {
+        initHeadless();
+        
+        std::string fen;
+        
+        for (int argIndex = 3; argIndex < argc; argIndex++)
+        {
+            fen += (argIndex == 3 ? "" : " ") + std::string(argv[argIndex]);
+        }
+        
+        Position position;
+        
+        if (!parseFen(&position, fen.c_str()))
+        {
+            std::cout << "bad fen " << fen << std::endl;
+            return 1;
+        }
+        
+        if (setTablebasePath(argv[1]) < 0)
+        {
+            std::cout << "can't read " << argv[1] << std::endl;
+            return 1;
+        }
+        
+        TablebaseResult result;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        
+        if (!probeForDisplay(&position, &result))
+        {
+            std::cout << "no table for " << materialName(&position) << std::endl;
+            return 1;
+        }
+        
+        // The first probe of a table maps it.
+        double firstMs = millisecondsSince(start);
+        
+        std::cout << materialName(&position) << ": "
+                  << describeTablebaseResult(result)
+                  << " (" << firstMs << " ms)" << std::endl;
+        
+        MoveList list;
+        generateLegalMoves(&position, &list);
+        
+        std::vector<std::pair<int, std::string> > lines;
+        
+        for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+        {
+            Position next = position;
+            applyMove(&next, list.moves[moveIndex]);
+            
+            if (!probeForDisplay(&next, &result))
+            {
+                continue;
+            }
+            
+            // The move's result for the side that plays it.  A Syzygy
+            // distance starts again after a capture or pawn move.
+            Move move = list.moves[moveIndex];
+            bool zeroing = position.board[moveTo(move)] != 0 ||
+                           moveType(move) == MOVE_EN_PASSANT ||
+                           abs(position.board[moveFrom(move)]) == PIECE_PAWN;
+            
+            result.wdl = -result.wdl;
+            
+            if (result.wdl != TABLEBASE_DRAW && result.syzygy && zeroing)
+            {
+                result.plies = 1;
+            }
+            else if (result.wdl != TABLEBASE_DRAW && (!result.syzygy || result.plies > 0))
+            {
+                result.plies++;
+            }
+            
+            // Wins with no known distance go after the ones with one.
+            int plies = (result.syzygy && result.plies == 0) ? 9999 : result.plies;
+            int rank = (result.wdl == TABLEBASE_DRAW) ? 0 : result.wdl * (10000 - plies);
+            lines.push_back(std::make_pair(-rank, moveToSan(&position, list.moves[moveIndex]) +
+                                           "\t" + describeTablebaseResult(result)));
+        }
+        
+        std::sort(lines.begin(), lines.end());
+        
+        for (size_t lineIndex = 0; lineIndex < lines.size(); lineIndex++)
+        {
+            std::cout << lines[lineIndex].second << std::endl;
+        }
+        
+        return 0;
+    }
+    
+    std::cout << "tablebase needs make <dir> <material>... or probe <dir> fen <fen>" << std::endl;
+    
+    return 1;
+}
+
+// Like probeTablebase, but a Syzygy table answers whatever the fifty-move
+// count, and its plies are the distance to the next capture or pawn move
+// when there's a .rtbz file to say, or 0.
+static bool probeForDisplay(const Position *position, TablebaseResult *result)
+{
+    Position reset = *position;
+    reset.halfmoveClock = 0;
+    
+    if (!probeTablebase(&reset, result))
+    {
+        return false;
+    }
+    
+    int dtz;
+    
+    if (result->syzygy && result->wdl != TABLEBASE_DRAW && probeSyzygyDtz(position, &dtz))
+    {
+        result->plies = abs(dtz);
+    }
+    
+    return true;
+}
+
+static std::string describeTablebaseResult(const TablebaseResult &result)
+{
+    if (result.wdl == TABLEBASE_DRAW)
+    {
+        return "draw";
+    }
+    
+    std::string outcome = (result.wdl == TABLEBASE_WIN) ? "win" : "loss";
+    
+    if (!result.syzygy)
+    {
+        return outcome + ", mate in " + std::to_string(result.plies) + " plies";
+    }
+    
+    if (result.plies == 0)
+    {
+        return outcome;
+    }
+    
+    return outcome + ", " + std::to_string(result.plies) + " plies to a capture or pawn move";
+}
+
+// "convert" turns a PGN archive into a game file; otherwise every game in
+// the file is replayed across the thread pool, checking each move is legal
+// and each checkmate or stalemate really is one, or "show" prints one game.
+static int runGames(int argc, const char *argv[])
+{
+    if (argc >= 3 && strcmp(argv[0], "convert") == 0)
+    {
+        return convertPgnGames(argc, argv);
+    }
+    
+    if (argc < 1)
+    {
+        std::cout << "games needs a file, or convert <pgn> <file>" << std::endl;
+        return 1;
+    }
+    
+    int threads = 0;
+    int64_t shownGame = -1;
+    
+    for (int argIndex = 1; argIndex + 1 < argc; argIndex += 2)
+    {
+        std::string arg = argv[argIndex];
+        
+        if (arg == "threads")
+        {
+            threads = atoi(argv[argIndex + 1]);
+        }
+        else if (arg == "show")
+        {
+            shownGame = atoll(argv[argIndex + 1]);
+        }
+        else
+        {
+            std::cout << "unknown games option " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    initHeadless();
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    GameReader reader;
+    
+    if (!openGameReader(argv[0], &reader))
+    {
+        std::cout << "can't read " << argv[0] << std::endl;
+        return 1;
+    }
+    
+    double openMs = millisecondsSince(start);
+    
+    if (shownGame >= 0)
+    {
+        GameRecord record;
+        
+        if (!readGameRecord(&reader, (uint64_t)shownGame, &record))
+        {
+            std::cout << "no game " << shownGame << std::endl;
+            closeGameReader(&reader);
+            return 1;
+        }
+        
+        std::cout << "Number: " << record.number << std::endl;
+        std::cout << "Result: "
+                  << ((record.winner == COLOR_WHITE) ? "1-0" :
+                      (record.winner == COLOR_BLACK) ? "0-1" : "1/2-1/2")
+                  << " (" << GAME_END_NAMES[std::min(record.reason, GAME_END_OTHER)] << ")"
+                  << std::endl;
+        
+        Position position;
+        parseFen(&position, record.startFen.empty() ? START_FEN : record.startFen.c_str());
+        
+        if (!record.startFen.empty())
+        {
+            std::cout << "Start: " << record.startFen << std::endl;
+        }
+        
+        for (size_t ply = 0; ply < record.moves.size(); ply++)
+        {
+            if (position.sideToMove == COLOR_WHITE || ply == 0)
+            {
+                std::cout << position.fullmoveNumber
+                          << ((position.sideToMove == COLOR_WHITE) ? ". " : "... ");
+            }
+            
+            std::cout << moveToSan(&position, record.moves[ply]);
+            
+            if (!record.clocksMs.empty())
+            {
+                std::cout << " {" << record.clocksMs[ply] << " ms}";
+            }
+            
+            std::cout << ((position.sideToMove == COLOR_BLACK) ? "\n" : " ");
+            applyMove(&position, record.moves[ply]);
+        }
+        
+        std::cout << std::endl;
+        closeGameReader(&reader);
+        
+        return 0;
+    }
+    
+    if (threads < 1)
+    {
+        threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    
+    // Each thread counts bad games and plies separately; the first bad game
+    // found is the one reported.
+    std::vector<uint64_t> threadPlies(threads, 0);
+    std::vector<uint64_t> threadBadGames(threads, 0);
+    std::atomic<uint64_t> firstBadGame(reader.games);
+    
+    adviseSequential(&reader.data);
+    start = std::chrono::steady_clock::now();
+    
+    runTasks((int)reader.games, threads, [&](int game, int thread) {
+        GameRecord record;
+        
+        if (!readGameRecord(&reader, (uint64_t)game, &record) ||
+            !checkGameRecord(record))
+        {
+            threadBadGames[thread]++;
+            
+            uint64_t first = firstBadGame.load();
+            
+            while ((uint64_t)game < first &&
+                   !firstBadGame.compare_exchange_weak(first, (uint64_t)game))
+            {
+            }
+        }
+        
+        threadPlies[thread] += record.moves.size();
+    });
+    
+    double elapsedMs = millisecondsSince(start);
+    uint64_t plies = 0;
+    uint64_t badGames = 0;
+    
+    for (int thread = 0; thread < threads; thread++)
+    {
+        plies += threadPlies[thread];
+        badGames += threadBadGames[thread];
+    }
+    
+    double seconds = elapsedMs / 1000.0 + 1e-9;
+    
+    if (badGames > 0)
+    {
+        std::cout << "First bad game: " << firstBadGame.load() << std::endl;
+    }
+    
+    std::cout << "Games: " << reader.games << " (" << badGames << " bad)" << std::endl;
+    std::cout << "Plies: " << plies << std::endl;
+    std::cout << "Size: " << reader.data.size << " bytes, "
+              << reader.data.size / (double)std::max(plies, (uint64_t)1) << " per ply" << std::endl;
+    std::cout << "Open: " << openMs << " ms, "
+              << ((reader.index.data != nullptr) ? "indexed" : "walked") << std::endl;
+    std::cout << "Time: " << (uint64_t)elapsedMs << " ms" << std::endl;
+    std::cout << "Games/sec: " << (uint64_t)(reader.games / seconds) << std::endl;
+    std::cout << "Positions/sec: " << (uint64_t)(plies / seconds) << std::endl;
+    
+    closeGameReader(&reader);
+    
+    return (badGames == 0) ? 0 : 1;
+}
+
+// Keeps every game that replays cleanly, in whatever order the pool
+// finishes them, numbered in that order.
+static int convertPgnGames(int argc, const char *argv[])
+{
+    int threads = 0;
+    
+    for (int argIndex = 3; argIndex + 1 < argc; argIndex += 2)
+    {
+        if (strcmp(argv[argIndex], "threads") == 0)
+        {
+            threads = atoi(argv[argIndex + 1]);
+        }
+        else
+        {
+            std::cout << "unknown games option " << argv[argIndex] << std::endl;
+            return 1;
+        }
+    }
+    
+    initHeadless();
+    
+    GameWriter writer;
+    
+    if (!openGameWriter(argv[2], &writer))
+    {
+        std::cout << "can't write " << argv[2] << std::endl;
+        return 1;
+    }
+    
+    uint64_t gamesBefore = writer.games;
+    uint64_t bytesBefore = writer.size;
+    std::mutex writerLock;
+    std::string startFen = START_FEN;
+    
+    PgnGameVisitor visit = [&](const Position *start,
+                               const std::vector<Move> &moves,
+                               const std::string &result,
+                               int thread) {
+        GameRecord record;
+        record.winner = (result == "1-0") ? COLOR_WHITE : (result == "0-1") ? COLOR_BLACK : 0;
+        record.reason = GAME_END_OTHER;
+        record.moves = moves;
+        
+        std::string fen = formatFen(start);
+        
+        if (fen != startFen)
+        {
+            record.startFen = fen;
+        }
+        
+        Position position = *start;
+        
+        for (size_t ply = 0; ply < moves.size(); ply++)
+        {
+            applyMove(&position, moves[ply]);
+        }
+        
+        MoveList list;
+        generateLegalMoves(&position, &list);
+        
+        if (list.count == 0)
+        {
+            record.reason = isInCheck(&position, position.sideToMove) ?
+                            GAME_END_CHECKMATE :
+                            GAME_END_STALEMATE;
+        }
+        else if (position.halfmoveClock >= 100 && result == "1/2-1/2")
+        {
+            record.reason = GAME_END_FIFTY_MOVES;
+        }
+        
+        std::lock_guard<std::mutex> guard(writerLock);
+        record.number = (uint32_t)writer.games;
+        writeGameRecord(&writer, record);
+    };
+    
+    PgnReplayStats stats;
+    
+    if (!replayPgnFile(argv[1], threads, 0, visit, &stats))
+    {
+        std::cout << "can't read " << argv[1] << std::endl;
+        closeGameWriter(&writer);
+        return 1;
+    }
+    
+    uint64_t written = writer.games - gamesBefore;
+    uint64_t bytes = writer.size - bytesBefore;
+    closeGameWriter(&writer);
+    
+    std::cout << "Games: " << written << " of " << stats.games
+              << " (" << stats.badGames << " bad)" << std::endl;
+    std::cout << "Size: " << stats.bytes << " bytes of PGN, " << bytes << " recorded ("
+              << (uint64_t)(stats.bytes / (double)std::max(bytes, (uint64_t)1)) << "x smaller)" << std::endl;
+    std::cout << "Time: " << (uint64_t)stats.elapsedMs << " ms" << std::endl;
+    
+    return (stats.badGames == 0) ? 0 : 1;
+}
+
+// Replays record from its start, checking every move is legal and that a
+// game said to end in checkmate or stalemate does.
+static bool checkGameRecord(const GameRecord &record)
+{
+    Position position;
+    
+    if (!parseFen(&position, record.startFen.empty() ? START_FEN : record.startFen.c_str()))
+    {
+        return false;
+    }
+    
+    MoveList list;
+    
+    for (size_t ply = 0; ply < record.moves.size(); ply++)
+    {
+        generateLegalMoves(&position, &list);
+        
+        if (std::find(list.moves, list.moves + list.count, record.moves[ply]) ==
+            list.moves + list.count)
+        {
+            return false;
+        }
+        
+        applyMove(&position, record.moves[ply]);
+    }
+    
+    if (record.reason == GAME_END_CHECKMATE || record.reason == GAME_END_STALEMATE)
+    {
+        generateLegalMoves(&position, &list);
+        bool mated = isInCheck(&position, position.sideToMove);
+        
+        return list.count == 0 && mated == (record.reason == GAME_END_CHECKMATE);
+    }
+    
+    return true;
+}
+
+// Every round plays one random move in every game, as if that many players
+// had each just moved, and starts over any game that has finished.  Reports
+// the rate and what the games cost in memory.
+static int runHost(int argc, const char *argv[])
+{
+    int games = 10000;
+    int rounds = 200;
+    int threads = 0;
+    int shards = 0;
+    uint32_t seed = 20160501;
+    
+    for (int argIndex = 0; argIndex + 1 < argc; argIndex += 2)
+    {
+        std::string arg = argv[argIndex];
+        int value = atoi(argv[argIndex + 1]);
+        
+        if (arg == "games")
+        {
+            games = value;
+        }
+        else if (arg == "rounds")
+        {
+            rounds = value;
+        }
+        else if (arg == "threads")
+        {
+            threads = value;
+        }
+        else if (arg == "shards")
+        {
+            shards = value;
+        }
+        else if (arg == "seed")
+        {
+            seed = (uint32_t)strtoul(argv[argIndex + 1], nullptr, 10);
+        }
+        else
+        {
+            std::cout << "unknown host option " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    initHeadless();
+    
+    if (threads < 1)
+    {
+        threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    
+    // A few shards a thread, so the pool can even out shards whose games
+    // happen to be slower.
+    if (shards < 1)
+    {
+        shards = threads * 4;
+    }
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    GameHost host;
+    initGameHost(&host, games, shards);
+    double setupMs = millisecondsSince(start);
+    
+    std::vector<uint64_t> threadMoves(threads, 0);
+    std::vector<uint64_t> threadFinished(threads, 0);
+    
+    start = std::chrono::steady_clock::now();
+    
+    for (int round = 0; round < rounds; round++)
+    {
+        visitHostedGames(&host, threads, [&](int game, int thread) {
+            const Position *position = getGamePosition();
+            
+            if (getWinner() != 0 || position->halfmoveClock >= 100)
+            {
+                threadFinished[thread]++;
+                resetGame();
+                return;
+            }
+            
+            MoveList list;
+            generateLegalMoves(position, &list);
+            
+            if (playMove(list.moves[hostedRandom(seed, game, round) % list.count]))
+            {
+                threadMoves[thread]++;
+            }
+        });
+    }
+    
+    double elapsedMs = millisecondsSince(start);
+    uint64_t moves = 0;
+    uint64_t finished = 0;
+    
+    for (int thread = 0; thread < threads; thread++)
+    {
+        moves += threadMoves[thread];
+        finished += threadFinished[thread];
+    }
+    
+    GameHostMemory memory = gameHostMemory(&host);
+    double seconds = elapsedMs / 1000.0 + 1e-9;
+    
+    std::cout << "Games: " << memory.games << " in " << shards << " shards on "
+              << threads << " threads" << std::endl;
+    std::cout << "Setup: " << setupMs << " ms" << std::endl;
+    std::cout << "Moves: " << moves << " (" << finished << " games finished and restarted)" << std::endl;
+    std::cout << "Time: " << (uint64_t)elapsedMs << " ms" << std::endl;
+    std::cout << "Moves/sec: " << (uint64_t)(moves / seconds) << std::endl;
+    std::cout << "Game memory: " << memory.gameBytes << " bytes, "
+              << memory.gameBytes / std::max(memory.games, (size_t)1) << " a game, largest "
+              << memory.largestGameBytes << std::endl;
+    std::cout << "Arena slabs: " << memory.arenaBytes << " bytes" << std::endl;
+    std::cout << "Peak memory: " << peakResidentBytes() / (1024 * 1024) << " MB" << std::endl;
+    
+    freeGameHost(&host);
+    
+    return 0;
+}
+
+// The same for a given seed, game and round however the shards fall on the
+// threads, so runs can be repeated.  The splitmix64 finisher.
+static uint32_t hostedRandom(uint32_t seed, int game, int round)
+{
+    uint64_t value = ((uint64_t)seed << 32) ^ ((uint64_t)game << 12) ^ (uint64_t)round;
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    
+    return (uint32_t)((value ^ (value >> 31)) >> 32);
+}
+
+static int runServe(int argc, const char *argv[])
+{
+    if (argc < 1)
+    {
+        std::cout << "serve needs a socket path or a port" << std::endl;
+        return 1;
+    }
+    
+    GameServerOptions options;
+    options.address = argv[0];
+    options.workers = 0;
+    
+    for (int argIndex = 1; argIndex + 1 < argc; argIndex += 2)
+    {
+        if (strcmp(argv[argIndex], "workers") == 0)
+        {
+            options.workers = atoi(argv[argIndex + 1]);
+        }
+        else
+        {
+            std::cout << "unknown serve option " << argv[argIndex] << std::endl;
+            return 1;
+        }
+    }
+    
+    initHeadless();
+    
+    GameServerStats stats;
+    
+    std::cout << "Serving on " << options.address << std::endl;
+    
+    if (!runGameServer(options, &stats))
+    {
+        std::cout << "can't serve on " << options.address << std::endl;
+        return 1;
+    }
+    
+    std::cout << "Connections: " << stats.connections << std::endl;
+    std::cout << "Requests: " << stats.requests << std::endl;
+    std::cout << "Games: " << stats.games << " (" << stats.openGames << " still open)" << std::endl;
+    std::cout << "Moves: " << stats.moves << " (" << stats.illegalMoves << " illegal)" << std::endl;
+    std::cout << "Time: " << (uint64_t)stats.elapsedMs << " ms" << std::endl;
+    
+    return 0;
+}
+
+static int runLoadTest(int argc, const char *argv[])
+{
+    if (argc < 1)
+    {
+        std::cout << "loadtest needs a socket path or a port" << std::endl;
+        return 1;
+    }
+    
+    LoadClientOptions options;
+    options.address = argv[0];
+    options.connections = 4;
+    options.gamesPerConnection = 64;
+    options.seconds = 5;
+    options.maxPlies = 200;
+    options.seed = 20160501;
+    
+    for (int argIndex = 1; argIndex + 1 < argc; argIndex += 2)
+    {
+        std::string arg = argv[argIndex];
+        int value = atoi(argv[argIndex + 1]);
+        
+        if (arg == "connections")
+        {
+            options.connections = value;
+        }
+        else if (arg == "games")
+        {
+            options.gamesPerConnection = value;
+        }
+        else if (arg == "seconds")
+        {
+            options.seconds = value;
+        }
+        else if (arg == "maxplies")
+        {
+            options.maxPlies = value;
+        }
+        else if (arg == "seed")
+        {
+            options.seed = (uint32_t)strtoul(argv[argIndex + 1], nullptr, 10);
+        }
+        else
+        {
+            std::cout << "unknown loadtest option " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    initHeadless();
+    
+    LoadClientStats stats;
+    
+    if (!runLoadClient(options, &stats))
+    {
+        std::cout << "can't connect to " << options.address << std::endl;
+        return 1;
+    }
+    
+    double seconds = stats.elapsedMs / 1000.0 + 1e-9;
+    
+    std::cout << "Connections: " << options.connections << ", "
+              << options.gamesPerConnection << " games each" << std::endl;
+    std::cout << "Games: " << stats.games << std::endl;
+    std::cout << "Moves: " << stats.moves << std::endl;
+    std::cout << "Moves/sec: " << (uint64_t)(stats.moves / seconds) << std::endl;
+    std::cout << "Latency: p50 " << stats.medianLatencyUs << " us, p99 "
+              << stats.p99LatencyUs << " us, max " << stats.maxLatencyUs << " us" << std::endl;
+    std::cout << "Disagreements: " << stats.disagreements << std::endl;
+    std::cout << "Errors: " << stats.errors << std::endl;
+    
+    return (stats.disagreements == 0 && stats.errors == 0) ? 0 : 1;
+}
+
+// Positions from random legal games, with a fixed seed so every run times
+// the same suite.
+static std::vector<Position> randomPositions(int count)
+{
+    std::vector<Position> positions;
+    std::mt19937 random(20160501);
+    Position position = *getGamePosition();
+    MoveList list;
+    
+    while ((int)positions.size() < count)
+    {
+        generateLegalMoves(&position, &list);
+        
+        if (list.count == 0 || position.halfmoveClock >= 100)
+        {
+            position = *getGamePosition();
+            continue;
+        }
+        
+        applyMove(&position, list.moves[random() % list.count]);
+        positions.push_back(position);
+    }
+    
+    return positions;
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+        
+    return elapsed.count();
+}
+
+static uint64_t peakResidentBytes()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;
+#else
+    // Linux counts in kilobytes.
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
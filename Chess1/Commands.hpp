@@ -0,0 +1,18 @@
+//
+//  Commands.hpp
+//  Chess1
+//
+//  Headless modes, selected by the first command line argument.  Both the
+//  SDL game and the headless binary dispatch through here, and none of these
+//  modes touch SDL.
+//
+
+#ifndef Commands_hpp
+#define Commands_hpp
+
+// Runs the mode named by argv[1] with the remaining arguments.  Returns the
+// process exit status, or -1 if argv[1] isn't a known mode.
+int runCommand(int argc, const char *argv[]);
+void printCommandUsage();
+
+#endif /* Commands_hpp */
@@ -0,0 +1,314 @@
+//
+//  Epd.cpp
+//  Chess1
+//
+
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <ctype.h>
+#include <stdlib.h>
+#include "Epd.hpp"
+#include "MoveGen.hpp"
+#include "Search.hpp"
+#include "ThreadPool.hpp"
+
+static bool parseOperation(const std::string &operation, EpdEntry *entry);
+static bool parseMoves(const Position *position,
+                       std::istringstream &operands,
+                       std::vector<Move> *moves);
+static bool isNumber(const std::string &text);
+static EpdResult checkEntry(const EpdEntry &entry, const EpdLimits &limits);
+static bool containsMove(const std::vector<Move> &moves, Move move);
+
+bool loadEpdFile(const char *path,
+                 std::vector<EpdEntry> *entries,
+                 std::vector<std::string> *errors)
+{
+    std::ifstream file(path);
+    
+    if (!file)
+    {
+        return false;
+    }
+    
+    std::string line;
+    int lineNumber = 0;
+    
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+        
+        size_t start = line.find_first_not_of(" \t");
+        
+        if (start == std::string::npos || line[start] == '#')
+        {
+            continue;
+        }
+        
+        EpdEntry entry;
+        
+        if (!parseEpdLine(line, &entry))
+        {
+            if (errors != nullptr)
+            {
+                errors->push_back("line " + std::to_string(lineNumber) + ": " + line);
+            }
+            
+            continue;
+        }
+        
+        if (entry.id.empty())
+        {
+            entry.id = "line " + std::to_string(lineNumber);
+        }
+        
+        entries->push_back(entry);
+    }
+    
+    return true;
+}
+
+bool parseEpdLine(const std::string &line, EpdEntry *entry)
+{
+    std::istringstream stream(line);
+    std::string field;
+    std::string fen;
+    
+    for (int fieldIndex = 0; fieldIndex < 4; fieldIndex++)
+    {
+        if (!(stream >> field))
+        {
+            return false;
+        }
+        
+        fen += (fieldIndex == 0 ? "" : " ") + field;
+    }
+    
+    std::string operations;
+    std::getline(stream, operations);
+    
+    // Some suites write whole FENs, move counters included.
+    std::istringstream counters(operations);
+    std::string halfmoves;
+    std::string fullmoves;
+    
+    if (counters >> halfmoves >> fullmoves &&
+        isNumber(halfmoves) &&
+        isNumber(fullmoves))
+    {
+        fen += " " + halfmoves + " " + fullmoves;
+        std::getline(counters, operations);
+    }
+    
+    if (!parseFen(&entry->position, fen.c_str()))
+    {
+        return false;
+    }
+    
+    entry->id.clear();
+    entry->perft.clear();
+    entry->bestMoves.clear();
+    entry->avoidMoves.clear();
+    
+    std::istringstream operationStream(operations);
+    std::string operation;
+    
+    while (std::getline(operationStream, operation, ';'))
+    {
+        if (!parseOperation(operation, entry))
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+std::vector<EpdResult> runEpdSuite(const std::vector<EpdEntry> &entries,
+                                   const EpdLimits &limits)
+{
+    std::vector<EpdResult> results(entries.size());
+    
+    runTasks((int)entries.size(), limits.threads, [&](int task, int thread) {
+        results[task] = checkEntry(entries[task], limits);
+    });
+    
+    return results;
+}
+
+// Unknown opcodes are skipped, since suites carry all sorts of annotations.
+static bool parseOperation(const std::string &operation, EpdEntry *entry)
+{
+    std::istringstream operands(operation);
+    std::string opcode;
+    
+    if (!(operands >> opcode))
+    {
+        return true;
+    }
+    
+    if (opcode == "id")
+    {
+        std::string id;
+        std::getline(operands, id);
+        id.erase(std::remove(id.begin(), id.end(), '"'), id.end());
+        
+        size_t start = id.find_first_not_of(' ');
+        entry->id = (start == std::string::npos) ? "" : id.substr(start);
+    }
+    else if (opcode.size() > 1 && opcode[0] == 'D' && isNumber(opcode.substr(1)))
+    {
+        std::string count;
+        
+        if (!(operands >> count) || !isNumber(count))
+        {
+            return false;
+        }
+        
+        PerftCheck check = { atoi(opcode.c_str() + 1), strtoull(count.c_str(), nullptr, 10) };
+        entry->perft.push_back(check);
+    }
+    else if (opcode == "bm")
+    {
+        return parseMoves(&entry->position, operands, &entry->bestMoves);
+    }
+    else if (opcode == "am")
+    {
+        return parseMoves(&entry->position, operands, &entry->avoidMoves);
+    }
+    else if (opcode == "hmvc" || opcode == "fmvn")
+    {
+        int value = 0;
+        operands >> value;
+        
+        if (opcode == "hmvc")
+        {
+            entry->position.halfmoveClock = value;
+        }
+        else
+        {
+            entry->position.fullmoveNumber = value;
+        }
+    }
+    
+    return true;
+}
+
+// Moves are normally in SAN, but coordinate notation is accepted too.
+static bool parseMoves(const Position *position,
+                       std::istringstream &operands,
+                       std::vector<Move> *moves)
+{
+    std::string text;
+    
+    while (operands >> text)
+    {
+        Move move = moveFromSan(position, text);
+        
+        if (move == NULL_MOVE)
+        {
+            move = moveFromString(position, text);
+        }
+        
+        if (move == NULL_MOVE)
+        {
+            return false;
+        }
+        
+        moves->push_back(move);
+    }
+    
+    return true;
+}
+
+static bool isNumber(const std::string &text)
+{
+    if (text.empty())
+    {
+        return false;
+    }
+    
+    for (size_t index = 0; index < text.size(); index++)
+    {
+        if (!isdigit((unsigned char)text[index]))
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+static EpdResult checkEntry(const EpdEntry &entry, const EpdLimits &limits)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    EpdResult result;
+    result.passed = true;
+    result.skipped = true;
+    result.nodes = 0;
+    
+    for (size_t checkIndex = 0; checkIndex < entry.perft.size(); checkIndex++)
+    {
+        const PerftCheck &check = entry.perft[checkIndex];
+        
+        if (check.depth > limits.perftDepth)
+        {
+            continue;
+        }
+        
+        uint64_t nodes = perft(&entry.position, check.depth);
+        result.nodes += nodes;
+        result.skipped = false;
+        result.detail = "perft " + std::to_string(check.depth);
+        
+        if (nodes != check.nodes)
+        {
+            result.passed = false;
+            result.detail += " gave " + std::to_string(nodes) +
+                             ", expected " + std::to_string(check.nodes);
+            break;
+        }
+    }
+    
+    if (result.passed && (!entry.bestMoves.empty() || !entry.avoidMoves.empty()))
+    {
+        SearchLimits searchLimits = { limits.searchDepth, limits.moveTimeMs, 1 };
+        uint64_t searchNodes = 0;
+        
+        Move chosen = searchPosition(&entry.position, searchLimits, [&searchNodes](const SearchReport &report) {
+            searchNodes = report.nodes;
+        }, nullptr);
+        
+        result.nodes += searchNodes;
+        result.skipped = false;
+        result.passed = (entry.bestMoves.empty() || containsMove(entry.bestMoves, chosen)) &&
+                        !containsMove(entry.avoidMoves, chosen);
+        
+        std::string wanted = entry.bestMoves.empty() ? "am" : "bm";
+        const std::vector<Move> &listed = entry.bestMoves.empty() ?
+                                          entry.avoidMoves :
+                                          entry.bestMoves;
+        
+        for (size_t moveIndex = 0; moveIndex < listed.size(); moveIndex++)
+        {
+            wanted += " " + moveToSan(&entry.position, listed[moveIndex]);
+        }
+        
+        result.detail += (result.detail.empty() ? "" : ", ") + wanted + ", played " +
+                         ((chosen == NULL_MOVE) ? "nothing" : moveToSan(&entry.position, chosen));
+    }
+    
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    result.elapsedMs = elapsed.count();
+    
+    return result;
+}
+
+static bool containsMove(const std::vector<Move> &moves, Move move)
+{
+    return std::find(moves.begin(), moves.end(), move) != moves.end();
+}
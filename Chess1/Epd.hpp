@@ -0,0 +1,65 @@
+//
+//  Epd.hpp
+//  Chess1
+//
+//  Extended Position Description test suites: one position per line, the
+//  first four FEN fields followed by operations such as ";D3 8902" (perft
+//  count at depth 3), "bm Nf3;" (best move) and "id \"name\";".  Suites are
+//  checked in parallel, one position per task, and every check is timed so
+//  a slowdown in the rules shows up next to the position that caused it.
+//
+
+#ifndef Epd_hpp
+#define Epd_hpp
+
+#include <string>
+#include <vector>
+#include "Position.hpp"
+
+typedef struct
+{
+    int depth;
+    uint64_t nodes;
+} PerftCheck;
+
+typedef struct
+{
+    Position position;
+    std::string id;                 // The "id" operation, or the line number.
+    std::vector<PerftCheck> perft;
+    std::vector<Move> bestMoves;    // "bm": any of these passes.
+    std::vector<Move> avoidMoves;   // "am": none of these may be chosen.
+} EpdEntry;
+
+typedef struct
+{
+    int perftDepth;         // Deeper perft checks are skipped.
+    int searchDepth;        // 0 means no depth limit.
+    int moveTimeMs;         // 0 means no time limit.
+    int threads;            // Fewer than 1 means one per core.
+} EpdLimits;
+
+typedef struct
+{
+    bool passed;
+    bool skipped;           // Nothing on the line was checked.
+    std::string detail;     // What failed, or what was checked.
+    uint64_t nodes;
+    double elapsedMs;
+} EpdResult;
+
+// Reads every line of path.  Lines that can't be parsed are described in
+// errors (which may be null) and left out.  Returns false if path can't be
+// read at all.
+bool loadEpdFile(const char *path,
+                 std::vector<EpdEntry> *entries,
+                 std::vector<std::string> *errors);
+bool parseEpdLine(const std::string &line, EpdEntry *entry);
+
+// Checks every entry, results[i] going with entries[i].  Searches for "bm"
+// and "am" use one thread each; the entries themselves are spread over
+// limits.threads.
+std::vector<EpdResult> runEpdSuite(const std::vector<EpdEntry> &entries,
+                                   const EpdLimits &limits);
+
+#endif /* Epd_hpp */
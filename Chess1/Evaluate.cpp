@@ -0,0 +1,624 @@
+//
+//  Evaluate.cpp
+//  Chess1
+//
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include "Evaluate.hpp"
+
+constexpr int PIECE_VALUES[PIECE_TYPE_COUNT] = {
+    0,      // null
+    100,    // pawn
+    500,    // rook
+    320,    // knight
+    330,    // bishop
+    900,    // queen
+    0       // king
+};
+
+static constexpr int ENDGAME_PIECE_VALUES[PIECE_TYPE_COUNT] = { 0, 120, 520, 300, 320, 930, 0 };
+
+constexpr int GAME_PHASE_WEIGHTS[PIECE_TYPE_COUNT] = { 0, 0, 2, 1, 1, 4, 0 };
+
+// Bonuses for white's pieces, laid out the way the board is drawn (a8 first,
+// h1 last); black's are the same tables turned over.  Indexed by piece type.
+static constexpr int MIDDLEGAME_SQUARES[PIECE_TYPE_COUNT][SQUARE_COUNT] = {
+    {},
+    {
+          0,   0,   0,   0,   0,   0,   0,   0,
+         50,  50,  50,  50,  50,  50,  50,  50,
+         10,  10,  20,  30,  30,  20,  10,  10,
+          5,   5,  10,  25,  25,  10,   5,   5,
+          0,   0,   0,  20,  20,   0,   0,   0,
+          5,  -5, -10,   0,   0, -10,  -5,   5,
+          5,  10,  10, -20, -20,  10,  10,   5,
+          0,   0,   0,   0,   0,   0,   0,   0
+    },
+    {
+          0,   0,   0,   0,   0,   0,   0,   0,
+          5,  10,  10,  10,  10,  10,  10,   5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+          0,   0,   0,   5,   5,   0,   0,   0
+    },
+    {
+        -50, -40, -30, -30, -30, -30, -40, -50,
+        -40, -20,   0,   0,   0,   0, -20, -40,
+        -30,   0,  10,  15,  15,  10,   0, -30,
+        -30,   5,  15,  20,  20,  15,   5, -30,
+        -30,   0,  15,  20,  20,  15,   0, -30,
+        -30,   5,  10,  15,  15,  10,   5, -30,
+        -40, -20,   0,   5,   5,   0, -20, -40,
+        -50, -40, -30, -30, -30, -30, -40, -50
+    },
+    {
+        -20, -10, -10, -10, -10, -10, -10, -20,
+        -10,   0,   0,   0,   0,   0,   0, -10,
+        -10,   0,   5,  10,  10,   5,   0, -10,
+        -10,   5,   5,  10,  10,   5,   5, -10,
+        -10,   0,  10,  10,  10,  10,   0, -10,
+        -10,  10,  10,  10,  10,  10,  10, -10,
+        -10,   5,   0,   0,   0,   0,   5, -10,
+        -20, -10, -10, -10, -10, -10, -10, -20
+    },
+    {
+        -20, -10, -10,  -5,  -5, -10, -10, -20,
+        -10,   0,   0,   0,   0,   0,   0, -10,
+        -10,   0,   5,   5,   5,   5,   0, -10,
+         -5,   0,   5,   5,   5,   5,   0,  -5,
+          0,   0,   5,   5,   5,   5,   0,  -5,
+        -10,   5,   5,   5,   5,   5,   0, -10,
+        -10,   0,   5,   0,   0,   0,   0, -10,
+        -20, -10, -10,  -5,  -5, -10, -10, -20
+    },
+    {
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -20, -30, -30, -40, -40, -30, -30, -20,
+        -10, -20, -20, -20, -20, -20, -20, -10,
+         20,  20,   0,   0,   0,   0,  20,  20,
+         20,  30,  10,   0,   0,  10,  30,  20
+    }
+};
+
+// In the endgame pawns are worth pushing and the king belongs in the middle;
+// the other pieces keep their middlegame bonuses.
+static constexpr int ENDGAME_PAWN_SQUARES[SQUARE_COUNT] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+     80,  80,  80,  80,  80,  80,  80,  80,
+     50,  50,  50,  50,  50,  50,  50,  50,
+     30,  30,  30,  30,  30,  30,  30,  30,
+     15,  15,  15,  15,  15,  15,  15,  15,
+      5,   5,   5,   5,   5,   5,   5,   5,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0
+};
+
+static constexpr int ENDGAME_KING_SQUARES[SQUARE_COUNT] = {
+    -50, -40, -30, -20, -20, -30, -40, -50,
+    -30, -20, -10,   0,   0, -10, -20, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -30,   0,   0,   0,   0, -30, -30,
+    -50, -30, -30, -30, -30, -30, -30, -50
+};
+
+// Per square a piece could go to, by piece type.
+static const int MOBILITY_MIDDLEGAME[PIECE_TYPE_COUNT] = { 0, 0, 2, 4, 5, 1, 0 };
+static const int MOBILITY_ENDGAME[PIECE_TYPE_COUNT] = { 0, 0, 4, 4, 5, 2, 0 };
+
+// How much a piece of each type bearing on the king's squares threatens it,
+// and how much more dangerous several attackers are than one.
+static const int KING_ATTACK_WEIGHTS[PIECE_TYPE_COUNT] = { 0, 0, 3, 2, 2, 5, 0 };
+static const int KING_ATTACKER_SCALE[5] = { 0, 1, 4, 6, 8 };
+static const int PAWN_SHIELD_BONUS = 10;
+
+static const int DOUBLED_PAWN_MIDDLEGAME = -10;
+static const int DOUBLED_PAWN_ENDGAME = -20;
+static const int ISOLATED_PAWN_MIDDLEGAME = -10;
+static const int ISOLATED_PAWN_ENDGAME = -15;
+
+// Indexed by how far up the board the passed pawn is, from its own side.
+static const int PASSED_PAWN_MIDDLEGAME[8] = { 0, 5, 10, 15, 25, 40, 60, 0 };
+static const int PASSED_PAWN_ENDGAME[8] = { 0, 10, 20, 35, 55, 85, 120, 0 };
+
+// Worked out at compile time, so positions set up before main runs still
+// get the right totals.
+constexpr PieceSquareTable pieceSquareTable()
+{
+    PieceSquareTable table = {};
+    
+    for (int type = PIECE_PAWN; type < PIECE_TYPE_COUNT; type++)
+    {
+        for (int square = 0; square < SQUARE_COUNT; square++)
+        {
+            // The tables are drawn from white's side, so white's a1 is the
+            // bottom left entry (56) and black's is the top left (0).
+            int squares[2] = { square ^ 56, square };
+            
+            for (int color = 0; color < 2; color++)
+            {
+                int sign = (color == 0) ? 1 : -1;
+                int drawn = squares[color];
+                int endgameBonus = (type == PIECE_PAWN) ? ENDGAME_PAWN_SQUARES[drawn] :
+                                   (type == PIECE_KING) ? ENDGAME_KING_SQUARES[drawn] :
+                                   MIDDLEGAME_SQUARES[type][drawn];
+                
+                table.middlegame[color][type][square] =
+                    (int16_t)(sign * (PIECE_VALUES[type] + MIDDLEGAME_SQUARES[type][drawn]));
+                table.endgame[color][type][square] =
+                    (int16_t)(sign * (ENDGAME_PIECE_VALUES[type] + endgameBonus));
+            }
+        }
+    }
+    
+    return table;
+}
+
+constexpr PieceSquareTable PIECE_SQUARE = pieceSquareTable();
+
+static Bitboard pawnAttacksOf(Bitboard pawns, int color);
+static Bitboard pieceAttacks(int type, int square, Bitboard occupied);
+static Bitboard adjacentFiles(int file);
+static Bitboard ranksAhead(int square, int color);
+static void addTerm(TermScore *total, TermScore term);
+static TermScore pieceSquareTotalsScalar(const Position *position);
+static int fastestEvalKernel();
+#if defined(__x86_64__) || defined(__i386__)
+static TermScore pieceSquareTotalsSse2(const Position *position);
+static TermScore pieceSquareTotalsAvx2(const Position *position);
+#endif
+
+int evaluate(const Position *position)
+{
+    TermScore total = materialTerm(position);
+    addTerm(&total, mobilityTerm(position));
+    addTerm(&total, kingSafetyTerm(position));
+    addTerm(&total, pawnTerm(position));
+    
+    int score = taperedScore(position, total);
+    
+    return (position->sideToMove == COLOR_WHITE) ? score : -score;
+}
+
+TermScore materialTerm(const Position *position)
+{
+    return { position->middlegame, position->endgame };
+}
+
+// Squares each knight, bishop, rook and queen could go to, other than its
+// own side's and those an enemy pawn guards.
+TermScore mobilityTerm(const Position *position)
+{
+    TermScore score = { 0, 0 };
+    
+    for (int color = COLOR_WHITE; color <= COLOR_BLACK; color += 2)
+    {
+        int sign = (color == COLOR_WHITE) ? 1 : -1;
+        Bitboard reachable = ~position->colors[colorIndex(color)] &
+                             ~pawnAttacksOf(piecesOf(position, -color, PIECE_PAWN), -color);
+        
+        for (int type = PIECE_ROOK; type <= PIECE_QUEEN; type++)
+        {
+            Bitboard pieces = piecesOf(position, color, type);
+            
+            while (pieces != 0)
+            {
+                int square = popLowestSquare(&pieces);
+                int moves = popCount(pieceAttacks(type, square, position->occupied) & reachable);
+                
+                score.middlegame += sign * MOBILITY_MIDDLEGAME[type] * moves;
+                score.endgame += sign * MOBILITY_ENDGAME[type] * moves;
+            }
+        }
+    }
+    
+    return score;
+}
+
+// Enemy pieces bearing on the squares round each king, and the pawns in
+// front of it.  Only the middlegame part counts; with the queens and rooks
+// gone, the king is meant to come out.
+TermScore kingSafetyTerm(const Position *position)
+{
+    TermScore score = { 0, 0 };
+    
+    for (int color = COLOR_WHITE; color <= COLOR_BLACK; color += 2)
+    {
+        int sign = (color == COLOR_WHITE) ? 1 : -1;
+        int king = kingSquare(position, color);
+        Bitboard zone = KING_ATTACKS[king] | squareBit(king);
+        int attackers = 0;
+        int weight = 0;
+        
+        for (int type = PIECE_ROOK; type <= PIECE_QUEEN; type++)
+        {
+            Bitboard pieces = piecesOf(position, -color, type);
+            
+            while (pieces != 0)
+            {
+                Bitboard hits = pieceAttacks(type, popLowestSquare(&pieces), position->occupied) & zone;
+                
+                if (hits != 0)
+                {
+                    attackers++;
+                    weight += KING_ATTACK_WEIGHTS[type] * popCount(hits);
+                }
+            }
+        }
+        
+        // The king's files, on the two ranks in front of it.
+        Bitboard shield = ((color == COLOR_WHITE) ? zone << 8 : zone >> 8) & ranksAhead(king, color);
+        int shieldPawns = std::min(popCount(piecesOf(position, color, PIECE_PAWN) & shield), 3);
+        
+        score.middlegame -= sign * weight * KING_ATTACKER_SCALE[std::min(attackers, 4)];
+        score.middlegame += sign * PAWN_SHIELD_BONUS * shieldPawns;
+    }
+    
+    return score;
+}
+
+TermScore pawnTerm(const Position *position)
+{
+    TermScore score = { 0, 0 };
+    
+    for (int color = COLOR_WHITE; color <= COLOR_BLACK; color += 2)
+    {
+        int sign = (color == COLOR_WHITE) ? 1 : -1;
+        Bitboard pawns = piecesOf(position, color, PIECE_PAWN);
+        Bitboard enemyPawns = piecesOf(position, -color, PIECE_PAWN);
+        
+        for (int file = 0; file < 8; file++)
+        {
+            int count = popCount(pawns & (FILE_A_BITS << file));
+            
+            if (count > 1)
+            {
+                score.middlegame += sign * DOUBLED_PAWN_MIDDLEGAME * (count - 1);
+                score.endgame += sign * DOUBLED_PAWN_ENDGAME * (count - 1);
+            }
+        }
+        
+        Bitboard remaining = pawns;
+        
+        while (remaining != 0)
+        {
+            int square = popLowestSquare(&remaining);
+            int file = square & 7;
+            Bitboard neighbours = adjacentFiles(file) & ~(FILE_A_BITS << file);
+            
+            if ((pawns & neighbours) == 0)
+            {
+                score.middlegame += sign * ISOLATED_PAWN_MIDDLEGAME;
+                score.endgame += sign * ISOLATED_PAWN_ENDGAME;
+            }
+            
+            if ((enemyPawns & adjacentFiles(file) & ranksAhead(square, color)) == 0)
+            {
+                int advance = (color == COLOR_WHITE) ? (square >> 3) : 7 - (square >> 3);
+                score.middlegame += sign * PASSED_PAWN_MIDDLEGAME[advance];
+                score.endgame += sign * PASSED_PAWN_ENDGAME[advance];
+            }
+        }
+    }
+    
+    return score;
+}
+
+int taperedScore(const Position *position, TermScore score)
+{
+    int phase = std::min(position->phase, MAX_GAME_PHASE);
+    
+    return (score.middlegame * phase + score.endgame * (MAX_GAME_PHASE - phase)) / MAX_GAME_PHASE;
+}
+
+TermScore pieceSquareTotals(const Position *position, int kernel)
+{
+    switch (kernel)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        case EVAL_KERNEL_SSE2:
+            return pieceSquareTotalsSse2(position);
+            
+        case EVAL_KERNEL_AVX2:
+            return pieceSquareTotalsAvx2(position);
+#endif
+        
+        default:
+            return pieceSquareTotalsScalar(position);
+    }
+}
+
+bool evalKernelAvailable(int kernel)
+{
+    switch (kernel)
+    {
+        case EVAL_KERNEL_SCALAR:
+            return true;
+            
+#if defined(__x86_64__) || defined(__i386__)
+        case EVAL_KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2");
+            
+        case EVAL_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        
+        default:
+            return false;
+    }
+}
+
+// With at most 32 pieces on 64 squares the board is sparse, and whether a
+// mask over eight or sixteen squares beats one piece at a time depends on
+// the processor, so the kernels are timed against each other the first
+// time this is asked.
+int bestEvalKernel()
+{
+    static const int best = fastestEvalKernel();
+    
+    return best;
+}
+
+const char *evalKernelName(int kernel)
+{
+    static const char *NAMES[EVAL_KERNEL_COUNT] = { "scalar", "SSE2", "AVX2" };
+    
+    return (kernel >= 0 && kernel < EVAL_KERNEL_COUNT) ? NAMES[kernel] : "unknown";
+}
+
+// The squares color's pawns attack, all at once.
+static Bitboard pawnAttacksOf(Bitboard pawns, int color)
+{
+    if (color == COLOR_WHITE)
+    {
+        return ((pawns << 7) & ~FILE_H_BITS) | ((pawns << 9) & ~FILE_A_BITS);
+    }
+    
+    return ((pawns >> 9) & ~FILE_H_BITS) | ((pawns >> 7) & ~FILE_A_BITS);
+}
+
+static Bitboard pieceAttacks(int type, int square, Bitboard occupied)
+{
+    switch (type)
+    {
+        case PIECE_ROOK:
+            return rookAttacks(square, occupied);
+            
+        case PIECE_KNIGHT:
+            return KNIGHT_ATTACKS[square];
+            
+        case PIECE_BISHOP:
+            return bishopAttacks(square, occupied);
+            
+        default:
+            return queenAttacks(square, occupied);
+    }
+}
+
+// file and the files either side of it.
+static Bitboard adjacentFiles(int file)
+{
+    Bitboard files = FILE_A_BITS << file;
+    
+    return files | ((files << 1) & ~FILE_A_BITS) | ((files >> 1) & ~FILE_H_BITS);
+}
+
+// Every square on the ranks in front of square, as color sees it.
+static Bitboard ranksAhead(int square, int color)
+{
+    int rank = square >> 3;
+    
+    if (color == COLOR_WHITE)
+    {
+        return (rank < 7) ? ~0ULL << (8 * (rank + 1)) : 0;
+    }
+    
+    return (rank > 0) ? ~0ULL >> (8 * (8 - rank)) : 0;
+}
+
+static void addTerm(TermScore *total, TermScore term)
+{
+    total->middlegame += term.middlegame;
+    total->endgame += term.endgame;
+}
+
+static TermScore pieceSquareTotalsScalar(const Position *position)
+{
+    TermScore totals = { 0, 0 };
+    
+    for (int color = 0; color < 2; color++)
+    {
+        for (int type = PIECE_PAWN; type < PIECE_TYPE_COUNT; type++)
+        {
+            Bitboard pieces = position->pieces[type] & position->colors[color];
+            
+            while (pieces != 0)
+            {
+                int square = popLowestSquare(&pieces);
+                totals.middlegame += PIECE_SQUARE.middlegame[color][type][square];
+                totals.endgame += PIECE_SQUARE.endgame[color][type][square];
+            }
+        }
+    }
+    
+    return totals;
+}
+
+// Times every available kernel over a few positions, opening to endgame,
+// and returns the quickest.  Two passes, keeping each kernel's better time,
+// so the one that happens to run first isn't charged for a cold cache.
+static int fastestEvalKernel()
+{
+    static const char *TIMING_FENS[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"
+    };
+    const int POSITION_COUNT = sizeof(TIMING_FENS) / sizeof(TIMING_FENS[0]);
+    const int ROUNDS = 2000;
+    Position positions[POSITION_COUNT];
+    double times[EVAL_KERNEL_COUNT];
+    volatile int sink = 0;
+    
+    for (int index = 0; index < POSITION_COUNT; index++)
+    {
+        parseFen(&positions[index], TIMING_FENS[index]);
+    }
+    
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int kernel = 0; kernel < EVAL_KERNEL_COUNT; kernel++)
+        {
+            if (!evalKernelAvailable(kernel))
+            {
+                continue;
+            }
+            
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            
+            for (int round = 0; round < ROUNDS; round++)
+            {
+                for (int index = 0; index < POSITION_COUNT; index++)
+                {
+                    sink = sink + pieceSquareTotals(&positions[index], kernel).middlegame;
+                }
+            }
+            
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            times[kernel] = (pass == 0) ? elapsed.count() : std::min(times[kernel], elapsed.count());
+        }
+    }
+    
+    int best = EVAL_KERNEL_SCALAR;
+    
+    for (int kernel = 0; kernel < EVAL_KERNEL_COUNT; kernel++)
+    {
+        if (evalKernelAvailable(kernel) && times[kernel] < times[best])
+        {
+            best = kernel;
+        }
+    }
+    
+    return best;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Each sixteen-bit lane keeps the running total for the squares it stands
+// for, one from each chunk.  A square holds at most one piece, so a lane
+// never adds up more than eight pieces' values, well inside sixteen bits.
+__attribute__((target("sse2")))
+static TermScore pieceSquareTotalsSse2(const Position *position)
+{
+    const __m128i squareBits = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+    __m128i middlegame = _mm_setzero_si128();
+    __m128i endgame = _mm_setzero_si128();
+    
+    for (int color = 0; color < 2; color++)
+    {
+        for (int type = PIECE_PAWN; type < PIECE_TYPE_COUNT; type++)
+        {
+            Bitboard pieces = position->pieces[type] & position->colors[color];
+            
+            for (int chunk = 0; pieces != 0; chunk++, pieces >>= 8)
+            {
+                if ((pieces & 0xFF) == 0)
+                {
+                    continue;
+                }
+                
+                __m128i chunkBits = _mm_set1_epi16((short)(pieces & 0xFF));
+                __m128i mask = _mm_cmpeq_epi16(_mm_and_si128(chunkBits, squareBits), squareBits);
+                const __m128i *middlegameBonuses =
+                    (const __m128i *)&PIECE_SQUARE.middlegame[color][type][chunk * 8];
+                const __m128i *endgameBonuses =
+                    (const __m128i *)&PIECE_SQUARE.endgame[color][type][chunk * 8];
+                    
+                middlegame = _mm_add_epi16(middlegame, _mm_and_si128(mask, _mm_loadu_si128(middlegameBonuses)));
+                endgame = _mm_add_epi16(endgame, _mm_and_si128(mask, _mm_loadu_si128(endgameBonuses)));
+            }
+        }
+    }
+    
+    // Pairs of lanes widened to 32 bits and added, then the four sums folded.
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i sums[2] = { _mm_madd_epi16(middlegame, ones), _mm_madd_epi16(endgame, ones) };
+    int totals[2];
+    
+    for (int part = 0; part < 2; part++)
+    {
+        __m128i sum = _mm_add_epi32(sums[part], _mm_shuffle_epi32(sums[part], _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        totals[part] = _mm_cvtsi128_si32(sum);
+    }
+    
+    return { totals[0], totals[1] };
+}
+
+// The same sixteen squares at a time, so a lane adds up at most four pieces.
+__attribute__((target("avx2")))
+static TermScore pieceSquareTotalsAvx2(const Position *position)
+{
+    const __m256i squareBits = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128,
+                                                 256, 512, 1024, 2048,
+                                                 4096, 8192, 16384, (short)0x8000);
+    __m256i middlegame = _mm256_setzero_si256();
+    __m256i endgame = _mm256_setzero_si256();
+    
+    for (int color = 0; color < 2; color++)
+    {
+        for (int type = PIECE_PAWN; type < PIECE_TYPE_COUNT; type++)
+        {
+            Bitboard pieces = position->pieces[type] & position->colors[color];
+            
+            for (int chunk = 0; pieces != 0; chunk++, pieces >>= 16)
+            {
+                if ((pieces & 0xFFFF) == 0)
+                {
+                    continue;
+                }
+                
+                __m256i chunkBits = _mm256_set1_epi16((short)(pieces & 0xFFFF));
+                __m256i mask = _mm256_cmpeq_epi16(_mm256_and_si256(chunkBits, squareBits), squareBits);
+                const __m256i *middlegameBonuses =
+                    (const __m256i *)&PIECE_SQUARE.middlegame[color][type][chunk * 16];
+                const __m256i *endgameBonuses =
+                    (const __m256i *)&PIECE_SQUARE.endgame[color][type][chunk * 16];
+                    
+                middlegame = _mm256_add_epi16(middlegame,
+                                              _mm256_and_si256(mask, _mm256_loadu_si256(middlegameBonuses)));
+                endgame = _mm256_add_epi16(endgame,
+                                           _mm256_and_si256(mask, _mm256_loadu_si256(endgameBonuses)));
+            }
+        }
+    }
+    
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sums[2] = { _mm256_madd_epi16(middlegame, ones), _mm256_madd_epi16(endgame, ones) };
+    int totals[2];
+    
+    for (int part = 0; part < 2; part++)
+    {
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(sums[part]),
+                                    _mm256_extracti128_si256(sums[part], 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        totals[part] = _mm_cvtsi128_si32(sum);
+    }
+    
+    return { totals[0], totals[1] };
+}
+
+#endif
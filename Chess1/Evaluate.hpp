@@ -0,0 +1,57 @@
+//
+//  Evaluate.hpp
+//  Chess1
+//
+//  The static evaluation: material and piece-square bonuses, mobility, king
+//  safety and pawn structure, each with a middlegame and an endgame part
+//  that are blended by how much material is left.  Material and piece
+//  squares cost nothing here, because Position keeps their totals up to date
+//  as pieces are put down and picked up, so makeMove and unmakeMove carry
+//  them along; the other terms are worked out from the bitboards each time.
+//
+
+#ifndef Evaluate_hpp
+#define Evaluate_hpp
+
+#include "Position.hpp"
+
+// Centipawn values, indexed by piece type.
+extern const int PIECE_VALUES[PIECE_TYPE_COUNT];
+
+// What pieceSquareTotals adds up with: one square at a time, or the bonuses
+// of eight (SSE2) or sixteen (AVX2) squares at once, picked out of the
+// tables by a mask made from the bitboard.  The vector kernels are only
+// built for x86, and only run where the processor has the instructions.
+static const int EVAL_KERNEL_SCALAR = 0;
+static const int EVAL_KERNEL_SSE2 = 1;
+static const int EVAL_KERNEL_AVX2 = 2;
+static const int EVAL_KERNEL_COUNT = 3;
+
+// A term's middlegame and endgame parts, as white's lead in centipawns.
+typedef struct
+{
+    int middlegame;
+    int endgame;
+} TermScore;
+
+// Static score in centipawns from the side to move's point of view.
+int evaluate(const Position *position);
+
+// The terms evaluate adds up, for the eval command and for tuning.
+TermScore materialTerm(const Position *position);
+TermScore mobilityTerm(const Position *position);
+TermScore kingSafetyTerm(const Position *position);
+TermScore pawnTerm(const Position *position);
+
+// Blends score by position's phase, all middlegame at MAX_GAME_PHASE and all
+// endgame at 0.
+int taperedScore(const Position *position, TermScore score);
+
+// The material and piece-square totals added up from scratch with kernel,
+// which evalKernelAvailable must allow, to check the ones Position keeps.
+TermScore pieceSquareTotals(const Position *position, int kernel);
+bool evalKernelAvailable(int kernel);
+int bestEvalKernel();
+const char *evalKernelName(int kernel);
+
+#endif /* Evaluate_hpp */
@@ -0,0 +1,65 @@
+//
+//  GameHost.cpp
+//  Chess1
+//
+
+#include <algorithm>
+#include "GameHost.hpp"
+#include "ThreadPool.hpp"
+
+void initGameHost(GameHost *host, int gameCount, int shardCount)
+{
+    freeGameHost(host);
+    
+    // Sized once, before any game points at an arena.
+    host->arenas.resize(std::max(shardCount, 1));
+    host->games.resize(std::max(gameCount, 0));
+    
+    for (size_t game = 0; game < host->games.size(); game++)
+    {
+        initGame(&host->games[game], &host->arenas[game % host->arenas.size()]);
+    }
+}
+
+void freeGameHost(GameHost *host)
+{
+    host->games.clear();
+    host->arenas.clear();
+}
+
+void visitHostedGames(GameHost *host,
+                      int threads,
+                      const std::function<void(int game, int thread)> &visit)
+{
+    int shards = (int)host->arenas.size();
+    int games = (int)host->games.size();
+    
+    runTasks(shards, threads, [&](int shard, int thread) {
+        for (int game = shard; game < games; game += shards)
+        {
+            useGame(&host->games[game]);
+            visit(game, thread);
+        }
+        
+        useGame(nullptr);
+    });
+}
+
+GameHostMemory gameHostMemory(const GameHost *host)
+{
+    GameHostMemory memory = { host->games.size(), 0, 0, 0 };
+    
+    for (size_t game = 0; game < host->games.size(); game++)
+    {
+        size_t bytes = gameMemoryBytes(&host->games[game]);
+        memory.gameBytes += bytes;
+        memory.largestGameBytes = std::max(memory.largestGameBytes, bytes);
+    }
+    
+    for (size_t shard = 0; shard < host->arenas.size(); shard++)
+    {
+        memory.arenaBytes += arenaMemoryBytes(&host->arenas[shard]);
+    }
+    
+    return memory;
+}
@@ -0,0 +1,50 @@
+//
+//  GameHost.hpp
+//  Chess1
+//
+//  Keeps many games going in one process at once, the way a server hosting
+//  thousands of players would.  Games are split into shards by number, and
+//  each shard has its own MoveArena for the games' histories.  A pass over
+//  the games runs each shard as a single task on the thread pool, so a game
+//  and its arena are only ever touched by one thread at a time and games
+//  never wait on a lock for each other, however many there are.
+//
+
+#ifndef GameHost_hpp
+#define GameHost_hpp
+
+#include <vector>
+#include <functional>
+#include "Rules.hpp"
+
+typedef struct
+{
+    std::vector<Game> games;
+    std::vector<MoveArena> arenas;  // One per shard; game n is in shard n % shards.
+} GameHost;
+
+typedef struct
+{
+    size_t games;
+    size_t gameBytes;           // All the games together, history included.
+    size_t largestGameBytes;
+    size_t arenaBytes;          // Every slab, whether its blocks are used or free.
+} GameHostMemory;
+
+// Sets up gameCount games at the usual start in shardCount shards (at least
+// one).  Not safe during a pass.
+void initGameHost(GameHost *host, int gameCount, int shardCount);
+void freeGameHost(GameHost *host);
+
+// Calls visit once for every game, with that game current so the Rules
+// functions play it, spreading the shards over threads threads (fewer than 1
+// means one per core).  visit learns the game's number and the thread's,
+// and a shard's games are visited in order.  Blocks until every game has
+// been visited.
+void visitHostedGames(GameHost *host,
+                      int threads,
+                      const std::function<void(int game, int thread)> &visit);
+
+GameHostMemory gameHostMemory(const GameHost *host);
+
+#endif /* GameHost_hpp */
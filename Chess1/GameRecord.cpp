@@ -0,0 +1,401 @@
+//
+//  GameRecord.cpp
+//  Chess1
+//
+
+#include <string.h>
+#include <unistd.h>
+#include "GameRecord.hpp"
+
+static const char GAME_FILE_MAGIC[4] = { 'C', '1', 'G', 'R' };
+static const uint64_t MAGIC_BYTES = 4;
+static const uint64_t LENGTH_BYTES = 4;
+
+// Number, winner, reason, flags and move count.
+static const uint64_t FIXED_RECORD_BYTES = 9;
+static const uint64_t INDEX_ENTRY_BYTES = 8;
+
+static std::string indexPath(const char *path);
+static bool indexMatches(const MappedFile *data, const MappedFile *index);
+static void walkRecords(const MappedFile *data, std::vector<uint64_t> *offsets);
+static uint64_t recordOffset(const GameReader *reader, uint64_t game);
+static uint64_t readLittleEndian(const char *bytes, int count);
+static void writeLittleEndian(std::string *output, uint64_t value, int count);
+static bool fileExists(const char *path);
+
+bool openGameWriter(const char *path, GameWriter *writer)
+{
+    GameReader reader;
+    bool indexFresh = false;
+    std::vector<uint64_t> offsets;
+    uint64_t size = 0;
+    
+    writer->games = 0;
+    
+    if (openGameReader(path, &reader))
+    {
+        indexFresh = (reader.index.data != nullptr);
+        writer->games = reader.games;
+        size = MAGIC_BYTES;
+        
+        for (uint64_t game = 0; game < reader.games; game++)
+        {
+            offsets.push_back(recordOffset(&reader, game));
+        }
+        
+        if (reader.games > 0)
+        {
+            uint64_t last = offsets.back();
+            size = last + LENGTH_BYTES + readLittleEndian(reader.data.data + last, 4);
+        }
+        
+        bool damaged = (size < reader.data.size);
+        closeGameReader(&reader);
+        
+        // Appending after half a record would make everything after it
+        // unreadable.
+        if (damaged && truncate(path, (off_t)size) != 0)
+        {
+            return false;
+        }
+    }
+    else if (fileExists(path))
+    {
+        // Something else, or a file too short to have its magic; better not
+        // to append to either.
+        return false;
+    }
+    
+    writer->data.open(path, std::ios::binary | std::ios::app);
+    
+    if (size == 0)
+    {
+        writer->data.write(GAME_FILE_MAGIC, MAGIC_BYTES);
+        size = MAGIC_BYTES;
+    }
+    
+    writer->size = size;
+    
+    if (indexFresh)
+    {
+        writer->index.open(indexPath(path).c_str(), std::ios::binary | std::ios::app);
+    }
+    else
+    {
+        writer->index.open(indexPath(path).c_str(), std::ios::binary | std::ios::trunc);
+        std::string entries;
+        
+        for (size_t game = 0; game < offsets.size(); game++)
+        {
+            writeLittleEndian(&entries, offsets[game], INDEX_ENTRY_BYTES);
+        }
+        
+        writer->index.write(entries.data(), entries.size());
+    }
+    
+    if (!writer->data || !writer->index)
+    {
+        closeGameWriter(writer);
+        return false;
+    }
+    
+    return true;
+}
+
+void closeGameWriter(GameWriter *writer)
+{
+    writer->data.close();
+    writer->index.close();
+}
+
+bool writeGameRecord(GameWriter *writer, const GameRecord &record)
+{
+    if (record.moves.size() > MAX_GAME_RECORD_MOVES ||
+        record.startFen.size() > 0xFF ||
+        (!record.clocksMs.empty() && record.clocksMs.size() != record.moves.size()))
+    {
+        return false;
+    }
+    
+    int flags = (record.startFen.empty() ? 0 : GAME_RECORD_START_FEN) |
+                (record.clocksMs.empty() ? 0 : GAME_RECORD_CLOCKS);
+    
+    // Built whole and written at once, so a record is either all there or
+    // (after a crash) cut short at the end of the file.
+    std::string bytes;
+    bytes.reserve(LENGTH_BYTES + FIXED_RECORD_BYTES + record.moves.size() * 3);
+    
+    writeLittleEndian(&bytes, 0, LENGTH_BYTES);
+    writeLittleEndian(&bytes, record.number, 4);
+    writeLittleEndian(&bytes, (uint8_t)(int8_t)record.winner, 1);
+    writeLittleEndian(&bytes, (uint64_t)record.reason, 1);
+    writeLittleEndian(&bytes, (uint64_t)flags, 1);
+    writeLittleEndian(&bytes, record.moves.size(), 2);
+    
+    if (flags & GAME_RECORD_START_FEN)
+    {
+        writeLittleEndian(&bytes, record.startFen.size(), 1);
+        bytes += record.startFen;
+    }
+    
+    for (size_t moveIndex = 0; moveIndex < record.moves.size(); moveIndex++)
+    {
+        writeLittleEndian(&bytes, record.moves[moveIndex], 2);
+    }
+    
+    for (size_t clockIndex = 0; clockIndex < record.clocksMs.size(); clockIndex++)
+    {
+        uint32_t clock = record.clocksMs[clockIndex];
+        
+        while (clock >= 0x80)
+        {
+            bytes += (char)((clock & 0x7F) | 0x80);
+            clock >>= 7;
+        }
+        
+        bytes += (char)clock;
+    }
+    
+    uint64_t length = bytes.size() - LENGTH_BYTES;
+    
+    for (uint64_t byte = 0; byte < LENGTH_BYTES; byte++)
+    {
+        bytes[byte] = (char)((length >> (8 * byte)) & 0xFF);
+    }
+    
+    std::string entry;
+    writeLittleEndian(&entry, writer->size, INDEX_ENTRY_BYTES);
+    
+    writer->data.write(bytes.data(), bytes.size());
+    writer->index.write(entry.data(), entry.size());
+    writer->size += bytes.size();
+    writer->games++;
+    
+    return writer->data && writer->index;
+}
+
+bool openGameReader(const char *path, GameReader *reader)
+{
+    reader->index = { nullptr, 0 };
+    reader->offsets.clear();
+    reader->games = 0;
+    
+    if (!mapFile(path, &reader->data))
+    {
+        return false;
+    }
+    
+    if (reader->data.size < MAGIC_BYTES ||
+        memcmp(reader->data.data, GAME_FILE_MAGIC, MAGIC_BYTES) != 0)
+    {
+        closeGameReader(reader);
+        return false;
+    }
+    
+    if (mapFile(indexPath(path).c_str(), &reader->index) &&
+        indexMatches(&reader->data, &reader->index))
+    {
+        reader->games = reader->index.size / INDEX_ENTRY_BYTES;
+    }
+    else
+    {
+        unmapFile(&reader->index);
+        walkRecords(&reader->data, &reader->offsets);
+        reader->games = reader->offsets.size();
+    }
+    
+    return true;
+}
+
+void closeGameReader(GameReader *reader)
+{
+    unmapFile(&reader->data);
+    unmapFile(&reader->index);
+    reader->offsets.clear();
+    reader->games = 0;
+}
+
+bool readGameRecord(const GameReader *reader, uint64_t game, GameRecord *record)
+{
+    if (game >= reader->games)
+    {
+        return false;
+    }
+    
+    uint64_t offset = recordOffset(reader, game);
+    
+    if (offset + LENGTH_BYTES + FIXED_RECORD_BYTES > reader->data.size)
+    {
+        return false;
+    }
+    
+    const char *bytes = reader->data.data + offset;
+    uint64_t length = readLittleEndian(bytes, 4);
+    uint64_t end = LENGTH_BYTES + length;
+    
+    if (length < FIXED_RECORD_BYTES || offset + end > reader->data.size)
+    {
+        return false;
+    }
+    
+    record->number = (uint32_t)readLittleEndian(bytes + 4, 4);
+    record->winner = (int8_t)bytes[8];
+    record->reason = (uint8_t)bytes[9];
+    
+    int flags = (uint8_t)bytes[10];
+    uint64_t moveCount = readLittleEndian(bytes + 11, 2);
+    uint64_t position = LENGTH_BYTES + FIXED_RECORD_BYTES;
+    
+    record->startFen.clear();
+    
+    if (flags & GAME_RECORD_START_FEN)
+    {
+        if (position + 1 > end)
+        {
+            return false;
+        }
+        
+        uint64_t fenLength = (uint8_t)bytes[position];
+        
+        if (position + 1 + fenLength > end)
+        {
+            return false;
+        }
+        
+        record->startFen.assign(bytes + position + 1, fenLength);
+        position += 1 + fenLength;
+    }
+    
+    if (position + moveCount * 2 > end)
+    {
+        return false;
+    }
+    
+    record->moves.resize(moveCount);
+    
+    for (uint64_t moveIndex = 0; moveIndex < moveCount; moveIndex++)
+    {
+        record->moves[moveIndex] = (Move)readLittleEndian(bytes + position, 2);
+        position += 2;
+    }
+    
+    record->clocksMs.clear();
+    
+    if (flags & GAME_RECORD_CLOCKS)
+    {
+        record->clocksMs.reserve(moveCount);
+        
+        for (uint64_t clockIndex = 0; clockIndex < moveCount; clockIndex++)
+        {
+            uint32_t clock = 0;
+            int shift = 0;
+            
+            while (true)
+            {
+                if (position >= end || shift > 28)
+                {
+                    return false;
+                }
+                
+                uint8_t byte = (uint8_t)bytes[position++];
+                clock |= (uint32_t)(byte & 0x7F) << shift;
+                shift += 7;
+                
+                if (!(byte & 0x80))
+                {
+                    break;
+                }
+            }
+            
+            record->clocksMs.push_back(clock);
+        }
+    }
+    
+    return true;
+}
+
+static std::string indexPath(const char *path)
+{
+    return std::string(path) + ".idx";
+}
+
+// Cheap rather than thorough: the index has to start at the first record
+// and its last entry has to end exactly at the end of the data, which is
+// what appending without it (or a crash between the two writes) breaks.
+static bool indexMatches(const MappedFile *data, const MappedFile *index)
+{
+    if (index->size % INDEX_ENTRY_BYTES != 0)
+    {
+        return false;
+    }
+    
+    if (index->size == 0)
+    {
+        return data->size == MAGIC_BYTES;
+    }
+    
+    uint64_t first = readLittleEndian(index->data, INDEX_ENTRY_BYTES);
+    uint64_t last = readLittleEndian(index->data + index->size - INDEX_ENTRY_BYTES,
+                                     INDEX_ENTRY_BYTES);
+    
+    if (first != MAGIC_BYTES || last + LENGTH_BYTES > data->size)
+    {
+        return false;
+    }
+    
+    return last + LENGTH_BYTES + readLittleEndian(data->data + last, 4) == data->size;
+}
+
+// Finds every whole record by hopping from length to length.
+static void walkRecords(const MappedFile *data, std::vector<uint64_t> *offsets)
+{
+    uint64_t offset = MAGIC_BYTES;
+    
+    while (offset + LENGTH_BYTES <= data->size)
+    {
+        uint64_t length = readLittleEndian(data->data + offset, 4);
+        
+        if (length < FIXED_RECORD_BYTES || offset + LENGTH_BYTES + length > data->size)
+        {
+            break;
+        }
+        
+        offsets->push_back(offset);
+        offset += LENGTH_BYTES + length;
+    }
+}
+
+static uint64_t recordOffset(const GameReader *reader, uint64_t game)
+{
+    if (reader->index.data != nullptr)
+    {
+        return readLittleEndian(reader->index.data + game * INDEX_ENTRY_BYTES, INDEX_ENTRY_BYTES);
+    }
+    
+    return reader->offsets[game];
+}
+
+static uint64_t readLittleEndian(const char *bytes, int count)
+{
+    uint64_t value = 0;
+    
+    for (int byte = count - 1; byte >= 0; byte--)
+    {
+        value = (value << 8) | (uint8_t)bytes[byte];
+    }
+    
+    return value;
+}
+
+static void writeLittleEndian(std::string *output, uint64_t value, int count)
+{
+    for (int byte = 0; byte < count; byte++)
+    {
+        *output += (char)((value >> (8 * byte)) & 0xFF);
+    }
+}
+
+static bool fileExists(const char *path)
+{
+    return access(path, F_OK) == 0;
+}
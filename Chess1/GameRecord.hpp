@@ -0,0 +1,97 @@
+//
+//  GameRecord.hpp
+//  Chess1
+//
+//  Games stored compactly in one growing file: self-play batches, converted
+//  PGN archives and the windowed game's own history all append to it.  The
+//  file is the four bytes "C1GR" and then one record per game, all
+//  little-endian:
+//
+//   uint32 length of the rest of the record
+//   uint32 number          the writer's own numbering (self-play game, say)
+//   int8 winner            COLOR_WHITE, COLOR_BLACK, or 0 if drawn/unfinished
+//   uint8 end reason       GAME_END_*
+//   uint8 flags            GAME_RECORD_START_FEN, GAME_RECORD_CLOCKS
+//   uint16 move count
+//   [uint8 length, FEN]    only with GAME_RECORD_START_FEN
+//   uint16 moves[move count]           as Move packs them
+//   [varint clocks[move count]]        only with GAME_RECORD_CLOCKS
+//
+//  Clocks are the milliseconds spent on each move, seven bits a byte with
+//  the top bit set on all but the last, so a quick move costs one byte.
+//
+//  Next to the file, path + ".idx" holds each record's uint64 offset, so
+//  game n is found without reading the ones before it.  The writer keeps it
+//  up to date; when it is missing or stale the reader walks the records'
+//  lengths instead, and the next writer rebuilds it.
+//
+
+#ifndef GameRecord_hpp
+#define GameRecord_hpp
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Position.hpp"
+#include "MappedFile.hpp"
+
+// Why a game stopped.
+static const int GAME_END_CHECKMATE = 0;
+static const int GAME_END_STALEMATE = 1;
+static const int GAME_END_FIFTY_MOVES = 2;
+static const int GAME_END_MAX_PLIES = 3;
+static const int GAME_END_TABLEBASE = 4;    // Adjudicated from the tables.
+static const int GAME_END_OTHER = 5;        // Resigned, agreed, abandoned or unknown.
+
+static const int MAX_GAME_RECORD_MOVES = 0xFFFF;
+
+static const int GAME_RECORD_START_FEN = 1;
+static const int GAME_RECORD_CLOCKS = 2;
+
+typedef struct
+{
+    uint32_t number;
+    int winner;
+    int reason;
+    std::string startFen;           // Empty for the usual start position.
+    std::vector<Move> moves;
+    std::vector<uint32_t> clocksMs; // Empty, or one per move.
+} GameRecord;
+
+typedef struct
+{
+    std::ofstream data;
+    std::ofstream index;
+    uint64_t size;                  // Of data, so the next record's offset.
+    uint64_t games;
+} GameWriter;
+
+typedef struct
+{
+    MappedFile data;
+    MappedFile index;               // Only kept when it matches data.
+    std::vector<uint64_t> offsets;  // Walked out of data otherwise.
+    uint64_t games;
+} GameReader;
+
+// Opens path for appending, creating it if need be.  A record cut short by
+// a crash is dropped first, and a missing or stale index is rebuilt.
+// Returns false if path isn't a game file or can't be written.
+bool openGameWriter(const char *path, GameWriter *writer);
+void closeGameWriter(GameWriter *writer);
+
+// Appends record; not safe from more than one thread at once.  Returns false
+// if it has more than MAX_GAME_RECORD_MOVES moves or the write failed.
+bool writeGameRecord(GameWriter *writer, const GameRecord &record);
+
+// Maps path.  Returns false if it can't be read or isn't a game file; a
+// truncated last record is left out.
+bool openGameReader(const char *path, GameReader *reader);
+void closeGameReader(GameReader *reader);
+
+// Reads game number game, counting from 0 in file order.  Safe from any
+// number of threads.  Returns false if there is no such game or its record
+// is damaged.
+bool readGameRecord(const GameReader *reader, uint64_t game, GameRecord *record);
+
+#endif /* GameRecord_hpp */
@@ -0,0 +1,860 @@
+//
+//  GameServer.cpp
+//  Chess1
+//
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#endif
+#include "GameServer.hpp"
+#include "Rules.hpp"
+#include "MoveGen.hpp"
+
+static bool parsePort(const std::string &address, int *port);
+static bool unixAddress(const std::string &address, struct sockaddr_un *unixSocket);
+
+#ifdef __linux__
+
+static const int REQUEST_NEW = 0;
+static const int REQUEST_MOVE = 1;
+static const int REQUEST_STATE = 2;
+static const int REQUEST_RESIGN = 3;
+static const int REQUEST_CLOSE = 4;
+
+// A connection that sends a longer line, or stops reading while this much
+// is waiting for it, is dropped.
+static const size_t MAX_REQUEST_LINE = 256;
+static const size_t MAX_WAITING_OUTPUT = 1 << 20;
+
+static const int MAX_EVENTS = 256;
+
+// epoll's data for the loop's own descriptors; connections are numbered from
+// FIRST_CONNECTION.
+static const uint64_t LISTENER_EVENT = 0;
+static const uint64_t WAKE_EVENT = 1;
+static const uint64_t SIGNAL_EVENT = 2;
+static const uint64_t FIRST_CONNECTION = 3;
+
+typedef struct
+{
+    uint64_t connection;
+    int kind;
+    uint32_t game;
+    std::string argument;   // The move, or the resigning color.
+} ServerRequest;
+
+typedef struct
+{
+    uint64_t connection;
+    std::string line;
+} ServerAnswer;
+
+typedef struct
+{
+    int fd;
+    std::string input;
+    std::string output;
+    bool waitingToWrite;    // Watched for EPOLLOUT because output backed up.
+} ServerConnection;
+
+// From the workers to the loop, which wakeFd wakes.
+typedef struct
+{
+    std::mutex lock;
+    std::vector<ServerAnswer> answers;
+    int wakeFd;
+} AnswerQueue;
+
+typedef struct
+{
+    std::mutex lock;        // Guards requests and stopping.
+    std::condition_variable wake;
+    std::vector<ServerRequest> requests;
+    bool stopping;
+    // Only the worker's own thread touches the rest.
+    MoveArena arena;
+    std::unordered_map<uint32_t, Game> games;
+    uint64_t gamesStarted;
+    uint64_t moves;
+    uint64_t illegalMoves;
+    std::thread thread;
+} ServerWorker;
+
+static int listenOn(const std::string &address);
+static bool watch(int epollFd, int operation, int fd, uint64_t id, uint32_t events);
+static void acceptConnections(int epollFd,
+                              int listener,
+                              uint64_t *nextConnection,
+                              std::unordered_map<uint64_t, ServerConnection> *connections,
+                              GameServerStats *stats);
+static bool readRequests(ServerConnection *connection,
+                         uint64_t id,
+                         uint32_t *nextGame,
+                         std::vector<std::vector<ServerRequest>> *routed,
+                         GameServerStats *stats);
+static bool parseRequest(const std::string &line,
+                         uint64_t connection,
+                         uint32_t *nextGame,
+                         ServerRequest *request);
+static bool flushConnection(int epollFd, uint64_t id, ServerConnection *connection);
+static void runWorker(ServerWorker *worker, AnswerQueue *answers);
+static std::string answerRequest(ServerWorker *worker, const ServerRequest &request);
+static const char *statusName(int winner);
+
+bool runGameServer(const GameServerOptions &options, GameServerStats *stats)
+{
+    *stats = { 0, 0, 0, 0, 0, 0, 0.0 };
+    
+    int listener = listenOn(options.address);
+    
+    if (listener < 0)
+    {
+        return false;
+    }
+    
+    int workerCount = options.workers;
+    
+    if (workerCount < 1)
+    {
+        workerCount = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    
+    // Blocked before the workers start, so they inherit it and the signals
+    // only ever arrive through signalFd.
+    sigset_t signals;
+    sigset_t previousSignals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &previousSignals);
+    
+    int signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    AnswerQueue answers;
+    answers.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    
+    watch(epollFd, EPOLL_CTL_ADD, listener, LISTENER_EVENT, EPOLLIN);
+    watch(epollFd, EPOLL_CTL_ADD, answers.wakeFd, WAKE_EVENT, EPOLLIN);
+    watch(epollFd, EPOLL_CTL_ADD, signalFd, SIGNAL_EVENT, EPOLLIN);
+    
+    std::vector<std::unique_ptr<ServerWorker>> workers(workerCount);
+    
+    for (int worker = 0; worker < workerCount; worker++)
+    {
+        workers[worker].reset(new ServerWorker());
+        workers[worker]->thread = std::thread(runWorker, workers[worker].get(), &answers);
+    }
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::unordered_map<uint64_t, ServerConnection> connections;
+    std::vector<std::vector<ServerRequest>> routed(workerCount);
+    std::vector<ServerAnswer> arrived;
+    std::vector<uint64_t> touched;      // Connections that may have output.
+    uint64_t nextConnection = FIRST_CONNECTION;
+    uint32_t nextGame = 1;
+    bool stopping = false;
+    struct epoll_event events[MAX_EVENTS];
+    
+    while (!stopping)
+    {
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            
+            break;
+        }
+        
+        for (int eventIndex = 0; eventIndex < count; eventIndex++)
+        {
+            uint64_t id = events[eventIndex].data.u64;
+            
+            if (id == LISTENER_EVENT)
+            {
+                acceptConnections(epollFd, listener, &nextConnection, &connections, stats);
+                continue;
+            }
+            
+            if (id == SIGNAL_EVENT)
+            {
+                // Read, or it would still be pending when the old mask is
+                // put back, and kill the process there.
+                struct signalfd_siginfo signal;
+                ssize_t ignored = read(signalFd, &signal, sizeof(signal));
+                (void)ignored;
+                
+                stopping = true;
+                continue;
+            }
+            
+            if (id == WAKE_EVENT)
+            {
+                uint64_t wakes;
+                ssize_t ignored = read(answers.wakeFd, &wakes, sizeof(wakes));
+                (void)ignored;
+                
+                {
+                    std::lock_guard<std::mutex> lock(answers.lock);
+                    arrived.swap(answers.answers);
+                }
+                
+                for (size_t answerIndex = 0; answerIndex < arrived.size(); answerIndex++)
+                {
+                    std::unordered_map<uint64_t, ServerConnection>::iterator found =
+                        connections.find(arrived[answerIndex].connection);
+                        
+                    // The client may have gone while its request was out.
+                    if (found != connections.end())
+                    {
+                        found->second.output += arrived[answerIndex].line;
+                        found->second.output += '\n';
+                        touched.push_back(found->first);
+                    }
+                }
+                
+                arrived.clear();
+                continue;
+            }
+            
+            std::unordered_map<uint64_t, ServerConnection>::iterator found = connections.find(id);
+            
+            if (found == connections.end())
+            {
+                continue;
+            }
+            
+            if ((events[eventIndex].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) &&
+                !readRequests(&found->second, id, &nextGame, &routed, stats))
+            {
+                close(found->second.fd);
+                connections.erase(found);
+                continue;
+            }
+            
+            touched.push_back(id);
+        }
+        
+        // Each worker gets everything this pass read for it in one go.
+        for (int worker = 0; worker < workerCount; worker++)
+        {
+            if (routed[worker].empty())
+            {
+                continue;
+            }
+            
+            {
+                std::lock_guard<std::mutex> lock(workers[worker]->lock);
+                std::vector<ServerRequest> &requests = workers[worker]->requests;
+                requests.insert(requests.end(),
+                                std::make_move_iterator(routed[worker].begin()),
+                                std::make_move_iterator(routed[worker].end()));
+            }
+            
+            workers[worker]->wake.notify_one();
+            routed[worker].clear();
+        }
+        
+        for (size_t touchedIndex = 0; touchedIndex < touched.size(); touchedIndex++)
+        {
+            std::unordered_map<uint64_t, ServerConnection>::iterator found =
+                connections.find(touched[touchedIndex]);
+                
+            if (found != connections.end() &&
+                !flushConnection(epollFd, found->first, &found->second))
+            {
+                close(found->second.fd);
+                connections.erase(found);
+            }
+        }
+        
+        touched.clear();
+    }
+    
+    // Workers answer whatever they were already given before they stop.
+    for (int worker = 0; worker < workerCount; worker++)
+    {
+        {
+            std::lock_guard<std::mutex> lock(workers[worker]->lock);
+            workers[worker]->stopping = true;
+        }
+        
+        workers[worker]->wake.notify_one();
+        workers[worker]->thread.join();
+        
+        stats->games += workers[worker]->gamesStarted;
+        stats->openGames += workers[worker]->games.size();
+        stats->moves += workers[worker]->moves;
+        stats->illegalMoves += workers[worker]->illegalMoves;
+    }
+    
+    for (std::unordered_map<uint64_t, ServerConnection>::iterator connection = connections.begin();
+         connection != connections.end();
+         connection++)
+    {
+        close(connection->second.fd);
+    }
+    
+    close(listener);
+    close(epollFd);
+    close(signalFd);
+    close(answers.wakeFd);
+    pthread_sigmask(SIG_SETMASK, &previousSignals, nullptr);
+    
+    struct sockaddr_un unixSocket;
+    
+    if (unixAddress(options.address, &unixSocket))
+    {
+        unlink(unixSocket.sun_path);
+    }
+    
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats->elapsedMs = elapsed.count();
+    
+    return true;
+}
+
+static int listenOn(const std::string &address)
+{
+    int port;
+    int fd;
+    
+    if (parsePort(address, &port))
+    {
+        struct sockaddr_in tcpSocket;
+        memset(&tcpSocket, 0, sizeof(tcpSocket));
+        tcpSocket.sin_family = AF_INET;
+        tcpSocket.sin_port = htons((uint16_t)port);
+        tcpSocket.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        
+        int reuse = 1;
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        
+        if (fd < 0 ||
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+            bind(fd, (struct sockaddr *)&tcpSocket, sizeof(tcpSocket)) != 0)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            
+            return -1;
+        }
+    }
+    else
+    {
+        struct sockaddr_un unixSocket;
+        struct stat status;
+        
+        if (!unixAddress(address, &unixSocket))
+        {
+            return -1;
+        }
+        
+        // A socket left behind by a server that didn't get to clean up; any
+        // other kind of file is left alone, and bind fails on it.
+        if (stat(unixSocket.sun_path, &status) == 0 && S_ISSOCK(status.st_mode))
+        {
+            unlink(unixSocket.sun_path);
+        }
+        
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        
+        if (fd < 0 || bind(fd, (struct sockaddr *)&unixSocket, sizeof(unixSocket)) != 0)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            
+            return -1;
+        }
+    }
+    
+    if (listen(fd, SOMAXCONN) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    
+    return fd;
+}
+
+static bool watch(int epollFd, int operation, int fd, uint64_t id, uint32_t events)
+{
+    struct epoll_event event;
+    event.events = events;
+    event.data.u64 = id;
+    
+    return epoll_ctl(epollFd, operation, fd, &event) == 0;
+}
+
+static void acceptConnections(int epollFd,
+                              int listener,
+                              uint64_t *nextConnection,
+                              std::unordered_map<uint64_t, ServerConnection> *connections,
+                              GameServerStats *stats)
+{
+    while (true)
+    {
+        int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        
+        if (fd < 0)
+        {
+            // EAGAIN once the backlog is empty; anything else (out of
+            // descriptors, say) is tried again on the next wakeup.
+            return;
+        }
+        
+        // Answers are small and a client waits on each, so send them at
+        // once.  Fails harmlessly on a Unix socket.
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        
+        uint64_t id = (*nextConnection)++;
+        
+        if (!watch(epollFd, EPOLL_CTL_ADD, fd, id, EPOLLIN | EPOLLRDHUP))
+        {
+            close(fd);
+            continue;
+        }
+        
+        (*connections)[id] = { fd, std::string(), std::string(), false };
+        stats->connections++;
+    }
+}
+
+// Reads all there is and routes every whole line to its game's worker;
+// malformed ones are answered straight away.  Returns false once the client
+// has gone or broken the rules.
+static bool readRequests(ServerConnection *connection,
+                         uint64_t id,
+                         uint32_t *nextGame,
+                         std::vector<std::vector<ServerRequest>> *routed,
+                         GameServerStats *stats)
+{
+    char buffer[4096];
+    bool open = true;
+    
+    while (true)
+    {
+        ssize_t got = read(connection->fd, buffer, sizeof(buffer));
+        
+        if (got > 0)
+        {
+            connection->input.append(buffer, (size_t)got);
+            continue;
+        }
+        
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        
+        if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            open = false;
+        }
+        
+        break;
+    }
+    
+    size_t lineStart = 0;
+    size_t lineEnd;
+    
+    while ((lineEnd = connection->input.find('\n', lineStart)) != std::string::npos)
+    {
+        std::string line = connection->input.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+        
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        
+        if (line.empty())
+        {
+            continue;
+        }
+        
+        ServerRequest request;
+        stats->requests++;
+        
+        if (parseRequest(line, id, nextGame, &request))
+        {
+            (*routed)[request.game % routed->size()].push_back(request);
+        }
+        else
+        {
+            connection->output += "error " + std::to_string(request.game) + "\n";
+        }
+    }
+    
+    connection->input.erase(0, lineStart);
+    
+    return open && connection->input.size() <= MAX_REQUEST_LINE;
+}
+
+// Returns false for anything that isn't a request, with request->game set
+// to whatever game id it managed to read, or 0.
+static bool parseRequest(const std::string &line,
+                         uint64_t connection,
+                         uint32_t *nextGame,
+                         ServerRequest *request)
+{
+    std::istringstream words(line);
+    std::string command;
+    std::string gameText;
+    std::string argument;
+    std::string extra;
+    
+    words >> command >> gameText >> argument >> extra;
+    
+    request->connection = connection;
+    request->game = 0;
+    
+    if (command == "new")
+    {
+        // 0 is never a game, so errors can use it.
+        if (*nextGame == 0)
+        {
+            (*nextGame)++;
+        }
+        
+        request->kind = REQUEST_NEW;
+        request->game = (*nextGame)++;
+        
+        return gameText.empty();
+    }
+    
+    char *end;
+    unsigned long game = strtoul(gameText.c_str(), &end, 10);
+    
+    if (gameText.empty() || *end != '\0' || game > UINT32_MAX || !extra.empty())
+    {
+        return false;
+    }
+    
+    request->game = (uint32_t)game;
+    request->argument = argument;
+    
+    if (command == "move")
+    {
+        request->kind = REQUEST_MOVE;
+        return !argument.empty();
+    }
+    
+    if (command == "state")
+    {
+        request->kind = REQUEST_STATE;
+        return argument.empty();
+    }
+    
+    if (command == "resign")
+    {
+        request->kind = REQUEST_RESIGN;
+        return argument == "white" || argument == "black";
+    }
+    
+    if (command == "close")
+    {
+        request->kind = REQUEST_CLOSE;
+        return argument.empty();
+    }
+    
+    return false;
+}
+
+// Writes what the socket will take and watches for room for the rest.
+// Returns false if the client has gone or isn't reading.
+static bool flushConnection(int epollFd, uint64_t id, ServerConnection *connection)
+{
+    size_t written = 0;
+    
+    while (written < connection->output.size())
+    {
+        ssize_t sent = send(connection->fd,
+                            connection->output.data() + written,
+                            connection->output.size() - written,
+                            MSG_NOSIGNAL);
+        
+        if (sent > 0)
+        {
+            written += (size_t)sent;
+        }
+        else if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    
+    connection->output.erase(0, written);
+    
+    bool backedUp = !connection->output.empty();
+    
+    if (backedUp != connection->waitingToWrite)
+    {
+        uint32_t events = EPOLLIN | EPOLLRDHUP | (backedUp ? (uint32_t)EPOLLOUT : 0u);
+        
+        if (!watch(epollFd, EPOLL_CTL_MOD, connection->fd, id, events))
+        {
+            return false;
+        }
+        
+        connection->waitingToWrite = backedUp;
+    }
+    
+    return connection->output.size() <= MAX_WAITING_OUTPUT;
+}
+
+// Takes everything queued at once and hands back all the answers together,
+// so a busy worker locks and wakes the loop once a batch rather than once a
+// request.
+static void runWorker(ServerWorker *worker, AnswerQueue *answers)
+{
+    std::vector<ServerRequest> requests;
+    std::vector<ServerAnswer> finished;
+    
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(worker->lock);
+            worker->wake.wait(lock, [worker] {
+                return !worker->requests.empty() || worker->stopping;
+            });
+            
+            if (worker->requests.empty())
+            {
+                break;
+            }
+            
+            requests.swap(worker->requests);
+        }
+        
+        for (size_t requestIndex = 0; requestIndex < requests.size(); requestIndex++)
+        {
+            finished.push_back({ requests[requestIndex].connection,
+                                 answerRequest(worker, requests[requestIndex]) });
+        }
+        
+        requests.clear();
+        
+        {
+            std::lock_guard<std::mutex> lock(answers->lock);
+            answers->answers.insert(answers->answers.end(),
+                                    std::make_move_iterator(finished.begin()),
+                                    std::make_move_iterator(finished.end()));
+        }
+        
+        finished.clear();
+        
+        uint64_t wake = 1;
+        ssize_t ignored = write(answers->wakeFd, &wake, sizeof(wake));
+        (void)ignored;
+    }
+    
+    useGame(nullptr);
+}
+
+static std::string answerRequest(ServerWorker *worker, const ServerRequest &request)
+{
+    std::string id = std::to_string(request.game);
+    
+    if (request.kind == REQUEST_NEW)
+    {
+        initGame(&worker->games[request.game], &worker->arena);
+        worker->gamesStarted++;
+        return "game " + id;
+    }
+    
+    std::unordered_map<uint32_t, Game>::iterator found = worker->games.find(request.game);
+    
+    if (found == worker->games.end())
+    {
+        return "error " + id;
+    }
+    
+    if (request.kind == REQUEST_CLOSE)
+    {
+        // Its history's blocks go back to the arena for the next new game.
+        releaseGame(&found->second);
+        worker->games.erase(found);
+        return "closed " + id;
+    }
+    
+    useGame(&found->second);
+    
+    switch (request.kind)
+    {
+        case REQUEST_MOVE:
+        {
+            Move move = moveFromString(getGamePosition(), request.argument);
+            
+            if (move == NULL_MOVE || !playMove(move))
+            {
+                worker->illegalMoves++;
+                return "illegal " + id;
+            }
+            
+            worker->moves++;
+            return "ok " + id + " " + statusName(getWinner());
+        }
+        
+        case REQUEST_STATE:
+            return "state " + id + " " + statusName(getWinner()) + " " +
+                   formatFen(getGamePosition());
+        
+        default:
+            resign((request.argument == "white") ? COLOR_WHITE : COLOR_BLACK);
+            return "resigned " + id + " " + statusName(getWinner());
+    }
+}
+
+static const char *statusName(int winner)
+{
+    switch (winner)
+    {
+        case COLOR_WHITE:
+            return "white";
+            
+        case COLOR_BLACK:
+            return "black";
+            
+        case GAME_DRAWN:
+            return "drawn";
+            
+        default:
+            return "playing";
+    }
+}
+
+#else
+
+bool runGameServer(const GameServerOptions &options, GameServerStats *stats)
+{
+    *stats = { 0, 0, 0, 0, 0, 0, 0.0 };
+    
+    return false;
+}
+
+#endif
+
+int connectToGameServer(const std::string &address)
+{
+    int port;
+    int fd;
+    
+    if (parsePort(address, &port))
+    {
+        struct sockaddr_in tcpSocket;
+        memset(&tcpSocket, 0, sizeof(tcpSocket));
+        tcpSocket.sin_family = AF_INET;
+        tcpSocket.sin_port = htons((uint16_t)port);
+        tcpSocket.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        
+        if (fd < 0)
+        {
+            return -1;
+        }
+        
+        if (connect(fd, (struct sockaddr *)&tcpSocket, sizeof(tcpSocket)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    }
+    else
+    {
+        struct sockaddr_un unixSocket;
+        
+        if (!unixAddress(address, &unixSocket))
+        {
+            return -1;
+        }
+        
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        
+        if (fd < 0)
+        {
+            return -1;
+        }
+        
+        if (connect(fd, (struct sockaddr *)&unixSocket, sizeof(unixSocket)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    
+    return fd;
+}
+
+// A port is all digits; anything else is a socket path.
+static bool parsePort(const std::string &address, int *port)
+{
+    if (address.empty() || address.size() > 5 ||
+        address.find_first_not_of("0123456789") != std::string::npos)
+    {
+        return false;
+    }
+    
+    *port = atoi(address.c_str());
+    
+    return *port > 0 && *port <= 65535;
+}
+
+static bool unixAddress(const std::string &address, struct sockaddr_un *unixSocket)
+{
+    int port;
+    
+    if (parsePort(address, &port) || address.empty() ||
+        address.size() >= sizeof(unixSocket->sun_path))
+    {
+        return false;
+    }
+    
+    memset(unixSocket, 0, sizeof(*unixSocket));
+    unixSocket->sun_family = AF_UNIX;
+    memcpy(unixSocket->sun_path, address.c_str(), address.size());
+    
+    return true;
+}
@@ -0,0 +1,67 @@
+//
+//  GameServer.hpp
+//  Chess1
+//
+//  Serves games to local clients, with no window, over a Unix domain socket
+//  or a loopback TCP port.  One thread runs an epoll loop that accepts
+//  connections, reads and writes them without blocking and splits requests
+//  into lines; a pool of workers owns the games, each worker every game
+//  whose id modulo the pool size is its number, and checks moves with the
+//  rules engine.  A game is only ever touched by its own worker, so games
+//  never lock against each other; the only locks are on the queues between
+//  the loop and the workers.  epoll is Linux's, so elsewhere runGameServer
+//  refuses to start.
+//
+//  The protocol is one request a line, answered with one line:
+//
+//   new                    game <id>
+//   move <id> <move>       ok <id> <status>, or illegal <id>
+//   state <id>             state <id> <status> <fen>
+//   resign <id> <color>    resigned <id> <status>
+//   close <id>             closed <id>
+//
+//  Moves are in coordinate notation ("e2e4", "e7e8q"), colors are white or
+//  black, and a status is who has won: playing, white, black or drawn.
+//  Anything else, or a game that doesn't exist, is answered "error <id>"
+//  (0 when there's no id).  Answers about different games can come back in a
+//  different order from the requests, which is why every answer carries its
+//  game's id.
+//
+//  A game stays on its worker, finished or not, until it's closed, which
+//  hands its history back to the worker's arena, so clients should close
+//  every game they start once they're done with it.
+//
+
+#ifndef GameServer_hpp
+#define GameServer_hpp
+
+#include <string>
+#include <stdint.h>
+
+typedef struct
+{
+    // A Unix socket's path, or a port number to listen on at 127.0.0.1.
+    std::string address;
+    int workers;            // Fewer than 1 means one per core.
+} GameServerOptions;
+
+typedef struct
+{
+    uint64_t connections;
+    uint64_t requests;
+    uint64_t games;         // Started.
+    uint64_t openGames;     // Not closed by the time the server stopped.
+    uint64_t moves;         // Legal ones, played.
+    uint64_t illegalMoves;
+    double elapsedMs;
+} GameServerStats;
+
+// Serves until SIGINT or SIGTERM.  Returns false, having served nothing, if
+// it can't listen on the address (or isn't on Linux).  The bitboards and
+// Zobrist keys must already be set up.
+bool runGameServer(const GameServerOptions &options, GameServerStats *stats);
+
+// A blocking connection to the server at address (as above), or -1.
+int connectToGameServer(const std::string &address);
+
+#endif /* GameServer_hpp */
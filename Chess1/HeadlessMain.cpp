@@ -0,0 +1,22 @@
+//
+//  HeadlessMain.cpp
+//  Chess1
+//
+//  Entry point for the headless build.  It links only the rules engine and
+//  the command modes, never SDL.
+//
+
+#include "Commands.hpp"
+
+int main(int argc, const char * argv[])
+{
+    int status = runCommand(argc, argv);
+    
+    if (status < 0)
+    {
+        printCommandUsage();
+        return 1;
+    }
+    
+    return status;
+}
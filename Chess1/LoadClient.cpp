@@ -0,0 +1,367 @@
+//
+//  LoadClient.cpp
+//  Chess1
+//
+
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <random>
+#include <chrono>
+#include <sstream>
+#include <algorithm>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include "LoadClient.hpp"
+#include "GameServer.hpp"
+#include "MoveGen.hpp"
+
+// One game of a connection's, as far as the client knows it.
+typedef struct
+{
+    uint32_t id;                // 0 while waiting for "new" to be answered.
+    Position position;
+    int plies;
+    bool over;
+} LoadGame;
+
+typedef struct
+{
+    uint64_t moves;
+    uint64_t games;
+    uint64_t disagreements;
+    uint64_t errors;
+    std::vector<uint32_t> latenciesUs;
+    bool connected;
+} ConnectionResult;
+
+static void driveConnection(const LoadClientOptions &options,
+                            int connection,
+                            std::chrono::steady_clock::time_point deadline,
+                            ConnectionResult *result);
+static bool writeAll(int fd, const std::string &text);
+static bool readLine(int fd, std::string *buffer, std::string *line);
+static double percentile(std::vector<uint32_t> *values, double fraction);
+
+bool runLoadClient(const LoadClientOptions &options, LoadClientStats *stats)
+{
+    *stats = { 0, 0, 0, 0, 0.0, 0.0, 0.0, 0.0 };
+    
+    // A server that goes away shows up as a failed write, not a signal.
+    signal(SIGPIPE, SIG_IGN);
+    
+    int connections = std::max(options.connections, 1);
+    std::vector<ConnectionResult> results(connections);
+    std::vector<std::thread> threads;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point deadline = start + std::chrono::seconds(options.seconds);
+    
+    for (int connection = 0; connection < connections; connection++)
+    {
+        threads.push_back(std::thread(driveConnection,
+                                      std::cref(options),
+                                      connection,
+                                      deadline,
+                                      &results[connection]));
+    }
+    
+    std::vector<uint32_t> latenciesUs;
+    bool anyConnected = false;
+    
+    for (int connection = 0; connection < connections; connection++)
+    {
+        threads[connection].join();
+        
+        ConnectionResult &result = results[connection];
+        anyConnected = anyConnected || result.connected;
+        stats->moves += result.moves;
+        stats->games += result.games;
+        stats->disagreements += result.disagreements;
+        stats->errors += result.errors;
+        latenciesUs.insert(latenciesUs.end(), result.latenciesUs.begin(), result.latenciesUs.end());
+    }
+    
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats->elapsedMs = elapsed.count();
+    stats->medianLatencyUs = percentile(&latenciesUs, 0.5);
+    stats->p99LatencyUs = percentile(&latenciesUs, 0.99);
+    stats->maxLatencyUs = percentile(&latenciesUs, 1.0);
+    
+    return anyConnected;
+}
+
+static void driveConnection(const LoadClientOptions &options,
+                            int connection,
+                            std::chrono::steady_clock::time_point deadline,
+                            ConnectionResult *result)
+{
+    result->moves = 0;
+    result->games = 0;
+    result->disagreements = 0;
+    result->errors = 0;
+    result->connected = false;
+    
+    int fd = connectToGameServer(options.address);
+    
+    if (fd < 0)
+    {
+        result->errors++;
+        return;
+    }
+    
+    result->connected = true;
+    
+    std::mt19937 random(options.seed + (uint32_t)connection);
+    std::vector<LoadGame> games(std::max(options.gamesPerConnection, 1));
+    std::unordered_map<uint32_t, int> gameIndexes;
+    std::vector<Move> sentMoves(games.size(), NULL_MOVE);
+    std::vector<std::chrono::steady_clock::time_point> sentTimes(games.size());
+    std::string buffer;
+    std::string line;
+    std::string request;
+    MoveList list;
+    
+    for (size_t game = 0; game < games.size(); game++)
+    {
+        games[game].id = 0;
+    }
+    
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        // Games with no id yet, in the order their "new" went out; any game
+        // id that comes back can go to any of them.
+        std::vector<int> waitingForNew;
+        int answersDue = 0;
+        bool written = true;
+        
+        for (size_t game = 0; game < games.size() && written; game++)
+        {
+            LoadGame &loadGame = games[game];
+            sentMoves[game] = NULL_MOVE;
+            request.clear();
+            
+            if (loadGame.id == 0)
+            {
+                request = "new\n";
+                waitingForNew.push_back((int)game);
+                answersDue++;
+            }
+            else
+            {
+                generateLegalMoves(&loadGame.position, &list);
+                
+                if (list.count == 0 || loadGame.plies >= options.maxPlies || loadGame.over)
+                {
+                    // Checkmate and stalemate have been answered already; this
+                    // only reaches the server for games that went on too long.
+                    if (!loadGame.over)
+                    {
+                        request = "resign " + std::to_string(loadGame.id) + " white\n";
+                        answersDue++;
+                        
+                        if (list.count == 0)
+                        {
+                            result->disagreements++;
+                        }
+                    }
+                    
+                    // The server keeps every game until it's closed.
+                    request += "close " + std::to_string(loadGame.id) + "\n";
+                    answersDue++;
+                    gameIndexes.erase(loadGame.id);
+                    loadGame.id = 0;
+                }
+                else
+                {
+                    sentMoves[game] = list.moves[random() % list.count];
+                    request = "move " + std::to_string(loadGame.id) + " " +
+                              moveToString(sentMoves[game]) + "\n";
+                    answersDue++;
+                }
+            }
+            
+            // Each request goes out on its own, so a move's time starts when
+            // it was sent rather than when the round began.
+            sentTimes[game] = std::chrono::steady_clock::now();
+            written = writeAll(fd, request);
+        }
+        
+        if (!written)
+        {
+            result->errors++;
+            break;
+        }
+        
+        size_t nextWaiting = 0;
+        bool lost = false;
+        
+        for (int answer = 0; answer < answersDue; answer++)
+        {
+            if (!readLine(fd, &buffer, &line))
+            {
+                lost = true;
+                break;
+            }
+            
+            std::istringstream words(line);
+            std::string kind;
+            uint32_t id = 0;
+            std::string status;
+            words >> kind >> id >> status;
+            
+            if (kind == "game" && nextWaiting < waitingForNew.size())
+            {
+                int game = waitingForNew[nextWaiting++];
+                games[game].id = id;
+                parseFen(&games[game].position, START_FEN);
+                games[game].plies = 0;
+                games[game].over = false;
+                gameIndexes[id] = game;
+                result->games++;
+                continue;
+            }
+            
+            if (kind == "resigned" || kind == "closed")
+            {
+                continue;
+            }
+            
+            std::unordered_map<uint32_t, int>::iterator found = gameIndexes.find(id);
+            
+            if (kind == "error" || found == gameIndexes.end())
+            {
+                result->errors++;
+                continue;
+            }
+            
+            LoadGame &loadGame = games[found->second];
+            Move move = sentMoves[found->second];
+            
+            if (kind == "illegal")
+            {
+                result->disagreements++;
+                loadGame.over = true;
+                continue;
+            }
+            
+            std::chrono::duration<double, std::micro> latency =
+                std::chrono::steady_clock::now() - sentTimes[found->second];
+            result->latenciesUs.push_back((uint32_t)latency.count());
+            result->moves++;
+            
+            applyMove(&loadGame.position, move);
+            loadGame.plies++;
+            
+            if (status != "playing")
+            {
+                generateLegalMoves(&loadGame.position, &list);
+                
+                if (list.count != 0)
+                {
+                    result->disagreements++;
+                }
+                
+                loadGame.over = true;
+            }
+        }
+        
+        if (lost)
+        {
+            result->errors++;
+            break;
+        }
+    }
+    
+    // Close the games still going, so the server doesn't keep them.
+    request.clear();
+    int closesDue = 0;
+    
+    for (size_t game = 0; game < games.size(); game++)
+    {
+        if (games[game].id != 0)
+        {
+            request += "close " + std::to_string(games[game].id) + "\n";
+            closesDue++;
+        }
+    }
+    
+    if (closesDue > 0 && writeAll(fd, request))
+    {
+        while (closesDue > 0 && readLine(fd, &buffer, &line))
+        {
+            closesDue--;
+        }
+    }
+    
+    close(fd);
+}
+
+static bool writeAll(int fd, const std::string &text)
+{
+    size_t written = 0;
+    
+    while (written < text.size())
+    {
+        ssize_t sent = write(fd, text.data() + written, text.size() - written);
+        
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        
+        if (sent <= 0)
+        {
+            return false;
+        }
+        
+        written += (size_t)sent;
+    }
+    
+    return true;
+}
+
+// The next line from fd, without its newline; buffer keeps what has been
+// read past it.
+static bool readLine(int fd, std::string *buffer, std::string *line)
+{
+    while (true)
+    {
+        size_t end = buffer->find('\n');
+        
+        if (end != std::string::npos)
+        {
+            line->assign(*buffer, 0, end);
+            buffer->erase(0, end + 1);
+            return true;
+        }
+        
+        char bytes[4096];
+        ssize_t got = read(fd, bytes, sizeof(bytes));
+        
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        
+        if (got <= 0)
+        {
+            return false;
+        }
+        
+        buffer->append(bytes, (size_t)got);
+    }
+}
+
+static double percentile(std::vector<uint32_t> *values, double fraction)
+{
+    if (values->empty())
+    {
+        return 0.0;
+    }
+    
+    size_t index = std::min((size_t)(fraction * values->size()), values->size() - 1);
+    std::nth_element(values->begin(), values->begin() + index, values->end());
+    
+    return (*values)[index];
+}
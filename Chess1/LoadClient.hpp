@@ -0,0 +1,47 @@
+//
+//  LoadClient.hpp
+//  Chess1
+//
+//  Drives a running game server as hard as it can, to see how it holds up.
+//  Every connection has a thread of its own and a number of games going on
+//  it; each round it sends one request for every game (a random legal move,
+//  or "close" and then "new" in place of a game that has finished), each
+//  written as soon as it's made, and then waits for all the answers, timing
+//  each move from the moment its own request was sent.  The games are
+//  followed on the client's own boards, so a move the server turns down, or
+//  a game it thinks has ended that hasn't, is counted as a disagreement.
+//
+
+#ifndef LoadClient_hpp
+#define LoadClient_hpp
+
+#include <string>
+#include <stdint.h>
+
+typedef struct
+{
+    std::string address;        // As GameServer.hpp describes.
+    int connections;
+    int gamesPerConnection;
+    int seconds;
+    int maxPlies;               // Longer games are resigned.
+    uint32_t seed;
+} LoadClientOptions;
+
+typedef struct
+{
+    uint64_t moves;
+    uint64_t games;             // Started.
+    uint64_t disagreements;
+    uint64_t errors;            // "error" answers, or connections lost.
+    double elapsedMs;
+    // The time from sending a move to its answer, in microseconds.
+    double medianLatencyUs;
+    double p99LatencyUs;
+    double maxLatencyUs;
+} LoadClientStats;
+
+// Runs for options.seconds.  Returns false if it couldn't connect at all.
+bool runLoadClient(const LoadClientOptions &options, LoadClientStats *stats);
+
+#endif /* LoadClient_hpp */
@@ -0,0 +1,100 @@
+//
+//  MappedFile.cpp
+//  Chess1
+//
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "MappedFile.hpp"
+
+static size_t pageSize();
+
+bool mapFile(const char *path, MappedFile *file)
+{
+    file->data = nullptr;
+    file->size = 0;
+    
+    int descriptor = open(path, O_RDONLY);
+    
+    if (descriptor < 0)
+    {
+        return false;
+    }
+    
+    struct stat status;
+    
+    if (fstat(descriptor, &status) != 0)
+    {
+        close(descriptor);
+        return false;
+    }
+    
+    if (status.st_size > 0)
+    {
+        void *data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        
+        if (data == MAP_FAILED)
+        {
+            close(descriptor);
+            return false;
+        }
+        
+        file->data = (const char *)data;
+        file->size = (size_t)status.st_size;
+    }
+    
+    // The mapping keeps the file open.
+    close(descriptor);
+    
+    return true;
+}
+
+void unmapFile(MappedFile *file)
+{
+    if (file->data != nullptr)
+    {
+        munmap((void *)file->data, file->size);
+    }
+    
+    file->data = nullptr;
+    file->size = 0;
+}
+
+void adviseSequential(const MappedFile *file)
+{
+    if (file->data != nullptr)
+    {
+        madvise((void *)file->data, file->size, MADV_SEQUENTIAL);
+    }
+}
+
+void adviseRandom(const MappedFile *file)
+{
+    if (file->data != nullptr)
+    {
+        madvise((void *)file->data, file->size, MADV_RANDOM);
+    }
+}
+
+// Only whole pages inside the range are released, so nothing either side
+// of it is touched.
+void releaseRange(const MappedFile *file, size_t offset, size_t length)
+{
+    size_t page = pageSize();
+    size_t start = (offset + page - 1) / page * page;
+    size_t end = (offset + length) / page * page;
+    
+    if (file->data != nullptr && end > start)
+    {
+        madvise((void *)(file->data + start), end - start, MADV_DONTNEED);
+    }
+}
+
+static size_t pageSize()
+{
+    static const size_t size = (size_t)sysconf(_SC_PAGESIZE);
+    
+    return size;
+}
@@ -0,0 +1,38 @@
+//
+//  MappedFile.hpp
+//  Chess1
+//
+//  Read-only memory-mapped files, for data too big to read into memory
+//  first (game archives, opening books, tablebases).  The pages are only
+//  read from disk when touched and can be handed back once used, so a file
+//  larger than RAM can be walked through start to finish.
+//
+
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <stddef.h>
+
+typedef struct
+{
+    const char *data;
+    size_t size;
+} MappedFile;
+
+// Maps all of path.  Returns false, with file->data null, if it can't be
+// opened.  An empty file maps to a null data pointer and a size of 0.
+bool mapFile(const char *path, MappedFile *file);
+void unmapFile(MappedFile *file);
+
+// Hints that the file will be read from start to finish.
+void adviseSequential(const MappedFile *file);
+
+// Hints that the file will be read a few bytes at a time from anywhere in
+// it, so reading ahead would only waste memory.
+void adviseRandom(const MappedFile *file);
+
+// Lets the system drop the pages under [offset, offset + length) from
+// memory; they are read in again if touched later.
+void releaseRange(const MappedFile *file, size_t offset, size_t length);
+
+#endif /* MappedFile_hpp */
@@ -0,0 +1,551 @@
+//
+//  MoveGen.cpp
+//  Chess1
+//
+
+#include <string.h>
+#include <ctype.h>
+#include "MoveGen.hpp"
+
+static const Bitboard RANK_3_BITS = RANK_1_BITS << 16;
+static const Bitboard RANK_6_BITS = RANK_1_BITS << 40;
+
+static Bitboard pinnedPieces(const Position *position, int color, int king);
+static void addPawnMoves(const Position *position,
+                         MoveList *list,
+                         Bitboard targets);
+static void addPawnMove(MoveList *list, int from, int to, bool promotion);
+static void addPieceMoves(MoveList *list, int from, Bitboard targets);
+static void addCastlingMoves(const Position *position,
+                             MoveList *list,
+                             Bitboard dangers);
+static void removePinnedMoves(MoveList *list,
+                              int first,
+                              Bitboard pinned,
+                              int king);
+static uint64_t perftFrom(Position *position, int depth);
+static std::string sanWithoutCheck(const Position *position,
+                                   const MoveList *list,
+                                   Move move);
+
+// Checkers and pinned pieces are found once up front, so every move this
+// emits is legal without trying it.  In check, the other pieces may only
+// capture the checker or block it, and in double check only the king moves.
+void generateLegalMoves(const Position *position, MoveList *list)
+{
+    int color = position->sideToMove;
+    int king = kingSquare(position, color);
+    Bitboard own = position->colors[colorIndex(color)];
+    Bitboard enemy = position->colors[colorIndex(-color)];
+    Bitboard checkers = attackersTo(position, king, position->occupied) & enemy;
+    
+    // Take the king off the board, so it can't hide from a slider behind
+    // its own square.
+    Bitboard dangers = attackedSquares(position,
+                                       -color,
+                                       position->occupied ^ squareBit(king));
+    
+    list->count = 0;
+    addPieceMoves(list, king, KING_ATTACKS[king] & ~own & ~dangers);
+    
+    if (popCount(checkers) > 1)
+    {
+        return;
+    }
+    
+    Bitboard targets = ~own;
+    
+    if (checkers != 0)
+    {
+        targets = checkers | BETWEEN_BITS[king][lowestSquare(checkers)];
+    }
+    else
+    {
+        addCastlingMoves(position, list, dangers);
+    }
+    
+    int firstPieceMove = list->count;
+    
+    addPawnMoves(position, list, targets);
+    
+    Bitboard knights = piecesOf(position, color, PIECE_KNIGHT);
+    
+    while (knights != 0)
+    {
+        int from = popLowestSquare(&knights);
+        addPieceMoves(list, from, KNIGHT_ATTACKS[from] & targets);
+    }
+    
+    Bitboard diagonals = piecesOf(position, color, PIECE_BISHOP) |
+                         piecesOf(position, color, PIECE_QUEEN);
+    
+    while (diagonals != 0)
+    {
+        int from = popLowestSquare(&diagonals);
+        addPieceMoves(list, from, bishopAttacks(from, position->occupied) & targets);
+    }
+    
+    Bitboard straights = piecesOf(position, color, PIECE_ROOK) |
+                         piecesOf(position, color, PIECE_QUEEN);
+    
+    while (straights != 0)
+    {
+        int from = popLowestSquare(&straights);
+        addPieceMoves(list, from, rookAttacks(from, position->occupied) & targets);
+    }
+    
+    Bitboard pinned = pinnedPieces(position, color, king);
+    
+    if (pinned != 0)
+    {
+        removePinnedMoves(list, firstPieceMove, pinned, king);
+    }
+}
+
+uint64_t perft(const Position *position, int depth)
+{
+    Position scratch = *position;
+    
+    return perftFrom(&scratch, depth);
+}
+
+std::string moveToString(Move move)
+{
+    static const char promotionNames[4] = { 'r', 'n', 'b', 'q' };
+    
+    if (move == NULL_MOVE)
+    {
+        return "0000";
+    }
+    
+    std::string text = nameForSquare(moveFrom(move));
+    text += nameForSquare(moveTo(move));
+    
+    if (moveType(move) == MOVE_PROMOTION)
+    {
+        text += promotionNames[movePromotion(move) - PIECE_ROOK];
+    }
+    
+    return text;
+}
+
+Move moveFromString(const Position *position, const std::string &text)
+{
+    MoveList list;
+    generateLegalMoves(position, &list);
+    
+    for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+    {
+        if (moveToString(list.moves[moveIndex]) == text)
+        {
+            return list.moves[moveIndex];
+        }
+    }
+    
+    return NULL_MOVE;
+}
+
+// Makes and unmakes on the one position all the way down.
+static uint64_t perftFrom(Position *position, int depth)
+{
+    MoveList list;
+    generateLegalMoves(position, &list);
+    
+    if (depth <= 1)
+    {
+        return (depth == 1) ? list.count : 1;
+    }
+    
+    uint64_t nodes = 0;
+    
+    for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+    {
+        Undo undo;
+        
+        makeMove(position, list.moves[moveIndex], &undo);
+        nodes += perftFrom(position, depth - 1);
+        unmakeMove(position, list.moves[moveIndex], &undo);
+    }
+    
+    return nodes;
+}
+
+std::string moveToSan(const Position *position, Move move)
+{
+    MoveList list;
+    generateLegalMoves(position, &list);
+    
+    std::string text = sanWithoutCheck(position, &list, move);
+    Position next = *position;
+    applyMove(&next, move);
+    
+    if (isInCheck(&next, next.sideToMove))
+    {
+        generateLegalMoves(&next, &list);
+        text += (list.count == 0) ? '#' : '+';
+    }
+    
+    return text;
+}
+
+Move moveFromSan(const Position *position, const std::string &text)
+{
+    return moveFromSan(position, text.c_str(), text.size());
+}
+
+// Reads the piece, any from file or rank and the destination straight out of
+// the text and keeps the one legal move that fits, rather than writing out
+// every legal move to compare against; replaying big archives spends most
+// of its time here.
+Move moveFromSan(const Position *position, const char *text, size_t length)
+{
+    static const char PIECE_LETTERS[] = "  RNBQK";
+    
+    while (length > 0 && strchr("+#!?", text[length - 1]) != nullptr)
+    {
+        length--;
+    }
+    
+    MoveList list;
+    generateLegalMoves(position, &list);
+    
+    // Some writers use zeros for castling.
+    if (length >= 3 && (text[0] == 'O' || text[0] == '0'))
+    {
+        bool kingside = (length == 3);
+        bool queenside = (length == 5);
+        
+        for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+        {
+            Move move = list.moves[moveIndex];
+            
+            if (moveType(move) == MOVE_CASTLING &&
+                ((kingside && moveTo(move) > moveFrom(move)) ||
+                 (queenside && moveTo(move) < moveFrom(move))))
+            {
+                return move;
+            }
+        }
+        
+        return NULL_MOVE;
+    }
+    
+    int promotion = PIECE_NONE;
+    
+    if (length >= 3 && strchr("RNBQrnbq", text[length - 1]) != nullptr &&
+        (text[length - 2] == '=' || isdigit((unsigned char)text[length - 2])))
+    {
+        promotion = (int)(strchr(PIECE_LETTERS + 2, toupper(text[length - 1])) - PIECE_LETTERS);
+        length -= (text[length - 2] == '=') ? 2 : 1;
+    }
+    
+    if (length < 2)
+    {
+        return NULL_MOVE;
+    }
+    
+    int to = squareForName(text + length - 2);
+    int type = PIECE_PAWN;
+    size_t start = 0;
+    
+    if (text[0] != '\0' && strchr(PIECE_LETTERS + 2, text[0]) != nullptr)
+    {
+        type = (int)(strchr(PIECE_LETTERS + 2, text[0]) - PIECE_LETTERS);
+        start = 1;
+    }
+    
+    int fromFile = -1;
+    int fromRank = -1;
+    
+    for (size_t index = start; index + 2 < length; index++)
+    {
+        char letter = text[index];
+        
+        if (letter >= 'a' && letter <= 'h')
+        {
+            fromFile = letter - 'a';
+        }
+        else if (letter >= '1' && letter <= '8')
+        {
+            fromRank = letter - '1';
+        }
+        else if (letter != 'x' && letter != '-' && letter != ':')
+        {
+            return NULL_MOVE;
+        }
+    }
+    
+    if (to < 0)
+    {
+        return NULL_MOVE;
+    }
+    
+    Move found = NULL_MOVE;
+    
+    for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+    {
+        Move move = list.moves[moveIndex];
+        int from = moveFrom(move);
+        int movePromotionType = (moveType(move) == MOVE_PROMOTION) ?
+                                movePromotion(move) :
+                                PIECE_NONE;
+        
+        if (moveTo(move) != to ||
+            moveType(move) == MOVE_CASTLING ||
+            abs(position->board[from]) != type ||
+            movePromotionType != promotion ||
+            (fromFile >= 0 && (from & 7) != fromFile) ||
+            (fromRank >= 0 && (from >> 3) != fromRank))
+        {
+            continue;
+        }
+        
+        // Two fits means the text didn't say enough.
+        if (found != NULL_MOVE)
+        {
+            return NULL_MOVE;
+        }
+        
+        found = move;
+    }
+    
+    return found;
+}
+
+// Own pieces that are the only thing between the king and an enemy slider.
+static Bitboard pinnedPieces(const Position *position, int color, int king)
+{
+    Bitboard snipers = (rookAttacks(king, 0) &
+                        (piecesOf(position, -color, PIECE_ROOK) |
+                         piecesOf(position, -color, PIECE_QUEEN))) |
+                       (bishopAttacks(king, 0) &
+                        (piecesOf(position, -color, PIECE_BISHOP) |
+                         piecesOf(position, -color, PIECE_QUEEN)));
+    Bitboard pinned = 0;
+    
+    while (snipers != 0)
+    {
+        Bitboard blockers = BETWEEN_BITS[king][popLowestSquare(&snipers)] &
+                            position->occupied;
+        
+        if (popCount(blockers) == 1)
+        {
+            pinned |= blockers & position->colors[colorIndex(color)];
+        }
+    }
+    
+    return pinned;
+}
+
+// Pawn moves that land on targets.  En passant is the one move whose
+// legality is easier to test by playing it: it takes two pieces off the
+// same rank at once, which can uncover a rook on the king.
+static void addPawnMoves(const Position *position,
+                         MoveList *list,
+                         Bitboard targets)
+{
+    int color = position->sideToMove;
+    Bitboard enemy = position->colors[colorIndex(-color)];
+    Bitboard empty = ~position->occupied;
+    Bitboard pawns = piecesOf(position, color, PIECE_PAWN);
+    Bitboard promotionRank = (color == COLOR_WHITE) ? RANK_8_BITS : RANK_1_BITS;
+    int forward = (color == COLOR_WHITE) ? 8 : -8;
+    
+    // Pawn pushes, done set-wise and then split into moves.
+    Bitboard singlePushes = (color == COLOR_WHITE) ? (pawns << 8) : (pawns >> 8);
+    singlePushes &= empty;
+    
+    Bitboard doublePushes = singlePushes &
+                            ((color == COLOR_WHITE) ? RANK_3_BITS : RANK_6_BITS);
+    doublePushes = (color == COLOR_WHITE) ? (doublePushes << 8) : (doublePushes >> 8);
+    doublePushes &= empty & targets;
+    singlePushes &= targets;
+    
+    while (singlePushes != 0)
+    {
+        int to = popLowestSquare(&singlePushes);
+        addPawnMove(list, to - forward, to, (squareBit(to) & promotionRank) != 0);
+    }
+    
+    while (doublePushes != 0)
+    {
+        int to = popLowestSquare(&doublePushes);
+        list->moves[list->count++] = encodeMove(to - 2 * forward, to, MOVE_NORMAL);
+    }
+    
+    while (pawns != 0)
+    {
+        int from = popLowestSquare(&pawns);
+        Bitboard captures = PAWN_ATTACKS[colorIndex(color)][from] & enemy & targets;
+        
+        while (captures != 0)
+        {
+            int to = popLowestSquare(&captures);
+            addPawnMove(list, from, to, (squareBit(to) & promotionRank) != 0);
+        }
+        
+        if (position->enPassantSquare != NO_SQUARE &&
+            (PAWN_ATTACKS[colorIndex(color)][from] &
+             squareBit(position->enPassantSquare)))
+        {
+            Move move = encodeMove(from, position->enPassantSquare, MOVE_EN_PASSANT);
+            Position next = *position;
+            applyMove(&next, move);
+            
+            if (!isInCheck(&next, color))
+            {
+                list->moves[list->count++] = move;
+            }
+        }
+    }
+}
+
+static void addPawnMove(MoveList *list, int from, int to, bool promotion)
+{
+    if (!promotion)
+    {
+        list->moves[list->count++] = encodeMove(from, to, MOVE_NORMAL);
+        return;
+    }
+    
+    list->moves[list->count++] = encodePromotion(from, to, PIECE_QUEEN);
+    list->moves[list->count++] = encodePromotion(from, to, PIECE_ROOK);
+    list->moves[list->count++] = encodePromotion(from, to, PIECE_BISHOP);
+    list->moves[list->count++] = encodePromotion(from, to, PIECE_KNIGHT);
+}
+
+static void addPieceMoves(MoveList *list, int from, Bitboard targets)
+{
+    while (targets != 0)
+    {
+        list->moves[list->count++] = encodeMove(from,
+                                                popLowestSquare(&targets),
+                                                MOVE_NORMAL);
+    }
+}
+
+// Only called when not in check.  dangers is every square the enemy
+// attacks; the king may not pass through or land on one.
+static void addCastlingMoves(const Position *position,
+                             MoveList *list,
+                             Bitboard dangers)
+{
+    int color = position->sideToMove;
+    int kingside = (color == COLOR_WHITE) ? WHITE_KINGSIDE : BLACK_KINGSIDE;
+    int queenside = (color == COLOR_WHITE) ? WHITE_QUEENSIDE : BLACK_QUEENSIDE;
+    int king = (color == COLOR_WHITE) ? 4 : 60;
+    
+    if ((position->castlingRights & kingside) &&
+        (position->occupied & (squareBit(king + 1) | squareBit(king + 2))) == 0 &&
+        (dangers & (squareBit(king + 1) | squareBit(king + 2))) == 0)
+    {
+        list->moves[list->count++] = encodeMove(king, king + 2, MOVE_CASTLING);
+    }
+    
+    if ((position->castlingRights & queenside) &&
+        (position->occupied & (squareBit(king - 1) |
+                               squareBit(king - 2) |
+                               squareBit(king - 3))) == 0 &&
+        (dangers & (squareBit(king - 1) | squareBit(king - 2))) == 0)
+    {
+        list->moves[list->count++] = encodeMove(king, king - 2, MOVE_CASTLING);
+    }
+}
+
+// A pinned piece may still slide along the pin, or take the pinner.  Only
+// moves from first on are looked at.
+static void removePinnedMoves(MoveList *list,
+                              int first,
+                              Bitboard pinned,
+                              int king)
+{
+    int kept = first;
+    
+    for (int moveIndex = first; moveIndex < list->count; moveIndex++)
+    {
+        Move move = list->moves[moveIndex];
+        int from = moveFrom(move);
+        
+        if ((pinned & squareBit(from)) == 0 ||
+            (LINE_BITS[king][from] & squareBit(moveTo(move))) != 0)
+        {
+            list->moves[kept++] = move;
+        }
+    }
+    
+    list->count = kept;
+}
+
+// list holds every legal move in position, for working out whether another
+// piece of the same kind could also reach the square.
+static std::string sanWithoutCheck(const Position *position,
+                                   const MoveList *list,
+                                   Move move)
+{
+    static const char PIECE_LETTERS[] = "  RNBQK";
+    int from = moveFrom(move);
+    int to = moveTo(move);
+    int type = abs(position->board[from]);
+    bool capture = position->board[to] != 0 || moveType(move) == MOVE_EN_PASSANT;
+    std::string text;
+    
+    if (moveType(move) == MOVE_CASTLING)
+    {
+        return (to > from) ? "O-O" : "O-O-O";
+    }
+    
+    if (type == PIECE_PAWN)
+    {
+        if (capture)
+        {
+            text += (char)('a' + (from & 7));
+        }
+    }
+    else
+    {
+        text += PIECE_LETTERS[type];
+        
+        bool ambiguous = false;
+        bool sameFile = false;
+        bool sameRank = false;
+        
+        for (int moveIndex = 0; moveIndex < list->count; moveIndex++)
+        {
+            int otherFrom = moveFrom(list->moves[moveIndex]);
+            
+            if (otherFrom != from &&
+                moveTo(list->moves[moveIndex]) == to &&
+                abs(position->board[otherFrom]) == type)
+            {
+                ambiguous = true;
+                sameFile = sameFile || (otherFrom & 7) == (from & 7);
+                sameRank = sameRank || (otherFrom >> 3) == (from >> 3);
+            }
+        }
+        
+        if (ambiguous && (!sameFile || sameRank))
+        {
+            text += (char)('a' + (from & 7));
+        }
+        
+        if (ambiguous && sameFile)
+        {
+            text += (char)('1' + (from >> 3));
+        }
+    }
+    
+    if (capture)
+    {
+        text += 'x';
+    }
+    
+    text += nameForSquare(to);
+    
+    if (moveType(move) == MOVE_PROMOTION)
+    {
+        text += '=';
+        text += PIECE_LETTERS[movePromotion(move)];
+    }
+    
+    return text;
+}
@@ -0,0 +1,45 @@
+//
+//  MoveGen.hpp
+//  Chess1
+//
+
+#ifndef MoveGen_hpp
+#define MoveGen_hpp
+
+#include <string>
+#include "Position.hpp"
+
+// No legal chess position has more than 218 moves.
+static const int MAX_MOVES = 256;
+
+typedef struct
+{
+    Move moves[MAX_MOVES];
+    int count;
+} MoveList;
+
+// Every legal move for the side to move.
+void generateLegalMoves(const Position *position, MoveList *list);
+
+// Counts the leaf nodes of the legal move tree, depth plies deep.
+uint64_t perft(const Position *position, int depth);
+
+// Coordinate notation, the way UCI writes moves: "e2e4", "e7e8q".
+std::string moveToString(Move move);
+
+// The legal move written as text in coordinate notation, or NULL_MOVE.
+Move moveFromString(const Position *position, const std::string &text);
+
+// Standard algebraic notation, the way PGN and EPD write moves: "Nbd2",
+// "exd6", "O-O", "e8=Q+".  move must be legal in position.
+std::string moveToSan(const Position *position, Move move);
+
+// The legal move written in standard algebraic notation, or NULL_MOVE if
+// there is none or the text fits more than one.  Check marks and
+// annotations ("+", "#", "!?") are ignored, and so is a missing "=" before a
+// promotion piece.  The second form reads length characters of text, which
+// needn't be terminated.
+Move moveFromSan(const Position *position, const std::string &text);
+Move moveFromSan(const Position *position, const char *text, size_t length);
+
+#endif /* MoveGen_hpp */
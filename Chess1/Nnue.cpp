@@ -0,0 +1,563 @@
+//
+//  Nnue.cpp
+//  Chess1
+//
+
+#include <fstream>
+#include <algorithm>
+#include "Nnue.hpp"
+#include "MappedFile.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+static const char NNUE_MAGIC[4] = { 'C', '1', 'N', 'N' };
+static const uint32_t NNUE_VERSION = 1;
+static const size_t NNUE_HEADER_BYTES = 12;
+static const size_t NNUE_FILE_BYTES = NNUE_HEADER_BYTES +
+                                      (NNUE_FEATURES * NNUE_HIDDEN + NNUE_HIDDEN) * 2 +
+                                      2 * NNUE_HIDDEN + 4;
+
+// Outputs of the hidden layer are clipped to this, so that they fit the
+// unsigned eight bits the vector kernels multiply with.
+static const int NNUE_CLIP = 127;
+
+// The starting network's hidden sums count in units of this many
+// centipawns; one neuron per piece kind and file for each side.
+static const int START_UNIT = 8;
+static const int START_KING_BIAS = 8;
+static const int START_OUTPUT_WEIGHT = 32;
+
+typedef struct
+{
+    int16_t featureWeights[NNUE_FEATURES][NNUE_HIDDEN];
+    int16_t featureBiases[NNUE_HIDDEN];
+    int8_t outputWeights[2 * NNUE_HIDDEN];
+    int32_t outputBias;
+} NnueNetwork;
+
+// values = previous + the rows of added - the rows of removed, one side's
+// NNUE_HIDDEN sums.
+typedef void (*AccumulateKernel)(const int16_t *previous,
+                                 int16_t *values,
+                                 const int *added,
+                                 int addedCount,
+                                 const int *removed,
+                                 int removedCount);
+
+// The dot product of both sides' clipped sums with the output weights.
+typedef int (*OutputKernel)(const int16_t *own, const int16_t *other);
+
+static NnueNetwork network;
+static bool networkLoaded = false;
+static bool kernelChosen = false;
+static int currentKernel = NNUE_KERNEL_SCALAR;
+
+static int featureIndex(int perspective, int id, int square);
+static int bestNnueKernel();
+static uint64_t readLittleEndian(const char *bytes, int count);
+static void writeLittleEndian(std::ostream *output, uint64_t value, int count);
+static void accumulateScalar(const int16_t *previous,
+                             int16_t *values,
+                             const int *added,
+                             int addedCount,
+                             const int *removed,
+                             int removedCount);
+static int outputScalar(const int16_t *own, const int16_t *other);
+#if defined(__x86_64__) || defined(__i386__)
+static void accumulateSse41(const int16_t *previous,
+                            int16_t *values,
+                            const int *added,
+                            int addedCount,
+                            const int *removed,
+                            int removedCount);
+static int outputSse41(const int16_t *own, const int16_t *other);
+static void accumulateAvx2(const int16_t *previous,
+                           int16_t *values,
+                           const int *added,
+                           int addedCount,
+                           const int *removed,
+                           int removedCount);
+static int outputAvx2(const int16_t *own, const int16_t *other);
+#endif
+
+static AccumulateKernel accumulateKernel = accumulateScalar;
+static OutputKernel outputKernel = outputScalar;
+
+bool loadNnue(const char *path)
+{
+    unloadNnue();
+    
+    MappedFile file;
+    
+    if (!mapFile(path, &file))
+    {
+        return false;
+    }
+    
+    bool valid = file.size == NNUE_FILE_BYTES &&
+                 std::equal(NNUE_MAGIC, NNUE_MAGIC + 4, file.data) &&
+                 readLittleEndian(file.data + 4, 4) == NNUE_VERSION &&
+                 readLittleEndian(file.data + 8, 4) == (uint64_t)NNUE_HIDDEN;
+    
+    if (valid)
+    {
+        const char *bytes = file.data + NNUE_HEADER_BYTES;
+        
+        for (int feature = 0; feature < NNUE_FEATURES; feature++)
+        {
+            for (int hidden = 0; hidden < NNUE_HIDDEN; hidden++, bytes += 2)
+            {
+                network.featureWeights[feature][hidden] = (int16_t)readLittleEndian(bytes, 2);
+            }
+        }
+        
+        for (int hidden = 0; hidden < NNUE_HIDDEN; hidden++, bytes += 2)
+        {
+            network.featureBiases[hidden] = (int16_t)readLittleEndian(bytes, 2);
+        }
+        
+        for (int weight = 0; weight < 2 * NNUE_HIDDEN; weight++, bytes++)
+        {
+            network.outputWeights[weight] = (int8_t)*bytes;
+        }
+        
+        network.outputBias = (int32_t)readLittleEndian(bytes, 4);
+        networkLoaded = true;
+        
+        if (!kernelChosen)
+        {
+            setNnueKernel(bestNnueKernel());
+        }
+    }
+    
+    unmapFile(&file);
+    
+    return valid;
+}
+
+void unloadNnue()
+{
+    networkLoaded = false;
+}
+
+bool nnueLoaded()
+{
+    return networkLoaded;
+}
+
+bool makeNnue(const char *path)
+{
+    NnueNetwork *start = new NnueNetwork();
+    
+    // Own pieces (relative 0) count for the side whose view it is and the
+    // other side's pieces against it.  Seen from white, own pieces are white
+    // ones and the rest black, and black's view is the same board turned
+    // round, so white's and black's tables serve both views.  Every piece
+    // plus its square's bonus is positive apart from the king's, which a
+    // bias lifts clear of the clip; with one king a side the bias cancels.
+    for (int relative = 0; relative < 2; relative++)
+    {
+        for (int type = PIECE_PAWN; type < PIECE_TYPE_COUNT; type++)
+        {
+            int hidden = (relative * 6 + type - 1) * 8;
+            
+            for (int square = 0; square < SQUARE_COUNT; square++)
+            {
+                int feature = (relative * 6 + type - 1) * SQUARE_COUNT + square;
+                int bonus = PIECE_SQUARE.middlegame[relative][type][square] * ((relative == 0) ? 1 : -1);
+                int rounding = (bonus >= 0) ? START_UNIT / 2 : -START_UNIT / 2;
+                start->featureWeights[feature][hidden + (square & 7)] = (int16_t)((bonus + rounding) / START_UNIT);
+            }
+            
+            for (int file = 0; file < 8; file++)
+            {
+                int sign = (relative == 0) ? 1 : -1;
+                start->featureBiases[hidden + file] = (int16_t)((type == PIECE_KING) ? START_KING_BIAS : 0);
+                start->outputWeights[hidden + file] = (int8_t)(sign * START_OUTPUT_WEIGHT);
+                start->outputWeights[NNUE_HIDDEN + hidden + file] = (int8_t)(-sign * START_OUTPUT_WEIGHT);
+            }
+        }
+    }
+    
+    std::ofstream file(path, std::ios::binary);
+    
+    file.write(NNUE_MAGIC, 4);
+    writeLittleEndian(&file, NNUE_VERSION, 4);
+    writeLittleEndian(&file, NNUE_HIDDEN, 4);
+    
+    for (int feature = 0; feature < NNUE_FEATURES; feature++)
+    {
+        for (int hidden = 0; hidden < NNUE_HIDDEN; hidden++)
+        {
+            writeLittleEndian(&file, (uint16_t)start->featureWeights[feature][hidden], 2);
+        }
+    }
+    
+    for (int hidden = 0; hidden < NNUE_HIDDEN; hidden++)
+    {
+        writeLittleEndian(&file, (uint16_t)start->featureBiases[hidden], 2);
+    }
+    
+    for (int weight = 0; weight < 2 * NNUE_HIDDEN; weight++)
+    {
+        writeLittleEndian(&file, (uint8_t)start->outputWeights[weight], 1);
+    }
+    
+    writeLittleEndian(&file, (uint32_t)start->outputBias, 4);
+    delete start;
+    
+    return (bool)file;
+}
+
+void refreshNnueAccumulator(const Position *position, NnueAccumulator *accumulator)
+{
+    for (int perspective = 0; perspective < 2; perspective++)
+    {
+        int added[SQUARE_COUNT];
+        int addedCount = 0;
+        Bitboard pieces = position->occupied;
+        
+        while (pieces != 0)
+        {
+            int square = popLowestSquare(&pieces);
+            added[addedCount++] = featureIndex(perspective, position->board[square], square);
+        }
+        
+        accumulateKernel(network.featureBiases, accumulator->values[perspective],
+                         added, addedCount, nullptr, 0);
+    }
+}
+
+void updateNnueAccumulator(const Position *position,
+                           Move move,
+                           const Undo *undo,
+                           const NnueAccumulator *previous,
+                           NnueAccumulator *accumulator)
+{
+    int from = moveFrom(move);
+    int to = moveTo(move);
+    int type = moveType(move);
+    int color = -position->sideToMove;
+    int id = position->board[to];
+    
+    // Up to two pieces leave a square and two arrive, as (id, square).
+    int leaving[2][2];
+    int arriving[2][2] = { { id, to } };
+    int leavingCount = 1;
+    int arrivingCount = 1;
+    
+    leaving[0][0] = (type == MOVE_PROMOTION) ? PIECE_PAWN * color : id;
+    leaving[0][1] = from;
+    
+    if (undo->captured != 0)
+    {
+        leaving[1][0] = undo->captured;
+        leaving[1][1] = (type == MOVE_EN_PASSANT) ? to - ((color == COLOR_WHITE) ? 8 : -8) : to;
+        leavingCount++;
+    }
+    else if (type == MOVE_CASTLING)
+    {
+        int rookFrom = (to > from) ? to + 1 : to - 2;
+        int rookTo = (to > from) ? to - 1 : to + 1;
+        
+        leaving[1][0] = position->board[rookTo];
+        leaving[1][1] = rookFrom;
+        arriving[1][0] = position->board[rookTo];
+        arriving[1][1] = rookTo;
+        leavingCount++;
+        arrivingCount++;
+    }
+    
+    for (int perspective = 0; perspective < 2; perspective++)
+    {
+        int added[2];
+        int removed[2];
+        
+        for (int piece = 0; piece < arrivingCount; piece++)
+        {
+            added[piece] = featureIndex(perspective, arriving[piece][0], arriving[piece][1]);
+        }
+        
+        for (int piece = 0; piece < leavingCount; piece++)
+        {
+            removed[piece] = featureIndex(perspective, leaving[piece][0], leaving[piece][1]);
+        }
+        
+        accumulateKernel(previous->values[perspective], accumulator->values[perspective],
+                         added, arrivingCount, removed, leavingCount);
+    }
+}
+
+int nnueEvaluate(const Position *position, const NnueAccumulator *accumulator)
+{
+    int own = colorIndex(position->sideToMove);
+    int sum = outputKernel(accumulator->values[own], accumulator->values[1 - own]) + network.outputBias;
+    
+    return sum / NNUE_OUTPUT_SCALE;
+}
+
+void setNnueKernel(int kernel)
+{
+    currentKernel = kernel;
+    kernelChosen = true;
+    
+    switch (kernel)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        case NNUE_KERNEL_SSE41:
+            accumulateKernel = accumulateSse41;
+            outputKernel = outputSse41;
+            break;
+            
+        case NNUE_KERNEL_AVX2:
+            accumulateKernel = accumulateAvx2;
+            outputKernel = outputAvx2;
+            break;
+#endif
+        
+        default:
+            currentKernel = NNUE_KERNEL_SCALAR;
+            accumulateKernel = accumulateScalar;
+            outputKernel = outputScalar;
+            break;
+    }
+}
+
+int nnueKernel()
+{
+    return currentKernel;
+}
+
+bool nnueKernelAvailable(int kernel)
+{
+    switch (kernel)
+    {
+        case NNUE_KERNEL_SCALAR:
+            return true;
+            
+#if defined(__x86_64__) || defined(__i386__)
+        case NNUE_KERNEL_SSE41:
+            return __builtin_cpu_supports("sse4.1");
+            
+        case NNUE_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        
+        default:
+            return false;
+    }
+}
+
+const char *nnueKernelName(int kernel)
+{
+    static const char *NAMES[NNUE_KERNEL_COUNT] = { "scalar", "SSE4.1", "AVX2" };
+    
+    return (kernel >= 0 && kernel < NNUE_KERNEL_COUNT) ? NAMES[kernel] : "unknown";
+}
+
+// Own pieces first, then the other side's, each by type and then square;
+// black's view turns the board round so its pieces start on the first rank.
+static int featureIndex(int perspective, int id, int square)
+{
+    int relative = (colorIndexForId(id) == perspective) ? 0 : 1;
+    int viewed = (perspective == 0) ? square : square ^ 56;
+    
+    return (relative * 6 + abs(id) - 1) * SQUARE_COUNT + viewed;
+}
+
+static int bestNnueKernel()
+{
+    return nnueKernelAvailable(NNUE_KERNEL_AVX2) ? NNUE_KERNEL_AVX2 :
+           nnueKernelAvailable(NNUE_KERNEL_SSE41) ? NNUE_KERNEL_SSE41 :
+           NNUE_KERNEL_SCALAR;
+}
+
+static uint64_t readLittleEndian(const char *bytes, int count)
+{
+    uint64_t value = 0;
+    
+    for (int byte = count - 1; byte >= 0; byte--)
+    {
+        value = (value << 8) | (uint8_t)bytes[byte];
+    }
+    
+    return value;
+}
+
+static void writeLittleEndian(std::ostream *output, uint64_t value, int count)
+{
+    for (int byte = 0; byte < count; byte++)
+    {
+        output->put((char)((value >> (byte * 8)) & 0xFF));
+    }
+}
+
+static void accumulateScalar(const int16_t *previous,
+                             int16_t *values,
+                             const int *added,
+                             int addedCount,
+                             const int *removed,
+                             int removedCount)
+{
+    std::copy(previous, previous + NNUE_HIDDEN, values);
+    
+    for (int feature = 0; feature < addedCount; feature++)
+    {
+        const int16_t *row = network.featureWeights[added[feature]];
+        
+        for (int hidden = 0; hidden < NNUE_HIDDEN; hidden++)
+        {
+            values[hidden] = (int16_t)(values[hidden] + row[hidden]);
+        }
+    }
+    
+    for (int feature = 0; feature < removedCount; feature++)
+    {
+        const int16_t *row = network.featureWeights[removed[feature]];
+        
+        for (int hidden = 0; hidden < NNUE_HIDDEN; hidden++)
+        {
+            values[hidden] = (int16_t)(values[hidden] - row[hidden]);
+        }
+    }
+}
+
+static int outputScalar(const int16_t *own, const int16_t *other)
+{
+    int sum = 0;
+    
+    for (int hidden = 0; hidden < NNUE_HIDDEN; hidden++)
+    {
+        sum += std::min(std::max((int)own[hidden], 0), NNUE_CLIP) * network.outputWeights[hidden];
+        sum += std::min(std::max((int)other[hidden], 0), NNUE_CLIP) * network.outputWeights[NNUE_HIDDEN + hidden];
+    }
+    
+    return sum;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// The sums wrap at sixteen bits as the scalar ones do, so every kernel
+// agrees even with weights that overflow.
+__attribute__((target("sse4.1")))
+static void accumulateSse41(const int16_t *previous,
+                            int16_t *values,
+                            const int *added,
+                            int addedCount,
+                            const int *removed,
+                            int removedCount)
+{
+    for (int hidden = 0; hidden < NNUE_HIDDEN; hidden += 8)
+    {
+        __m128i sum = _mm_loadu_si128((const __m128i *)&previous[hidden]);
+        
+        for (int feature = 0; feature < addedCount; feature++)
+        {
+            const __m128i *row = (const __m128i *)&network.featureWeights[added[feature]][hidden];
+            sum = _mm_add_epi16(sum, _mm_loadu_si128(row));
+        }
+        
+        for (int feature = 0; feature < removedCount; feature++)
+        {
+            const __m128i *row = (const __m128i *)&network.featureWeights[removed[feature]][hidden];
+            sum = _mm_sub_epi16(sum, _mm_loadu_si128(row));
+        }
+        
+        _mm_storeu_si128((__m128i *)&values[hidden], sum);
+    }
+}
+
+// Sixteen sums are clipped and packed into sixteen unsigned bytes, which
+// maddubs multiplies by the signed byte weights and adds in pairs; 2 * 127
+// * 127 still fits sixteen bits.
+__attribute__((target("sse4.1")))
+static int outputSse41(const int16_t *own, const int16_t *other)
+{
+    const __m128i clip = _mm_set1_epi16(NNUE_CLIP);
+    const __m128i ones = _mm_set1_epi16(1);
+    const int16_t *halves[2] = { own, other };
+    __m128i total = _mm_setzero_si128();
+    
+    for (int half = 0; half < 2; half++)
+    {
+        const int8_t *weights = &network.outputWeights[half * NNUE_HIDDEN];
+        
+        for (int hidden = 0; hidden < NNUE_HIDDEN; hidden += 16)
+        {
+            __m128i low = _mm_min_epi16(_mm_loadu_si128((const __m128i *)&halves[half][hidden]), clip);
+            __m128i high = _mm_min_epi16(_mm_loadu_si128((const __m128i *)&halves[half][hidden + 8]), clip);
+            __m128i clipped = _mm_packus_epi16(low, high);
+            __m128i products = _mm_maddubs_epi16(clipped, _mm_loadu_si128((const __m128i *)&weights[hidden]));
+            total = _mm_add_epi32(total, _mm_madd_epi16(products, ones));
+        }
+    }
+    
+    total = _mm_add_epi32(total, _mm_shuffle_epi32(total, _MM_SHUFFLE(1, 0, 3, 2)));
+    total = _mm_add_epi32(total, _mm_shuffle_epi32(total, _MM_SHUFFLE(2, 3, 0, 1)));
+    
+    return _mm_cvtsi128_si32(total);
+}
+
+__attribute__((target("avx2")))
+static void accumulateAvx2(const int16_t *previous,
+                           int16_t *values,
+                           const int *added,
+                           int addedCount,
+                           const int *removed,
+                           int removedCount)
+{
+    for (int hidden = 0; hidden < NNUE_HIDDEN; hidden += 16)
+    {
+        __m256i sum = _mm256_loadu_si256((const __m256i *)&previous[hidden]);
+        
+        for (int feature = 0; feature < addedCount; feature++)
+        {
+            const __m256i *row = (const __m256i *)&network.featureWeights[added[feature]][hidden];
+            sum = _mm256_add_epi16(sum, _mm256_loadu_si256(row));
+        }
+        
+        for (int feature = 0; feature < removedCount; feature++)
+        {
+            const __m256i *row = (const __m256i *)&network.featureWeights[removed[feature]][hidden];
+            sum = _mm256_sub_epi16(sum, _mm256_loadu_si256(row));
+        }
+        
+        _mm256_storeu_si256((__m256i *)&values[hidden], sum);
+    }
+}
+
+// packus works within each 128-bit half, so the packed bytes come out with
+// the middle two quarters swapped; the permute puts them back in order.
+__attribute__((target("avx2")))
+static int outputAvx2(const int16_t *own, const int16_t *other)
+{
+    const __m256i clip = _mm256_set1_epi16(NNUE_CLIP);
+    const __m256i ones = _mm256_set1_epi16(1);
+    const int16_t *halves[2] = { own, other };
+    __m256i total = _mm256_setzero_si256();
+    
+    for (int half = 0; half < 2; half++)
+    {
+        const int8_t *weights = &network.outputWeights[half * NNUE_HIDDEN];
+        
+        for (int hidden = 0; hidden < NNUE_HIDDEN; hidden += 32)
+        {
+            __m256i low = _mm256_min_epi16(_mm256_loadu_si256((const __m256i *)&halves[half][hidden]), clip);
+            __m256i high = _mm256_min_epi16(_mm256_loadu_si256((const __m256i *)&halves[half][hidden + 16]), clip);
+            __m256i clipped = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), _MM_SHUFFLE(3, 1, 2, 0));
+            __m256i products = _mm256_maddubs_epi16(clipped,
+                                                    _mm256_loadu_si256((const __m256i *)&weights[hidden]));
+            total = _mm256_add_epi32(total, _mm256_madd_epi16(products, ones));
+        }
+    }
+    
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    
+    return _mm_cvtsi128_si32(sum);
+}
+
+#endif
@@ -0,0 +1,83 @@
+//
+//  Nnue.hpp
+//  Chess1
+//
+//  An efficiently updatable neural network evaluation, used by the search in
+//  place of the hand-written one while a network is loaded.  The inputs are
+//  one feature per piece kind on each square, 768 in all, seen twice: once
+//  from white's side of the board and once from black's, turned round so
+//  that "own pieces" and "their pieces" mean the same to both.  Each side's
+//  features feed NNUE_HIDDEN sixteen-bit sums, its accumulator.
+//
+//  A move changes at most four features (castling moves two pieces, a
+//  capture takes one away, a promotion swaps one), so an accumulator is
+//  never recomputed during the search: each ply's is the one before plus
+//  the rows of the features the move added and minus those it removed,
+//  worked out from the position after the move and its Undo.  The output
+//  clips both sums to 0..127, side to move first, and takes their dot product
+//  with eight-bit weights.  Both steps have scalar, SSE4.1 and AVX2 kernels,
+//  picked once from what the processor has.
+//
+//  A network file is "C1NN", then the version and NNUE_HIDDEN as 32-bit
+//  numbers, then the feature weights (768 rows of NNUE_HIDDEN), the feature
+//  biases, the output weights (own side's NNUE_HIDDEN, then the other's) and
+//  the output bias, all little-endian.  There's no trainer in this tree;
+//  `nnue make` writes a starting network that reproduces the material and
+//  middlegame piece-square bonuses, for a trainer to start from and for
+//  checking the machinery.
+//
+
+#ifndef Nnue_hpp
+#define Nnue_hpp
+
+#include "Position.hpp"
+
+static const int NNUE_FEATURES = 2 * 6 * SQUARE_COUNT;
+static const int NNUE_HIDDEN = 256;
+
+// Output sums are divided by this to give centipawns.
+static const int NNUE_OUTPUT_SCALE = 8;
+
+static const int NNUE_KERNEL_SCALAR = 0;
+static const int NNUE_KERNEL_SSE41 = 1;
+static const int NNUE_KERNEL_AVX2 = 2;
+static const int NNUE_KERNEL_COUNT = 3;
+
+// Indexed by colorIndex: white's view first, then black's.
+typedef struct
+{
+    int16_t values[2][NNUE_HIDDEN];
+} NnueAccumulator;
+
+// Replaces any loaded network.  Returns false, leaving none loaded, if path
+// can't be read or isn't a network of this size.  Not safe while a search is
+// running.
+bool loadNnue(const char *path);
+void unloadNnue();
+bool nnueLoaded();
+
+// Writes the starting network described above.
+bool makeNnue(const char *path);
+
+// position's accumulator from scratch.
+void refreshNnueAccumulator(const Position *position, NnueAccumulator *accumulator);
+
+// The accumulator after move, from the one before it; position is the one
+// after the move, and undo what makeMove filled in.
+void updateNnueAccumulator(const Position *position,
+                           Move move,
+                           const Undo *undo,
+                           const NnueAccumulator *previous,
+                           NnueAccumulator *accumulator);
+
+// Centipawns from the side to move's point of view.
+int nnueEvaluate(const Position *position, const NnueAccumulator *accumulator);
+
+// Chooses the kernel the functions above use; it must be available.  The
+// best one is chosen to start with.
+void setNnueKernel(int kernel);
+int nnueKernel();
+bool nnueKernelAvailable(int kernel);
+const char *nnueKernelName(int kernel);
+
+#endif /* Nnue_hpp */
@@ -0,0 +1,460 @@
+//
+//  Pgn.cpp
+//  Chess1
+//
+
+#include <chrono>
+#include <string.h>
+#include <ctype.h>
+#include "Pgn.hpp"
+#include "MappedFile.hpp"
+#include "MoveGen.hpp"
+#include "ThreadPool.hpp"
+
+// Big enough that a batch keeps every thread busy, small enough that the
+// batch's pages are a modest amount of memory.
+static const size_t BATCH_BYTES = 64 << 20;
+
+typedef struct
+{
+    size_t begin;
+    size_t end;
+    uint64_t firstLine;
+    uint64_t number;
+} GameSpan;
+
+typedef struct
+{
+    int plies;
+    bool bad;
+    PgnProblem problem;
+} GameResult;
+
+// A cursor over one game's text that keeps count of lines, so problems can
+// say where they are.
+typedef struct
+{
+    const char *next;
+    const char *end;
+    uint64_t line;
+} GameText;
+
+static size_t findGames(const MappedFile *file,
+                        size_t offset,
+                        uint64_t *line,
+                        uint64_t *gameNumber,
+                        std::vector<GameSpan> *spans);
+static void replayGame(const char *data,
+                       const GameSpan &span,
+                       const PgnGameVisitor &visit,
+                       int thread,
+                       GameResult *result);
+static bool readTags(GameText *text, Position *position, std::string *tagResult);
+static void skipSpace(GameText *text);
+static void skipPast(GameText *text, char close);
+static void skipVariation(GameText *text);
+static void setProblem(GameResult *result,
+                       const GameSpan &span,
+                       uint64_t line,
+                       int ply,
+                       const std::string &text,
+                       const std::string &reason);
+static const char *expectedResult(const Position *position);
+
+bool replayPgnFile(const char *path,
+                   int threads,
+                   size_t maxProblems,
+                   const PgnGameVisitor &visit,
+                   PgnReplayStats *stats)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    MappedFile file;
+    
+    if (!mapFile(path, &file))
+    {
+        return false;
+    }
+    
+    adviseSequential(&file);
+    
+    stats->games = 0;
+    stats->badGames = 0;
+    stats->plies = 0;
+    stats->bytes = file.size;
+    stats->problems.clear();
+    
+    size_t offset = 0;
+    uint64_t line = 1;
+    uint64_t gameNumber = 0;
+    std::vector<GameSpan> spans;
+    std::vector<GameResult> results;
+    
+    while (offset < file.size)
+    {
+        spans.clear();
+        size_t batchEnd = findGames(&file, offset, &line, &gameNumber, &spans);
+        results.assign(spans.size(), GameResult());
+        
+        runTasks((int)spans.size(), threads, [&](int task, int thread) {
+            replayGame(file.data, spans[task], visit, thread, &results[task]);
+        });
+        
+        for (size_t gameIndex = 0; gameIndex < results.size(); gameIndex++)
+        {
+            stats->games++;
+            stats->plies += results[gameIndex].plies;
+            
+            if (results[gameIndex].bad)
+            {
+                stats->badGames++;
+                
+                if (stats->problems.size() < maxProblems)
+                {
+                    stats->problems.push_back(results[gameIndex].problem);
+                }
+            }
+        }
+        
+        releaseRange(&file, offset, batchEnd - offset);
+        offset = batchEnd;
+    }
+    
+    unmapFile(&file);
+    
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    stats->elapsedMs = elapsed.count();
+    
+    return true;
+}
+
+// Splits about a batch's worth of the file, from offset, into games and
+// returns where the next batch starts.  A game ends where a tag line follows
+// its movetext.  line and gameNumber carry on from one batch to the next.
+static size_t findGames(const MappedFile *file,
+                        size_t offset,
+                        uint64_t *line,
+                        uint64_t *gameNumber,
+                        std::vector<GameSpan> *spans)
+{
+    const char *data = file->data;
+    size_t position = offset;
+    size_t gameStart = offset;
+    uint64_t gameLine = *line;
+    bool seenMoves = false;
+    bool seenText = false;
+    
+    while (position < file->size)
+    {
+        const char *newline = (const char *)memchr(data + position, '\n', file->size - position);
+        size_t lineEnd = (newline == nullptr) ? file->size : (size_t)(newline - data) + 1;
+        char first = data[position];
+        
+        if (first == '[' && seenMoves)
+        {
+            GameSpan span = { gameStart, position, gameLine, ++*gameNumber };
+            spans->push_back(span);
+            
+            if (position - offset >= BATCH_BYTES)
+            {
+                return position;
+            }
+            
+            gameStart = position;
+            gameLine = *line;
+            seenMoves = false;
+            seenText = false;
+        }
+        
+        if (!isspace((unsigned char)first))
+        {
+            seenText = true;
+            seenMoves = seenMoves || first != '[';
+        }
+        
+        position = lineEnd;
+        (*line)++;
+    }
+    
+    if (seenText)
+    {
+        GameSpan span = { gameStart, file->size, gameLine, ++*gameNumber };
+        spans->push_back(span);
+    }
+    
+    return file->size;
+}
+
+static void replayGame(const char *data,
+                       const GameSpan &span,
+                       const PgnGameVisitor &visit,
+                       int thread,
+                       GameResult *result)
+{
+    GameText text = { data + span.begin, data + span.end, span.firstLine };
+    Position position;
+    std::string tagResult;
+    
+    result->plies = 0;
+    result->bad = false;
+    parseFen(&position, START_FEN);
+    
+    if (!readTags(&text, &position, &tagResult))
+    {
+        setProblem(result, span, text.line, 0, "FEN", "bad FEN tag");
+        return;
+    }
+    
+    std::string gameResult = tagResult;
+    Position start = position;
+    std::vector<Move> moves;
+    
+    while (true)
+    {
+        skipSpace(&text);
+        
+        if (text.next >= text.end)
+        {
+            break;
+        }
+        
+        char first = *text.next;
+        
+        if (first == '{')
+        {
+            skipPast(&text, '}');
+            continue;
+        }
+        else if (first == ';' || first == '%')
+        {
+            skipPast(&text, '\n');
+            continue;
+        }
+        else if (first == '(')
+        {
+            skipVariation(&text);
+            continue;
+        }
+        else if (first == ')' || first == '}')
+        {
+            // Unmatched; step over it.
+            text.next++;
+            continue;
+        }
+        
+        const char *token = text.next;
+        
+        while (text.next < text.end &&
+               !isspace((unsigned char)*text.next) &&
+               strchr("{}();", *text.next) == nullptr)
+        {
+            text.next++;
+        }
+        
+        size_t length = (size_t)(text.next - token);
+        std::string word(token, length);
+        
+        if (first == '$')
+        {
+            continue;
+        }
+        else if (word == "1-0" || word == "0-1" || word == "1/2-1/2" || word == "*")
+        {
+            gameResult = word;
+            continue;
+        }
+        
+        // A move number, which may run straight into its move ("12.e4").
+        if (isdigit((unsigned char)first) && word.compare(0, 3, "0-0") != 0)
+        {
+            while (length > 0 && (isdigit((unsigned char)*token) || *token == '.'))
+            {
+                token++;
+                length--;
+            }
+            
+            if (length == 0)
+            {
+                continue;
+            }
+        }
+        
+        Move move = moveFromSan(&position, token, length);
+        
+        if (move == NULL_MOVE)
+        {
+            setProblem(result, span, text.line, result->plies + 1,
+                       std::string(token, length), "illegal or ambiguous move");
+            return;
+        }
+        
+        applyMove(&position, move);
+        result->plies++;
+        
+        if (visit)
+        {
+            moves.push_back(move);
+        }
+    }
+    
+    const char *expected = expectedResult(&position);
+    
+    if (expected != nullptr && !gameResult.empty() && gameResult != "*" &&
+        gameResult != expected)
+    {
+        setProblem(result, span, text.line, result->plies, gameResult,
+                   std::string("the final position is ") + expected);
+    }
+    
+    if (visit && !result->bad)
+    {
+        visit(&start, moves, gameResult, thread);
+    }
+}
+
+// Reads the tag pairs at the top of a game.  Only FEN and Result matter
+// here.  Returns false if the FEN tag can't be read.
+static bool readTags(GameText *text, Position *position, std::string *tagResult)
+{
+    while (true)
+    {
+        skipSpace(text);
+        
+        if (text->next >= text->end || *text->next != '[')
+        {
+            return true;
+        }
+        
+        text->next++;
+        
+        const char *name = text->next;
+        
+        while (text->next < text->end && !isspace((unsigned char)*text->next))
+        {
+            text->next++;
+        }
+        
+        std::string tagName(name, (size_t)(text->next - name));
+        std::string value;
+        
+        while (text->next < text->end && *text->next != '"' && *text->next != '\n')
+        {
+            text->next++;
+        }
+        
+        if (text->next < text->end && *text->next == '"')
+        {
+            text->next++;
+            
+            while (text->next < text->end && *text->next != '"' && *text->next != '\n')
+            {
+                if (*text->next == '\\' && text->next + 1 < text->end)
+                {
+                    text->next++;
+                }
+                
+                value += *text->next++;
+            }
+        }
+        
+        skipPast(text, ']');
+        
+        if (tagName == "FEN" && !parseFen(position, value.c_str()))
+        {
+            return false;
+        }
+        else if (tagName == "Result")
+        {
+            *tagResult = value;
+        }
+    }
+}
+
+static void skipSpace(GameText *text)
+{
+    while (text->next < text->end && isspace((unsigned char)*text->next))
+    {
+        text->line += (*text->next == '\n');
+        text->next++;
+    }
+}
+
+// Leaves text just after close, or at the end.
+static void skipPast(GameText *text, char close)
+{
+    while (text->next < text->end && *text->next != close)
+    {
+        text->line += (*text->next == '\n');
+        text->next++;
+    }
+    
+    if (text->next < text->end)
+    {
+        text->line += (close == '\n');
+        text->next++;
+    }
+}
+
+// Variations nest, and may hold comments with brackets in them.
+static void skipVariation(GameText *text)
+{
+    int depth = 0;
+    
+    while (text->next < text->end)
+    {
+        char letter = *text->next;
+        
+        if (letter == '{')
+        {
+            skipPast(text, '}');
+            continue;
+        }
+        
+        text->line += (letter == '\n');
+        text->next++;
+        
+        if (letter == '(')
+        {
+            depth++;
+        }
+        else if (letter == ')' && --depth == 0)
+        {
+            return;
+        }
+    }
+}
+
+static void setProblem(GameResult *result,
+                       const GameSpan &span,
+                       uint64_t line,
+                       int ply,
+                       const std::string &text,
+                       const std::string &reason)
+{
+    result->bad = true;
+    result->problem.game = span.number;
+    result->problem.line = line;
+    result->problem.ply = ply;
+    result->problem.text = text;
+    result->problem.reason = reason;
+}
+
+// The only result a finished game can have, or null if it could have
+// ended any way (resignation, agreement, time).
+static const char *expectedResult(const Position *position)
+{
+    MoveList list;
+    generateLegalMoves(position, &list);
+    
+    if (list.count > 0)
+    {
+        return nullptr;
+    }
+    
+    if (!isInCheck(position, position->sideToMove))
+    {
+        return "1/2-1/2";
+    }
+    
+    return (position->sideToMove == COLOR_WHITE) ? "0-1" : "1-0";
+}
@@ -0,0 +1,58 @@
+//
+//  Pgn.hpp
+//  Chess1
+//
+//  Replays Portable Game Notation archives through the move generator to
+//  check that every move is legal and every result fits the final position.
+//  The file is memory-mapped and walked in batches: each batch is split into
+//  games (spans of the mapping, nothing copied), the games are replayed
+//  across the thread pool, and the batch's pages are handed back before the
+//  next one, so archives bigger than RAM go through in a fixed amount of
+//  memory.
+//
+
+#ifndef Pgn_hpp
+#define Pgn_hpp
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "Position.hpp"
+
+typedef struct
+{
+    uint64_t game;          // Counting from 1, in file order.
+    uint64_t line;          // Counting from 1.
+    int ply;                // The move's ply in the game, counting from 1.
+    std::string text;       // The move or tag that was wrong.
+    std::string reason;
+} PgnProblem;
+
+typedef struct
+{
+    uint64_t games;
+    uint64_t badGames;
+    uint64_t plies;
+    uint64_t bytes;
+    std::vector<PgnProblem> problems;   // Each bad game's first, in order.
+    double elapsedMs;
+} PgnReplayStats;
+
+// Called for every game that replays cleanly, on whichever pool thread
+// replayed it, with the game's result ("1-0", "0-1", "1/2-1/2", "*" or
+// empty).
+typedef std::function<void(const Position *start,
+                           const std::vector<Move> &moves,
+                           const std::string &result,
+                           int thread)> PgnGameVisitor;
+
+// Replays every game in path on threads threads (fewer than 1 means one per
+// core), keeping at most maxProblems problems.  visit may be empty.  Returns
+// false if path can't be mapped.
+bool replayPgnFile(const char *path,
+                   int threads,
+                   size_t maxProblems,
+                   const PgnGameVisitor &visit,
+                   PgnReplayStats *stats);
+
+#endif /* Pgn_hpp */
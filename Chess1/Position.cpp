@@ -0,0 +1,477 @@
+//
+//  Position.cpp
+//  Chess1
+//
+
+#include <string.h>
+#include <ctype.h>
+#include "Position.hpp"
+
+uint64_t ZOBRIST_PIECES[2][PIECE_TYPE_COUNT][SQUARE_COUNT];
+uint64_t ZOBRIST_CASTLING[ALL_CASTLING_RIGHTS + 1];
+uint64_t ZOBRIST_EN_PASSANT[8];
+uint64_t ZOBRIST_BLACK_TO_MOVE;
+
+static uint64_t nextRandom(uint64_t *state);
+static const char *skipSpaces(const char *text);
+
+// Fixed seed, so keys are the same on every run and can be compared between
+// runs and processes.
+void initZobrist()
+{
+    uint64_t randomState = 0x9E3779B97F4A7C15ULL;
+    
+    for (int color = 0; color < 2; color++)
+    {
+        for (int type = 0; type < PIECE_TYPE_COUNT; type++)
+        {
+            for (int square = 0; square < SQUARE_COUNT; square++)
+            {
+                ZOBRIST_PIECES[color][type][square] = nextRandom(&randomState);
+            }
+        }
+    }
+    
+    // One number per right, so that losing a right is a single XOR however
+    // the rights are combined.
+    uint64_t rightKeys[4];
+    
+    for (int right = 0; right < 4; right++)
+    {
+        rightKeys[right] = nextRandom(&randomState);
+    }
+    
+    for (int rights = 0; rights <= ALL_CASTLING_RIGHTS; rights++)
+    {
+        ZOBRIST_CASTLING[rights] = 0;
+        
+        for (int right = 0; right < 4; right++)
+        {
+            if (rights & (1 << right))
+            {
+                ZOBRIST_CASTLING[rights] ^= rightKeys[right];
+            }
+        }
+    }
+    
+    for (int file = 0; file < 8; file++)
+    {
+        ZOBRIST_EN_PASSANT[file] = nextRandom(&randomState);
+    }
+    
+    ZOBRIST_BLACK_TO_MOVE = nextRandom(&randomState);
+}
+
+uint64_t computeKey(const Position *position)
+{
+    uint64_t key = ZOBRIST_CASTLING[position->castlingRights];
+    
+    for (int square = 0; square < SQUARE_COUNT; square++)
+    {
+        int id = position->board[square];
+        
+        if (id != 0)
+        {
+            key ^= ZOBRIST_PIECES[colorIndexForId(id)][abs(id)][square];
+        }
+    }
+    
+    if (position->enPassantSquare != NO_SQUARE)
+    {
+        key ^= ZOBRIST_EN_PASSANT[position->enPassantSquare & 7];
+    }
+    
+    if (position->sideToMove == COLOR_BLACK)
+    {
+        key ^= ZOBRIST_BLACK_TO_MOVE;
+    }
+    
+    return key;
+}
+
+void makeMove(Position *position, Move move, Undo *undo)
+{
+    int from = moveFrom(move);
+    int to = moveTo(move);
+    int type = moveType(move);
+    int id = position->board[from];
+    int color = position->sideToMove;
+    int forward = (color == COLOR_WHITE) ? 8 : -8;
+    bool capture = position->board[to] != 0;
+    bool pawnMove = abs(id) == PIECE_PAWN;
+    
+    undo->captured = position->board[to];
+    undo->castlingRights = position->castlingRights;
+    undo->enPassantSquare = position->enPassantSquare;
+    undo->halfmoveClock = position->halfmoveClock;
+    undo->key = position->key;
+    
+    removePiece(position, from);
+    
+    if (type == MOVE_EN_PASSANT)
+    {
+        undo->captured = PIECE_PAWN * -color;
+        removePiece(position, to - forward);
+        capture = true;
+    }
+    else if (type == MOVE_CASTLING)
+    {
+        // The king's destination tells us which rook comes along.
+        int rookFrom = (to > from) ? to + 1 : to - 2;
+        int rookTo = (to > from) ? to - 1 : to + 1;
+        int rookId = position->board[rookFrom];
+        
+        removePiece(position, rookFrom);
+        putPiece(position, rookTo, rookId);
+    }
+    
+    if (type == MOVE_PROMOTION)
+    {
+        id = movePromotion(move) * color;
+    }
+    
+    putPiece(position, to, id);
+    updateCastlingRights(position, from, to);
+    
+    setEnPassantSquare(position, NO_SQUARE);
+    
+    if (pawnMove && abs(to - from) == 16)
+    {
+        // Only remember the square if a pawn can actually take on it, so that
+        // transpositions still compare equal.
+        int passedSquare = from + forward;
+        
+        if (PAWN_ATTACKS[colorIndex(color)][passedSquare] &
+            piecesOf(position, -color, PIECE_PAWN))
+        {
+            setEnPassantSquare(position, passedSquare);
+        }
+    }
+    
+    if (capture || pawnMove)
+    {
+        position->halfmoveClock = 0;
+    }
+    else
+    {
+        position->halfmoveClock++;
+    }
+    
+    if (color == COLOR_BLACK)
+    {
+        position->fullmoveNumber++;
+    }
+    
+    setSideToMove(position, -color);
+}
+
+void unmakeMove(Position *position, Move move, const Undo *undo)
+{
+    int from = moveFrom(move);
+    int to = moveTo(move);
+    int type = moveType(move);
+    int color = -position->sideToMove;
+    int id = position->board[to];
+    
+    removePiece(position, to);
+    
+    if (type == MOVE_PROMOTION)
+    {
+        id = PIECE_PAWN * color;
+    }
+    
+    putPiece(position, from, id);
+    
+    if (type == MOVE_EN_PASSANT)
+    {
+        putPiece(position, to - ((color == COLOR_WHITE) ? 8 : -8), undo->captured);
+    }
+    else if (type == MOVE_CASTLING)
+    {
+        int rookFrom = (to > from) ? to + 1 : to - 2;
+        int rookTo = (to > from) ? to - 1 : to + 1;
+        
+        putPiece(position, rookFrom, position->board[rookTo]);
+        removePiece(position, rookTo);
+    }
+    else
+    {
+        putPiece(position, to, undo->captured);
+    }
+    
+    if (color == COLOR_BLACK)
+    {
+        position->fullmoveNumber--;
+    }
+    
+    // The piece moves above kept the key in step, but the rights and side to
+    // move are quicker to restore wholesale.
+    position->castlingRights = undo->castlingRights;
+    position->enPassantSquare = undo->enPassantSquare;
+    position->halfmoveClock = undo->halfmoveClock;
+    position->sideToMove = color;
+    position->key = undo->key;
+}
+
+void applyMove(Position *position, Move move)
+{
+    Undo undo;
+    makeMove(position, move, &undo);
+}
+
+bool parseFen(Position *position, const char *fen)
+{
+    static const char PIECE_LETTERS[] = " prnbqk";
+    Position parsed;
+    clearPosition(&parsed);
+    
+    const char *text = skipSpaces(fen);
+    int rank = 7;
+    int file = 0;
+    
+    for (; *text != '\0' && *text != ' '; text++)
+    {
+        const char *letter = strchr(PIECE_LETTERS + 1, tolower(*text));
+        
+        if (*text == '/')
+        {
+            if (file != 8 || rank == 0)
+            {
+                return false;
+            }
+            
+            rank--;
+            file = 0;
+        }
+        else if (*text >= '1' && *text <= '8')
+        {
+            file += *text - '0';
+        }
+        else if (letter != nullptr && file < 8)
+        {
+            int color = isupper(*text) ? COLOR_WHITE : COLOR_BLACK;
+            putPiece(&parsed, rank * 8 + file, (int)(letter - PIECE_LETTERS) * color);
+            file++;
+        }
+        else
+        {
+            return false;
+        }
+        
+        if (file > 8)
+        {
+            return false;
+        }
+    }
+    
+    if (rank != 0 || file != 8)
+    {
+        return false;
+    }
+    
+    text = skipSpaces(text);
+    
+    if (*text == 'w' || *text == 'b')
+    {
+        setSideToMove(&parsed, (*text == 'w') ? COLOR_WHITE : COLOR_BLACK);
+        text++;
+    }
+    else
+    {
+        return false;
+    }
+    
+    text = skipSpaces(text);
+    int rights = 0;
+    
+    for (; *text != '\0' && *text != ' '; text++)
+    {
+        switch (*text)
+        {
+            case 'K':
+                rights |= WHITE_KINGSIDE;
+                break;
+                
+            case 'Q':
+                rights |= WHITE_QUEENSIDE;
+                break;
+                
+            case 'k':
+                rights |= BLACK_KINGSIDE;
+                break;
+                
+            case 'q':
+                rights |= BLACK_QUEENSIDE;
+                break;
+                
+            case '-':
+                break;
+                
+            default:
+                return false;
+        }
+    }
+    
+    // Drop rights the pieces can't back up, so the move generator never
+    // castles with a rook that isn't there.
+    int rightSquares[4][2] = {
+        { 4, 7 }, { 4, 0 }, { 60, 63 }, { 60, 56 }
+    };
+    
+    for (int right = 0; right < 4; right++)
+    {
+        int color = (right < 2) ? COLOR_WHITE : COLOR_BLACK;
+        
+        if (parsed.board[rightSquares[right][0]] != PIECE_KING * color ||
+            parsed.board[rightSquares[right][1]] != PIECE_ROOK * color)
+        {
+            rights &= ~(1 << right);
+        }
+    }
+    
+    setCastlingRights(&parsed, rights);
+    
+    text = skipSpaces(text);
+    int enPassantSquare = squareForName(text);
+    
+    if (enPassantSquare != NO_SQUARE)
+    {
+        // Only kept when a pawn can take on it, as makeMove does.
+        if (PAWN_ATTACKS[colorIndex(-parsed.sideToMove)][enPassantSquare] &
+            piecesOf(&parsed, parsed.sideToMove, PIECE_PAWN))
+        {
+            setEnPassantSquare(&parsed, enPassantSquare);
+        }
+        
+        text += 2;
+    }
+    else if (*text == '-')
+    {
+        text++;
+    }
+    else
+    {
+        return false;
+    }
+    
+    text = skipSpaces(text);
+    
+    if (isdigit(*text))
+    {
+        parsed.halfmoveClock = (int)strtol(text, (char **)&text, 10);
+        text = skipSpaces(text);
+        
+        if (isdigit(*text))
+        {
+            parsed.fullmoveNumber = (int)strtol(text, (char **)&text, 10);
+        }
+    }
+    
+    if (popCount(piecesOf(&parsed, COLOR_WHITE, PIECE_KING)) != 1 ||
+        popCount(piecesOf(&parsed, COLOR_BLACK, PIECE_KING)) != 1 ||
+        isInCheck(&parsed, -parsed.sideToMove))
+    {
+        return false;
+    }
+    
+    *position = parsed;
+    
+    return true;
+}
+
+std::string formatFen(const Position *position)
+{
+    static const char PIECE_LETTERS[] = " prnbqk";
+    std::string fen;
+    
+    for (int rank = 7; rank >= 0; rank--)
+    {
+        int empty = 0;
+        
+        for (int file = 0; file < 8; file++)
+        {
+            int id = position->board[rank * 8 + file];
+            
+            if (id == 0)
+            {
+                empty++;
+                continue;
+            }
+            
+            if (empty > 0)
+            {
+                fen += (char)('0' + empty);
+                empty = 0;
+            }
+            
+            char letter = PIECE_LETTERS[abs(id)];
+            fen += (id < 0) ? (char)toupper(letter) : letter;
+        }
+        
+        if (empty > 0)
+        {
+            fen += (char)('0' + empty);
+        }
+        
+        if (rank > 0)
+        {
+            fen += '/';
+        }
+    }
+    
+    fen += (position->sideToMove == COLOR_WHITE) ? " w " : " b ";
+    
+    if (position->castlingRights == 0)
+    {
+        fen += '-';
+    }
+    
+    if (position->castlingRights & WHITE_KINGSIDE)
+    {
+        fen += 'K';
+    }
+    
+    if (position->castlingRights & WHITE_QUEENSIDE)
+    {
+        fen += 'Q';
+    }
+    
+    if (position->castlingRights & BLACK_KINGSIDE)
+    {
+        fen += 'k';
+    }
+    
+    if (position->castlingRights & BLACK_QUEENSIDE)
+    {
+        fen += 'q';
+    }
+    
+    fen += ' ';
+    fen += (position->enPassantSquare == NO_SQUARE) ?
+           "-" :
+           nameForSquare(position->enPassantSquare);
+    fen += ' ' + std::to_string(position->halfmoveClock) +
+           ' ' + std::to_string(position->fullmoveNumber);
+    
+    return fen;
+}
+
+static const char *skipSpaces(const char *text)
+{
+    while (*text == ' ')
+    {
+        text++;
+    }
+    
+    return text;
+}
+
+// splitmix64
+static uint64_t nextRandom(uint64_t *state)
+{
+    uint64_t result = (*state += 0x9E3779B97F4A7C15ULL);
+    result = (result ^ (result >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    result = (result ^ (result >> 27)) * 0x94D049BB133111EBULL;
+    
+    return result ^ (result >> 31);
+}
@@ -0,0 +1,394 @@
+//
+//  Position.hpp
+//  Chess1
+//
+
+#ifndef Position_hpp
+#define Position_hpp
+
+#include <stdlib.h>
+#include <string>
+#include "Bitboard.hpp"
+
+static const int COLOR_WHITE = -1;
+static const int COLOR_BLACK = 1;
+
+// Piece ids are signed, type * color: negative for white, positive for
+// black.  The type also indexes the display registry in the rules engine
+// (0 is the null piece), which creates the pieces in this order.
+enum PieceType
+{
+    PIECE_NONE = 0,
+    PIECE_PAWN,
+    PIECE_ROOK,
+    PIECE_KNIGHT,
+    PIECE_BISHOP,
+    PIECE_QUEEN,
+    PIECE_KING,
+    PIECE_TYPE_COUNT
+};
+
+static const int NO_SQUARE = -1;
+
+static const int WHITE_KINGSIDE = 1;
+static const int WHITE_QUEENSIDE = 2;
+static const int BLACK_KINGSIDE = 4;
+static const int BLACK_QUEENSIDE = 8;
+static const int ALL_CASTLING_RIGHTS = 15;
+
+// Moves are packed into 16 bits: from square, to square, the promotion piece
+// (rook, knight, bishop or queen, offset from PIECE_ROOK) and the move type.
+// Castling is encoded as the king's two square step.
+typedef uint16_t Move;
+
+static const Move NULL_MOVE = 0;
+static const int MOVE_NORMAL = 0;
+static const int MOVE_PROMOTION = 1 << 14;
+static const int MOVE_EN_PASSANT = 2 << 14;
+static const int MOVE_CASTLING = 3 << 14;
+
+// Zobrist keys: a position's key is the XOR of one random number per piece
+// on its square, the castling rights, the en passant file and the side to
+// move (only when it's black).  Filled in by initZobrist().
+extern uint64_t ZOBRIST_PIECES[2][PIECE_TYPE_COUNT][SQUARE_COUNT];
+extern uint64_t ZOBRIST_CASTLING[ALL_CASTLING_RIGHTS + 1];
+extern uint64_t ZOBRIST_EN_PASSANT[8];
+extern uint64_t ZOBRIST_BLACK_TO_MOVE;
+
+// Each piece's material plus the bonus for its square, in centipawns, for the
+// middlegame and for the endgame: positive for white's pieces and negative
+// for black's, so that a position's totals are white's lead.  Defined with
+// the rest of the evaluation, in Evaluate.cpp.
+typedef struct
+{
+    int16_t middlegame[2][PIECE_TYPE_COUNT][SQUARE_COUNT];
+    int16_t endgame[2][PIECE_TYPE_COUNT][SQUARE_COUNT];
+} PieceSquareTable;
+
+extern const PieceSquareTable PIECE_SQUARE;
+
+// How much each piece type keeps the game out of the endgame; the start
+// position adds up to MAX_GAME_PHASE.
+extern const int GAME_PHASE_WEIGHTS[PIECE_TYPE_COUNT];
+static const int MAX_GAME_PHASE = 24;
+
+typedef struct
+{
+    signed char board[SQUARE_COUNT];
+    Bitboard pieces[PIECE_TYPE_COUNT];
+    Bitboard colors[2];
+    Bitboard occupied;
+    int sideToMove;
+    int castlingRights;
+    int enPassantSquare;
+    int halfmoveClock;
+    int fullmoveNumber;
+    uint64_t key;       // Kept up to date by the functions below,
+    int middlegame;     // as are the PIECE_SQUARE totals
+    int endgame;
+    int phase;          // and the GAME_PHASE_WEIGHTS total.
+} Position;
+
+// What makeMove overwrites and unmakeMove needs back.  Callers keep these in
+// a preallocated stack, one per ply, so trying a move never allocates.
+typedef struct
+{
+    int captured;
+    int castlingRights;
+    int enPassantSquare;
+    int halfmoveClock;
+    uint64_t key;
+} Undo;
+
+// COLOR_WHITE (-1) maps to 0 and COLOR_BLACK (1) maps to 1.
+inline int colorIndex(int color)
+{
+    return (color + 1) >> 1;
+}
+
+inline int colorIndexForId(int id)
+{
+    return id > 0;
+}
+
+inline Move encodeMove(int from, int to, int type)
+{
+    return (Move)(from | (to << 6) | type);
+}
+
+inline Move encodePromotion(int from, int to, int pieceType)
+{
+    return (Move)(from | (to << 6) | ((pieceType - PIECE_ROOK) << 12) |
+                  MOVE_PROMOTION);
+}
+
+inline int moveFrom(Move move)
+{
+    return move & 63;
+}
+
+inline int moveTo(Move move)
+{
+    return (move >> 6) & 63;
+}
+
+inline int moveType(Move move)
+{
+    return move & (3 << 14);
+}
+
+inline int movePromotion(Move move)
+{
+    return ((move >> 12) & 3) + PIECE_ROOK;
+}
+
+inline void clearPosition(Position *position)
+{
+    for (int square = 0; square < SQUARE_COUNT; square++)
+    {
+        position->board[square] = 0;
+    }
+    
+    for (int type = 0; type < PIECE_TYPE_COUNT; type++)
+    {
+        position->pieces[type] = 0;
+    }
+    
+    position->colors[0] = 0;
+    position->colors[1] = 0;
+    position->occupied = 0;
+    position->sideToMove = COLOR_WHITE;
+    position->castlingRights = 0;
+    position->enPassantSquare = NO_SQUARE;
+    position->halfmoveClock = 0;
+    position->fullmoveNumber = 1;
+    position->key = 0;
+    position->middlegame = 0;
+    position->endgame = 0;
+    position->phase = 0;
+}
+
+inline void removePiece(Position *position, int square)
+{
+    int id = position->board[square];
+    
+    if (id == 0)
+    {
+        return;
+    }
+    
+    Bitboard bit = squareBit(square);
+    position->key ^= ZOBRIST_PIECES[colorIndexForId(id)][abs(id)][square];
+    position->middlegame -= PIECE_SQUARE.middlegame[colorIndexForId(id)][abs(id)][square];
+    position->endgame -= PIECE_SQUARE.endgame[colorIndexForId(id)][abs(id)][square];
+    position->phase -= GAME_PHASE_WEIGHTS[abs(id)];
+    position->board[square] = 0;
+    position->pieces[abs(id)] ^= bit;
+    position->colors[colorIndexForId(id)] ^= bit;
+    position->occupied ^= bit;
+}
+
+inline void putPiece(Position *position, int square, int id)
+{
+    removePiece(position, square);
+    
+    if (id == 0)
+    {
+        return;
+    }
+    
+    Bitboard bit = squareBit(square);
+    position->key ^= ZOBRIST_PIECES[colorIndexForId(id)][abs(id)][square];
+    position->middlegame += PIECE_SQUARE.middlegame[colorIndexForId(id)][abs(id)][square];
+    position->endgame += PIECE_SQUARE.endgame[colorIndexForId(id)][abs(id)][square];
+    position->phase += GAME_PHASE_WEIGHTS[abs(id)];
+    position->board[square] = (signed char)id;
+    position->pieces[abs(id)] |= bit;
+    position->colors[colorIndexForId(id)] |= bit;
+    position->occupied |= bit;
+}
+
+inline void setCastlingRights(Position *position, int rights)
+{
+    position->key ^= ZOBRIST_CASTLING[position->castlingRights] ^
+                     ZOBRIST_CASTLING[rights];
+    position->castlingRights = rights;
+}
+
+inline void setEnPassantSquare(Position *position, int square)
+{
+    if (position->enPassantSquare != NO_SQUARE)
+    {
+        position->key ^= ZOBRIST_EN_PASSANT[position->enPassantSquare & 7];
+    }
+    
+    if (square != NO_SQUARE)
+    {
+        position->key ^= ZOBRIST_EN_PASSANT[square & 7];
+    }
+    
+    position->enPassantSquare = square;
+}
+
+inline void setSideToMove(Position *position, int color)
+{
+    if (position->sideToMove != color)
+    {
+        position->key ^= ZOBRIST_BLACK_TO_MOVE;
+        position->sideToMove = color;
+    }
+}
+
+inline int pieceOnSquare(const Position *position, int square)
+{
+    return position->board[square];
+}
+
+inline Bitboard piecesOf(const Position *position, int color, int type)
+{
+    return position->pieces[type] & position->colors[colorIndex(color)];
+}
+
+inline int kingSquare(const Position *position, int color)
+{
+    return lowestSquare(piecesOf(position, color, PIECE_KING));
+}
+
+// Every piece of either color attacking square, given the occupancy.
+inline Bitboard attackersTo(const Position *position,
+                            int square,
+                            Bitboard occupied)
+{
+    const Bitboard *pieces = position->pieces;
+    
+    return (PAWN_ATTACKS[0][square] & pieces[PIECE_PAWN] & position->colors[1]) |
+           (PAWN_ATTACKS[1][square] & pieces[PIECE_PAWN] & position->colors[0]) |
+           (KNIGHT_ATTACKS[square] & pieces[PIECE_KNIGHT]) |
+           (KING_ATTACKS[square] & pieces[PIECE_KING]) |
+           (bishopAttacks(square, occupied) &
+            (pieces[PIECE_BISHOP] | pieces[PIECE_QUEEN])) |
+           (rookAttacks(square, occupied) &
+            (pieces[PIECE_ROOK] | pieces[PIECE_QUEEN]));
+}
+
+// Every square color attacks, given the occupancy, in one pass over its
+// pieces.  Pawns are shifted as a set.
+inline Bitboard attackedSquares(const Position *position,
+                                int color,
+                                Bitboard occupied)
+{
+    Bitboard pawns = piecesOf(position, color, PIECE_PAWN);
+    Bitboard attacks;
+    
+    if (color == COLOR_WHITE)
+    {
+        attacks = ((pawns << 7) & ~FILE_H_BITS) | ((pawns << 9) & ~FILE_A_BITS);
+    }
+    else
+    {
+        attacks = ((pawns >> 9) & ~FILE_H_BITS) | ((pawns >> 7) & ~FILE_A_BITS);
+    }
+    
+    Bitboard knights = piecesOf(position, color, PIECE_KNIGHT);
+    Bitboard diagonals = piecesOf(position, color, PIECE_BISHOP) |
+                         piecesOf(position, color, PIECE_QUEEN);
+    Bitboard straights = piecesOf(position, color, PIECE_ROOK) |
+                         piecesOf(position, color, PIECE_QUEEN);
+    Bitboard kings = piecesOf(position, color, PIECE_KING);
+    
+    while (knights != 0)
+    {
+        attacks |= KNIGHT_ATTACKS[popLowestSquare(&knights)];
+    }
+    
+    while (diagonals != 0)
+    {
+        attacks |= bishopAttacks(popLowestSquare(&diagonals), occupied);
+    }
+    
+    while (straights != 0)
+    {
+        attacks |= rookAttacks(popLowestSquare(&straights), occupied);
+    }
+    
+    if (kings != 0)
+    {
+        attacks |= KING_ATTACKS[lowestSquare(kings)];
+    }
+    
+    return attacks;
+}
+
+inline bool isSquareAttacked(const Position *position, int square, int byColor)
+{
+    return (attackersTo(position, square, position->occupied) &
+            position->colors[colorIndex(byColor)]) != 0;
+}
+
+inline bool isInCheck(const Position *position, int color)
+{
+    return isSquareAttacked(position, kingSquare(position, color), -color);
+}
+
+// The castling rights that are lost once anything moves from or to square.
+inline int castlingRightsForSquare(int square)
+{
+    switch (square)
+    {
+        case 0:
+            return WHITE_QUEENSIDE;
+            
+        case 4:
+            return WHITE_KINGSIDE | WHITE_QUEENSIDE;
+            
+        case 7:
+            return WHITE_KINGSIDE;
+            
+        case 56:
+            return BLACK_QUEENSIDE;
+            
+        case 60:
+            return BLACK_KINGSIDE | BLACK_QUEENSIDE;
+            
+        case 63:
+            return BLACK_KINGSIDE;
+            
+        default:
+            return 0;
+    }
+}
+
+inline void updateCastlingRights(Position *position, int from, int to)
+{
+    setCastlingRights(position,
+                      position->castlingRights &
+                      ~(castlingRightsForSquare(from) | castlingRightsForSquare(to)));
+}
+
+// Must be called once before any position is set up.
+void initZobrist();
+
+// The key worked out from scratch, for checking the incremental one.
+uint64_t computeKey(const Position *position);
+
+// Plays a legal (or at least pseudo-legal) move, including castling, en
+// passant and promotion, and hands the turn to the other side.  undo is
+// filled in so unmakeMove can put everything back exactly.
+void makeMove(Position *position, Move move, Undo *undo);
+void unmakeMove(Position *position, Move move, const Undo *undo);
+
+// makeMove for when the move will never be taken back.
+void applyMove(Position *position, Move move);
+
+static const char *const START_FEN =
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+// Sets position from Forsyth-Edwards Notation.  The move counters may be left
+// off.  Returns false, leaving position alone, if fen isn't a position with
+// one king a side and the side not to move out of check.
+bool parseFen(Position *position, const char *fen);
+
+// The position as FEN, all six fields.  parseFen reads it back unchanged.
+std::string formatFen(const Position *position);
+
+#endif /* Position_hpp */
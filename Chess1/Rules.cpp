@@ -0,0 +1,799 @@
+//
+//  Rules.cpp
+//  Chess1
+//
+
+#include <iostream>
+#include <algorithm>
+#include "Rules.hpp"
+#include "MoveGen.hpp"
+
+static bool attacksPosition(Bitboard attacks, Vector2i position);
+static int addPossiblePiece(ChessPiece piece);
+static void createPiece(std::string name, std::string imagePath);
+static bool pieceCanReach(int type, Vector2i currentPos, Vector2i nextPos);
+static bool pawnCanReach(Vector2i currentPos, Vector2i nextPos);
+static int getIntSign(int num);
+static void recordTakenPiece(int color, int takeId);
+static void recordMove(Move move);
+static MoveBlock *allocateMoveBlock(MoveArena *arena);
+static int blocksForMoves(int moveCount);
+static void printTakenPieces(int color);
+static inline int positiveMod(int i, int n);
+static bool outOfBounds(Vector2i position);
+static Bitboard attacksOfColor(int color);
+static bool hasLegalMove(int color);
+static void setLoser(int color);
+static void checkGameOver();
+
+// Read-only once initPieces has run, so every thread shares it.
+static std::vector<ChessPiece> possiblePieces;
+
+// Every thread has a game of its own, so headless tools can play one game on
+// each thread at once without setting anything up; the windowed game only
+// ever uses its main thread's.  Hosts bring their own with useGame.
+static thread_local MoveArena threadArena;
+static thread_local Game threadGame = {
+    {}, {}, &threadArena, nullptr, nullptr, 0, COLOR_WHITE, 0, {}, {}, {}, {}, true
+};
+static thread_local Game *currentGame = &threadGame;
+
+static bool attacksPosition(Bitboard attacks, Vector2i position)
+{
+    return (attacks & squareBit(squareForPosition(position))) != 0;
+}
+
+void initPieces()
+{
+    // The order pieces are created in gives them their ids, which must match
+    // the PieceType values in Position.hpp.  The registry is only used for
+    // names and images; the rules go through pieceCanReach.
+    createPiece("Pawn", "pawn.png");
+    createPiece("Rook", "rook.png");
+    createPiece("Knight", "knight.png");
+    createPiece("Bishop", "bishop.png");
+    createPiece("Queen", "queen.png");
+    createPiece("King", "king.png");
+}
+
+// Whether the piece at currentPos could move to nextPos on the current
+// board, ignoring check.  A switch on the type instead of a call through the
+// registry, so the compiler can inline each case.  Castling and en passant
+// aren't clicks; they only come through playMove.
+static bool pieceCanReach(int type, Vector2i currentPos, Vector2i nextPos)
+{
+    int square = squareForPosition(currentPos);
+    
+    switch (type)
+    {
+        case PIECE_PAWN:
+            return pawnCanReach(currentPos, nextPos);
+            
+        case PIECE_ROOK:
+            return attacksPosition(rookAttacks(square, currentGame->position.occupied),
+                                   nextPos);
+        
+        case PIECE_KNIGHT:
+            return attacksPosition(KNIGHT_ATTACKS[square], nextPos);
+            
+        case PIECE_BISHOP:
+            return attacksPosition(bishopAttacks(square, currentGame->position.occupied),
+                                   nextPos);
+        
+        case PIECE_QUEEN:
+            return attacksPosition(queenAttacks(square, currentGame->position.occupied),
+                                   nextPos);
+        
+        case PIECE_KING:
+            return attacksPosition(KING_ATTACKS[square], nextPos);
+            
+        default:
+            return false;
+    }
+}
+
+static bool pawnCanReach(Vector2i currentPos, Vector2i nextPos)
+{
+    // A but hacky and unclear but it works.
+    // The pieces color corresponds to the direction it can move
+    // (Up is negative, down is positive).
+    int allowedDirection = getColorAtPosition(currentPos);
+    
+    if (nextPos.y == currentPos.y + allowedDirection &&
+        abs(nextPos.x - currentPos.x) == 1 &&
+        pieceAtPosition(nextPos))
+    {
+        return true;
+    }
+    
+    // Pushes only go to empty squares.
+    if (nextPos.x != currentPos.x || pieceAtPosition(nextPos))
+    {
+        return false;
+    }
+    
+    if (nextPos.y == currentPos.y + allowedDirection)
+    {
+        return true;
+    }
+    
+    int secondRelativeRank = positiveMod(allowedDirection, BOARD_SIZE - 1);
+    
+    // A double step can't jump a piece either.
+    Vector2i stepPos = { currentPos.x, currentPos.y + allowedDirection };
+    
+    if (nextPos.y == currentPos.y + (allowedDirection * 2) &&
+        !pieceAtPosition(stepPos) &&
+        // Definitely hacky and unclear, but still, it works.
+        // Example:
+        //      If the piece's color is white, which corresponds to -1,
+        //      and BOARD_SIZE == 8, -1 % (8 - 1) == -1 % 7 == 6.
+        //      If the piece's color is black, which corresponds to 1,
+        //      and BOARD_SIZE == 8, 1 % (8 - 1) == 1 % 7 == 1.
+        //      In each of these cases, this trick correctly picks the
+        //      second rank relative to the direction the player is facing.
+        currentPos.y == secondRelativeRank)
+    {
+        return true;
+    }
+    
+    // There currently is not enough information being stored to represent
+    // an En Passant.  If the last move's position was stored for each color
+    // it would be possible.  I'll do it later.
+    
+    return false;
+}
+
+void resetGame()
+{
+    Position start;
+    parseFen(&start, START_FEN);
+    setGamePosition(&start);
+}
+
+void initGame(Game *game, MoveArena *arena)
+{
+    *game = Game();
+    game->arena = arena;
+    
+    Game *previous = currentGame;
+    currentGame = game;
+    resetGame();
+    currentGame = previous;
+}
+
+void releaseGame(Game *game)
+{
+    if (game->firstBlock != nullptr)
+    {
+        // The chain goes back whole, onto the front of the free list.
+        game->lastBlock->next = game->arena->freeBlocks;
+        game->arena->freeBlocks = game->firstBlock;
+        game->arena->blocksInUse -= blocksForMoves(game->moveCount);
+    }
+    
+    game->firstBlock = nullptr;
+    game->lastBlock = nullptr;
+    game->moveCount = 0;
+}
+
+void useGame(Game *game)
+{
+    currentGame = (game != nullptr) ? game : &threadGame;
+}
+
+size_t gameMemoryBytes(const Game *game)
+{
+    return sizeof(Game) + blocksForMoves(game->moveCount) * sizeof(MoveBlock);
+}
+
+size_t arenaMemoryBytes(const MoveArena *arena)
+{
+    return arena->slabs.size() * MOVE_SLAB_BLOCKS * sizeof(MoveBlock);
+}
+
+void setGamePosition(const Position *position)
+{
+    releaseGame(currentGame);
+    currentGame->position = *position;
+    currentGame->start = *position;
+    
+    currentGame->winner = 0;
+    currentGame->currentTurn = position->sideToMove;
+    currentGame->takenCounts[0] = 0;
+    currentGame->takenCounts[1] = 0;
+    currentGame->whiteKingPosition = positionForSquare(kingSquare(position, COLOR_WHITE));
+    currentGame->blackKingPosition = positionForSquare(kingSquare(position, COLOR_BLACK));
+}
+
+const Position *getGamePosition()
+{
+    return &currentGame->position;
+}
+
+const Position *getGameStart()
+{
+    return &currentGame->start;
+}
+
+int getGameMoveCount()
+{
+    return currentGame->moveCount;
+}
+
+std::vector<Move> getGameMoves()
+{
+    std::vector<Move> moves;
+    moves.reserve(currentGame->moveCount);
+    
+    for (MoveBlock *block = currentGame->firstBlock; block != nullptr; block = block->next)
+    {
+        int count = std::min(currentGame->moveCount - (int)moves.size(), MOVE_BLOCK_MOVES);
+        moves.insert(moves.end(), block->moves, block->moves + count);
+    }
+    
+    return moves;
+}
+
+const std::vector<ChessPiece> &getPossiblePieces()
+{
+    return possiblePieces;
+}
+
+static int addPossiblePiece(ChessPiece piece)
+{
+    if (possiblePieces.size() == 0)
+    {
+        ChessPiece nullPiece = {
+            0,
+            "null",
+            ""
+        };
+        
+        possiblePieces.push_back(nullPiece);
+    }
+    
+    piece.id = (int)possiblePieces.size();
+    possiblePieces.push_back(piece);
+    
+    return piece.id;
+}
+
+static void createPiece(std::string name, std::string imagePath)
+{
+    addPossiblePiece({
+        0,
+        name,
+        imagePath
+    });
+}
+
+int idForNameAndColor(std::string name, int color)
+{
+    for (int pieceIndex = 0;
+         pieceIndex < possiblePieces.size();
+         pieceIndex++)
+    {
+        if (name == possiblePieces[pieceIndex].name)
+        {
+            return pieceIndex * color;
+        }
+    }
+    
+    return INT32_MAX;
+}
+
+bool pieceAtPosition(Vector2i position)
+{
+    return (currentGame->position.occupied & squareBit(squareForPosition(position))) != 0;
+}
+
+ChessPiece getPieceAtPosition(Vector2i position)
+{
+    int pieceId = getIdAtPosition(position);
+    ChessPiece piece = possiblePieces[abs(pieceId)];
+    
+    return piece;
+}
+
+bool pieceCanMove(ChessPiece piece, Vector2i position, Vector2i nextPosition)
+{
+    int currentPieceId = getIdAtPosition(position);
+    int nextPieceId = getIdAtPosition(nextPosition);
+    
+    return (pieceCanReach(piece.id, position, nextPosition) &&
+            (getIntSign(currentPieceId) != getIntSign(nextPieceId) ||
+            nextPieceId == 0));
+}
+
+void movePiece(Vector2i position, Vector2i nextPosition)
+{
+    int pieceId = getIdAtPosition(position);
+    
+    if (abs(pieceId) == PIECE_KING)
+    {
+        if (currentGame->currentTurn == COLOR_WHITE)
+        {
+            currentGame->whiteKingPosition = nextPosition;
+        }
+        else
+        {
+            currentGame->blackKingPosition = nextPosition;
+        }
+    }
+    
+    if (pieceAtPosition(nextPosition))
+    {
+        // Give piece to current player.
+        recordTakenPiece(currentGame->currentTurn, getIdAtPosition(nextPosition));
+    }
+    
+    // Let the position do its own bookkeeping (castling rights, the en
+    // passant square, the move clocks) so the move generator agrees with the
+    // board, but leave changing the turn to switchTurns.
+    Move move = encodeMove(squareForPosition(position),
+                           squareForPosition(nextPosition),
+                           MOVE_NORMAL);
+    applyMove(&currentGame->position, move);
+    recordMove(move);
+    setSideToMove(&currentGame->position, currentGame->currentTurn);
+}
+
+static int getIntSign(int num)
+{
+    if (num < 0)
+    {
+        return -1;
+    }
+    
+    return 1;
+}
+
+void switchTurns()
+{
+    currentGame->currentTurn = (currentGame->currentTurn == COLOR_WHITE) ? COLOR_BLACK : COLOR_WHITE;
+    setSideToMove(&currentGame->position, currentGame->currentTurn);
+    printGameState();
+}
+
+bool isColorsTurn(int color)
+{
+    return (currentGame->currentTurn == color);
+}
+
+int getCurrentTurn()
+{
+    return currentGame->currentTurn;
+}
+
+int getWinner()
+{
+    return currentGame->winner;
+}
+
+int getIdAtPosition(Vector2i position)
+{
+    return pieceOnSquare(&currentGame->position, squareForPosition(position));
+}
+
+int getColorAtPosition(Vector2i position)
+{
+    return getIntSign(getIdAtPosition(position));
+}
+
+static void recordTakenPiece(int color, int takeId)
+{
+    int index = colorIndex(color);
+    
+    // Only a set-up position with more than a full army could overflow.
+    if (currentGame->takenCounts[index] < 15)
+    {
+        currentGame->takenPieces[index][currentGame->takenCounts[index]++] = (signed char)takeId;
+    }
+}
+
+static void recordMove(Move move)
+{
+    int index = currentGame->moveCount % MOVE_BLOCK_MOVES;
+    
+    if (index == 0)
+    {
+        MoveBlock *block = allocateMoveBlock(currentGame->arena);
+        block->next = nullptr;
+        
+        if (currentGame->lastBlock != nullptr)
+        {
+            currentGame->lastBlock->next = block;
+        }
+        else
+        {
+            currentGame->firstBlock = block;
+        }
+        
+        currentGame->lastBlock = block;
+    }
+    
+    currentGame->lastBlock->moves[index] = move;
+    currentGame->moveCount++;
+}
+
+// A freed block if there is one, otherwise the next of the newest slab.
+static MoveBlock *allocateMoveBlock(MoveArena *arena)
+{
+    MoveBlock *block = arena->freeBlocks;
+    
+    if (block != nullptr)
+    {
+        arena->freeBlocks = block->next;
+    }
+    else
+    {
+        if (arena->slabs.empty() || arena->slabBlocksUsed == MOVE_SLAB_BLOCKS)
+        {
+            arena->slabs.emplace_back(new MoveBlock[MOVE_SLAB_BLOCKS]);
+            arena->slabBlocksUsed = 0;
+        }
+        
+        block = &arena->slabs.back()[arena->slabBlocksUsed++];
+    }
+    
+    arena->blocksInUse++;
+    
+    return block;
+}
+
+static int blocksForMoves(int moveCount)
+{
+    return (moveCount + MOVE_BLOCK_MOVES - 1) / MOVE_BLOCK_MOVES;
+}
+
+void setPrintGameState(bool enabled)
+{
+    currentGame->printingGameState = enabled;
+}
+
+void printGameState()
+{
+    if (!currentGame->printingGameState)
+    {
+        return;
+    }
+    
+    std::string turnString;
+    
+    if (currentGame->currentTurn == COLOR_WHITE)
+    {
+        turnString = "White";
+    }
+    else
+    {
+        turnString = "Black";
+    }
+    
+    std::cout << "Current Turn: " << turnString << std::endl;
+    
+    std::cout << "White's taken pieces:" << std::endl;
+    printTakenPieces(COLOR_WHITE);
+    std::cout << "Black's taken pieces:" << std::endl;
+    printTakenPieces(COLOR_BLACK);
+    std::cout << std::endl;
+}
+
+static void printTakenPieces(int color)
+{
+    int index = colorIndex(color);
+    
+    for (int pieceIndex = 0;
+         pieceIndex < currentGame->takenCounts[index];
+         pieceIndex++)
+    {
+        std::string pieceName = getPieceNameForId(abs(currentGame->takenPieces[index][pieceIndex]));
+        std::cout << " - " << pieceName << std::endl;
+    }
+}
+
+std::string getPieceNameForId(int id)
+{
+    return possiblePieces[id].name;
+}
+
+// Code is from
+// http://stackoverflow.com/questions/14997165/fastest-way-to-get-a-positive-modulo-in-c-c
+static inline int positiveMod(int i, int n)
+{
+    return (i % n + n) % n;
+}
+
+bool positionIsVulnerable(int color, Vector2i position)
+{
+    if (outOfBounds(position))
+    {
+        return false;
+    }
+    
+    return (attacksOfColor(-color) & squareBit(squareForPosition(position))) != 0;
+}
+
+bool positionIsVulnerableByPieces(int color, Vector2i position)
+{
+    if (outOfBounds(position))
+    {
+        return false;
+    }
+    
+    int pieceId = getIdAtPosition(position);
+    
+    // Only the other color's pieces can attack, so walk their occupancy set
+    // instead of all 64 squares.
+    Bitboard enemies = currentGame->position.colors[colorIndex(-color)];
+    
+    while (enemies != 0)
+    {
+        Vector2i currentPosition = positionForSquare(popLowestSquare(&enemies));
+        int currentId = getIdAtPosition(currentPosition);
+        
+        if (currentId == pieceId)
+        {
+            continue;
+        }
+        
+        if (pieceCanReach(abs(currentId), currentPosition, position))
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+bool isKingInCheck(int color)
+{
+    Vector2i kingPosition;
+    
+    if (color == COLOR_WHITE)
+    {
+        kingPosition = currentGame->whiteKingPosition;
+    }
+    else
+    {
+        kingPosition = currentGame->blackKingPosition;
+    }
+    
+    return positionIsVulnerable(color, kingPosition);
+}
+
+// Both are exact now: the legal move generator already knows about pins,
+// blocks and double checks.
+bool isKingInCheckMate(int color)
+{
+    return isInCheck(&currentGame->position, color) && !hasLegalMove(color);
+}
+
+bool isStalemate(int color)
+{
+    return !isInCheck(&currentGame->position, color) && !hasLegalMove(color);
+}
+
+static bool outOfBounds(Vector2i position)
+{
+    return (position.x < 0 || position.x >= BOARD_SIZE ||
+            position.y < 0 || position.y >= BOARD_SIZE);
+}
+
+// The squares color attacks, worked out once per position and then reused
+// until the board changes.  The Zobrist key tells us when it has, and taking
+// a piece off and putting it back returns to the same key and the same map,
+// and a thread moving from one game to another finds the maps still right.
+static Bitboard attacksOfColor(int color)
+{
+    static thread_local bool cached[2] = { false, false };
+    static thread_local uint64_t cachedKeys[2];
+    static thread_local Bitboard cachedAttacks[2];
+    int index = colorIndex(color);
+    
+    if (!cached[index] || cachedKeys[index] != currentGame->position.key)
+    {
+        cachedAttacks[index] = attackedSquares(&currentGame->position,
+                                               color,
+                                               currentGame->position.occupied);
+        cachedKeys[index] = currentGame->position.key;
+        cached[index] = true;
+    }
+    
+    return cachedAttacks[index];
+}
+
+static bool hasLegalMove(int color)
+{
+    Position position = currentGame->position;
+    
+    if (position.sideToMove != color)
+    {
+        setSideToMove(&position, color);
+        setEnPassantSquare(&position, NO_SQUARE);
+    }
+    
+    MoveList list;
+    generateLegalMoves(&position, &list);
+    
+    return list.count > 0;
+}
+
+bool nextMoveTakesColorOutOfCheck(int color,
+                                         Vector2i currentPosition,
+                                         Vector2i nextPosition)
+{
+    ChessPiece selected = getPieceAtPosition(currentPosition);
+    
+    if (!pieceCanMove(selected,
+                      currentPosition,
+                      nextPosition))
+    {
+        return false;
+    }
+    
+    // Try it on the real position and take it straight back, which leaves
+    // the board, the taken pieces and the turn exactly as they were.
+    Move move = encodeMove(squareForPosition(currentPosition),
+                           squareForPosition(nextPosition),
+                           MOVE_NORMAL);
+    Undo undo;
+    
+    makeMove(&currentGame->position, move, &undo);
+    bool outOfCheck = !isInCheck(&currentGame->position, color);
+    unmakeMove(&currentGame->position, move, &undo);
+    
+    return outOfCheck;
+}
+
+bool submitMove(Vector2i position, Vector2i nextPosition)
+{
+    if (currentGame->winner != 0 ||
+        outOfBounds(position) ||
+        outOfBounds(nextPosition) ||
+        !pieceAtPosition(position) ||
+        !isColorsTurn(getColorAtPosition(position)) ||
+        (position.x == nextPosition.x && position.y == nextPosition.y))
+    {
+        return false;
+    }
+    
+    // Whether or not the king is in check now, a move that leaves it in
+    // check (walking into an attack, or a pinned piece stepping aside) is
+    // turned down, so the king can never be taken.
+    if (!nextMoveTakesColorOutOfCheck(currentGame->currentTurn,
+                                      position,
+                                      nextPosition))
+    {
+        return false;
+    }
+    
+    // A pawn that reaches the far rank becomes a queen.
+    int from = squareForPosition(position);
+    int to = squareForPosition(nextPosition);
+    
+    if (abs(getIdAtPosition(position)) == PIECE_PAWN && (to < 8 || to >= 56))
+    {
+        return playMove(encodePromotion(from, to, PIECE_QUEEN));
+    }
+    
+    movePiece(position, nextPosition);
+    switchTurns();
+    checkGameOver();
+    
+    return true;
+}
+
+bool playMove(Move move)
+{
+    if (currentGame->winner != 0)
+    {
+        return false;
+    }
+    
+    MoveList list;
+    generateLegalMoves(&currentGame->position, &list);
+    
+    bool legal = false;
+    
+    for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+    {
+        if (list.moves[moveIndex] == move)
+        {
+            legal = true;
+            break;
+        }
+    }
+    
+    if (!legal)
+    {
+        return false;
+    }
+    
+    int takeSquare = moveTo(move);
+    
+    if (moveType(move) == MOVE_EN_PASSANT)
+    {
+        takeSquare += (currentGame->currentTurn == COLOR_WHITE) ? -8 : 8;
+    }
+    
+    int takeId = currentGame->position.board[takeSquare];
+    
+    if (takeId != 0)
+    {
+        recordTakenPiece(currentGame->currentTurn, takeId);
+    }
+    
+    applyMove(&currentGame->position, move);
+    recordMove(move);
+    currentGame->whiteKingPosition = positionForSquare(kingSquare(&currentGame->position, COLOR_WHITE));
+    currentGame->blackKingPosition = positionForSquare(kingSquare(&currentGame->position, COLOR_BLACK));
+    currentGame->currentTurn = currentGame->position.sideToMove;
+    printGameState();
+    checkGameOver();
+    
+    return true;
+}
+
+void resign(int color)
+{
+    if (currentGame->winner == 0)
+    {
+        setLoser(color);
+    }
+}
+
+Bitboard legalMovesFrom(Vector2i position, Move moves[SQUARE_COUNT])
+{
+    if (currentGame->winner != 0 || outOfBounds(position))
+    {
+        return 0;
+    }
+    
+    MoveList list;
+    generateLegalMoves(&currentGame->position, &list);
+    
+    int from = squareForPosition(position);
+    Bitboard destinations = 0;
+    
+    for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+    {
+        Move move = list.moves[moveIndex];
+        
+        if (moveFrom(move) != from ||
+            (moveType(move) == MOVE_PROMOTION && movePromotion(move) != PIECE_QUEEN))
+        {
+            continue;
+        }
+        
+        moves[moveTo(move)] = move;
+        destinations |= squareBit(moveTo(move));
+    }
+    
+    return destinations;
+}
+
+static void setLoser(int color)
+{
+    if (color == COLOR_WHITE)
+    {
+        currentGame->winner = COLOR_BLACK;
+    }
+    else
+    {
+        currentGame->winner = COLOR_WHITE;
+    }
+}
+
+// Called after every move, for the side that is now to move.
+static void checkGameOver()
+{
+    if (isKingInCheckMate(currentGame->currentTurn))
+    {
+        setLoser(currentGame->currentTurn);
+    }
+    else if (isStalemate(currentGame->currentTurn))
+    {
+        currentGame->winner = GAME_DRAWN;
+    }
+}
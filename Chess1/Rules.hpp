@@ -0,0 +1,174 @@
+//
+//  Rules.hpp
+//  Chess1
+//
+//  The rules engine: piece registry, board state, move validation and
+//  check/checkmate detection.  Nothing in here depends on SDL, so it can be
+//  linked into the headless tools as well as the windowed game.
+//
+
+#ifndef Rules_hpp
+#define Rules_hpp
+
+#include <vector>
+#include <string>
+#include <memory>
+#include "Bitboard.hpp"
+#include "Position.hpp"
+
+// Display information for a piece type.  id is the PieceType.
+typedef struct
+{
+    int id;
+    std::string name;
+    std::string imagePath;
+} ChessPiece;
+
+static const int BOARD_SIZE = 8;
+
+// getWinner() returns this, rather than a color, after a stalemate.
+static const int GAME_DRAWN = 2;
+
+// A game's moves are kept in blocks of this many, chained oldest first.
+static const int MOVE_BLOCK_MOVES = 60;
+
+// Blocks are carved out of slabs of this many.
+static const int MOVE_SLAB_BLOCKS = 256;
+
+typedef struct MoveBlock
+{
+    struct MoveBlock *next;
+    Move moves[MOVE_BLOCK_MOVES];
+} MoveBlock;
+
+// Hands out MoveBlocks and takes them back when a game starts over, so games
+// stop touching the heap once the arena has grown to fit them.  An arena has
+// a single owner and no synchronization of any kind (it isn't lock-free, it
+// just isn't shared): only one thread may use it, and the games drawing on
+// it, at a time, which is why every host shard and server worker has its
+// own.  A zeroed arena is empty and ready to use.
+typedef struct
+{
+    std::vector<std::unique_ptr<MoveBlock[]>> slabs;
+    int slabBlocksUsed;         // Of the newest slab.
+    MoveBlock *freeBlocks;
+    size_t blocksInUse;
+} MoveArena;
+
+// Everything one game needs.  The functions below all work on the calling
+// thread's current game, which is the thread's own unless useGame has picked
+// another, so a host can keep any number of games and play whichever one it
+// likes on whichever thread.
+typedef struct
+{
+    Position position;
+    Position start;
+    MoveArena *arena;           // Where the history's blocks come from.
+    MoveBlock *firstBlock;
+    MoveBlock *lastBlock;
+    int moveCount;
+    int currentTurn;
+    int winner;
+    Vector2i whiteKingPosition;
+    Vector2i blackKingPosition;
+    // By the side that took them, in the order they went.  Kings can't be
+    // taken and a promotion only replaces a pawn, so a side loses at most 15.
+    signed char takenPieces[2][15];
+    int takenCounts[2];
+    bool printingGameState;
+} Game;
+
+void initPieces();
+
+// Sets game up at the usual start with printing off, its history drawing on
+// arena (which has to outlive it).
+void initGame(Game *game, MoveArena *arena);
+
+// Gives game's history back to its arena.  The game can be reset after.
+void releaseGame(Game *game);
+
+// Makes game the calling thread's current game, or the thread's own game
+// again if it is nullptr.  A game must only be current on one thread at once.
+void useGame(Game *game);
+
+// What game holds on to: itself and its history's blocks.
+size_t gameMemoryBytes(const Game *game);
+
+// The slabs arena has allocated, used or free.
+size_t arenaMemoryBytes(const MoveArena *arena);
+
+void resetGame();
+const Position *getGamePosition();
+
+// Starts a game from position instead of the usual setup.
+void setGamePosition(const Position *position);
+
+// Where the game started, and every move played since, so it can be saved.
+const Position *getGameStart();
+int getGameMoveCount();
+std::vector<Move> getGameMoves();
+const std::vector<ChessPiece> &getPossiblePieces();
+// Linear search of the registry by name; for display code, not the rules.
+int idForNameAndColor(std::string name, int color);
+std::string getPieceNameForId(int id);
+
+bool pieceAtPosition(Vector2i position);
+ChessPiece getPieceAtPosition(Vector2i position);
+int getIdAtPosition(Vector2i position);
+int getColorAtPosition(Vector2i position);
+int getCurrentTurn();
+bool isColorsTurn(int color);
+int getWinner();
+
+bool pieceCanMove(ChessPiece piece,
+                  Vector2i position,
+                  Vector2i nextPosition);
+void movePiece(Vector2i position, Vector2i nextPosition);
+void switchTurns();
+// Whether color's opponent attacks position.  A bit test against an attack
+// map that is built once per position.
+bool positionIsVulnerable(int color, Vector2i position);
+
+// The same question answered the old way, by asking every enemy piece's
+// move function (so a pawn "attacks" the squares it can push to).  Only the
+// attacks benchmark uses it.
+bool positionIsVulnerableByPieces(int color, Vector2i position);
+
+bool isKingInCheck(int color);
+bool isKingInCheckMate(int color);
+bool isStalemate(int color);
+
+// Whether moving the piece at currentPosition to nextPosition would leave
+// color out of check.  Only tries the move; nothing is played.
+bool nextMoveTakesColorOutOfCheck(int color,
+                                  Vector2i currentPosition,
+                                  Vector2i nextPosition);
+
+// Tries to play the piece at position to nextPosition for the side to move,
+// turning down anything that would leave its king in check.  A pawn that
+// reaches the far rank becomes a queen.  Returns true if the move was made,
+// and sets the winner if it ends the game.
+bool submitMove(Vector2i position, Vector2i nextPosition);
+
+// Plays a move from the move generator (a computer player's, say), which
+// may castle, capture en passant or promote.  Returns false if it isn't
+// legal for the side to move.
+bool playMove(Move move);
+
+// Ends the game with color's opponent as the winner, unless it is already
+// over.
+void resign(int color);
+
+// The legal moves of the piece at position, one per destination square
+// (promotions are to a queen), with the destinations as a bitboard, so a
+// click can be checked with a bit test.  Returns 0, leaving moves alone, if
+// the game is over or the piece can't move.
+Bitboard legalMovesFrom(Vector2i position, Move moves[SQUARE_COUNT]);
+
+void printGameState();
+
+// Turns printGameState on or off for the current game; bulk tools
+// playing thousands of games don't want a report after every move.
+void setPrintGameState(bool enabled);
+
+#endif /* Rules_hpp */
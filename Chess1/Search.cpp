@@ -0,0 +1,705 @@
+//
+//  Search.cpp
+//  Chess1
+//
+
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include "Search.hpp"
+#include "MoveGen.hpp"
+#include "Evaluate.hpp"
+#include "TranspositionTable.hpp"
+#include "Tablebase.hpp"
+#include "Nnue.hpp"
+
+// Shared by every thread of one search.
+typedef struct
+{
+    SearchLimits limits;
+    std::atomic<bool> *stop;
+    std::atomic<bool> finished;     // Set when the main thread is done.
+    std::chrono::steady_clock::time_point start;
+} SearchShared;
+
+// Everything a search thread writes to, apart from the transposition table.
+// Lazy SMP: every thread searches the same root on its own copy of the
+// position, and they only help each other through the table.
+typedef struct
+{
+    SearchShared *shared;
+    bool stopped;
+    uint64_t nodes;
+    std::atomic<uint64_t> publishedNodes;   // nodes, for the main thread to read
+    TranspositionStats tableStats;          // Added to the table's totals at the end.
+    Move rootBestMove;
+    Move killers[MAX_PLY][2];
+    int history[2][SQUARE_COUNT][SQUARE_COUNT];
+    Move pv[MAX_PLY][MAX_PLY];
+    int pvLength[MAX_PLY];
+    Undo undoStack[MAX_PLY];
+    NnueAccumulator accumulators[MAX_PLY];  // Only kept while a network is loaded.
+} SearchWorker;
+
+// Cheapest attacker first, most valuable victim first.
+static const int MVV_LVA_RANK[PIECE_TYPE_COUNT] = { 0, 1, 4, 2, 3, 5, 6 };
+static const int HASH_MOVE_ORDER = 2000000;
+static const int CAPTURE_ORDER = 1000000;
+static const int KILLER_ORDER = 900000;
+
+static int alphaBeta(SearchWorker *worker,
+                     Position *position,
+                     int alpha,
+                     int beta,
+                     int depth,
+                     int ply);
+static int quiescence(SearchWorker *worker,
+                      Position *position,
+                      int alpha,
+                      int beta,
+                      int ply);
+static void runHelper(SearchWorker *worker,
+                      Position position,
+                      int firstDepth,
+                      int maxDepth);
+static void playMove(SearchWorker *worker, Position *position, Move move, int ply);
+static int staticEvaluation(const SearchWorker *worker, const Position *position, int ply);
+static bool shouldStop(SearchWorker *worker);
+static double elapsedMs(const SearchWorker *worker);
+static bool isTactical(const Position *position, Move move);
+static void scoreMoves(const SearchWorker *worker,
+                       const Position *position,
+                       const MoveList *list,
+                       int scores[],
+                       Move hashMove,
+                       int ply);
+static Move pickNextMove(MoveList *list, int scores[], int index);
+static void updatePv(SearchWorker *worker, Move move, int ply);
+static void rememberQuietCutoff(SearchWorker *worker,
+                                const Position *position,
+                                Move move,
+                                int depth,
+                                int ply);
+static int scoreToTable(int score, int ply);
+static int scoreFromTable(int score, int ply);
+static int tablebaseScore(const TablebaseResult &result, int ply);
+
+Move searchPosition(const Position *position,
+                    SearchLimits limits,
+                    const SearchReporter &reporter,
+                    std::atomic<bool> *stop)
+{
+    MoveList rootMoves;
+    generateLegalMoves(position, &rootMoves);
+    
+    if (rootMoves.count == 0)
+    {
+        return NULL_MOVE;
+    }
+    
+    SearchShared shared;
+    shared.limits = limits;
+    shared.stop = stop;
+    shared.finished = false;
+    shared.start = std::chrono::steady_clock::now();
+    newTranspositionSearch();
+    
+    int maxDepth = MAX_PLY - 1;
+    
+    if (limits.depth > 0 && limits.depth < maxDepth)
+    {
+        maxDepth = limits.depth;
+    }
+    
+    // Workers are too big for the stack once the history table is in there.
+    // The () zeroes the tables.
+    int threadCount = (limits.threads > 1) ? limits.threads : 1;
+    std::vector<SearchWorker *> workers;
+    std::vector<std::thread> helpers;
+    
+    for (int threadIndex = 0; threadIndex < threadCount; threadIndex++)
+    {
+        workers.push_back(new SearchWorker());
+        workers[threadIndex]->shared = &shared;
+    }
+    
+    for (int threadIndex = 1; threadIndex < threadCount; threadIndex++)
+    {
+        helpers.push_back(std::thread(runHelper,
+                                      workers[threadIndex],
+                                      *position,
+                                      1 + (threadIndex & 1),
+                                      maxDepth));
+    }
+    
+    SearchWorker *worker = workers[0];
+    Position root = *position;
+    Move bestMove = rootMoves.moves[0];
+    
+    for (int depth = 1; depth <= maxDepth; depth++)
+    {
+        int score = alphaBeta(worker, &root, -INFINITE_SCORE, INFINITE_SCORE, depth, 0);
+        
+        // A partial iteration can't be trusted, except that anything is
+        // better than nothing at depth 1.
+        if (worker->stopped && depth > 1)
+        {
+            break;
+        }
+        
+        if (worker->pvLength[0] > 0)
+        {
+            bestMove = worker->pv[0][0];
+            worker->rootBestMove = bestMove;
+        }
+        
+        if (reporter)
+        {
+            SearchReport report;
+            report.depth = depth;
+            report.score = score;
+            report.nodes = worker->nodes;
+            
+            for (int threadIndex = 1; threadIndex < threadCount; threadIndex++)
+            {
+                report.nodes += workers[threadIndex]->publishedNodes.load(std::memory_order_relaxed);
+            }
+            
+            report.elapsedMs = elapsedMs(worker);
+            report.nodesPerSecond = (uint64_t)(report.nodes * 1000.0 /
+                                               (report.elapsedMs + 1e-9));
+            report.hashfull = transpositionTableFullness();
+            report.pv.assign(worker->pv[0], worker->pv[0] + worker->pvLength[0]);
+            reporter(report);
+        }
+        
+        if (worker->stopped ||
+            abs(score) >= MATE_SCORE - MAX_PLY)
+        {
+            break;
+        }
+        
+        // The next iteration would take several times as long as this one,
+        // so don't start what can't be finished.
+        if (limits.moveTimeMs > 0 &&
+            elapsedMs(worker) > limits.moveTimeMs / 2.0)
+        {
+            break;
+        }
+    }
+    
+    shared.finished = true;
+    
+    for (size_t helperIndex = 0; helperIndex < helpers.size(); helperIndex++)
+    {
+        helpers[helperIndex].join();
+    }
+    
+    for (int threadIndex = 0; threadIndex < threadCount; threadIndex++)
+    {
+        addTranspositionStats(workers[threadIndex]->tableStats);
+        delete workers[threadIndex];
+    }
+    
+    return bestMove;
+}
+
+std::string formatSearchReport(const SearchReport &report)
+{
+    std::ostringstream text;
+    text << "info depth " << report.depth << " score ";
+    
+    if (abs(report.score) >= MATE_SCORE - MAX_PLY)
+    {
+        int plies = MATE_SCORE - abs(report.score);
+        int moves = (plies + 1) / 2;
+        text << "mate " << ((report.score > 0) ? moves : -moves);
+    }
+    else
+    {
+        text << "cp " << report.score;
+    }
+    
+    text << " nodes " << report.nodes
+         << " nps " << report.nodesPerSecond
+         << " time " << (uint64_t)report.elapsedMs
+         << " hashfull " << report.hashfull
+         << " pv";
+    
+    for (size_t moveIndex = 0; moveIndex < report.pv.size(); moveIndex++)
+    {
+        text << " " << moveToString(report.pv[moveIndex]);
+    }
+    
+    return text.str();
+}
+
+static int alphaBeta(SearchWorker *worker,
+                     Position *position,
+                     int alpha,
+                     int beta,
+                     int depth,
+                     int ply)
+{
+    worker->pvLength[ply] = ply;
+    
+    if (ply == 0 && nnueLoaded())
+    {
+        refreshNnueAccumulator(position, &worker->accumulators[0]);
+    }
+    
+    bool inCheck = isInCheck(position, position->sideToMove);
+    
+    // Don't drop into quiescence while in check.
+    if (inCheck)
+    {
+        depth++;
+    }
+    
+    // A tablebase knows the exact result, leaves included, so there is
+    // nothing to search below it.  Past the fifty-move rule it can be wrong.
+    // Syzygy tables are only probed right after a capture or pawn move, so
+    // the search gets to a winning one by making that move.
+    TablebaseResult tablebase;
+    
+    if (ply > 0 && position->halfmoveClock < 100 && probeTablebase(position, &tablebase))
+    {
+        return tablebaseScore(tablebase, ply);
+    }
+    
+    if (depth <= 0)
+    {
+        return quiescence(worker, position, alpha, beta, ply);
+    }
+    
+    worker->nodes++;
+    
+    if (shouldStop(worker))
+    {
+        return 0;
+    }
+    
+    if (ply >= MAX_PLY - 1)
+    {
+        return staticEvaluation(worker, position, ply);
+    }
+    
+    if (ply > 0 && position->halfmoveClock >= 100)
+    {
+        return 0;
+    }
+    
+    TranspositionEntry entry;
+    Move hashMove = NULL_MOVE;
+    
+    worker->tableStats.probes++;
+    
+    if (probeTranspositionTable(position->key, &entry))
+    {
+        int score = scoreFromTable(entry.score, ply);
+        worker->tableStats.hits++;
+        hashMove = entry.move;
+        
+        // The root always searches, so that there is a move to play.
+        if (ply > 0 && entry.depth >= depth &&
+            (entry.bound == BOUND_EXACT ||
+             (entry.bound == BOUND_LOWER && score >= beta) ||
+             (entry.bound == BOUND_UPPER && score <= alpha)))
+        {
+            return score;
+        }
+    }
+    
+    if (ply == 0 && worker->rootBestMove != NULL_MOVE)
+    {
+        hashMove = worker->rootBestMove;
+    }
+    
+    MoveList list;
+    generateLegalMoves(position, &list);
+    
+    if (list.count == 0)
+    {
+        return inCheck ? -MATE_SCORE + ply : 0;
+    }
+    
+    int scores[MAX_MOVES];
+    scoreMoves(worker, position, &list, scores, hashMove, ply);
+    
+    Move bestMove = NULL_MOVE;
+    int bound = BOUND_UPPER;
+    
+    for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+    {
+        Move move = pickNextMove(&list, scores, moveIndex);
+        playMove(worker, position, move, ply);
+        int score = -alphaBeta(worker, position, -beta, -alpha, depth - 1, ply + 1);
+        unmakeMove(position, move, &worker->undoStack[ply]);
+        
+        if (worker->stopped)
+        {
+            return 0;
+        }
+        
+        if (score > alpha)
+        {
+            alpha = score;
+            bestMove = move;
+            bound = BOUND_EXACT;
+            updatePv(worker, move, ply);
+            
+            if (alpha >= beta)
+            {
+                if (!isTactical(position, move))
+                {
+                    rememberQuietCutoff(worker, position, move, depth, ply);
+                }
+                
+                storeTranspositionEntry(position->key, move,
+                                        scoreToTable(beta, ply),
+                                        depth, BOUND_LOWER);
+                worker->tableStats.stores++;
+                
+                return beta;
+            }
+        }
+    }
+    
+    storeTranspositionEntry(position->key, bestMove,
+                            scoreToTable(alpha, ply), depth, bound);
+    worker->tableStats.stores++;
+    
+    return alpha;
+}
+
+static int quiescence(SearchWorker *worker,
+                      Position *position,
+                      int alpha,
+                      int beta,
+                      int ply)
+{
+    worker->nodes++;
+    
+    if (shouldStop(worker))
+    {
+        return 0;
+    }
+    
+    int standPat = staticEvaluation(worker, position, ply);
+    
+    if (ply >= MAX_PLY - 1 || standPat >= beta)
+    {
+        return standPat;
+    }
+    
+    if (standPat > alpha)
+    {
+        alpha = standPat;
+    }
+    
+    MoveList list;
+    generateLegalMoves(position, &list);
+    
+    // Only captures and promotions from here on.
+    int tacticalCount = 0;
+    
+    for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+    {
+        if (isTactical(position, list.moves[moveIndex]))
+        {
+            list.moves[tacticalCount++] = list.moves[moveIndex];
+        }
+    }
+    
+    list.count = tacticalCount;
+    
+    int scores[MAX_MOVES];
+    scoreMoves(worker, position, &list, scores, NULL_MOVE, ply);
+    
+    for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+    {
+        Move move = pickNextMove(&list, scores, moveIndex);
+        playMove(worker, position, move, ply);
+        int score = -quiescence(worker, position, -beta, -alpha, ply + 1);
+        unmakeMove(position, move, &worker->undoStack[ply]);
+        
+        if (worker->stopped)
+        {
+            return 0;
+        }
+        
+        if (score > alpha)
+        {
+            alpha = score;
+            
+            if (alpha >= beta)
+            {
+                return beta;
+            }
+        }
+    }
+    
+    return alpha;
+}
+
+// A helper thread's iterative deepening.  Odd numbered helpers start a
+// depth ahead, so the threads spread out over neighbouring depths instead of
+// all searching the same tree.  Their results only reach the main thread
+// through the transposition table.
+static void runHelper(SearchWorker *worker,
+                      Position position,
+                      int firstDepth,
+                      int maxDepth)
+{
+    for (int depth = firstDepth; depth <= maxDepth && !worker->stopped; depth++)
+    {
+        alphaBeta(worker, &position, -INFINITE_SCORE, INFINITE_SCORE, depth, 0);
+        
+        if (worker->pvLength[0] > 0)
+        {
+            worker->rootBestMove = worker->pv[0][0];
+        }
+    }
+}
+
+// makeMove, bringing the next ply's accumulator up to date from this one's
+// when there's a network to evaluate with.
+static void playMove(SearchWorker *worker, Position *position, Move move, int ply)
+{
+    makeMove(position, move, &worker->undoStack[ply]);
+    
+    if (nnueLoaded())
+    {
+        updateNnueAccumulator(position, move, &worker->undoStack[ply],
+                              &worker->accumulators[ply], &worker->accumulators[ply + 1]);
+    }
+}
+
+static int staticEvaluation(const SearchWorker *worker, const Position *position, int ply)
+{
+    return nnueLoaded() ? nnueEvaluate(position, &worker->accumulators[ply]) : evaluate(position);
+}
+
+// The stop flags are read at every node, so "stop" from a GUI lands within
+// microseconds; the clock and the node count other threads see are only
+// updated every 2048 nodes, because reading the clock costs far more.
+static bool shouldStop(SearchWorker *worker)
+{
+    if (worker->stopped)
+    {
+        return true;
+    }
+    
+    SearchShared *shared = worker->shared;
+    
+    if ((shared->stop != nullptr &&
+         shared->stop->load(std::memory_order_relaxed)) ||
+        shared->finished.load(std::memory_order_relaxed))
+    {
+        worker->stopped = true;
+        return true;
+    }
+    
+    if ((worker->nodes & 2047) != 0)
+    {
+        return false;
+    }
+    
+    worker->publishedNodes.store(worker->nodes, std::memory_order_relaxed);
+    
+    if (shared->limits.moveTimeMs > 0 &&
+        elapsedMs(worker) >= shared->limits.moveTimeMs)
+    {
+        worker->stopped = true;
+    }
+    
+    return worker->stopped;
+}
+
+static double elapsedMs(const SearchWorker *worker)
+{
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - worker->shared->start;
+        
+    return elapsed.count();
+}
+
+static bool isTactical(const Position *position, Move move)
+{
+    return position->board[moveTo(move)] != 0 ||
+           moveType(move) == MOVE_EN_PASSANT ||
+           moveType(move) == MOVE_PROMOTION;
+}
+
+static void scoreMoves(const SearchWorker *worker,
+                       const Position *position,
+                       const MoveList *list,
+                       int scores[],
+                       Move hashMove,
+                       int ply)
+{
+    int color = colorIndex(position->sideToMove);
+    
+    for (int moveIndex = 0; moveIndex < list->count; moveIndex++)
+    {
+        Move move = list->moves[moveIndex];
+        int from = moveFrom(move);
+        int to = moveTo(move);
+        
+        if (move == hashMove)
+        {
+            scores[moveIndex] = HASH_MOVE_ORDER;
+        }
+        else if (isTactical(position, move))
+        {
+            int victim = abs(position->board[to]);
+            int attacker = abs(position->board[from]);
+            
+            if (moveType(move) == MOVE_EN_PASSANT)
+            {
+                victim = PIECE_PAWN;
+            }
+            
+            scores[moveIndex] = CAPTURE_ORDER +
+                                MVV_LVA_RANK[victim] * 8 -
+                                MVV_LVA_RANK[attacker];
+            
+            if (moveType(move) == MOVE_PROMOTION)
+            {
+                scores[moveIndex] += MVV_LVA_RANK[movePromotion(move)] * 8;
+            }
+        }
+        else if (move == worker->killers[ply][0])
+        {
+            scores[moveIndex] = KILLER_ORDER + 1;
+        }
+        else if (move == worker->killers[ply][1])
+        {
+            scores[moveIndex] = KILLER_ORDER;
+        }
+        else
+        {
+            scores[moveIndex] = worker->history[color][from][to];
+        }
+    }
+}
+
+// Selection sort, one step at a time.  Most nodes cut off after a move or
+// two, so sorting the whole list up front would be wasted work.
+static Move pickNextMove(MoveList *list, int scores[], int index)
+{
+    int best = index;
+    
+    for (int moveIndex = index + 1; moveIndex < list->count; moveIndex++)
+    {
+        if (scores[moveIndex] > scores[best])
+        {
+            best = moveIndex;
+        }
+    }
+    
+    Move move = list->moves[best];
+    int score = scores[best];
+    list->moves[best] = list->moves[index];
+    scores[best] = scores[index];
+    list->moves[index] = move;
+    scores[index] = score;
+    
+    return move;
+}
+
+static void updatePv(SearchWorker *worker, Move move, int ply)
+{
+    worker->pv[ply][ply] = move;
+    
+    for (int nextPly = ply + 1; nextPly < worker->pvLength[ply + 1]; nextPly++)
+    {
+        worker->pv[ply][nextPly] = worker->pv[ply + 1][nextPly];
+    }
+    
+    worker->pvLength[ply] = worker->pvLength[ply + 1];
+}
+
+static void rememberQuietCutoff(SearchWorker *worker,
+                                const Position *position,
+                                Move move,
+                                int depth,
+                                int ply)
+{
+    if (worker->killers[ply][0] != move)
+    {
+        worker->killers[ply][1] = worker->killers[ply][0];
+        worker->killers[ply][0] = move;
+    }
+    
+    int &history = worker->history[colorIndex(position->sideToMove)]
+                                  [moveFrom(move)][moveTo(move)];
+    history += depth * depth;
+    
+    // Keep history scores well below the killer and capture bands.
+    if (history > KILLER_ORDER / 2)
+    {
+        for (int color = 0; color < 2; color++)
+        {
+            for (int from = 0; from < SQUARE_COUNT; from++)
+            {
+                for (int to = 0; to < SQUARE_COUNT; to++)
+                {
+                    worker->history[color][from][to] /= 2;
+                }
+            }
+        }
+    }
+}
+
+// Mate and tablebase scores count plies from the root, but the table is
+// shared between different roots, so store them counted from the node
+// instead.
+static int scoreToTable(int score, int ply)
+{
+    if (score >= TABLEBASE_WIN_SCORE - MAX_PLY)
+    {
+        return score + ply;
+    }
+    
+    if (score <= -TABLEBASE_WIN_SCORE + MAX_PLY)
+    {
+        return score - ply;
+    }
+    
+    return score;
+}
+
+static int scoreFromTable(int score, int ply)
+{
+    if (score >= TABLEBASE_WIN_SCORE - MAX_PLY)
+    {
+        return score - ply;
+    }
+    
+    if (score <= -TABLEBASE_WIN_SCORE + MAX_PLY)
+    {
+        return score + ply;
+    }
+    
+    return score;
+}
+
+// Scored like a mate found by the search, counting from the root, or when
+// a Syzygy table doesn't say when the mate comes, as the nearest win.
+static int tablebaseScore(const TablebaseResult &result, int ply)
+{
+    int winScore = result.syzygy ? TABLEBASE_WIN_SCORE - ply : MATE_SCORE - ply - result.plies;
+    
+    if (result.wdl == TABLEBASE_WIN)
+    {
+        return winScore;
+    }
+    
+    if (result.wdl == TABLEBASE_LOSS)
+    {
+        return -winScore;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,61 @@
+//
+//  Search.hpp
+//  Chess1
+//
+//  Negamax alpha-beta with iterative deepening, a transposition table and a
+//  capture-only quiescence search.  Moves are ordered by the hash move, then
+//  MVV-LVA for captures, then killer moves, then the history heuristic.
+//  Positions are scored by evaluate, or by the network while one is loaded.
+//
+
+#ifndef Search_hpp
+#define Search_hpp
+
+#include <vector>
+#include <functional>
+#include <atomic>
+#include "Position.hpp"
+
+static const int MAX_PLY = 128;
+static const int MATE_SCORE = 30000;
+
+// Below every mate score: a tablebase win whose mate is still to be found,
+// less the plies from the root to the probe.
+static const int TABLEBASE_WIN_SCORE = MATE_SCORE - 2 * MAX_PLY;
+static const int INFINITE_SCORE = 32000;
+
+typedef struct
+{
+    int depth;          // 0 means no depth limit.
+    int moveTimeMs;     // 0 means no time limit.
+    int threads;        // 0 or 1 searches on the calling thread only.
+} SearchLimits;
+
+// Sent after every completed iteration.
+typedef struct
+{
+    int depth;
+    int score;
+    uint64_t nodes;
+    double elapsedMs;
+    uint64_t nodesPerSecond;
+    int hashfull;
+    std::vector<Move> pv;
+} SearchReport;
+
+typedef std::function<void(const SearchReport &report)> SearchReporter;
+
+// Searches position until a limit is reached or stop becomes true, and
+// returns the best move found (NULL_MOVE if there are no legal moves).  The
+// reporter may be empty, and is only called from the calling thread.  stop
+// may be null.  Extra threads share nothing with the calling thread but the
+// transposition table.
+Move searchPosition(const Position *position,
+                    SearchLimits limits,
+                    const SearchReporter &reporter,
+                    std::atomic<bool> *stop);
+
+// The usual "info depth ... pv ..." line.
+std::string formatSearchReport(const SearchReport &report);
+
+#endif /* Search_hpp */
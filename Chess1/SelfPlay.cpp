@@ -0,0 +1,294 @@
+//
+//  SelfPlay.cpp
+//  Chess1
+//
+
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include "SelfPlay.hpp"
+#include "Rules.hpp"
+#include "MoveGen.hpp"
+#include "Search.hpp"
+#include "ThreadPool.hpp"
+#include "Book.hpp"
+#include "Tablebase.hpp"
+
+static void playGame(const SelfPlayOptions &options,
+                     int game,
+                     GameRecord *record,
+                     SelfPlayStats *stats);
+static Move chooseMove(const Mover &mover, std::mt19937 *random);
+static void playChosenMove(Move move, SelfPlayStats *stats);
+static void addStats(SelfPlayStats *total, const SelfPlayStats &stats);
+
+bool parseMover(const std::string &text, Mover *mover)
+{
+    if (text == "random")
+    {
+        mover->kind = MOVER_RANDOM;
+        mover->limit = 0;
+        
+        return true;
+    }
+    
+    size_t equals = text.find('=');
+    
+    if (equals == std::string::npos)
+    {
+        return false;
+    }
+    
+    std::string kind = text.substr(0, equals);
+    int limit = atoi(text.c_str() + equals + 1);
+    
+    if (limit < 1)
+    {
+        return false;
+    }
+    
+    if (kind == "depth")
+    {
+        mover->kind = MOVER_DEPTH;
+    }
+    else if (kind == "movetime")
+    {
+        mover->kind = MOVER_MOVETIME;
+    }
+    else
+    {
+        return false;
+    }
+    
+    mover->limit = limit;
+    
+    return true;
+}
+
+SelfPlayStats runSelfPlay(const SelfPlayOptions &options, GameWriter *output)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::mutex outputLock;
+    
+    // One set of counters per thread, added up at the end, so finishing a
+    // game only takes a lock to write it out.
+    int threadCount = options.threads;
+    
+    if (threadCount < 1)
+    {
+        threadCount = (int)std::thread::hardware_concurrency();
+    }
+    
+    if (threadCount < 1)
+    {
+        threadCount = 1;
+    }
+    
+    std::vector<SelfPlayStats> threadStats(threadCount, SelfPlayStats());
+    
+    runTasks(options.games, threadCount, [&](int game, int thread) {
+        GameRecord record;
+        playGame(options, game, &record, &threadStats[thread]);
+        
+        if (output != nullptr)
+        {
+            std::lock_guard<std::mutex> guard(outputLock);
+            writeGameRecord(output, record);
+        }
+    });
+    
+    // The calling thread played games too; give it back a fresh one.
+    setPrintGameState(true);
+    resetGame();
+    
+    SelfPlayStats total = SelfPlayStats();
+    
+    for (int thread = 0; thread < threadCount; thread++)
+    {
+        addStats(&total, threadStats[thread]);
+    }
+    
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    total.elapsedMs = elapsed.count();
+    
+    return total;
+}
+
+// Plays one game on this thread's copy of the rules until it is won, drawn
+// by stalemate or the fifty-move rule, or runs past maxPlies.
+static void playGame(const SelfPlayOptions &options,
+                     int game,
+                     GameRecord *record,
+                     SelfPlayStats *stats)
+{
+    std::mt19937 random(options.seed + (uint32_t)game);
+    Mover randomMover = { MOVER_RANDOM, 0 };
+    bool inBook = options.useBook && bookIsOpen();
+    int bookPlies = 0;
+    bool timed = options.movers[0].kind != MOVER_RANDOM ||
+                 options.movers[1].kind != MOVER_RANDOM;
+    
+    setPrintGameState(false);
+    resetGame();
+    
+    record->number = (uint32_t)game;
+    record->winner = 0;
+    
+    while (true)
+    {
+        const Position *position = getGamePosition();
+        int ply = (int)record->moves.size();
+        
+        if (getWinner() == GAME_DRAWN)
+        {
+            record->reason = GAME_END_STALEMATE;
+            break;
+        }
+        else if (getWinner() != 0)
+        {
+            record->winner = getWinner();
+            record->reason = GAME_END_CHECKMATE;
+            break;
+        }
+        else if (position->halfmoveClock >= 100)
+        {
+            record->reason = GAME_END_FIFTY_MOVES;
+            break;
+        }
+        else if (ply >= options.maxPlies || ply >= MAX_GAME_RECORD_MOVES)
+        {
+            record->reason = GAME_END_MAX_PLIES;
+            break;
+        }
+        
+        TablebaseResult tablebase;
+        
+        if (options.adjudicate && probeTablebase(position, &tablebase))
+        {
+            record->winner = tablebase.wdl * position->sideToMove;
+            record->reason = GAME_END_TABLEBASE;
+            break;
+        }
+        
+        std::chrono::steady_clock::time_point moveStart = std::chrono::steady_clock::now();
+        Move move = inBook ? pickBookMove(position, random()) : NULL_MOVE;
+        
+        if (move != NULL_MOVE)
+        {
+            bookPlies++;
+        }
+        else
+        {
+            // Once out of the book a game stays out, even if it transposes
+            // back in.
+            inBook = false;
+            
+            const Mover &mover = (ply - bookPlies < options.randomPlies) ?
+                                 randomMover :
+                                 options.movers[colorIndex(position->sideToMove)];
+            move = chooseMove(mover, &random);
+        }
+        
+        if (move == NULL_MOVE)
+        {
+            // The generator found no moves but the rules didn't end the game.
+            stats->rulesMismatches++;
+            record->reason = isInCheck(position, position->sideToMove) ?
+                             GAME_END_CHECKMATE :
+                             GAME_END_STALEMATE;
+            record->winner = (record->reason == GAME_END_CHECKMATE) ?
+                             -position->sideToMove :
+                             0;
+            break;
+        }
+        
+        if (timed)
+        {
+            std::chrono::duration<double, std::milli> spent =
+                std::chrono::steady_clock::now() - moveStart;
+            record->clocksMs.push_back((uint32_t)spent.count());
+        }
+        
+        playChosenMove(move, stats);
+        record->moves.push_back(move);
+    }
+    
+    stats->games++;
+    stats->plies += record->moves.size();
+    stats->adjudicated += (record->reason == GAME_END_TABLEBASE);
+    
+    if (record->winner == COLOR_WHITE)
+    {
+        stats->whiteWins++;
+    }
+    else if (record->winner == COLOR_BLACK)
+    {
+        stats->blackWins++;
+    }
+    else
+    {
+        stats->draws++;
+    }
+}
+
+static Move chooseMove(const Mover &mover, std::mt19937 *random)
+{
+    const Position *position = getGamePosition();
+    
+    if (mover.kind == MOVER_RANDOM)
+    {
+        MoveList list;
+        generateLegalMoves(position, &list);
+        
+        return (list.count == 0) ? NULL_MOVE : list.moves[(*random)() % list.count];
+    }
+    
+    // One thread per search; the games themselves keep the cores busy.
+    SearchLimits limits = { 0, 0, 1 };
+    
+    if (mover.kind == MOVER_DEPTH)
+    {
+        limits.depth = mover.limit;
+    }
+    else
+    {
+        limits.moveTimeMs = mover.limit;
+    }
+    
+    return searchPosition(position, limits, SearchReporter(), nullptr);
+}
+
+// Ordinary moves go through submitMove, the way a click would.  Castling and
+// en passant have no click path, and a click can only promote to a queen,
+// so those, and any legal move the click rules wrongly turn down, are
+// played with playMove.
+static void playChosenMove(Move move, SelfPlayStats *stats)
+{
+    if (moveType(move) == MOVE_NORMAL)
+    {
+        if (submitMove(positionForSquare(moveFrom(move)),
+                       positionForSquare(moveTo(move))))
+        {
+            return;
+        }
+        
+        stats->rulesMismatches++;
+    }
+    
+    playMove(move);
+}
+
+static void addStats(SelfPlayStats *total, const SelfPlayStats &stats)
+{
+    total->games += stats.games;
+    total->plies += stats.plies;
+    total->whiteWins += stats.whiteWins;
+    total->blackWins += stats.blackWins;
+    total->draws += stats.draws;
+    total->adjudicated += stats.adjudicated;
+    total->rulesMismatches += stats.rulesMismatches;
+}
@@ -0,0 +1,65 @@
+//
+//  SelfPlay.hpp
+//  Chess1
+//
+//  Plays batches of computer-against-computer games with no window, one game
+//  per thread at a time, for generating training and regression data.  Every
+//  ordinary move goes through submitMove, so the same rules the windowed game
+//  uses (pieceCanMove, movePiece, the end-of-game checks) get exercised on
+//  every game.
+//
+
+#ifndef SelfPlay_hpp
+#define SelfPlay_hpp
+
+#include <string>
+#include "Position.hpp"
+#include "GameRecord.hpp"
+
+static const int MOVER_RANDOM = 0;
+static const int MOVER_DEPTH = 1;
+static const int MOVER_MOVETIME = 2;
+
+// How one side picks its moves.  limit is the depth or the milliseconds.
+typedef struct
+{
+    int kind;
+    int limit;
+} Mover;
+
+typedef struct
+{
+    int games;
+    int threads;            // Fewer than 1 means one per core.
+    Mover movers[2];        // Indexed by colorIndex.
+    uint32_t seed;
+    bool useBook;           // Open with moves from the open book.
+    int randomPlies;        // Random moves once out of the book.
+    int maxPlies;           // Games this long are stopped and called drawn.
+    bool adjudicate;        // Stop once the registered tablebases know the result.
+} SelfPlayOptions;
+
+typedef struct
+{
+    uint64_t games;
+    uint64_t plies;
+    uint64_t whiteWins;
+    uint64_t blackWins;
+    uint64_t draws;
+    uint64_t adjudicated;   // Ended by GAME_END_TABLEBASE.
+    // Legal moves that submitMove turned down and playMove had to play.
+    uint64_t rulesMismatches;
+    double elapsedMs;
+} SelfPlayStats;
+
+// Parses "random", "depth=<n>" or "movetime=<ms>".
+bool parseMover(const std::string &text, Mover *mover);
+
+// Plays every game, appending each to output (which may be null) as soon as
+// it finishes, so records are in finishing order and carry their game
+// number.  When either mover searches, the records keep how long each move
+// took.  Game n's random moves come from seed + n, so a game can be replayed
+// from its number alone when both movers are random.
+SelfPlayStats runSelfPlay(const SelfPlayOptions &options, GameWriter *output);
+
+#endif /* SelfPlay_hpp */
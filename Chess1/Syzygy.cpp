@@ -0,0 +1,1373 @@
+//
+//  Syzygy.cpp
+//  Chess1
+//
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include "Syzygy.hpp"
+#include "MoveGen.hpp"
+#include "MappedFile.hpp"
+
+// The two kinds of file, and what they start with.
+static const int WDL = 0;
+static const int DTZ = 1;
+static const char *const EXTENSIONS[2] = { ".rtbw", ".rtbz" };
+static const uint8_t MAGICS[2][4] = {
+    { 0x71, 0xE8, 0x23, 0x5D },
+    { 0xD7, 0x66, 0x0C, 0xA5 }
+};
+
+// The compressed blocks start on 64 byte boundaries and are a multiple of
+// 64 bytes long, and a 16 byte checksum follows them.
+static const size_t BLOCK_ALIGNMENT = 64;
+static const size_t CHECKSUM_BYTES = 16;
+
+// The flags each part of a table starts with.  All but SINGLE_VALUE are
+// only used by DTZ files.
+static const int FLAG_STM = 1;              // Which side to move is stored.
+static const int FLAG_MAPPED = 2;           // Values go through a map.
+static const int FLAG_WIN_PLIES = 4;        // Wins count plies, not moves.
+static const int FLAG_LOSS_PLIES = 8;
+static const int FLAG_WIDE = 16;            // The map has 16 bit entries.
+static const int FLAG_SINGLE_VALUE = 128;   // Every position has one value.
+
+// Syzygy numbers pieces 1 to 6 as pawn, knight, bishop, rook, queen, king,
+// plus 8 for black.  Indexed by piece type.
+static const int SYZYGY_CODES[PIECE_TYPE_COUNT] = { 0, 1, 4, 2, 3, 5, 6 };
+static const int BLACK_CODE = 8;
+static const char PIECE_LETTERS[PIECE_TYPE_COUNT + 1] = " PRNBQK";
+
+// Where the DTZ map for each win/draw/loss starts, by wdl + 2.
+static const int MAP_SLOTS[5] = { 1, 3, 0, 2, 0 };
+
+// How a probe went.  A DTZ file only holds one side to move, so the other
+// side's distance comes from a search one ply deeper; and when the best
+// move is a capture or pawn move the tables hold nothing useful.
+static const int PROBE_FAIL = 0;
+static const int PROBE_OK = 1;
+static const int PROBE_CHANGE_STM = 2;
+static const int PROBE_ZEROING = 3;
+
+// One side to move of a table and, with pawns, one file of the leading pawn:
+// the order its pieces are indexed in, the groups they're indexed as, and
+// what's needed to decompress a value.
+typedef struct
+{
+    int flags;
+    int pieces[MAX_SYZYGY_PIECES];          // Syzygy codes, in index order.
+    int groupSizes[MAX_SYZYGY_PIECES + 1];  // Ends with a 0.
+    uint64_t groupFactors[MAX_SYZYGY_PIECES + 1];
+    int minSymbolBits;                      // With SINGLE_VALUE, the value.
+    uint64_t blockBytes;
+    uint64_t span;                          // Values between sparse entries.
+    uint64_t sparseCount;
+    uint64_t blockCount;
+    uint64_t blockLengthCount;
+    const uint8_t *lowestSymbols;           // 16 bits for each code length.
+    const uint8_t *pairs;                   // 24 bits for each symbol.
+    const uint8_t *sparseIndex;             // 48 bits for each entry.
+    const uint8_t *blockLengths;            // 16 bits for each block.
+    const uint8_t *blocks;
+    std::vector<uint64_t> base;             // The lowest code of each length.
+    std::vector<uint8_t> symbolLengths;     // Values a symbol stands for, less one.
+    int mapStarts[4];
+} SyzygyPart;
+
+typedef struct
+{
+    std::string path;
+    std::once_flag mapOnce;
+    MappedFile file;
+    bool usable;                            // Mapped and laid out.
+    SyzygyPart parts[2][4];                 // By side to move and file.
+    const uint8_t *map;
+} SyzygyFile;
+
+typedef struct
+{
+    std::string name;
+    uint64_t key;                           // With the name's first side white.
+    uint64_t key2;                          // And with it black.
+    int pieceCount;
+    bool hasPawns;
+    bool hasUniquePieces;                   // A lone piece besides the kings.
+    int pawnCounts[2];                      // The leading color's first.
+    bool hasDtz;
+    SyzygyFile files[2];
+} SyzygyTable;
+
+// A deque so registering a table never moves the others.
+static std::deque<SyzygyTable> tables;
+static std::unordered_map<uint64_t, SyzygyTable *> tablesByKey;
+static int largestTable = 0;
+
+// Index tables, filled in once.  Without pawns the first piece is put in
+// the a1-d1-d4 triangle (mapA1D1D4, the diagonal last) and, while pieces
+// are on the diagonal, the next one below it (mapB1H1H7).  Two kings alone
+// take one of 462 places (mapKK).  Pawns are numbered from the edges in,
+// rank by rank (mapPawns), and the highest numbered one leads.
+static int mapB1H1H7[SQUARE_COUNT];
+static int mapA1D1D4[SQUARE_COUNT];
+static int mapKK[10][SQUARE_COUNT];
+static int binomial[MAX_SYZYGY_PIECES - 1][SQUARE_COUNT];
+static int mapPawns[SQUARE_COUNT];
+static int leadPawnIndex[MAX_SYZYGY_PIECES - 1][SQUARE_COUNT];
+static int leadPawnsSize[MAX_SYZYGY_PIECES - 1][4];
+static std::once_flag indexTablesOnce;
+
+static void initIndexTables();
+static bool hasExtension(const std::string &name, const char *extension);
+static bool parseMaterial(const std::string &name, SyzygyTable *table);
+static uint64_t materialKey(const int counts[2][PIECE_TYPE_COUNT]);
+static uint64_t positionKey(const Position *position);
+static SyzygyTable *findTable(const Position *position);
+static bool mapTableFile(SyzygyTable *table, int type);
+static bool readLayout(SyzygyTable *table, int type);
+static SyzygyPart *tablePart(SyzygyTable *table, int type, int side, int file);
+static void setGroups(const SyzygyTable *table, SyzygyPart *part, const int order[2], int file);
+static const uint8_t *setSizes(SyzygyPart *part, const uint8_t *data);
+static int setSymbolLength(SyzygyPart *part, int symbol, std::vector<bool> *visited);
+static const uint8_t *setDtzMap(SyzygyTable *table, const uint8_t *start, const uint8_t *data);
+static const uint8_t *alignData(const uint8_t *start, const uint8_t *data, size_t alignment);
+static int decompress(const SyzygyPart *part, uint64_t index);
+static int probeTable(const Position *position, int type, int wdl, int *state);
+static int searchCaptures(const Position *position, bool pawnMoves, int *state);
+static int probeDtz(const Position *position, int *state);
+static int dtzBeforeZeroing(int wdl);
+static bool isZeroing(const Position *position, Move move);
+static int offDiagonal(int square);
+static bool comparePawns(int first, int second);
+static int pairLeft(const uint8_t *pair);
+static int pairRight(const uint8_t *pair);
+static uint64_t readLittle(const uint8_t *data, int bytes);
+static uint64_t readBig(const uint8_t *data, int bytes);
+static int signOf(int value);
+
+int setSyzygyPath(const char *directory)
+{
+    std::call_once(indexTablesOnce, initIndexTables);
+    
+    for (size_t tableIndex = 0; tableIndex < tables.size(); tableIndex++)
+    {
+        for (int type = WDL; type <= DTZ; type++)
+        {
+            unmapFile(&tables[tableIndex].files[type].file);
+        }
+    }
+    
+    tables.clear();
+    tablesByKey.clear();
+    largestTable = 0;
+    
+    DIR *listing = opendir(directory);
+    
+    if (listing == nullptr)
+    {
+        return -1;
+    }
+    
+    std::set<std::string> names[2];
+    
+    while (struct dirent *entry = readdir(listing))
+    {
+        std::string name = entry->d_name;
+        
+        for (int type = WDL; type <= DTZ; type++)
+        {
+            if (hasExtension(name, EXTENSIONS[type]))
+            {
+                names[type].insert(name.substr(0, name.size() - strlen(EXTENSIONS[type])));
+            }
+        }
+    }
+    
+    closedir(listing);
+    
+    for (const std::string &name : names[WDL])
+    {
+        tables.emplace_back();
+        SyzygyTable *table = &tables.back();
+        
+        if (!parseMaterial(name, table) || tablesByKey.count(table->key) != 0)
+        {
+            tables.pop_back();
+            continue;
+        }
+        
+        table->hasDtz = names[DTZ].count(name) != 0;
+        
+        for (int type = WDL; type <= DTZ; type++)
+        {
+            table->files[type].path = std::string(directory) + "/" + name + EXTENSIONS[type];
+            table->files[type].file.data = nullptr;
+            table->files[type].file.size = 0;
+            table->files[type].usable = false;
+            table->files[type].map = nullptr;
+        }
+        
+        tablesByKey[table->key] = table;
+        tablesByKey[table->key2] = table;
+        largestTable = std::max(largestTable, table->pieceCount);
+    }
+    
+    return (int)tables.size();
+}
+
+int syzygyPieces()
+{
+    return largestTable;
+}
+
+bool probeSyzygyWdl(const Position *position, int *wdl)
+{
+    if (largestTable == 0 ||
+        position->castlingRights != 0 ||
+        popCount(position->occupied) > largestTable)
+    {
+        return false;
+    }
+    
+    int state = PROBE_OK;
+    *wdl = searchCaptures(position, false, &state);
+    
+    return state != PROBE_FAIL;
+}
+
+bool probeSyzygyDtz(const Position *position, int *dtz)
+{
+    if (largestTable == 0 ||
+        position->castlingRights != 0 ||
+        popCount(position->occupied) > largestTable)
+    {
+        return false;
+    }
+    
+    int state = PROBE_OK;
+    *dtz = probeDtz(position, &state);
+    
+    return state != PROBE_FAIL;
+}
+
+static void initIndexTables()
+{
+    int code = 0;
+    
+    for (int square = 0; square < SQUARE_COUNT; square++)
+    {
+        if (offDiagonal(square) < 0)
+        {
+            mapB1H1H7[square] = code++;
+        }
+    }
+    
+    // b1 to d3 below the diagonal come first, then a1 to d4 on it.
+    std::vector<int> diagonal;
+    code = 0;
+    
+    for (int square = 0; square < 32; square++)
+    {
+        if ((square & 7) > 3)
+        {
+            continue;
+        }
+        
+        if (offDiagonal(square) < 0)
+        {
+            mapA1D1D4[square] = code++;
+        }
+        else if (offDiagonal(square) == 0)
+        {
+            diagonal.push_back(square);
+        }
+    }
+    
+    for (int square : diagonal)
+    {
+        mapA1D1D4[square] = code++;
+    }
+    
+    // The second king can't touch the first, and when the first is on the
+    // diagonal it goes below it.  Both on the diagonal come last.
+    std::vector<std::pair<int, int> > bothOnDiagonal;
+    code = 0;
+    
+    for (int slot = 0; slot < 10; slot++)
+    {
+        for (int first = 0; first < 32; first++)
+        {
+            if ((first & 7) > 3 || mapA1D1D4[first] != slot || (slot == 0 && first != 1))
+            {
+                continue;
+            }
+            
+            for (int second = 0; second < SQUARE_COUNT; second++)
+            {
+                if ((KING_ATTACKS[first] | squareBit(first)) & squareBit(second))
+                {
+                    continue;
+                }
+                
+                if (offDiagonal(first) == 0 && offDiagonal(second) > 0)
+                {
+                    continue;
+                }
+                
+                if (offDiagonal(first) == 0 && offDiagonal(second) == 0)
+                {
+                    bothOnDiagonal.push_back(std::make_pair(slot, second));
+                }
+                else
+                {
+                    mapKK[slot][second] = code++;
+                }
+            }
+        }
+    }
+    
+    for (const std::pair<int, int> &kings : bothOnDiagonal)
+    {
+        mapKK[kings.first][kings.second] = code++;
+    }
+    
+    binomial[0][0] = 1;
+    
+    for (int squares = 1; squares < SQUARE_COUNT; squares++)
+    {
+        for (int pieces = 0; pieces < MAX_SYZYGY_PIECES - 1 && pieces <= squares; pieces++)
+        {
+            binomial[pieces][squares] = (pieces > 0 ? binomial[pieces - 1][squares - 1] : 0) +
+                                        (pieces < squares ? binomial[pieces][squares - 1] : 0);
+        }
+    }
+    
+    // With the leading pawn on a square, the others can't be nearer the edge
+    // or lower on its file: 47 squares are left with it on a2, two fewer for
+    // each rank it goes up.
+    int available = 47;
+    
+    for (int leadPawns = 1; leadPawns < MAX_SYZYGY_PIECES - 1; leadPawns++)
+    {
+        for (int file = 0; file < 4; file++)
+        {
+            int index = 0;
+            
+            for (int rank = 1; rank < 7; rank++)
+            {
+                int square = rank * 8 + file;
+                
+                if (leadPawns == 1)
+                {
+                    mapPawns[square] = available--;
+                    mapPawns[square ^ 7] = available--;
+                }
+                
+                leadPawnIndex[leadPawns][square] = index;
+                index += binomial[leadPawns - 1][mapPawns[square]];
+            }
+            
+            leadPawnsSize[leadPawns][file] = index;
+        }
+    }
+}
+
+static bool hasExtension(const std::string &name, const char *extension)
+{
+    size_t length = strlen(extension);
+    
+    return name.size() > length && name.compare(name.size() - length, length, extension) == 0;
+}
+
+// A name such as "KRPvKR": a king and the pieces of each side.
+static bool parseMaterial(const std::string &name, SyzygyTable *table)
+{
+    int counts[2][PIECE_TYPE_COUNT] = { { 0 } };
+    int side = 0;
+    
+    table->name = name;
+    table->pieceCount = 0;
+    
+    for (size_t letter = 0; letter < name.size(); letter++)
+    {
+        if (name[letter] == 'v' && side == 0)
+        {
+            side = 1;
+            continue;
+        }
+        
+        const char *found = strchr(PIECE_LETTERS + 1, name[letter]);
+        
+        if (found == nullptr || name[letter] == '\0')
+        {
+            return false;
+        }
+        
+        counts[side][found - PIECE_LETTERS]++;
+        table->pieceCount++;
+    }
+    
+    if (side == 0 ||
+        counts[0][PIECE_KING] != 1 ||
+        counts[1][PIECE_KING] != 1 ||
+        table->pieceCount > MAX_SYZYGY_PIECES)
+    {
+        return false;
+    }
+    
+    int swapped[2][PIECE_TYPE_COUNT];
+    
+    table->hasUniquePieces = false;
+    
+    for (int type = 0; type < PIECE_TYPE_COUNT; type++)
+    {
+        swapped[0][type] = counts[1][type];
+        swapped[1][type] = counts[0][type];
+        
+        if (type != PIECE_KING && (counts[0][type] == 1 || counts[1][type] == 1))
+        {
+            table->hasUniquePieces = true;
+        }
+    }
+    
+    table->key = materialKey(counts);
+    table->key2 = materialKey(swapped);
+    
+    // With pawns on both sides the side with fewer leads, which compresses
+    // better; ties go to white.
+    int whitePawns = counts[0][PIECE_PAWN];
+    int blackPawns = counts[1][PIECE_PAWN];
+    bool whiteLeads = blackPawns == 0 || (whitePawns != 0 && blackPawns >= whitePawns);
+    
+    table->hasPawns = whitePawns + blackPawns > 0;
+    table->pawnCounts[0] = whiteLeads ? whitePawns : blackPawns;
+    table->pawnCounts[1] = whiteLeads ? blackPawns : whitePawns;
+    
+    return true;
+}
+
+// Four bits for each count of a color's pawns, rooks, knights, bishops and
+// queens, white's first.
+static uint64_t materialKey(const int counts[2][PIECE_TYPE_COUNT])
+{
+    uint64_t key = 0;
+    
+    for (int side = 0; side < 2; side++)
+    {
+        for (int type = PIECE_PAWN; type < PIECE_KING; type++)
+        {
+            key |= (uint64_t)counts[side][type] << (4 * (side * 5 + type - 1));
+        }
+    }
+    
+    return key;
+}
+
+static uint64_t positionKey(const Position *position)
+{
+    int counts[2][PIECE_TYPE_COUNT];
+    
+    for (int type = 0; type < PIECE_TYPE_COUNT; type++)
+    {
+        counts[0][type] = popCount(piecesOf(position, COLOR_WHITE, type));
+        counts[1][type] = popCount(piecesOf(position, COLOR_BLACK, type));
+    }
+    
+    return materialKey(counts);
+}
+
+static SyzygyTable *findTable(const Position *position)
+{
+    std::unordered_map<uint64_t, SyzygyTable *>::const_iterator found =
+        tablesByKey.find(positionKey(position));
+        
+    return (found == tablesByKey.end()) ? nullptr : found->second;
+}
+
+// Runs once per file, on whichever thread probes it first.
+static bool mapTableFile(SyzygyTable *table, int type)
+{
+    SyzygyFile *file = &table->files[type];
+    
+    if (type == DTZ && !table->hasDtz)
+    {
+        return false;
+    }
+    
+    std::call_once(file->mapOnce, [table, type, file]() {
+        if (!mapFile(file->path.c_str(), &file->file))
+        {
+            return;
+        }
+        
+        file->usable = readLayout(table, type);
+        
+        if (!file->usable)
+        {
+            unmapFile(&file->file);
+            return;
+        }
+        
+        adviseRandom(&file->file);
+    });
+    
+    return file->usable;
+}
+
+// After the magic and a flags byte, each file's (or the one) piece order,
+// then every part's sizes and symbol tables, the DTZ maps, every part's
+// sparse index, every part's block lengths and last the blocks.
+static bool readLayout(SyzygyTable *table, int type)
+{
+    const uint8_t *start = (const uint8_t *)table->files[type].file.data;
+    size_t size = table->files[type].file.size;
+    
+    if (size % BLOCK_ALIGNMENT != CHECKSUM_BYTES || memcmp(start, MAGICS[type], 4) != 0)
+    {
+        return false;
+    }
+    
+    int sides = (type == WDL && table->key != table->key2) ? 2 : 1;
+    int files = table->hasPawns ? 4 : 1;
+    bool bothPawns = table->hasPawns && table->pawnCounts[1] > 0;
+    const uint8_t *data = start + 5;
+    
+    for (int file = 0; file < files; file++)
+    {
+        // Which group is indexed where: the leading one, then the other
+        // side's pawns if there are any.  A nibble for each side to move.
+        int orders[2][2] = {
+            { data[0] & 0xF, bothPawns ? data[1] & 0xF : 0xF },
+            { data[0] >> 4, bothPawns ? data[1] >> 4 : 0xF }
+        };
+        
+        data += bothPawns ? 2 : 1;
+        
+        for (int piece = 0; piece < table->pieceCount; piece++, data++)
+        {
+            for (int side = 0; side < sides; side++)
+            {
+                tablePart(table, type, side, file)->pieces[piece] = side ? (*data >> 4) : (*data & 0xF);
+            }
+        }
+        
+        for (int side = 0; side < sides; side++)
+        {
+            setGroups(table, tablePart(table, type, side, file), orders[side], file);
+        }
+    }
+    
+    data = alignData(start, data, 2);
+    
+    for (int file = 0; file < files && data != nullptr; file++)
+    {
+        for (int side = 0; side < sides && data != nullptr; side++)
+        {
+            data = setSizes(tablePart(table, type, side, file), data);
+        }
+    }
+    
+    if (data == nullptr)
+    {
+        return false;
+    }
+    
+    if (type == DTZ)
+    {
+        data = setDtzMap(table, start, data);
+    }
+    
+    for (int file = 0; file < files; file++)
+    {
+        for (int side = 0; side < sides; side++)
+        {
+            SyzygyPart *part = tablePart(table, type, side, file);
+            part->sparseIndex = data;
+            data += part->sparseCount * 6;
+        }
+    }
+    
+    for (int file = 0; file < files; file++)
+    {
+        for (int side = 0; side < sides; side++)
+        {
+            SyzygyPart *part = tablePart(table, type, side, file);
+            part->blockLengths = data;
+            data += part->blockLengthCount * 2;
+        }
+    }
+    
+    for (int file = 0; file < files; file++)
+    {
+        for (int side = 0; side < sides; side++)
+        {
+            SyzygyPart *part = tablePart(table, type, side, file);
+            data = alignData(start, data, BLOCK_ALIGNMENT);
+            part->blocks = data;
+            data += part->blockCount * part->blockBytes;
+        }
+    }
+    
+    return (size_t)(data - start) + CHECKSUM_BYTES <= size;
+}
+
+// A DTZ file and a WDL file of equal material on both sides only have one
+// side to move.
+static SyzygyPart *tablePart(SyzygyTable *table, int type, int side, int file)
+{
+    int sides = (type == WDL && table->key != table->key2) ? 2 : 1;
+    
+    return &table->files[type].parts[side % sides][table->hasPawns ? file : 0];
+}
+
+// Splits the pieces into groups and works out what each group's index is
+// multiplied by.  The leading group is three lone pieces, the two kings or
+// the leading pawns; after that, identical pieces make a group.
+static void setGroups(const SyzygyTable *table, SyzygyPart *part, const int order[2], int file)
+{
+    int groups = 0;
+    int leadingLeft = table->hasPawns ? 0 : (table->hasUniquePieces ? 3 : 2);
+    
+    part->groupSizes[0] = 1;
+    
+    for (int piece = 1; piece < table->pieceCount; piece++)
+    {
+        if (--leadingLeft > 0 || part->pieces[piece] == part->pieces[piece - 1])
+        {
+            part->groupSizes[groups]++;
+        }
+        else
+        {
+            part->groupSizes[++groups] = 1;
+        }
+    }
+    
+    part->groupSizes[++groups] = 0;
+    
+    bool bothPawns = table->hasPawns && table->pawnCounts[1] > 0;
+    int next = bothPawns ? 2 : 1;
+    int freeSquares = SQUARE_COUNT - part->groupSizes[0] - (bothPawns ? part->groupSizes[1] : 0);
+    uint64_t factor = 1;
+    
+    for (int slot = 0; next < groups || slot == order[0] || slot == order[1]; slot++)
+    {
+        if (slot == order[0])
+        {
+            part->groupFactors[0] = factor;
+            factor *= table->hasPawns ? leadPawnsSize[part->groupSizes[0]][file] :
+                      table->hasUniquePieces ? 31332 : 462;
+        }
+        else if (slot == order[1])
+        {
+            part->groupFactors[1] = factor;
+            factor *= binomial[part->groupSizes[1]][48 - part->groupSizes[0]];
+        }
+        else
+        {
+            part->groupFactors[next] = factor;
+            factor *= binomial[part->groupSizes[next]][freeSquares];
+            freeSquares -= part->groupSizes[next++];
+        }
+    }
+    
+    part->groupFactors[groups] = factor;
+}
+
+// Values are canonical Huffman codes, longest codes lowest, for symbols
+// that each stand for one value or, by recursive pairing, for a pair of
+// other symbols.  Returns null if the sizes make no sense.
+static const uint8_t *setSizes(SyzygyPart *part, const uint8_t *data)
+{
+    part->flags = *data++;
+    
+    if (part->flags & FLAG_SINGLE_VALUE)
+    {
+        part->blockCount = 0;
+        part->blockLengthCount = 0;
+        part->span = 0;
+        part->sparseCount = 0;
+        part->minSymbolBits = *data++;
+        return data;
+    }
+    
+    int groups = 0;
+    
+    while (part->groupSizes[groups] != 0)
+    {
+        groups++;
+    }
+    
+    uint64_t tableSize = part->groupFactors[groups];
+    
+    part->blockBytes = (uint64_t)1 << data[0];
+    part->span = (uint64_t)1 << data[1];
+    part->sparseCount = (tableSize + part->span - 1) / part->span;
+    part->blockCount = readLittle(data + 3, 4);
+    part->blockLengthCount = part->blockCount + data[2];
+    
+    int maxSymbolBits = data[7];
+    part->minSymbolBits = data[8];
+    data += 9;
+    
+    if (part->minSymbolBits == 0 || maxSymbolBits < part->minSymbolBits || maxSymbolBits > 64)
+    {
+        return nullptr;
+    }
+    
+    // base[length] is the lowest code of that many bits more than the
+    // shortest, shifted up to the top of 64 bits.
+    part->lowestSymbols = data;
+    part->base.assign(maxSymbolBits - part->minSymbolBits + 1, 0);
+    
+    for (int length = (int)part->base.size() - 2; length >= 0; length--)
+    {
+        part->base[length] = (part->base[length + 1] +
+                              readLittle(part->lowestSymbols + 2 * length, 2) -
+                              readLittle(part->lowestSymbols + 2 * (length + 1), 2)) / 2;
+    }
+    
+    for (size_t length = 0; length < part->base.size(); length++)
+    {
+        part->base[length] <<= 64 - length - part->minSymbolBits;
+    }
+    
+    data += part->base.size() * 2;
+    part->symbolLengths.assign(readLittle(data, 2), 0);
+    data += 2;
+    part->pairs = data;
+    
+    std::vector<bool> visited(part->symbolLengths.size());
+    
+    for (size_t symbol = 0; symbol < part->symbolLengths.size(); symbol++)
+    {
+        if (!visited[symbol])
+        {
+            part->symbolLengths[symbol] = setSymbolLength(part, (int)symbol, &visited);
+        }
+    }
+    
+    return data + part->symbolLengths.size() * 3 + (part->symbolLengths.size() & 1);
+}
+
+// A symbol whose right half is 0xFFF is a value, the left half; any other
+// stands for its left symbol's values followed by its right symbol's.
+static int setSymbolLength(SyzygyPart *part, int symbol, std::vector<bool> *visited)
+{
+    (*visited)[symbol] = true;
+    
+    const uint8_t *pair = part->pairs + 3 * symbol;
+    int right = pairRight(pair);
+    int left = pairLeft(pair);
+    int count = (int)part->symbolLengths.size();
+    
+    if (right == 0xFFF || left >= count || right >= count)
+    {
+        return 0;
+    }
+    
+    if (!(*visited)[left])
+    {
+        part->symbolLengths[left] = setSymbolLength(part, left, visited);
+    }
+    
+    if (!(*visited)[right])
+    {
+        part->symbolLengths[right] = setSymbolLength(part, right, visited);
+    }
+    
+    return part->symbolLengths[left] + part->symbolLengths[right] + 1;
+}
+
+// Mapped DTZ parts turn a stored value into a distance through one of four
+// lists, for wins, losses, cursed wins and blessed losses.
+static const uint8_t *setDtzMap(SyzygyTable *table, const uint8_t *start, const uint8_t *data)
+{
+    SyzygyFile *file = &table->files[DTZ];
+    int files = table->hasPawns ? 4 : 1;
+    
+    file->map = data;
+    
+    for (int fileIndex = 0; fileIndex < files; fileIndex++)
+    {
+        SyzygyPart *part = tablePart(table, DTZ, 0, fileIndex);
+        
+        if (!(part->flags & FLAG_MAPPED))
+        {
+            continue;
+        }
+        
+        if (part->flags & FLAG_WIDE)
+        {
+            data = alignData(start, data, 2);
+            
+            for (int slot = 0; slot < 4; slot++)
+            {
+                part->mapStarts[slot] = (int)((data - file->map) / 2) + 1;
+                data += 2 * readLittle(data, 2) + 2;
+            }
+        }
+        else
+        {
+            for (int slot = 0; slot < 4; slot++)
+            {
+                part->mapStarts[slot] = (int)(data - file->map) + 1;
+                data += *data + 1;
+            }
+        }
+    }
+    
+    return alignData(start, data, 2);
+}
+
+static const uint8_t *alignData(const uint8_t *start, const uint8_t *data, size_t alignment)
+{
+    size_t offset = (size_t)(data - start);
+    
+    return start + (offset + alignment - 1) / alignment * alignment;
+}
+
+// The sparse index gives the block and offset of every span'th value; the
+// block lengths take it from there to the block holding index, which is
+// then decoded a symbol at a time up to it.
+static int decompress(const SyzygyPart *part, uint64_t index)
+{
+    if (part->flags & FLAG_SINGLE_VALUE)
+    {
+        return part->minSymbolBits;
+    }
+    
+    const uint8_t *entry = part->sparseIndex + 6 * (index / part->span);
+    uint64_t block = readLittle(entry, 4);
+    int offset = (int)readLittle(entry + 4, 2) + (int)(index % part->span) - (int)(part->span / 2);
+    
+    while (offset < 0)
+    {
+        offset += (int)readLittle(part->blockLengths + 2 * --block, 2) + 1;
+    }
+    
+    while (offset > (int)readLittle(part->blockLengths + 2 * block, 2))
+    {
+        offset -= (int)readLittle(part->blockLengths + 2 * block++, 2) + 1;
+    }
+    
+    const uint8_t *bits = part->blocks + block * part->blockBytes;
+    uint64_t buffer = readBig(bits, 8);
+    int bufferBits = 64;
+    int symbol;
+    
+    bits += 8;
+    
+    while (true)
+    {
+        int length = 0;
+        
+        while (buffer < part->base[length])
+        {
+            length++;
+        }
+        
+        symbol = (int)((buffer - part->base[length]) >> (64 - length - part->minSymbolBits)) +
+                 (int)readLittle(part->lowestSymbols + 2 * length, 2);
+        
+        if (offset < part->symbolLengths[symbol] + 1)
+        {
+            break;
+        }
+        
+        offset -= part->symbolLengths[symbol] + 1;
+        length += part->minSymbolBits;
+        buffer <<= length;
+        bufferBits -= length;
+        
+        if (bufferBits <= 32)
+        {
+            bufferBits += 32;
+            buffer |= readBig(bits, 4) << (64 - bufferBits);
+            bits += 4;
+        }
+    }
+    
+    // Down the pairs to the one value offset lands on.
+    while (part->symbolLengths[symbol] != 0)
+    {
+        const uint8_t *pair = part->pairs + 3 * symbol;
+        int left = pairLeft(pair);
+        
+        if (offset < part->symbolLengths[left] + 1)
+        {
+            symbol = left;
+        }
+        else
+        {
+            offset -= part->symbolLengths[left] + 1;
+            symbol = pairRight(pair);
+        }
+    }
+    
+    return pairLeft(part->pairs + 3 * symbol);
+}
+
+// The value type's file holds for position, as a wdl or, for DTZ, a
+// distance in plies.  Tables are made with the stronger side white, so a
+// position the other way round is looked up with the colors swapped and
+// the board turned over; then it's reflected to put the leading piece
+// where the table's index expects it.
+static int probeTable(const Position *position, int type, int wdl, int *state)
+{
+    if (popCount(position->occupied) == 2)
+    {
+        return SYZYGY_DRAW;
+    }
+    
+    SyzygyTable *table = findTable(position);
+    
+    if (table == nullptr || !mapTableFile(table, type))
+    {
+        *state = PROBE_FAIL;
+        return 0;
+    }
+    
+    int squares[MAX_SYZYGY_PIECES];
+    int pieces[MAX_SYZYGY_PIECES];
+    int count = 0;
+    int leadPawnCount = 0;
+    int file = 0;
+    Bitboard leadPawns = 0;
+    bool blackToMove = position->sideToMove == COLOR_BLACK;
+    bool flip = (table->key == table->key2 && blackToMove) || positionKey(position) != table->key;
+    int flipColor = flip ? BLACK_CODE : 0;
+    int flipSquares = flip ? 56 : 0;
+    int side = flip != blackToMove;
+    
+    // The leading pawns are in every part in the same color.
+    if (table->hasPawns)
+    {
+        int leadColor = ((tablePart(table, type, 0, 0)->pieces[0] ^ flipColor) & BLACK_CODE) ?
+                        COLOR_BLACK : COLOR_WHITE;
+        Bitboard pawns = leadPawns = piecesOf(position, leadColor, PIECE_PAWN);
+        
+        while (pawns != 0)
+        {
+            squares[count++] = popLowestSquare(&pawns) ^ flipSquares;
+        }
+        
+        leadPawnCount = count;
+        std::swap(squares[0], *std::max_element(squares, squares + leadPawnCount, comparePawns));
+        file = std::min(squares[0] & 7, 7 - (squares[0] & 7));
+    }
+    
+    SyzygyPart *part = tablePart(table, type, side, file);
+    
+    if (type == DTZ &&
+        (part->flags & FLAG_STM) != side &&
+        !(table->key == table->key2 && !table->hasPawns))
+    {
+        *state = PROBE_CHANGE_STM;
+        return 0;
+    }
+    
+    Bitboard others = position->occupied ^ leadPawns;
+    
+    while (others != 0)
+    {
+        int square = popLowestSquare(&others);
+        int id = position->board[square];
+        
+        squares[count] = square ^ flipSquares;
+        pieces[count++] = (SYZYGY_CODES[abs(id)] | ((id > 0) ? BLACK_CODE : 0)) ^ flipColor;
+    }
+    
+    // Into the part's piece order.
+    for (int piece = leadPawnCount; piece < count - 1; piece++)
+    {
+        for (int other = piece + 1; other < count; other++)
+        {
+            if (part->pieces[piece] == pieces[other])
+            {
+                std::swap(pieces[piece], pieces[other]);
+                std::swap(squares[piece], squares[other]);
+                break;
+            }
+        }
+    }
+    
+    if ((squares[0] & 7) > 3)
+    {
+        for (int piece = 0; piece < count; piece++)
+        {
+            squares[piece] ^= 7;
+        }
+    }
+    
+    uint64_t index;
+    
+    if (table->hasPawns)
+    {
+        index = leadPawnIndex[leadPawnCount][squares[0]];
+        std::stable_sort(squares + 1, squares + leadPawnCount, comparePawns);
+        
+        for (int piece = 1; piece < leadPawnCount; piece++)
+        {
+            index += binomial[piece][mapPawns[squares[piece]]];
+        }
+    }
+    else
+    {
+        if ((squares[0] >> 3) > 3)
+        {
+            for (int piece = 0; piece < count; piece++)
+            {
+                squares[piece] ^= 56;
+            }
+        }
+        
+        // The first of the leading group off the a1-h8 diagonal goes below
+        // it.
+        for (int piece = 0; piece < part->groupSizes[0]; piece++)
+        {
+            if (offDiagonal(squares[piece]) == 0)
+            {
+                continue;
+            }
+            
+            if (offDiagonal(squares[piece]) > 0)
+            {
+                for (int other = piece; other < count; other++)
+                {
+                    squares[other] = ((squares[other] >> 3) | (squares[other] << 3)) & 63;
+                }
+            }
+            
+            break;
+        }
+        
+        if (table->hasUniquePieces)
+        {
+            int adjust1 = squares[1] > squares[0];
+            int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+            
+            if (offDiagonal(squares[0]) != 0)
+            {
+                index = ((uint64_t)mapA1D1D4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 +
+                        squares[2] - adjust2;
+            }
+            else if (offDiagonal(squares[1]) != 0)
+            {
+                index = (6 * 63 + (uint64_t)(squares[0] >> 3) * 28 + mapB1H1H7[squares[1]]) * 62 +
+                        squares[2] - adjust2;
+            }
+            else if (offDiagonal(squares[2]) != 0)
+            {
+                index = 6 * 63 * 62 + 4 * 28 * 62 +
+                        (squares[0] >> 3) * 7 * 28 +
+                        ((squares[1] >> 3) - adjust1) * 28 +
+                        mapB1H1H7[squares[2]];
+            }
+            else
+            {
+                index = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 +
+                        (squares[0] >> 3) * 7 * 6 +
+                        ((squares[1] >> 3) - adjust1) * 6 +
+                        ((squares[2] >> 3) - adjust2);
+            }
+        }
+        else
+        {
+            index = mapKK[mapA1D1D4[squares[0]]][squares[1]];
+        }
+    }
+    
+    index *= part->groupFactors[0];
+    
+    // Each further group's squares in order, each counted down for the
+    // earlier groups' squares below it, and the other side's pawns down a
+    // rank as well.
+    int *groupSquares = squares + part->groupSizes[0];
+    bool remainingPawns = table->hasPawns && table->pawnCounts[1] > 0;
+    
+    for (int group = 1; part->groupSizes[group] != 0; group++)
+    {
+        std::stable_sort(groupSquares, groupSquares + part->groupSizes[group]);
+        uint64_t groupIndex = 0;
+        
+        for (int piece = 0; piece < part->groupSizes[group]; piece++)
+        {
+            int below = 0;
+            
+            for (int *earlier = squares; earlier < groupSquares; earlier++)
+            {
+                below += groupSquares[piece] > *earlier;
+            }
+            
+            groupIndex += binomial[piece + 1][groupSquares[piece] - below - 8 * remainingPawns];
+        }
+        
+        remainingPawns = false;
+        index += groupIndex * part->groupFactors[group];
+        groupSquares += part->groupSizes[group];
+    }
+    
+    int value = decompress(part, index);
+    
+    if (type == WDL)
+    {
+        return value - 2;
+    }
+    
+    if (part->flags & FLAG_MAPPED)
+    {
+        const uint8_t *map = table->files[DTZ].map;
+        int start = part->mapStarts[MAP_SLOTS[wdl + 2]];
+        
+        value = (part->flags & FLAG_WIDE) ? (int)readLittle(map + 2 * (start + value), 2) :
+                map[start + value];
+    }
+    
+    // Distances are stored in moves unless the flags say plies, and cursed
+    // and blessed ones always are.
+    if ((wdl == SYZYGY_WIN && !(part->flags & FLAG_WIN_PLIES)) ||
+        (wdl == SYZYGY_LOSS && !(part->flags & FLAG_LOSS_PLIES)) ||
+        wdl == SYZYGY_CURSED_WIN ||
+        wdl == SYZYGY_BLESSED_LOSS)
+    {
+        value *= 2;
+    }
+    
+    return value + 1;
+}
+
+// The WDL value, trying every capture (and with pawnMoves every pawn move)
+// first: the table's value can't be trusted where one of them is best, nor
+// with an en passant capture possible, which tables don't record.  Sets
+// state to PROBE_ZEROING when one of those moves is the best.
+static int searchCaptures(const Position *position, bool pawnMoves, int *state)
+{
+    MoveList list;
+    generateLegalMoves(position, &list);
+    
+    int best = SYZYGY_LOSS;
+    int tried = 0;
+    
+    for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+    {
+        Move move = list.moves[moveIndex];
+        bool capture = position->board[moveTo(move)] != 0 || moveType(move) == MOVE_EN_PASSANT;
+        
+        if (!capture && !(pawnMoves && abs(position->board[moveFrom(move)]) == PIECE_PAWN))
+        {
+            continue;
+        }
+        
+        tried++;
+        
+        Position next = *position;
+        applyMove(&next, move);
+        
+        int value = -searchCaptures(&next, false, state);
+        
+        if (*state == PROBE_FAIL)
+        {
+            return SYZYGY_DRAW;
+        }
+        
+        if (value > best)
+        {
+            best = value;
+            
+            if (value >= SYZYGY_WIN)
+            {
+                *state = PROBE_ZEROING;
+                return value;
+            }
+        }
+    }
+    
+    // When those were all the moves there is nothing left to look up.
+    bool noMoreMoves = tried > 0 && tried == list.count;
+    int value = best;
+    
+    if (!noMoreMoves)
+    {
+        value = probeTable(position, WDL, SYZYGY_DRAW, state);
+        
+        if (*state == PROBE_FAIL)
+        {
+            return SYZYGY_DRAW;
+        }
+    }
+    
+    if (best >= value)
+    {
+        *state = (best > SYZYGY_DRAW || noMoreMoves) ? PROBE_ZEROING : PROBE_OK;
+        return best;
+    }
+    
+    *state = PROBE_OK;
+    
+    return value;
+}
+
+// When the DTZ file holds the other side to move, the distance is the best
+// of the moves' distances one ply on.
+static int probeDtz(const Position *position, int *state)
+{
+    *state = PROBE_OK;
+    
+    int wdl = searchCaptures(position, true, state);
+    
+    if (*state == PROBE_FAIL || wdl == SYZYGY_DRAW)
+    {
+        return 0;
+    }
+    
+    if (*state == PROBE_ZEROING)
+    {
+        return dtzBeforeZeroing(wdl);
+    }
+    
+    int dtz = probeTable(position, DTZ, wdl, state);
+    
+    if (*state == PROBE_FAIL)
+    {
+        return 0;
+    }
+    
+    if (*state != PROBE_CHANGE_STM)
+    {
+        bool pastFifty = wdl == SYZYGY_CURSED_WIN || wdl == SYZYGY_BLESSED_LOSS;
+        return (dtz + (pastFifty ? 100 : 0)) * signOf(wdl);
+    }
+    
+    MoveList list;
+    generateLegalMoves(position, &list);
+    
+    int best = 0xFFFF;
+    
+    for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+    {
+        Move move = list.moves[moveIndex];
+        bool zeroing = isZeroing(position, move);
+        Position next = *position;
+        applyMove(&next, move);
+        
+        // A capture or pawn move's distance is the one before it; anything
+        // else is one more than the distance after it.
+        dtz = zeroing ? -dtzBeforeZeroing(searchCaptures(&next, false, state)) :
+              -probeDtz(&next, state);
+        
+        if (dtz == 1 && isInCheck(&next, next.sideToMove))
+        {
+            MoveList replies;
+            generateLegalMoves(&next, &replies);
+            
+            if (replies.count == 0)
+            {
+                best = 1;
+            }
+        }
+        
+        if (!zeroing)
+        {
+            dtz += signOf(dtz);
+        }
+        
+        if (dtz < best && signOf(dtz) == signOf(wdl))
+        {
+            best = dtz;
+        }
+        
+        if (*state == PROBE_FAIL)
+        {
+            return 0;
+        }
+    }
+    
+    // No moves: mated.
+    return (best == 0xFFFF) ? -1 : best;
+}
+
+static int dtzBeforeZeroing(int wdl)
+{
+    switch (wdl)
+    {
+        case SYZYGY_WIN:
+            return 1;
+            
+        case SYZYGY_CURSED_WIN:
+            return 101;
+            
+        case SYZYGY_BLESSED_LOSS:
+            return -101;
+            
+        case SYZYGY_LOSS:
+            return -1;
+            
+        default:
+            return 0;
+    }
+}
+
+static bool isZeroing(const Position *position, Move move)
+{
+    return position->board[moveTo(move)] != 0 ||
+           moveType(move) == MOVE_EN_PASSANT ||
+           abs(position->board[moveFrom(move)]) == PIECE_PAWN;
+}
+
+// Positive above the a1-h8 diagonal, negative below it.
+static int offDiagonal(int square)
+{
+    return (square >> 3) - (square & 7);
+}
+
+static bool comparePawns(int first, int second)
+{
+    return mapPawns[first] < mapPawns[second];
+}
+
+// Twelve bits each, packed into three bytes.
+static int pairLeft(const uint8_t *pair)
+{
+    return ((pair[1] & 0xF) << 8) | pair[0];
+}
+
+static int pairRight(const uint8_t *pair)
+{
+    return (pair[2] << 4) | (pair[1] >> 4);
+}
+
+static uint64_t readLittle(const uint8_t *data, int bytes)
+{
+    uint64_t value = 0;
+    
+    for (int byte = bytes - 1; byte >= 0; byte--)
+    {
+        value = (value << 8) | data[byte];
+    }
+    
+    return value;
+}
+
+static uint64_t readBig(const uint8_t *data, int bytes)
+{
+    uint64_t value = 0;
+    
+    for (int byte = 0; byte < bytes; byte++)
+    {
+        value = (value << 8) | data[byte];
+    }
+    
+    return value;
+}
+
+static int signOf(int value)
+{
+    return (value > 0) - (value < 0);
+}
@@ -0,0 +1,56 @@
+//
+//  Syzygy.hpp
+//  Chess1
+//
+//  Probing of Syzygy endgame tables, the compressed ones most engines use:
+//  a .rtbw file per set of pieces with win, draw or loss under the
+//  fifty-move rule, and a .rtbz file with the distance to the next capture
+//  or pawn move (DTZ) on the way there.  They're decoded the way Ronald de
+//  Man's probing code does it: the position is turned into an index over
+//  the table's piece groups, and the index into a value by walking the
+//  file's canonical Huffman blocks and its tree of recursively paired
+//  symbols.
+//
+//  Tables store nothing for positions where a capture is best, so every
+//  probe first tries the captures itself, which needs the tables of the
+//  material they lead to.  Values assume the fifty-move count was just
+//  reset and ignore castling.  Files are memory-mapped the first time a
+//  probe needs them, as with this program's own tables (Tablebase.hpp),
+//  which is what registers them and decides which answers.
+//
+
+#ifndef Syzygy_hpp
+#define Syzygy_hpp
+
+#include "Position.hpp"
+
+// Kings included; the index tables go no further.
+static const int MAX_SYZYGY_PIECES = 7;
+
+// For the side to move.  A cursed win is a win the fifty-move rule turns
+// into a draw, and a blessed loss a loss it saves.
+static const int SYZYGY_LOSS = -2;
+static const int SYZYGY_BLESSED_LOSS = -1;
+static const int SYZYGY_DRAW = 0;
+static const int SYZYGY_CURSED_WIN = 1;
+static const int SYZYGY_WIN = 2;
+
+// Registers directory's .rtbw files, and the .rtbz files beside them, in
+// place of any registered before.  Returns how many .rtbw files there are,
+// or -1 if directory can't be read.  Not safe while other threads probe.
+int setSyzygyPath(const char *directory);
+
+// The most pieces of any registered table, or 0.
+int syzygyPieces();
+
+// position's win/draw/loss, one of the values above.  Returns false if a
+// table it or one of its captures needs is missing or unreadable, or if
+// castling is still possible.  Safe to call from any number of threads.
+bool probeSyzygyWdl(const Position *position, int *wdl);
+
+// Plies to the capture or pawn move that keeps the result, positive when
+// the side to move wins and negative when it loses, or 0 when drawn.  Past
+// 100 it means a cursed win or blessed loss.  Needs the .rtbz files.
+bool probeSyzygyDtz(const Position *position, int *dtz);
+
+#endif /* Syzygy_hpp */
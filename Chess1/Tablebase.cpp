@@ -0,0 +1,1186 @@
+//
+//  Tablebase.cpp
+//  Chess1
+//
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <limits.h>
+#include <string.h>
+#include <dirent.h>
+#include "Tablebase.hpp"
+#include "Syzygy.hpp"
+#include "MoveGen.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+
+// A table file is a 16 byte header (the magic, a version byte, the piece
+// count, two spare bytes and the little-endian entry count as 8 bytes)
+// followed by a little-endian 16 bit value per entry.
+static const char TABLE_MAGIC[4] = { 'C', '1', 'T', 'B' };
+static const int TABLE_VERSION = 1;
+static const size_t HEADER_BYTES = 16;
+static const char *TABLE_EXTENSION = ".c1tb";
+
+// Values are for the side to move: 0 is a draw, 1 to 0x7FFF a win in that
+// many plies and LOSS_VALUE plus n a loss in n plies.
+static const uint16_t DRAW_VALUE = 0;
+static const uint16_t LOSS_VALUE = 0x8000;
+static const uint16_t PLIES_MASK = 0x7FFF;
+static const uint16_t UNKNOWN_VALUE = 0xFFFF;  // Only while generating.
+
+// The order pieces are named in, after the king, which is also the order
+// they have in a table's index.
+static const int NAME_ORDER[5] = {
+    PIECE_QUEEN, PIECE_ROOK, PIECE_BISHOP, PIECE_KNIGHT, PIECE_PAWN
+};
+static const char PIECE_LETTERS[PIECE_TYPE_COUNT + 1] = " PRNBQK";
+static const int PIECE_VALUES[PIECE_TYPE_COUNT] = { 0, 1, 5, 3, 3, 9, 0 };
+
+// Turning and reflecting the board doesn't change a position's value, so
+// without pawns the white king only needs indexing on the ten squares of the
+// a1-d1-d4 triangle.  Pawns only allow a left-right reflection, which puts
+// it on files a to d.
+static const int TRIANGLE_SLOTS = 10;
+static const int HALF_BOARD_SLOTS = 32;
+static const int TRIANGLE_SQUARES[TRIANGLE_SLOTS] = { 0, 1, 2, 3, 9, 10, 11, 18, 19, 27 };
+static const int FLIP_FILES = 1;
+static const int FLIP_RANKS = 2;
+static const int FLIP_DIAGONAL = 4;
+
+// Entries per generation task.
+static const size_t GENERATION_CHUNK = 1 << 16;
+
+static const uint8_t ENTRY_IDLE = 0;
+static const uint8_t ENTRY_DIRTY = 1;     // A move from it has a new value.
+static const uint8_t ENTRY_INVALID = 2;   // Illegal, or a reflection of another.
+
+static const int DECIDED = 0;
+static const int DEFERRED = 1;            // Decided, but not yet final.
+static const int UNDECIDED = 2;
+
+typedef struct
+{
+    std::string name;
+    std::string path;
+    uint64_t signature;
+    int pieceCount;
+    int pieces[MAX_TABLEBASE_PIECES];   // Piece ids in index order.
+    bool hasPawns;
+    size_t entryCount;
+    std::once_flag mapOnce;
+    MappedFile file;
+    bool usable;                        // Mapped and the right size.
+} TablebaseFile;
+
+// A deque so registering a table never moves the others.
+static std::deque<TablebaseFile> tables;
+static int largestTable = 0;
+
+static bool probeOwnTable(const Position *position, TablebaseResult *result);
+static bool probeSyzygyTable(const Position *position, TablebaseResult *result);
+static bool parseMaterial(const std::string &name, TablebaseFile *table);
+static bool registerTable(const char *directory, const char *fileName);
+static bool hasExtension(const std::string &name, const char *extension);
+static TablebaseFile *findTable(uint64_t signature);
+static void mapTable(TablebaseFile *table);
+static uint64_t signatureOf(const Position *position, bool flip);
+static int kingSlots(const TablebaseFile *table);
+static int transformSquare(int square, int transform);
+static size_t indexForSquares(const TablebaseFile *table,
+                              int side,
+                              const int squares[],
+                              int transform);
+static size_t positionIndex(const TablebaseFile *table, const Position *position, bool flip);
+static bool decodeIndex(const TablebaseFile *table, size_t index, Position *position);
+static bool lookupValue(const Position *position, uint16_t *value);
+static bool probeValue(const Position *position, uint16_t *value);
+static bool enPassantValue(const Position *position, uint16_t *value);
+static uint16_t valueBefore(uint16_t value);
+static int valueRank(uint16_t value);
+static bool buildTable(const char *directory,
+                       const std::string &name,
+                       int threads,
+                       const TablebaseReporter &reporter);
+static void generateTable(const TablebaseFile *table,
+                          int threads,
+                          std::vector<uint16_t> *values,
+                          TablebaseStats *stats);
+static uint16_t moveValue(const TablebaseFile *table,
+                          const std::vector<uint16_t> &values,
+                          const Position *next);
+static int decidePosition(const TablebaseFile *table,
+                          const std::vector<uint16_t> &values,
+                          size_t index,
+                          int pass,
+                          uint16_t *value);
+static void markPredecessors(const TablebaseFile *table,
+                             const std::vector<uint16_t> &values,
+                             size_t index,
+                             std::vector<uint8_t> *states);
+static bool writeTable(const TablebaseFile *table,
+                       const std::vector<uint16_t> &values,
+                       const std::string &path);
+
+int setTablebasePath(const char *directory)
+{
+    for (size_t tableIndex = 0; tableIndex < tables.size(); tableIndex++)
+    {
+        unmapFile(&tables[tableIndex].file);
+    }
+    
+    tables.clear();
+    largestTable = 0;
+    
+    int syzygyTables = setSyzygyPath(directory);
+    DIR *listing = opendir(directory);
+    
+    if (listing == nullptr)
+    {
+        return -1;
+    }
+    
+    while (struct dirent *entry = readdir(listing))
+    {
+        registerTable(directory, entry->d_name);
+    }
+    
+    closedir(listing);
+    
+    return (int)tables.size() + std::max(syzygyTables, 0);
+}
+
+int tablebasePieces()
+{
+    return std::max(largestTable, syzygyPieces());
+}
+
+bool probeTablebase(const Position *position, TablebaseResult *result)
+{
+    return probeOwnTable(position, result) || probeSyzygyTable(position, result);
+}
+
+static bool probeOwnTable(const Position *position, TablebaseResult *result)
+{
+    if (largestTable == 0 ||
+        position->castlingRights != 0 ||
+        popCount(position->occupied) > largestTable)
+    {
+        return false;
+    }
+    
+    uint16_t value;
+    
+    if (!probeValue(position, &value))
+    {
+        return false;
+    }
+    
+    if (value == DRAW_VALUE)
+    {
+        result->wdl = TABLEBASE_DRAW;
+        result->plies = 0;
+    }
+    else if (value & LOSS_VALUE)
+    {
+        result->wdl = TABLEBASE_LOSS;
+        result->plies = value & PLIES_MASK;
+    }
+    else
+    {
+        result->wdl = TABLEBASE_WIN;
+        result->plies = value;
+    }
+    
+    result->syzygy = false;
+    
+    return true;
+}
+
+// Syzygy values hold for a fifty-move count of zero, so other positions
+// are left to the search.  A win or loss the fifty-move rule takes away is
+// a draw.
+static bool probeSyzygyTable(const Position *position, TablebaseResult *result)
+{
+    int wdl;
+    
+    if (position->halfmoveClock != 0 || !probeSyzygyWdl(position, &wdl))
+    {
+        return false;
+    }
+    
+    result->wdl = (wdl == SYZYGY_WIN) ? TABLEBASE_WIN :
+                  (wdl == SYZYGY_LOSS) ? TABLEBASE_LOSS : TABLEBASE_DRAW;
+    result->plies = 0;
+    result->syzygy = true;
+    
+    return true;
+}
+
+std::string materialName(const Position *position)
+{
+    std::string name;
+    
+    for (int color = COLOR_WHITE; color <= COLOR_BLACK; color += 2)
+    {
+        name += (color == COLOR_WHITE) ? "K" : "vK";
+        
+        for (int orderIndex = 0; orderIndex < 5; orderIndex++)
+        {
+            int type = NAME_ORDER[orderIndex];
+            name.append(popCount(piecesOf(position, color, type)), PIECE_LETTERS[type]);
+        }
+    }
+    
+    return name;
+}
+
+// Each side's pieces are put in naming order, and the side with more
+// material (then more pieces, then bigger pieces) goes first.
+std::string canonicalMaterial(const std::string &material)
+{
+    size_t split = material.find('v');
+    
+    if (split == std::string::npos)
+    {
+        return "";
+    }
+    
+    std::string sides[2] = { material.substr(0, split), material.substr(split + 1) };
+    int values[2] = { 0, 0 };
+    int pieceCount = 0;
+    
+    for (int sideIndex = 0; sideIndex < 2; sideIndex++)
+    {
+        std::string &side = sides[sideIndex];
+        
+        if (side.empty() || side[0] != 'K')
+        {
+            return "";
+        }
+        
+        std::string ordered = "K";
+        
+        for (int orderIndex = 0; orderIndex < 5; orderIndex++)
+        {
+            int type = NAME_ORDER[orderIndex];
+            int count = (int)std::count(side.begin(), side.end(), PIECE_LETTERS[type]);
+            ordered.append(count, PIECE_LETTERS[type]);
+            values[sideIndex] += count * PIECE_VALUES[type];
+        }
+        
+        if (ordered.size() != side.size())
+        {
+            return "";
+        }
+        
+        side = ordered;
+        pieceCount += (int)side.size();
+    }
+    
+    if (pieceCount > MAX_TABLEBASE_PIECES)
+    {
+        return "";
+    }
+    
+    // Ties go to the side whose first difference is the bigger piece.
+    std::string ranks[2];
+    
+    for (int sideIndex = 0; sideIndex < 2; sideIndex++)
+    {
+        for (size_t letter = 1; letter < sides[sideIndex].size(); letter++)
+        {
+            ranks[sideIndex] += (char)('0' + (strchr("QRBNP", sides[sideIndex][letter]) - "QRBNP"));
+        }
+    }
+    
+    bool swap = values[1] > values[0] ||
+                (values[1] == values[0] && sides[1].size() > sides[0].size()) ||
+                (values[1] == values[0] && sides[1].size() == sides[0].size() && ranks[1] < ranks[0]);
+    
+    return swap ? sides[1] + "v" + sides[0] : sides[0] + "v" + sides[1];
+}
+
+bool makeTablebase(const char *directory,
+                   const std::string &material,
+                   int threads,
+                   const TablebaseReporter &reporter)
+{
+    std::string name = canonicalMaterial(material);
+    
+    if (name.empty() || setTablebasePath(directory) < 0)
+    {
+        return false;
+    }
+    
+    if (threads < 1)
+    {
+        threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    
+    return buildTable(directory, name, threads, reporter);
+}
+
+// Fills in everything but the path and the mapping from a canonical name.
+static bool parseMaterial(const std::string &name, TablebaseFile *table)
+{
+    if (name.empty() || canonicalMaterial(name) != name)
+    {
+        return false;
+    }
+    
+    int color = COLOR_WHITE;
+    
+    table->name = name;
+    table->signature = 0;
+    table->pieceCount = 0;
+    table->hasPawns = false;
+    
+    for (size_t letter = 0; letter < name.size(); letter++)
+    {
+        if (name[letter] == 'v')
+        {
+            color = COLOR_BLACK;
+            continue;
+        }
+        
+        int type = (int)(strchr(PIECE_LETTERS, name[letter]) - PIECE_LETTERS);
+        table->pieces[table->pieceCount++] = type * color;
+        table->hasPawns = table->hasPawns || type == PIECE_PAWN;
+        
+        if (type != PIECE_KING)
+        {
+            table->signature += (uint64_t)1 << (4 * (colorIndex(color) * 5 + type - 1));
+        }
+    }
+    
+    table->entryCount = 2 * (size_t)kingSlots(table);
+    
+    for (int piece = 1; piece < table->pieceCount; piece++)
+    {
+        table->entryCount *= SQUARE_COUNT;
+    }
+    
+    return true;
+}
+
+// Anything in the directory that isn't a table's file is ignored.
+static bool hasExtension(const std::string &name, const char *extension)
+{
+    size_t start = name.size() - std::min(name.size(), strlen(extension));
+    
+    return name.compare(start, std::string::npos, extension) == 0;
+}
+
+static bool registerTable(const char *directory, const char *fileName)
+{
+    std::string name = fileName;
+    
+    if (!hasExtension(name, TABLE_EXTENSION))
+    {
+        return false;
+    }
+    
+    name.erase(name.size() - strlen(TABLE_EXTENSION));
+    
+    tables.emplace_back();
+    TablebaseFile *table = &tables.back();
+    
+    if (!parseMaterial(name, table) || findTable(table->signature) != table)
+    {
+        tables.pop_back();
+        return false;
+    }
+    
+    table->path = std::string(directory) + "/" + fileName;
+    table->file.data = nullptr;
+    table->file.size = 0;
+    table->usable = false;
+    largestTable = std::max(largestTable, table->pieceCount);
+    
+    return true;
+}
+
+static TablebaseFile *findTable(uint64_t signature)
+{
+    for (size_t tableIndex = 0; tableIndex < tables.size(); tableIndex++)
+    {
+        if (tables[tableIndex].signature == signature)
+        {
+            return &tables[tableIndex];
+        }
+    }
+    
+    return nullptr;
+}
+
+// Runs once per table, on whichever thread probes it first.
+static void mapTable(TablebaseFile *table)
+{
+    std::call_once(table->mapOnce, [table]() {
+        if (!mapFile(table->path.c_str(), &table->file))
+        {
+            return;
+        }
+        
+        const char *header = table->file.data;
+        
+        table->usable = table->file.size == HEADER_BYTES + 2 * table->entryCount &&
+                        memcmp(header, TABLE_MAGIC, 4) == 0 &&
+                        header[4] == TABLE_VERSION &&
+                        header[5] == table->pieceCount;
+        
+        if (!table->usable)
+        {
+            unmapFile(&table->file);
+            return;
+        }
+        
+        adviseRandom(&table->file);
+    });
+}
+
+// Four bits for each count of a color's pawns, rooks, knights, bishops and
+// queens.  flip swaps the colors.
+static uint64_t signatureOf(const Position *position, bool flip)
+{
+    uint64_t signature = 0;
+    
+    for (int color = COLOR_WHITE; color <= COLOR_BLACK; color += 2)
+    {
+        int side = flip ? -color : color;
+        
+        for (int type = PIECE_PAWN; type < PIECE_KING; type++)
+        {
+            signature += (uint64_t)popCount(piecesOf(position, side, type)) <<
+                         (4 * (colorIndex(color) * 5 + type - 1));
+        }
+    }
+    
+    return signature;
+}
+
+static int kingSlots(const TablebaseFile *table)
+{
+    return table->hasPawns ? HALF_BOARD_SLOTS : TRIANGLE_SLOTS;
+}
+
+static int transformSquare(int square, int transform)
+{
+    if (transform & FLIP_FILES)
+    {
+        square ^= 7;
+    }
+    
+    if (transform & FLIP_RANKS)
+    {
+        square ^= 56;
+    }
+    
+    if (transform & FLIP_DIAGONAL)
+    {
+        square = ((square & 7) << 3) | (square >> 3);
+    }
+    
+    return square;
+}
+
+// The index is the side to move, the white king's slot and then a square for
+// each other piece.  Identical pieces are put in square order, so that each
+// arrangement has one index.
+static size_t indexForSquares(const TablebaseFile *table,
+                              int side,
+                              const int squares[],
+                              int transform)
+{
+    int moved[MAX_TABLEBASE_PIECES];
+    
+    for (int piece = 0; piece < table->pieceCount; piece++)
+    {
+        moved[piece] = transformSquare(squares[piece], transform);
+        
+        for (int other = piece;
+             other > 1 && table->pieces[other] == table->pieces[other - 1] &&
+             moved[other] < moved[other - 1];
+             other--)
+        {
+            std::swap(moved[other], moved[other - 1]);
+        }
+    }
+    
+    int king = moved[0];
+    int rank = king >> 3;
+    int file = king & 7;
+    int slot = table->hasPawns ? rank * 4 + file : rank * 4 - rank * (rank - 1) / 2 + file - rank;
+    size_t index = (size_t)colorIndex(side) * kingSlots(table) + slot;
+    
+    for (int piece = 1; piece < table->pieceCount; piece++)
+    {
+        index = index * SQUARE_COUNT + moved[piece];
+    }
+    
+    return index;
+}
+
+// position's material must be the table's (with the colors swapped if flip
+// is set).  The board is reflected to put the white king in its slots; when
+// it lands on the a1-h8 diagonal, either side of the diagonal would do, and
+// the smaller index is used.
+static size_t positionIndex(const TablebaseFile *table, const Position *position, bool flip)
+{
+    int squares[MAX_TABLEBASE_PIECES];
+    Bitboard pieces = 0;
+    
+    for (int piece = 0; piece < table->pieceCount; piece++)
+    {
+        int id = table->pieces[piece];
+        
+        if (piece == 0 || id != table->pieces[piece - 1])
+        {
+            int color = (id < 0) ? COLOR_WHITE : COLOR_BLACK;
+            pieces = piecesOf(position, flip ? -color : color, abs(id));
+        }
+        
+        int square = popLowestSquare(&pieces);
+        squares[piece] = flip ? square ^ 56 : square;
+    }
+    
+    int side = flip ? -position->sideToMove : position->sideToMove;
+    int transform = ((squares[0] & 7) > 3) ? FLIP_FILES : 0;
+    
+    if (!table->hasPawns)
+    {
+        transform |= ((squares[0] >> 3) > 3) ? FLIP_RANKS : 0;
+        
+        int king = transformSquare(squares[0], transform);
+        
+        if ((king >> 3) == (king & 7))
+        {
+            return std::min(indexForSquares(table, side, squares, transform),
+                            indexForSquares(table, side, squares, transform | FLIP_DIAGONAL));
+        }
+        
+        transform |= ((king >> 3) > (king & 7)) ? FLIP_DIAGONAL : 0;
+    }
+    
+    return indexForSquares(table, side, squares, transform);
+}
+
+// Sets position up from index, returning false if that isn't a legal
+// position or isn't the index positionIndex would give it.
+static bool decodeIndex(const TablebaseFile *table, size_t index, Position *position)
+{
+    size_t canonicalIndex = index;
+    int squares[MAX_TABLEBASE_PIECES];
+    
+    for (int piece = table->pieceCount - 1; piece > 0; piece--)
+    {
+        squares[piece] = (int)(index % SQUARE_COUNT);
+        index /= SQUARE_COUNT;
+    }
+    
+    int slot = (int)(index % kingSlots(table));
+    int side = (index / kingSlots(table) == 0) ? COLOR_WHITE : COLOR_BLACK;
+    squares[0] = table->hasPawns ? (slot / 4) * 8 + slot % 4 : TRIANGLE_SQUARES[slot];
+    
+    clearPosition(position);
+    
+    for (int piece = 0; piece < table->pieceCount; piece++)
+    {
+        int square = squares[piece];
+        int id = table->pieces[piece];
+        
+        if (position->board[square] != 0 ||
+            (abs(id) == PIECE_PAWN && ((square >> 3) == 0 || (square >> 3) == 7)))
+        {
+            return false;
+        }
+        
+        putPiece(position, square, id);
+    }
+    
+    setSideToMove(position, side);
+    
+    if (isInCheck(position, -side))
+    {
+        return false;
+    }
+    
+    return positionIndex(table, position, false) == canonicalIndex;
+}
+
+// A position with no en passant capture.  Bare kings are drawn without a
+// table.
+static bool lookupValue(const Position *position, uint16_t *value)
+{
+    if (popCount(position->occupied) == 2)
+    {
+        *value = DRAW_VALUE;
+        return true;
+    }
+    
+    bool flip = false;
+    TablebaseFile *table = findTable(signatureOf(position, false));
+    
+    if (table == nullptr)
+    {
+        flip = true;
+        table = findTable(signatureOf(position, true));
+    }
+    
+    if (table == nullptr)
+    {
+        return false;
+    }
+    
+    mapTable(table);
+    
+    if (!table->usable)
+    {
+        return false;
+    }
+    
+    const unsigned char *entry = (const unsigned char *)table->file.data + HEADER_BYTES +
+                                 2 * positionIndex(table, position, flip);
+    *value = (uint16_t)(entry[0] | (entry[1] << 8));
+    
+    return true;
+}
+
+// Tables only hold positions without an en passant capture.  With one, the
+// stored value covers every other move, and the capture is looked at
+// separately.
+static bool probeValue(const Position *position, uint16_t *value)
+{
+    if (!lookupValue(position, value))
+    {
+        return false;
+    }
+    
+    uint16_t capture;
+    
+    if (position->enPassantSquare != NO_SQUARE)
+    {
+        if (!enPassantValue(position, &capture))
+        {
+            return false;
+        }
+        
+        if (valueRank(capture) > valueRank(*value))
+        {
+            *value = capture;
+        }
+    }
+    
+    return true;
+}
+
+// The best en passant capture's value to the side to move.  Returns false if
+// one of them leads somewhere no table covers.
+static bool enPassantValue(const Position *position, uint16_t *value)
+{
+    MoveList list;
+    generateLegalMoves(position, &list);
+    
+    *value = LOSS_VALUE;
+    
+    for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+    {
+        Move move = list.moves[moveIndex];
+        
+        if (moveType(move) != MOVE_EN_PASSANT)
+        {
+            continue;
+        }
+        
+        Position next = *position;
+        applyMove(&next, move);
+        
+        uint16_t nextValue;
+        
+        if (!lookupValue(&next, &nextValue))
+        {
+            return false;
+        }
+        
+        nextValue = valueBefore(nextValue);
+        
+        if (valueRank(nextValue) > valueRank(*value))
+        {
+            *value = nextValue;
+        }
+    }
+    
+    return true;
+}
+
+// What a move is worth to the side that played it, given what the position
+// it leads to is worth to the side to move there.
+static uint16_t valueBefore(uint16_t value)
+{
+    if (value == UNKNOWN_VALUE || value == DRAW_VALUE)
+    {
+        return value;
+    }
+    
+    if (value & LOSS_VALUE)
+    {
+        return (uint16_t)((value & PLIES_MASK) + 1);
+    }
+    
+    return (uint16_t)(LOSS_VALUE | (value + 1));
+}
+
+// Higher is better for the side to move: quick wins, slow wins, draws, slow
+// losses, quick losses.
+static int valueRank(uint16_t value)
+{
+    if (value == DRAW_VALUE)
+    {
+        return 0;
+    }
+    
+    if (value & LOSS_VALUE)
+    {
+        return (value & PLIES_MASK) - LOSS_VALUE;
+    }
+    
+    return LOSS_VALUE - value;
+}
+
+// Builds the tables name leads to first, since its values are worked out
+// from theirs.
+static bool buildTable(const char *directory,
+                       const std::string &name,
+                       int threads,
+                       const TablebaseReporter &reporter)
+{
+    TablebaseFile table;
+    
+    if (!parseMaterial(name, &table))
+    {
+        return false;
+    }
+    
+    if (findTable(table.signature) != nullptr)
+    {
+        return true;
+    }
+    
+    for (size_t letter = 0; letter < name.size(); letter++)
+    {
+        char piece = name[letter];
+        
+        if (piece == 'K' || piece == 'v')
+        {
+            continue;
+        }
+        
+        std::string captured = name;
+        captured.erase(letter, 1);
+        
+        if (captured != "KvK" &&
+            !buildTable(directory, canonicalMaterial(captured), threads, reporter))
+        {
+            return false;
+        }
+        
+        for (int promotion = 0; piece == 'P' && promotion < 4; promotion++)
+        {
+            std::string promoted = name;
+            promoted[letter] = "QRBN"[promotion];
+            
+            if (!buildTable(directory, canonicalMaterial(promoted), threads, reporter))
+            {
+                return false;
+            }
+        }
+    }
+    
+    std::vector<uint16_t> values;
+    TablebaseStats stats;
+    std::string fileName = name + TABLE_EXTENSION;
+    
+    generateTable(&table, threads, &values, &stats);
+    
+    if (!writeTable(&table, values, std::string(directory) + "/" + fileName) ||
+        !registerTable(directory, fileName.c_str()))
+    {
+        return false;
+    }
+    
+    if (reporter)
+    {
+        reporter(stats);
+    }
+    
+    return true;
+}
+
+// Retrograde analysis.  Checkmates and stalemates are settled first; then
+// each pass settles the positions whose value follows from what is already
+// known: a win in n if some move leads to a loss in n - 1, a loss in n if
+// every move leads to a win and the longest is n - 1.  Moves leaving the
+// table (captures and promotions) are looked up in the smaller tables.
+// Only positions with a move to something settled in the last pass are
+// looked at again, and they are found by taking moves back, so the passes
+// get quicker as the table fills in.  Whatever is left at the end is drawn.
+static void generateTable(const TablebaseFile *table,
+                          int threads,
+                          std::vector<uint16_t> *values,
+                          TablebaseStats *stats)
+{
+    typedef std::pair<size_t, uint16_t> Decision;
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t entryCount = table->entryCount;
+    int taskCount = (int)((entryCount + GENERATION_CHUNK - 1) / GENERATION_CHUNK);
+    std::vector<uint8_t> states(entryCount, ENTRY_IDLE);
+    std::vector<std::vector<Decision> > decisions(threads);
+    std::vector<std::vector<size_t> > deferrals(threads);
+    
+    values->assign(entryCount, UNKNOWN_VALUE);
+    
+    runTasks(taskCount, threads, [&](int task, int thread) {
+        size_t end = std::min(entryCount, (task + 1) * GENERATION_CHUNK);
+        
+        for (size_t index = task * GENERATION_CHUNK; index < end; index++)
+        {
+            Position position;
+            
+            if (!decodeIndex(table, index, &position))
+            {
+                states[index] = ENTRY_INVALID;
+                (*values)[index] = DRAW_VALUE;
+                continue;
+            }
+            
+            MoveList list;
+            generateLegalMoves(&position, &list);
+            
+            if (list.count == 0)
+            {
+                (*values)[index] = isInCheck(&position, position.sideToMove) ?
+                                   LOSS_VALUE :
+                                   DRAW_VALUE;
+                decisions[thread].push_back(Decision(index, (*values)[index]));
+            }
+            else
+            {
+                states[index] = ENTRY_DIRTY;
+            }
+        }
+    });
+    
+    int pass = 0;
+    
+    while (true)
+    {
+        // Settled positions make the positions that can move to them dirty.
+        bool settling = false;
+        
+        for (int thread = 0; thread < threads; thread++)
+        {
+            for (size_t decision = 0; decision < decisions[thread].size(); decision++)
+            {
+                (*values)[decisions[thread][decision].first] = decisions[thread][decision].second;
+            }
+        }
+        
+        for (int thread = 0; thread < threads; thread++)
+        {
+            for (size_t decision = 0; decision < decisions[thread].size(); decision++)
+            {
+                markPredecessors(table, *values, decisions[thread][decision].first, &states);
+            }
+            
+            for (size_t deferral = 0; deferral < deferrals[thread].size(); deferral++)
+            {
+                states[deferrals[thread][deferral]] = ENTRY_DIRTY;
+            }
+            
+            settling = settling || !decisions[thread].empty() || !deferrals[thread].empty();
+            decisions[thread].clear();
+            deferrals[thread].clear();
+        }
+        
+        if (!settling && pass > 0)
+        {
+            break;
+        }
+        
+        pass++;
+        
+        runTasks(taskCount, threads, [&](int task, int thread) {
+            size_t end = std::min(entryCount, (task + 1) * GENERATION_CHUNK);
+            
+            for (size_t index = task * GENERATION_CHUNK; index < end; index++)
+            {
+                if (states[index] != ENTRY_DIRTY)
+                {
+                    continue;
+                }
+                
+                states[index] = ENTRY_IDLE;
+                
+                uint16_t value;
+                int outcome = decidePosition(table, *values, index, pass, &value);
+                
+                if (outcome == DECIDED)
+                {
+                    decisions[thread].push_back(Decision(index, value));
+                }
+                else if (outcome == DEFERRED)
+                {
+                    deferrals[thread].push_back(index);
+                }
+            }
+        });
+    }
+    
+    stats->name = table->name;
+    stats->positions = 0;
+    stats->wins = 0;
+    stats->draws = 0;
+    stats->losses = 0;
+    stats->longestMate = 0;
+    stats->passes = pass;
+    
+    for (size_t index = 0; index < entryCount; index++)
+    {
+        uint16_t &value = (*values)[index];
+        
+        if (value == UNKNOWN_VALUE)
+        {
+            value = DRAW_VALUE;
+        }
+        
+        if (states[index] == ENTRY_INVALID)
+        {
+            continue;
+        }
+        
+        stats->positions++;
+        
+        if (value == DRAW_VALUE)
+        {
+            stats->draws++;
+        }
+        else if (value & LOSS_VALUE)
+        {
+            stats->losses++;
+            stats->longestMate = std::max(stats->longestMate, value & PLIES_MASK);
+        }
+        else
+        {
+            stats->wins++;
+            stats->longestMate = std::max(stats->longestMate, (int)value);
+        }
+    }
+    
+    stats->elapsedMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// The value of the move that led to next, for the side that played it.
+// Moves that stay in the table read the values found so far.  If next has an
+// en passant capture that wins, its own value is taken to be that win even
+// while the rest is unknown, which can overstate the mate's length by a few
+// plies but always gets the result right.
+static uint16_t moveValue(const TablebaseFile *table,
+                          const std::vector<uint16_t> &values,
+                          const Position *next)
+{
+    uint16_t value;
+    
+    if (signatureOf(next, false) != table->signature)
+    {
+        return lookupValue(next, &value) ? valueBefore(value) : UNKNOWN_VALUE;
+    }
+    
+    value = values[positionIndex(table, next, false)];
+    
+    uint16_t capture;
+    
+    if (next->enPassantSquare != NO_SQUARE && enPassantValue(next, &capture))
+    {
+        if ((value == UNKNOWN_VALUE) ?
+            valueRank(capture) > 0 :
+            valueRank(capture) > valueRank(value))
+        {
+            value = capture;
+        }
+    }
+    
+    return valueBefore(value);
+}
+
+// A win or loss is DEFERRED when it is longer than pass: a capture reached it
+// straight away, but a quicker one may still turn up in the table.
+static int decidePosition(const TablebaseFile *table,
+                          const std::vector<uint16_t> &values,
+                          size_t index,
+                          int pass,
+                          uint16_t *value)
+{
+    Position position;
+    decodeIndex(table, index, &position);
+    
+    MoveList list;
+    generateLegalMoves(&position, &list);
+    
+    int quickestWin = INT_MAX;
+    int slowestLoss = 0;
+    bool allLose = true;
+    
+    for (int moveIndex = 0; moveIndex < list.count; moveIndex++)
+    {
+        Position next = position;
+        applyMove(&next, list.moves[moveIndex]);
+        
+        uint16_t nextValue = moveValue(table, values, &next);
+        
+        if (nextValue == UNKNOWN_VALUE || nextValue == DRAW_VALUE)
+        {
+            allLose = false;
+        }
+        else if (nextValue & LOSS_VALUE)
+        {
+            slowestLoss = std::max(slowestLoss, nextValue & PLIES_MASK);
+        }
+        else
+        {
+            quickestWin = std::min(quickestWin, (int)nextValue);
+        }
+    }
+    
+    if (quickestWin != INT_MAX)
+    {
+        *value = (uint16_t)quickestWin;
+        return (quickestWin <= pass) ? DECIDED : DEFERRED;
+    }
+    
+    if (allLose)
+    {
+        *value = (uint16_t)(LOSS_VALUE | slowestLoss);
+        return (slowestLoss <= pass) ? DECIDED : DEFERRED;
+    }
+    
+    return UNDECIDED;
+}
+
+// Takes back every move that could have led to index's position without
+// leaving the table (so no captures or promotions), and marks the unsettled
+// positions they lead back to as dirty.
+static void markPredecessors(const TablebaseFile *table,
+                             const std::vector<uint16_t> &values,
+                             size_t index,
+                             std::vector<uint8_t> *states)
+{
+    Position position;
+    decodeIndex(table, index, &position);
+    
+    int mover = -position.sideToMove;
+    Bitboard empty = ~position.occupied;
+    int forward = (mover == COLOR_WHITE) ? 8 : -8;
+    int doubleRank = (mover == COLOR_WHITE) ? 3 : 4;
+    
+    for (int type = PIECE_PAWN; type <= PIECE_KING; type++)
+    {
+        Bitboard pieces = piecesOf(&position, mover, type);
+        
+        while (pieces != 0)
+        {
+            int square = popLowestSquare(&pieces);
+            Bitboard origins;
+            
+            if (type == PIECE_PAWN)
+            {
+                int behind = square - forward;
+                origins = 0;
+                
+                if ((behind >> 3) != 0 && (behind >> 3) != 7 && (empty & squareBit(behind)))
+                {
+                    origins |= squareBit(behind);
+                    
+                    if ((square >> 3) == doubleRank && (empty & squareBit(behind - forward)))
+                    {
+                        origins |= squareBit(behind - forward);
+                    }
+                }
+            }
+            else if (type == PIECE_KNIGHT)
+            {
+                origins = KNIGHT_ATTACKS[square] & empty;
+            }
+            else if (type == PIECE_BISHOP)
+            {
+                origins = bishopAttacks(square, position.occupied) & empty;
+            }
+            else if (type == PIECE_ROOK)
+            {
+                origins = rookAttacks(square, position.occupied) & empty;
+            }
+            else if (type == PIECE_QUEEN)
+            {
+                origins = queenAttacks(square, position.occupied) & empty;
+            }
+            else
+            {
+                origins = KING_ATTACKS[square] & empty;
+            }
+            
+            while (origins != 0)
+            {
+                Position previous = position;
+                removePiece(&previous, square);
+                putPiece(&previous, popLowestSquare(&origins), type * mover);
+                setSideToMove(&previous, mover);
+                
+                if (isInCheck(&previous, -mover))
+                {
+                    continue;
+                }
+                
+                size_t previousIndex = positionIndex(table, &previous, false);
+                
+                if (values[previousIndex] == UNKNOWN_VALUE)
+                {
+                    (*states)[previousIndex] = ENTRY_DIRTY;
+                }
+            }
+        }
+    }
+}
+
+static bool writeTable(const TablebaseFile *table,
+                       const std::vector<uint16_t> &values,
+                       const std::string &path)
+{
+    std::vector<char> bytes(HEADER_BYTES + 2 * values.size(), 0);
+    
+    memcpy(&bytes[0], TABLE_MAGIC, 4);
+    bytes[4] = (char)TABLE_VERSION;
+    bytes[5] = (char)table->pieceCount;
+    
+    for (int byte = 0; byte < 8; byte++)
+    {
+        bytes[8 + byte] = (char)((values.size() >> (8 * byte)) & 0xFF);
+    }
+    
+    for (size_t index = 0; index < values.size(); index++)
+    {
+        bytes[HEADER_BYTES + 2 * index] = (char)(values[index] & 0xFF);
+        bytes[HEADER_BYTES + 2 * index + 1] = (char)(values[index] >> 8);
+    }
+    
+    std::ofstream output(path.c_str(), std::ios::binary);
+    output.write(&bytes[0], bytes.size());
+    
+    return (bool)output;
+}
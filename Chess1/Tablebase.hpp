@@ -0,0 +1,97 @@
+//
+//  Tablebase.hpp
+//  Chess1
+//
+//  Endgame tablebases in this program's own format: for every position with
+//  a given set of pieces, whether the side to move wins, draws or loses with
+//  best play, and in how many plies the mate comes.  There is one file per
+//  set of pieces, named after them ("KQvK.c1tb", "KRPvKR.c1tb") with the
+//  stronger side first; positions where the other side has those pieces are
+//  probed with the board turned round.
+//
+//  A directory of tables is registered with setTablebasePath, which only
+//  reads the file names.  A table is memory-mapped the first time a probe
+//  needs it, and its pages are read in as probes touch them, so registering
+//  a directory costs nothing until the search or self-play gets down to that
+//  few pieces.
+//
+//  These tables are generated here (`tablebase make`), uncompressed, and
+//  store distance to mate; probes of them ignore the fifty-move rule.  The
+//  same directory can also hold Syzygy tables (.rtbw and .rtbz files, see
+//  Syzygy.hpp), which cover more pieces but only say who wins.  A position
+//  is looked up in this program's tables first and then in Syzygy's, which
+//  only answer when a capture or pawn move has just been made, so the
+//  fifty-move rule can't change their verdict.
+//
+
+#ifndef Tablebase_hpp
+#define Tablebase_hpp
+
+#include <string>
+#include <functional>
+#include "Position.hpp"
+
+// Tables are uncompressed, two bytes a position, so five pieces would need
+// hundreds of megabytes each.
+static const int MAX_TABLEBASE_PIECES = 4;
+
+static const int TABLEBASE_LOSS = -1;
+static const int TABLEBASE_DRAW = 0;
+static const int TABLEBASE_WIN = 1;
+
+// For the side to move.  plies counts to the mate, with best play by both
+// sides, and is 0 when drawn (or when already checkmated).  A Syzygy table
+// doesn't know when the mate comes, so its results have plies 0 too.
+typedef struct
+{
+    int wdl;
+    int plies;
+    bool syzygy;
+} TablebaseResult;
+
+typedef struct
+{
+    std::string name;
+    uint64_t positions;     // Legal ones, not counting symmetrical copies.
+    uint64_t wins;
+    uint64_t draws;
+    uint64_t losses;
+    int longestMate;        // In plies.
+    int passes;
+    double elapsedMs;
+} TablebaseStats;
+
+typedef std::function<void(const TablebaseStats &stats)> TablebaseReporter;
+
+// Registers every table in directory, Syzygy's included, in place of any
+// registered before.  Returns how many there are, or -1 if directory can't
+// be read.  Not safe while other threads are probing.
+int setTablebasePath(const char *directory);
+
+// The most pieces (kings included) of any registered table, or 0.
+int tablebasePieces();
+
+// Looks position up, returning false if no registered table covers it.
+// Positions where castling is still possible aren't covered, nor are those
+// only a Syzygy table has unless the fifty-move count is 0.  Safe to call
+// from any number of threads.
+bool probeTablebase(const Position *position, TablebaseResult *result);
+
+// The name of position's table, such as "KRvKP" (white's pieces first).
+std::string materialName(const Position *position);
+
+// The table name for a set of pieces, stronger side first, or an empty
+// string if material isn't a name like "KQvKR" of at most
+// MAX_TABLEBASE_PIECES pieces.
+std::string canonicalMaterial(const std::string &material);
+
+// Builds material's table in directory, first building any smaller table it
+// leads to (by a capture or a promotion) that directory lacks, and registers
+// directory.  reporter, which may be empty, hears about every table built.
+// Returns false if material isn't a table name or a file can't be written.
+bool makeTablebase(const char *directory,
+                   const std::string &material,
+                   int threads,
+                   const TablebaseReporter &reporter);
+
+#endif /* Tablebase_hpp */
@@ -0,0 +1,125 @@
+//
+//  ThreadPool.cpp
+//  Chess1
+//
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ThreadPool.hpp"
+
+typedef struct
+{
+    std::mutex lock;
+    std::deque<int> tasks;
+} TaskQueue;
+
+static bool takeOwnTask(TaskQueue *queue, int *task);
+static bool stealTask(std::vector<TaskQueue> &queues, int thief, int *task);
+static void runWorker(std::vector<TaskQueue> &queues,
+                      int thread,
+                      const TaskFunction &run);
+
+void runTasks(int taskCount, int threadCount, const TaskFunction &run)
+{
+    if (threadCount < 1)
+    {
+        threadCount = (int)std::thread::hardware_concurrency();
+    }
+    
+    if (threadCount < 1)
+    {
+        threadCount = 1;
+    }
+    
+    std::vector<TaskQueue> queues(threadCount);
+    
+    // Contiguous shares, so neighbouring tasks tend to stay on one thread.
+    for (int task = 0; task < taskCount; task++)
+    {
+        queues[(int)((long long)task * threadCount / taskCount)].tasks.push_back(task);
+    }
+    
+    std::vector<std::thread> threads;
+    
+    for (int thread = 1; thread < threadCount; thread++)
+    {
+        threads.push_back(std::thread(runWorker, std::ref(queues), thread, std::cref(run)));
+    }
+    
+    runWorker(queues, 0, run);
+    
+    for (size_t threadIndex = 0; threadIndex < threads.size(); threadIndex++)
+    {
+        threads[threadIndex].join();
+    }
+}
+
+static void runWorker(std::vector<TaskQueue> &queues,
+                      int thread,
+                      const TaskFunction &run)
+{
+    int task;
+    
+    while (takeOwnTask(&queues[thread], &task) ||
+           stealTask(queues, thread, &task))
+    {
+        run(task, thread);
+    }
+}
+
+static bool takeOwnTask(TaskQueue *queue, int *task)
+{
+    std::lock_guard<std::mutex> guard(queue->lock);
+    
+    if (queue->tasks.empty())
+    {
+        return false;
+    }
+    
+    *task = queue->tasks.front();
+    queue->tasks.pop_front();
+    
+    return true;
+}
+
+// Tasks are never added once the batch starts, so a full pass that finds
+// every queue empty means the batch is done (apart from tasks already
+// running).
+static bool stealTask(std::vector<TaskQueue> &queues, int thief, int *task)
+{
+    int victim = -1;
+    size_t victimSize = 0;
+    
+    for (int thread = 0; thread < (int)queues.size(); thread++)
+    {
+        std::lock_guard<std::mutex> guard(queues[thread].lock);
+        
+        if (thread != thief && queues[thread].tasks.size() > victimSize)
+        {
+            victim = thread;
+            victimSize = queues[thread].tasks.size();
+        }
+    }
+    
+    if (victim < 0)
+    {
+        return false;
+    }
+    
+    {
+        std::lock_guard<std::mutex> guard(queues[victim].lock);
+        
+        if (!queues[victim].tasks.empty())
+        {
+            *task = queues[victim].tasks.back();
+            queues[victim].tasks.pop_back();
+            
+            return true;
+        }
+    }
+    
+    // Emptied since we looked; look again.
+    return stealTask(queues, thief, task);
+}
@@ -0,0 +1,24 @@
+//
+//  ThreadPool.hpp
+//  Chess1
+//
+//  Runs a batch of independent tasks on a fixed set of threads.  Every
+//  thread starts with an even share of the task numbers and works through
+//  them from one end; a thread that runs out steals from the other end of
+//  the busiest queue, so long tasks (a drawn-out game, say) don't leave the
+//  other threads idle.
+//
+
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <functional>
+
+// Called once per task number in [0, taskCount), with the number of the
+// thread running it (0 to threadCount - 1) for per-thread scratch state.
+typedef std::function<void(int task, int thread)> TaskFunction;
+
+// Blocks until every task has run.  threadCount < 1 means one per core.
+void runTasks(int taskCount, int threadCount, const TaskFunction &run);
+
+#endif /* ThreadPool_hpp */
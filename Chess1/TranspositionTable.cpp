@@ -0,0 +1,259 @@
+//
+//  TranspositionTable.cpp
+//  Chess1
+//
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include "TranspositionTable.hpp"
+
+typedef struct
+{
+    std::atomic<uint64_t> check;    // key ^ data
+    std::atomic<uint64_t> data;
+} Slot;
+
+// Four slots fill one 64 byte cache line, so a probe touches one line.  The
+// alignment keeps a bucket from straddling two, which new[] doesn't promise
+// before C++17, so the table comes from posix_memalign.
+static const int BUCKET_SLOTS = 4;
+static const size_t CACHE_LINE_BYTES = 64;
+
+typedef struct alignas(CACHE_LINE_BYTES)
+{
+    Slot slots[BUCKET_SLOTS];
+} Bucket;
+
+static_assert(sizeof(Bucket) == CACHE_LINE_BYTES, "a bucket should fill one cache line");
+
+static Bucket *buckets = nullptr;
+static size_t bucketMask = 0;
+// Searches on several threads at once (self-play, say) each bump this.
+static std::atomic<int> generation(0);
+
+// Totals from finished searches; each search thread counts its own.
+static std::atomic<uint64_t> probeCount(0);
+static std::atomic<uint64_t> hitCount(0);
+static std::atomic<uint64_t> storeCount(0);
+
+static uint64_t packEntry(Move move, int score, int depth, int bound);
+static TranspositionEntry unpackEntry(uint64_t data);
+static int entryDepth(uint64_t data);
+static int entryGeneration(uint64_t data);
+
+void resizeTranspositionTable(size_t megabytes)
+{
+    free(buckets);
+    buckets = nullptr;
+    bucketMask = 0;
+    
+    size_t bucketCount = 1;
+    
+    while (bucketCount * 2 * sizeof(Bucket) <= megabytes * 1024 * 1024)
+    {
+        bucketCount *= 2;
+    }
+    
+    void *memory = nullptr;
+    
+    if (posix_memalign(&memory, CACHE_LINE_BYTES, bucketCount * sizeof(Bucket)) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    
+    buckets = (Bucket *)memory;
+    
+    for (size_t bucket = 0; bucket < bucketCount; bucket++)
+    {
+        new (&buckets[bucket]) Bucket();
+    }
+    
+    bucketMask = bucketCount - 1;
+    clearTranspositionTable();
+}
+
+void clearTranspositionTable()
+{
+    for (size_t bucket = 0; bucket <= bucketMask && buckets != nullptr; bucket++)
+    {
+        for (int slot = 0; slot < BUCKET_SLOTS; slot++)
+        {
+            buckets[bucket].slots[slot].check.store(0, std::memory_order_relaxed);
+            buckets[bucket].slots[slot].data.store(0, std::memory_order_relaxed);
+        }
+    }
+    
+    generation.store(0, std::memory_order_relaxed);
+}
+
+size_t transpositionTableBytes()
+{
+    return (buckets == nullptr) ? 0 : (bucketMask + 1) * sizeof(Bucket);
+}
+
+void newTranspositionSearch()
+{
+    generation.store((generation.load(std::memory_order_relaxed) + 1) & 63,
+                     std::memory_order_relaxed);
+}
+
+bool probeTranspositionTable(uint64_t key, TranspositionEntry *entry)
+{
+    if (buckets == nullptr)
+    {
+        return false;
+    }
+    
+    Bucket &bucket = buckets[key & bucketMask];
+    
+    for (int slot = 0; slot < BUCKET_SLOTS; slot++)
+    {
+        uint64_t data = bucket.slots[slot].data.load(std::memory_order_relaxed);
+        uint64_t check = bucket.slots[slot].check.load(std::memory_order_relaxed);
+        
+        if ((check ^ data) == key && data != 0)
+        {
+            *entry = unpackEntry(data);
+            
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+// Overwrites this position's own slot if it has one, otherwise the slot
+// that is least worth keeping: old searches first, then shallow depths.
+void storeTranspositionEntry(uint64_t key,
+                             Move move,
+                             int score,
+                             int depth,
+                             int bound)
+{
+    if (buckets == nullptr)
+    {
+        return;
+    }
+    
+    Bucket &bucket = buckets[key & bucketMask];
+    int replace = 0;
+    int replaceWorth = INT32_MAX;
+    
+    for (int slot = 0; slot < BUCKET_SLOTS; slot++)
+    {
+        uint64_t data = bucket.slots[slot].data.load(std::memory_order_relaxed);
+        uint64_t check = bucket.slots[slot].check.load(std::memory_order_relaxed);
+        
+        if ((check ^ data) == key)
+        {
+            // Keep the old best move rather than forget it.
+            if (move == NULL_MOVE)
+            {
+                move = unpackEntry(data).move;
+            }
+            
+            replace = slot;
+            break;
+        }
+        
+        int age = (generation.load(std::memory_order_relaxed) -
+                   entryGeneration(data)) & 63;
+        int worth = entryDepth(data) - age * 8;
+        
+        if (worth < replaceWorth)
+        {
+            replace = slot;
+            replaceWorth = worth;
+        }
+    }
+    
+    uint64_t data = packEntry(move, score, depth, bound);
+    bucket.slots[replace].data.store(data, std::memory_order_relaxed);
+    bucket.slots[replace].check.store(key ^ data, std::memory_order_relaxed);
+}
+
+int transpositionTableFullness()
+{
+    if (buckets == nullptr)
+    {
+        return 0;
+    }
+    
+    int current = generation.load(std::memory_order_relaxed);
+    int used = 0;
+    int sampled = 0;
+    
+    for (size_t bucket = 0; bucket <= bucketMask && sampled < 1000; bucket++)
+    {
+        for (int slot = 0; slot < BUCKET_SLOTS && sampled < 1000; slot++)
+        {
+            uint64_t data = buckets[bucket].slots[slot].data.load(std::memory_order_relaxed);
+            
+            if (data != 0 && entryGeneration(data) == current)
+            {
+                used++;
+            }
+            
+            sampled++;
+        }
+    }
+    
+    return used * 1000 / sampled;
+}
+
+TranspositionStats getTranspositionStats()
+{
+    TranspositionStats stats;
+    stats.probes = probeCount.load(std::memory_order_relaxed);
+    stats.hits = hitCount.load(std::memory_order_relaxed);
+    stats.stores = storeCount.load(std::memory_order_relaxed);
+    
+    return stats;
+}
+
+void addTranspositionStats(const TranspositionStats &stats)
+{
+    probeCount.fetch_add(stats.probes, std::memory_order_relaxed);
+    hitCount.fetch_add(stats.hits, std::memory_order_relaxed);
+    storeCount.fetch_add(stats.stores, std::memory_order_relaxed);
+}
+
+void resetTranspositionStats()
+{
+    probeCount.store(0, std::memory_order_relaxed);
+    hitCount.store(0, std::memory_order_relaxed);
+    storeCount.store(0, std::memory_order_relaxed);
+}
+
+// Bits 0-15 move, 16-31 score, 32-39 depth, 40-41 bound, 42-47 generation.
+// The bound is never BOUND_NONE for a stored entry, so data is never 0.
+static uint64_t packEntry(Move move, int score, int depth, int bound)
+{
+    return (uint64_t)move |
+           ((uint64_t)(uint16_t)(int16_t)score << 16) |
+           ((uint64_t)(uint8_t)depth << 32) |
+           ((uint64_t)bound << 40) |
+           ((uint64_t)generation.load(std::memory_order_relaxed) << 42);
+}
+
+static TranspositionEntry unpackEntry(uint64_t data)
+{
+    TranspositionEntry entry;
+    entry.move = (Move)(data & 0xFFFF);
+    entry.score = (int16_t)((data >> 16) & 0xFFFF);
+    entry.depth = entryDepth(data);
+    entry.bound = (data >> 40) & 3;
+    
+    return entry;
+}
+
+static int entryDepth(uint64_t data)
+{
+    return (int)((data >> 32) & 0xFF);
+}
+
+static int entryGeneration(uint64_t data)
+{
+    return (int)((data >> 42) & 63);
+}
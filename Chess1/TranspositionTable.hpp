@@ -0,0 +1,67 @@
+//
+//  TranspositionTable.hpp
+//  Chess1
+//
+//  A fixed-size hash table of search results keyed by Zobrist key, shared by
+//  every search thread without locks.  Each entry is two 64-bit words, the
+//  packed data and the key XOR the data, so a torn write from two threads
+//  storing at once just fails verification and reads as a miss.
+//
+
+#ifndef TranspositionTable_hpp
+#define TranspositionTable_hpp
+
+#include <stddef.h>
+#include "Position.hpp"
+
+static const int BOUND_NONE = 0;
+static const int BOUND_UPPER = 1;
+static const int BOUND_LOWER = 2;
+static const int BOUND_EXACT = BOUND_UPPER | BOUND_LOWER;
+
+static const size_t DEFAULT_HASH_MB = 16;
+
+typedef struct
+{
+    Move move;
+    int score;
+    int depth;
+    int bound;
+} TranspositionEntry;
+
+typedef struct
+{
+    uint64_t probes;
+    uint64_t hits;
+    uint64_t stores;
+} TranspositionStats;
+
+// Replaces the table with an empty one of at most megabytes (rounded down to
+// a power of two buckets).  Not safe while a search is running.
+void resizeTranspositionTable(size_t megabytes);
+void clearTranspositionTable();
+size_t transpositionTableBytes();
+
+// Entries from earlier searches are replaced first, so call this before each
+// new search.
+void newTranspositionSearch();
+
+bool probeTranspositionTable(uint64_t key, TranspositionEntry *entry);
+void storeTranspositionEntry(uint64_t key,
+                             Move move,
+                             int score,
+                             int depth,
+                             int bound);
+
+// Permille of a sample of entries written during the current search, the way
+// UCI's "hashfull" reports it.
+int transpositionTableFullness();
+
+// Probing and storing don't count anything themselves: each search thread
+// counts its own and the search adds them here once it's done, so the
+// totals cover finished searches only.
+void addTranspositionStats(const TranspositionStats &stats);
+TranspositionStats getTranspositionStats();
+void resetTranspositionStats();
+
+#endif /* TranspositionTable_hpp */
@@ -0,0 +1,481 @@
+//
+//  Uci.cpp
+//  Chess1
+//
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <random>
+#include <ctype.h>
+#include <stdlib.h>
+#include "Uci.hpp"
+#include "MoveGen.hpp"
+#include "Search.hpp"
+#include "TranspositionTable.hpp"
+#include "Book.hpp"
+#include "Tablebase.hpp"
+#include "Nnue.hpp"
+
+static const int MAX_HASH_MB = 4096;
+static const int MAX_THREADS = 256;
+
+// Time kept back for the GUI and the pipe when playing on a clock.
+static const int MOVE_OVERHEAD_MS = 30;
+
+// Assumed when the GUI doesn't say how many moves are left to the control.
+static const int DEFAULT_MOVES_TO_GO = 30;
+
+// The "go" parameters that are followed by a number.
+static const char *GO_VALUE_WORDS[] = {
+    "depth", "movetime", "wtime", "btime", "winc", "binc", "movestogo", "nodes", "mate"
+};
+
+typedef struct
+{
+    std::mutex lock;
+    std::condition_variable arrived;
+    std::deque<std::string> lines;
+} InputQueue;
+
+typedef struct
+{
+    Position position;
+    int threads;
+    std::mt19937 random;        // Picks between book moves.
+    std::thread searchThread;
+    std::atomic<bool> stop;
+} UciEngine;
+
+static std::mutex outputLock;
+
+static void readInput(InputQueue *input, std::atomic<bool> *stop);
+static std::string nextLine(InputQueue *input);
+static void sendLine(const std::string &line);
+static void sendIdentity();
+static void setOption(UciEngine *engine, std::istringstream &args);
+static void setPosition(UciEngine *engine, std::istringstream &args);
+static bool goTakesValue(const std::string &word);
+static void startSearch(UciEngine *engine, std::istringstream &args);
+static void runSearch(UciEngine *engine, SearchLimits limits, bool infinite);
+static void stopSearch(UciEngine *engine);
+static std::string lowercase(std::string text);
+
+int runUci()
+{
+    UciEngine engine;
+    engine.threads = 1;
+    engine.random.seed(std::random_device()());
+    engine.stop = false;
+    parseFen(&engine.position, START_FEN);
+    
+    InputQueue input;
+    std::thread reader(readInput, &input, &engine.stop);
+    
+    while (true)
+    {
+        std::string line = nextLine(&input);
+        std::istringstream args(line);
+        std::string command;
+        args >> command;
+        
+        if (command == "uci")
+        {
+            sendIdentity();
+        }
+        else if (command == "isready")
+        {
+            sendLine("readyok");
+        }
+        else if (command == "setoption")
+        {
+            stopSearch(&engine);
+            setOption(&engine, args);
+        }
+        else if (command == "ucinewgame")
+        {
+            stopSearch(&engine);
+            clearTranspositionTable();
+        }
+        else if (command == "position")
+        {
+            stopSearch(&engine);
+            setPosition(&engine, args);
+        }
+        else if (command == "go")
+        {
+            stopSearch(&engine);
+            startSearch(&engine, args);
+        }
+        else if (command == "stop")
+        {
+            stopSearch(&engine);
+        }
+        else if (command == "quit")
+        {
+            stopSearch(&engine);
+            break;
+        }
+        
+        // Anything else ("debug", "ponderhit", ...) is ignored, as the
+        // protocol asks.
+    }
+    
+    reader.join();
+    
+    return 0;
+}
+
+// Runs on its own thread so "stop" reaches the search at once, rather than
+// waiting for the main thread to get round to it.  End of input counts as
+// "quit".
+static void readInput(InputQueue *input, std::atomic<bool> *stop)
+{
+    std::string line;
+    
+    while (true)
+    {
+        if (!std::getline(std::cin, line))
+        {
+            line = "quit";
+        }
+        
+        line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+        
+        std::string command = line.substr(0, line.find(' '));
+        
+        if (command == "stop" || command == "quit")
+        {
+            stop->store(true, std::memory_order_relaxed);
+        }
+        
+        {
+            std::lock_guard<std::mutex> guard(input->lock);
+            input->lines.push_back(line);
+        }
+        
+        input->arrived.notify_one();
+        
+        if (command == "quit")
+        {
+            break;
+        }
+    }
+}
+
+static std::string nextLine(InputQueue *input)
+{
+    std::unique_lock<std::mutex> guard(input->lock);
+    input->arrived.wait(guard, [input]() {
+        return !input->lines.empty();
+    });
+    
+    std::string line = input->lines.front();
+    input->lines.pop_front();
+    
+    return line;
+}
+
+// The search thread and the main thread both write, so whole lines go out
+// under a lock and are flushed straight away.
+static void sendLine(const std::string &line)
+{
+    std::lock_guard<std::mutex> guard(outputLock);
+    std::cout << line << std::endl;
+}
+
+static void sendIdentity()
+{
+    std::ostringstream hash;
+    hash << "option name Hash type spin default " << DEFAULT_HASH_MB
+         << " min 1 max " << MAX_HASH_MB;
+    
+    std::ostringstream threads;
+    threads << "option name Threads type spin default 1 min 1 max " << MAX_THREADS;
+    
+    sendLine("id name Chess1");
+    sendLine("id author Koissi Adjorlolo");
+    sendLine(hash.str());
+    sendLine(threads.str());
+    sendLine("option name Book type string default <empty>");
+    sendLine("option name TablebasePath type string default <empty>");
+    sendLine("option name EvalFile type string default <empty>");
+    sendLine("uciok");
+}
+
+// "setoption name <name> value <value>", where the name may have spaces.
+static void setOption(UciEngine *engine, std::istringstream &args)
+{
+    std::string word;
+    std::string name;
+    std::string value;
+    bool inValue = false;
+    
+    args >> word;
+    
+    while (args >> word)
+    {
+        if (!inValue && word == "value")
+        {
+            inValue = true;
+        }
+        else if (inValue)
+        {
+            value += (value.empty() ? "" : " ") + word;
+        }
+        else
+        {
+            name += (name.empty() ? "" : " ") + word;
+        }
+    }
+    
+    name = lowercase(name);
+    
+    if (name == "hash")
+    {
+        int megabytes = std::max(1, std::min(atoi(value.c_str()), MAX_HASH_MB));
+        resizeTranspositionTable(megabytes);
+    }
+    else if (name == "threads")
+    {
+        engine->threads = std::max(1, std::min(atoi(value.c_str()), MAX_THREADS));
+    }
+    else if (name == "book")
+    {
+        if (value.empty() || value == "<empty>")
+        {
+            closeBook();
+        }
+        else if (!openBook(value.c_str()))
+        {
+            sendLine("info string can't read book " + value);
+        }
+    }
+    else if (name == "tablebasepath")
+    {
+        // An empty path just unregisters the tables.
+        int count = setTablebasePath((value == "<empty>") ? "" : value.c_str());
+        
+        if (count < 0)
+        {
+            if (!value.empty() && value != "<empty>")
+            {
+                sendLine("info string can't read tablebases in " + value);
+            }
+        }
+        else
+        {
+            sendLine("info string " + std::to_string(count) + " tablebases in " + value +
+                     ", up to " + std::to_string(tablebasePieces()) + " pieces");
+        }
+    }
+    else if (name == "evalfile")
+    {
+        // Without a network the search goes back to the classical evaluation.
+        if (value.empty() || value == "<empty>")
+        {
+            unloadNnue();
+        }
+        else if (!loadNnue(value.c_str()))
+        {
+            sendLine("info string can't load network " + value);
+        }
+    }
+}
+
+// "position startpos|fen <fen> [moves <move>...]".  A bad position or move
+// leaves everything before it in place.
+static void setPosition(UciEngine *engine, std::istringstream &args)
+{
+    std::string word;
+    args >> word;
+    
+    if (word == "startpos")
+    {
+        parseFen(&engine->position, START_FEN);
+        args >> word;
+    }
+    else if (word == "fen")
+    {
+        std::string fen;
+        
+        while (args >> word && word != "moves")
+        {
+            fen += (fen.empty() ? "" : " ") + word;
+        }
+        
+        if (!parseFen(&engine->position, fen.c_str()))
+        {
+            sendLine("info string bad fen " + fen);
+            return;
+        }
+    }
+    else
+    {
+        return;
+    }
+    
+    if (word != "moves")
+    {
+        return;
+    }
+    
+    while (args >> word)
+    {
+        Move move = moveFromString(&engine->position, word);
+        
+        if (move == NULL_MOVE)
+        {
+            sendLine("info string illegal move " + word);
+            return;
+        }
+        
+        applyMove(&engine->position, move);
+    }
+}
+
+static bool goTakesValue(const std::string &word)
+{
+    for (const char *name : GO_VALUE_WORDS)
+    {
+        if (word == name)
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+// "go [depth <n>] [movetime <ms>] [wtime <ms>] [btime <ms>] [winc <ms>]
+// [binc <ms>] [movestogo <n>] [infinite]".  "ponder", unknown words and
+// everything from "searchmoves" on are ignored.  On a clock the engine
+// spends an even share of what's left until the next control, plus most of
+// the increment.  A move from the book is played straight away, except
+// under "go infinite", which is for analysis.
+static void startSearch(UciEngine *engine, std::istringstream &args)
+{
+    SearchLimits limits = { 0, 0, engine->threads };
+    bool infinite = false;
+    int timeLeft[2] = { 0, 0 };
+    int increment[2] = { 0, 0 };
+    int movesToGo = DEFAULT_MOVES_TO_GO;
+    std::string word;
+    
+    while (args >> word)
+    {
+        if (word == "infinite")
+        {
+            infinite = true;
+            continue;
+        }
+        
+        // The moves after "searchmoves" run to the end of the line and
+        // aren't supported, so the rest of the command is ignored.
+        if (word == "searchmoves")
+        {
+            break;
+        }
+        
+        // Flags such as "ponder" and words we don't know carry no value.
+        if (!goTakesValue(word))
+        {
+            continue;
+        }
+        
+        int value = 0;
+        args >> value;
+        
+        if (word == "depth")
+        {
+            limits.depth = value;
+        }
+        else if (word == "movetime")
+        {
+            limits.moveTimeMs = value;
+        }
+        else if (word == "wtime" || word == "btime")
+        {
+            timeLeft[colorIndex((word[0] == 'w') ? COLOR_WHITE : COLOR_BLACK)] = value;
+        }
+        else if (word == "winc" || word == "binc")
+        {
+            increment[colorIndex((word[0] == 'w') ? COLOR_WHITE : COLOR_BLACK)] = value;
+        }
+        else if (word == "movestogo" && value > 0)
+        {
+            movesToGo = value;
+        }
+    }
+    
+    int side = colorIndex(engine->position.sideToMove);
+    
+    if (!infinite && limits.moveTimeMs == 0 && timeLeft[side] > 0)
+    {
+        int budget = timeLeft[side] / movesToGo + increment[side] * 3 / 4;
+        limits.moveTimeMs = std::max(1, std::min(budget,
+                                                 timeLeft[side] - MOVE_OVERHEAD_MS));
+    }
+    
+    if (infinite)
+    {
+        limits.depth = 0;
+        limits.moveTimeMs = 0;
+    }
+    else
+    {
+        Move bookMove = pickBookMove(&engine->position, engine->random());
+        
+        if (bookMove != NULL_MOVE)
+        {
+            sendLine("info string book move");
+            sendLine("bestmove " + moveToString(bookMove));
+            return;
+        }
+    }
+    
+    engine->stop = false;
+    engine->searchThread = std::thread(runSearch, engine, limits, infinite);
+}
+
+static void runSearch(UciEngine *engine, SearchLimits limits, bool infinite)
+{
+    Move bestMove = searchPosition(&engine->position, limits, [](const SearchReport &report) {
+        sendLine(formatSearchReport(report));
+    }, &engine->stop);
+    
+    // "go infinite" may only answer once it is told to stop, even if the
+    // search has run out of things to look at.
+    while (infinite && !engine->stop.load(std::memory_order_relaxed))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    
+    sendLine("bestmove " + moveToString(bestMove));
+}
+
+// Stops any search in progress and waits for its bestmove to go out.
+static void stopSearch(UciEngine *engine)
+{
+    if (engine->searchThread.joinable())
+    {
+        engine->stop = true;
+        engine->searchThread.join();
+    }
+}
+
+static std::string lowercase(std::string text)
+{
+    for (size_t index = 0; index < text.size(); index++)
+    {
+        text[index] = (char)tolower(text[index]);
+    }
+    
+    return text;
+}
@@ -0,0 +1,18 @@
+//
+//  Uci.hpp
+//  Chess1
+//
+//  The Universal Chess Interface on stdin and stdout, so the engine can be
+//  run by GUIs and tournament managers.  Input is read on a thread of its own
+//  that raises the search's stop flag the moment "stop" arrives, and searches
+//  run on another, so the engine keeps answering "isready" while it thinks.
+//
+
+#ifndef Uci_hpp
+#define Uci_hpp
+
+// Talks UCI until "quit" or the end of input.  The bitboards, Zobrist keys
+// and transposition table must already be set up.
+int runUci();
+
+#endif /* Uci_hpp */
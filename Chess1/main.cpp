@@ -7,27 +7,23 @@
 //
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <vector>
-#include <functional>
 #include <string>
+#include <string.h>
+#include <thread>
+#include <random>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
-
-typedef struct
-{
-    int x, y;
-} Vector2i;
-
-typedef std::function<bool(Vector2i currentPosition,
-                           Vector2i nextPosition)> ValidMoveFunction;
-
-typedef struct
-{
-    int id;
-    std::string name;
-    ValidMoveFunction canMoveToPosition;
-    SDL_Texture *texture;
-} ChessPiece;
+#include "Rules.hpp"
+#include "Commands.hpp"
+#include "Search.hpp"
+#include "TranspositionTable.hpp"
+#include "Book.hpp"
+#include "Tablebase.hpp"
+#include "Nnue.hpp"
+#include "GameRecord.hpp"
 
 static const char *TITLE = "Chess";
 static const int WINDOW_POSX = SDL_WINDOWPOS_UNDEFINED;
@@ -36,84 +32,122 @@ static const int WINDOW_WIDTH = 728;
 static const int WINDOW_HEIGHT = 728;
 static const Uint32 WINDOW_FLAGS = 0;
 static const Uint32 RENDERER_FLAGS = SDL_RENDERER_ACCELERATED |
-                                     SDL_RENDERER_PRESENTVSYNC;
-static const double MS_PER_UPDATE = 1000 / 60;
+                                     SDL_RENDERER_PRESENTVSYNC |
+                                     SDL_RENDERER_TARGETTEXTURE;
+static const double MS_PER_UPDATE = 1000.0 / 60.0;
+
+// After falling this many updates behind (a long computer move, a dragged
+// window) the loop gives up catching up rather than replaying them all.
+static const int MAX_UPDATES_PER_FRAME = 5;
+
+// How long an idle window sleeps in SDL_WaitEventTimeout before looking
+// around anyway.
+static const int IDLE_WAIT_MS = 500;
+static const int COMPUTER_MOVE_TIME_MS = 1000;
 
-static const int BOARD_SIZE = 8;
-static const int COLOR_WHITE = -1;
-static const int COLOR_BLACK = 1;
 static const int TEXTURE_WIDTH = 128;
 static const int TEXTURE_HEIGHT = 128;
 static const int CELL_WIDTH = WINDOW_WIDTH / BOARD_SIZE;
 static const int CELL_HEIGHT = WINDOW_HEIGHT / BOARD_SIZE;
 
-static void initPieces();
-static void initBoard();
-static bool pieceAtPosition(Vector2i position);
+// The piece atlas: a column per piece type (pawn first, in PieceType order)
+// and a row per color, white on top.
+static const int ATLAS_COLUMNS = PIECE_TYPE_COUNT - 1;
+static const int ATLAS_WIDTH = TEXTURE_WIDTH * ATLAS_COLUMNS;
+static const int ATLAS_HEIGHT = TEXTURE_HEIGHT * 2;
+
+// The atlas pixels are red, green, blue, alpha in memory.  SDL 2.0.5 calls
+// that SDL_PIXELFORMAT_RGBA32, but the build pins 2.0.4, so the packed
+// format and the masks that match it are picked by byte order here.
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+static const Uint32 ATLAS_FORMAT = SDL_PIXELFORMAT_RGBA8888;
+static const Uint32 ATLAS_MASKS[4] = { 0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF };
+#else
+static const Uint32 ATLAS_FORMAT = SDL_PIXELFORMAT_ABGR8888;
+static const Uint32 ATLAS_MASKS[4] = { 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000 };
+#endif
+
+static void handleEvent(const SDL_Event *event, bool *running);
+static bool isIdle(bool drewLastPass);
 static void update();
-static void updateMouseBox();
+static void moveMouseBox(int x, int y);
+static void handleMouseButton(const SDL_MouseButtonEvent *button);
 static void render(SDL_Renderer *renderer);
+static void createBoardLayer(SDL_Renderer *renderer);
 static void renderBoard(SDL_Renderer *renderer);
 static void renderPieces(SDL_Renderer *renderer);
 static void renderMouseBox(SDL_Renderer *renderer);
-static int addPossiblePiece(ChessPiece piece);
-static void createPiece(std::string name,
-                        ValidMoveFunction function,
-                        std::string texturePath);
-static int idForNameAndColor(std::string name, int color);
-static SDL_Texture *textureForPath(SDL_Renderer *renderer, std::string path);
+static void renderMoveHints(SDL_Renderer *renderer);
+static void loadPieceTextures(SDL_Renderer *renderer);
+static SDL_Surface *surfaceForPath(std::string path);
+static SDL_Rect atlasRectForId(int pieceId);
+static void exitWithSdlError(std::string path);
 static Vector2i getMouseBoxSquarePosition();
-static ChessPiece getPieceAtPosition(Vector2i position);
-static ChessPiece getPieceAtPosition(Vector2i position);
 static void setMoveSelectedAtPosition(Vector2i position);
 static void clearSelections();
 static void setPieceSelectedAtPosition(Vector2i position);
-static bool pieceCanMove(ChessPiece piece,
-                         Vector2i position,
-                         Vector2i nextPosition);
-static void movePiece(ChessPiece piece,
-                      Vector2i position,
-                      Vector2i nextPosition);
-static int getIntSign(int num);
-static void switchTurns();
-static bool isColorsTurn(int color);
-static int getIdAtPosition(Vector2i position);
-static int getColorAtPosition(Vector2i position);
-static void takePiece(int color, Vector2i takePosition);
-static void printGameState();
-static void printTakenPieces(std::vector<int> takenPieces);
-static std::string getPieceNameForId(int id);
-static inline int positiveMod(int i, int n);
-static bool positionIsVulnerable(int color, Vector2i position);
-static bool isKingInCheck(int color);
-static bool isKingInCheckMate(int color);
 static void checkEndGame();
 static void reset();
-static bool outOfBounds(Vector2i position);
-static bool canBeTakenOutOfCheck(int color);
-static bool nextMoveTakesColorOutOfCheck(int color,
-                                         Vector2i currentPosition,
-                                         Vector2i nextPosition);
+static void makeComputerMove();
+static void saveGame();
 
 SDL_Renderer *gRenderer = nullptr;
 
-static int GAME_BOARD[8][8] = {
-    { 0, 0, 0, 0, 0, 0, 0, 0 },
-    { 0, 0, 0, 0, 0, 0, 0, 0 },
-    { 0, 0, 0, 0, 0, 0, 0, 0 },
-    { 0, 0, 0, 0, 0, 0, 0, 0 },
-    { 0, 0, 0, 0, 0, 0, 0, 0 },
-    { 0, 0, 0, 0, 0, 0, 0, 0 },
-    { 0, 0, 0, 0, 0, 0, 0, 0 },
-    { 0, 0, 0, 0, 0, 0, 0, 0 },
-};
-
 static Vector2i selectedPiecePosition = { 0, 0 };
 static Vector2i selectedMovePosition = { 0, 0 };
 bool pieceSelected = false;
 bool moveSelected = false;
 
-static std::vector<ChessPiece> possiblePieces;
+// The selected piece's legal moves by destination square, and the
+// destinations as a bitboard, worked out once when it is selected.
+static Move selectedMoves[SQUARE_COUNT];
+static Bitboard selectedDestinations = 0;
+
+// Every piece image in both colors, so a frame's pieces all come from one
+// texture and need no color changes.
+static SDL_Texture *pieceAtlas = nullptr;
+
+// The checkerboard, drawn once.  Null if the renderer can't draw to a
+// texture, in which case it is drawn square by square every frame.
+static SDL_Texture *boardLayer = nullptr;
+
+// Everything a frame shows.  A frame is only drawn when this differs from
+// the last one drawn, or when the window asks to be repainted.
+typedef struct
+{
+    uint64_t positionKey;
+    size_t plies;
+    int winner;
+    bool pieceSelected;
+    bool moveSelected;
+    Vector2i selectedPiecePosition;
+    Vector2i selectedMovePosition;
+    int mouseBoxX;
+    int mouseBoxY;
+} FrameState;
+
+static FrameState lastFrame;
+static bool redrawNeeded = true;
+
+// Where the loop's time goes, printed when the window closes.
+typedef struct
+{
+    uint64_t framesRendered;
+    uint64_t framesSkipped;
+    uint64_t updates;
+    uint64_t droppedUpdates;    // Given up on by MAX_UPDATES_PER_FRAME.
+    uint64_t idleWaits;
+    double updateMs;
+    double renderMs;
+    double maxUpdateMs;
+    double maxRenderMs;
+    double idleMs;              // Blocked waiting for events or a frame slot.
+} LoopStats;
+
+static LoopStats loopStats = LoopStats();
+
+// Set with --fps <n>; 0 leaves the frame rate to vsync.
+static int maxFramesPerSecond = 0;
 
 static SDL_Rect mouseBox = {
     0, 0,
@@ -121,17 +155,67 @@ static SDL_Rect mouseBox = {
     CELL_HEIGHT
 };
 
-static Uint32 mouseState = SDL_GetMouseState(&mouseBox.x, &mouseBox.y);
+// Set with --computer white|black.  0 leaves both sides to the mouse, though
+// space still asks the computer for a single move.
+static int computerColor = 0;
+
+// Picks between moves when --book <file> gives the computer an opening book.
+static std::mt19937 bookRandom(std::random_device{}());
 
-static int currentTurn = COLOR_WHITE;
-static std::vector<int> whitesTakenPieces;
-static std::vector<int> blacksTakenPieces;
-static Vector2i whiteKingPosition;
-static Vector2i blackKingPosition;
-static int winner = 0;
+// Set with --record <file>.  Each game is appended to it once, when it ends
+// or when the window closes on it.
+static const char *recordPath = nullptr;
+static bool gameSaved = false;
+
+static FrameState currentFrame();
+static bool framesDiffer(const FrameState &frame, const FrameState &other);
+static double millisecondsNow();
+static void printLoopStats();
 
 int main(int argc, const char * argv[])
 {
+    if (argc > 1)
+    {
+        int status = runCommand(argc, argv);
+        
+        if (status >= 0)
+        {
+            return status;
+        }
+    }
+    
+    for (int argIndex = 1; argIndex + 1 < argc; argIndex++)
+    {
+        if (strcmp(argv[argIndex], "--computer") == 0)
+        {
+            computerColor = (strcmp(argv[argIndex + 1], "white") == 0) ?
+                            COLOR_WHITE : COLOR_BLACK;
+        }
+        else if (strcmp(argv[argIndex], "--book") == 0 &&
+                 !openBook(argv[argIndex + 1]))
+        {
+            std::cout << "Unable to read book " << argv[argIndex + 1] << std::endl;
+        }
+        else if (strcmp(argv[argIndex], "--tablebases") == 0 &&
+                 setTablebasePath(argv[argIndex + 1]) < 0)
+        {
+            std::cout << "Unable to read tablebases in " << argv[argIndex + 1] << std::endl;
+        }
+        else if (strcmp(argv[argIndex], "--nnue") == 0 &&
+                 !loadNnue(argv[argIndex + 1]))
+        {
+            std::cout << "Unable to load network " << argv[argIndex + 1] << std::endl;
+        }
+        else if (strcmp(argv[argIndex], "--record") == 0)
+        {
+            recordPath = argv[argIndex + 1];
+        }
+        else if (strcmp(argv[argIndex], "--fps") == 0)
+        {
+            maxFramesPerSecond = std::max(0, atoi(argv[argIndex + 1]));
+        }
+    }
+    
     if (SDL_Init(SDL_INIT_EVERYTHING) < 0)
     {
         std::cout << "Unable to init SDL" << std::endl;
@@ -176,340 +260,216 @@ int main(int argc, const char * argv[])
     
     SDL_SetRenderDrawBlendMode(gRenderer, SDL_BLENDMODE_BLEND);
     
+    initBitboards();
+    initZobrist();
     initPieces();
+    resizeTranspositionTable(DEFAULT_HASH_MB);
+    loadPieceTextures(gRenderer);
+    createBoardLayer(gRenderer);
     reset();
     
     bool running = true;
     SDL_Event event;
     
-    double previous = (double)SDL_GetTicks();
+    // Updates run at exactly MS_PER_UPDATE; frames are drawn at most once
+    // per pass, only when something changed, and no more often than --fps.
+    double previous = millisecondsNow();
     double lag = 0.0;
+    double lastFrameStart = previous;
+    bool drewLastPass = true;
     
     while (running)
     {
-        while (SDL_PollEvent(&event))
-        {
-            switch (event.type)
-            {
-                case SDL_QUIT:
-                    running = false;
-                    break;
-                    
-                case SDL_KEYDOWN:
-                    
-                    if (winner != 0 &&
-                        event.key.keysym.sym == SDLK_RETURN)
-                    {
-                        reset();
-                    }
-                    
-                    break;
-                    
-                default:
-                    break;
-            }
-        }
-        
-        double current = (double)SDL_GetTicks();
-        double elapsed = current - previous;
-        lag += elapsed;
-        previous = current;
-        
-        while (lag >= MS_PER_UPDATE)
+        if (isIdle(drewLastPass))
         {
-            if (winner == 0)
+            // Nothing moves until the user does something, so sleep until
+            // they do and then update straight away to see what it was.
+            double waitStart = millisecondsNow();
+            
+            if (SDL_WaitEventTimeout(&event, IDLE_WAIT_MS))
             {
-                update();
+                handleEvent(&event, &running);
             }
-            lag -= elapsed;
-        }
-        
-        render(gRenderer);
-    }
-    
-    return 0;
-}
-
-static bool pieceAtPosition(Vector2i position)
-{
-    return (GAME_BOARD[position.x][position.y] != 0);
-}
-
-static void initPieces()
-{
-    createPiece("Pawn", [](Vector2i currentPos, Vector2i nextPos) -> bool {
-        // A but hacky and unclear but it works.
-        // The pieces color corresponds to the direction it can move
-        // (Up is negative, down is positive).
-        int allowedDirection = getColorAtPosition(currentPos);
-        
-        if (nextPos.y == currentPos.y + allowedDirection &&
-            abs(nextPos.x - currentPos.x) == 1 &&
-            pieceAtPosition(nextPos))
-        {
-            return true;
-        }
-        
-        if (nextPos.x != currentPos.x)
-        {
-            return false;
+            
+            previous = millisecondsNow();
+            lag = MS_PER_UPDATE;
+            loopStats.idleWaits++;
+            loopStats.idleMs += previous - waitStart;
         }
         
-        if (nextPos.y == currentPos.y + allowedDirection)
+        while (SDL_PollEvent(&event))
         {
-            return true;
+            handleEvent(&event, &running);
         }
         
-        int secondRelativeRank = positiveMod(allowedDirection, BOARD_SIZE - 1);
-        
-        if (nextPos.y == currentPos.y + (allowedDirection * 2) &&
-            // Definitely hacky and unclear, but still, it works.
-            // Example:
-            //      If the piece's color is white, which corresponds to -1,
-            //      and BOARD_SIZE == 8, -1 % (8 - 1) == -1 % 7 == 6.
-            //      If the piece's color is black, which corresponds to 1,
-            //      and BOARD_SIZE == 8, 1 % (8 - 1) == 1 % 7 == 1.
-            //      In each of these cases, this trick correctly picks the
-            //      second rank relative to the direction the player is facing.
-            currentPos.y == secondRelativeRank)
-        {
-            return true;
-        }
+        double current = millisecondsNow();
+        lag += current - previous;
+        previous = current;
         
-        // There currently is not enough information being stored to represent
-        // an En Passant.  If the last move's position was stored for each color
-        // it would be possible.  I'll do it later.
+        int updates = 0;
         
-        return false;
-    }, "pawn.png");
-    
-    createPiece("Rook", [](Vector2i currentPos, Vector2i nextPos) -> bool {
-        // Castling will be implemented in the King's callback.
-        if (nextPos.x == currentPos.x)
+        while (lag >= MS_PER_UPDATE && updates < MAX_UPDATES_PER_FRAME)
         {
-            for (int y = currentPos.y + getIntSign(nextPos.y - currentPos.y);
-                 y < BOARD_SIZE && y >= 0 && y != nextPos.y;
-                 y += getIntSign(nextPos.y - currentPos.y))
-            {
-                if (GAME_BOARD[currentPos.x][y] != 0)
-                {
-                    return false;
-                }
-            }
-        }
-        else if (nextPos.y == currentPos.y)
-        {
-            for (int x = currentPos.x + getIntSign(nextPos.x - currentPos.x);
-                 x < BOARD_SIZE && x >= 0 && x != nextPos.x;
-                 x += getIntSign(nextPos.x - currentPos.x))
+            double updateStart = millisecondsNow();
+            
+            if (getWinner() == 0)
             {
-                if (GAME_BOARD[x][currentPos.y] != 0)
-                {
-                    return false;
-                }
+                update();
             }
-        }
-        else
-        {
-            return false;
+            
+            double updateMs = millisecondsNow() - updateStart;
+            loopStats.updates++;
+            loopStats.updateMs += updateMs;
+            loopStats.maxUpdateMs = std::max(loopStats.maxUpdateMs, updateMs);
+            
+            lag -= MS_PER_UPDATE;
+            updates++;
         }
         
-        return true;
-    }, "rook.png");
-    
-    createPiece("Knight", [](Vector2i currentPos, Vector2i nextPos) -> bool {
-        if ((abs(nextPos.x - currentPos.x) == 2 &&
-             abs(nextPos.y - currentPos.y) == 1) ||
-            (abs(nextPos.x - currentPos.x) == 1 &&
-             abs(nextPos.y - currentPos.y) == 2))
+        if (lag >= MS_PER_UPDATE)
         {
-            return true;
+            loopStats.droppedUpdates += (uint64_t)(lag / MS_PER_UPDATE);
+            lag = std::fmod(lag, MS_PER_UPDATE);
         }
         
-        return false;
-    }, "knight.png");
-    
-    createPiece("Bishop", [](Vector2i currentPos, Vector2i nextPos) -> bool {
-        // Very similar to the rook's.
-        int xDiff = nextPos.x - currentPos.x;
-        int yDiff = nextPos.y - currentPos.y;
+        double frameSlot = (maxFramesPerSecond > 0) ? 1000.0 / maxFramesPerSecond : 0.0;
+        FrameState frame = currentFrame();
+        drewLastPass = millisecondsNow() - lastFrameStart >= frameSlot &&
+                       (redrawNeeded || framesDiffer(frame, lastFrame));
         
-        if (abs(xDiff) == abs(yDiff))
+        if (drewLastPass)
         {
-            int xDir = getIntSign(xDiff);
-            int yDir = getIntSign(yDiff);
+            double renderStart = millisecondsNow();
+            render(gRenderer);
+            lastFrame = frame;
+            redrawNeeded = false;
             
-            for (int x = currentPos.x + xDir, y = currentPos.y + yDir;
-                 x < BOARD_SIZE && x >= 0 &&
-                 y < BOARD_SIZE && y >= 0;
-                 x += xDir, y += yDir)
-            {
-                if (x == nextPos.x &&
-                    y == nextPos.y)
-                {
-                    return true;
-                }
-                
-                if (pieceAtPosition({ x, y }))
-                {
-                    return false;
-                }
-            }
+            double renderMs = millisecondsNow() - renderStart;
+            loopStats.framesRendered++;
+            loopStats.renderMs += renderMs;
+            loopStats.maxRenderMs = std::max(loopStats.maxRenderMs, renderMs);
+            lastFrameStart = renderStart;
         }
         else
         {
-            return false;
-        }
-        
-        return true;
-    }, "bishop.png");
-    
-    createPiece("Queen", [](Vector2i currentPos, Vector2i nextPos) -> bool {
-        int xDiff = nextPos.x - currentPos.x;
-        int yDiff = nextPos.y - currentPos.y;
-        
-        if (abs(xDiff) == abs(yDiff))
-        {
-            int xDir = getIntSign(xDiff);
-            int yDir = getIntSign(yDiff);
+            // Presenting is what waits for vsync, so a pass that draws
+            // nothing sleeps until the next update is due instead of
+            // spinning.
+            loopStats.framesSkipped++;
+            
+            double sleepMs = MS_PER_UPDATE - lag;
             
-            for (int x = currentPos.x + xDir, y = currentPos.y + yDir;
-                 x < BOARD_SIZE && x >= 0 &&
-                 y < BOARD_SIZE && y >= 0;
-                 x += xDir, y += yDir)
+            if (sleepMs >= 1.0)
             {
-                if (x == nextPos.x &&
-                    y == nextPos.y)
-                {
-                    return true;
-                }
-                
-                if (pieceAtPosition({ x, y }))
-                {
-                    return false;
-                }
+                SDL_Delay((Uint32)sleepMs);
+                loopStats.idleMs += sleepMs;
             }
         }
-        else
-        {
-            if (nextPos.x == currentPos.x)
+    }
+    
+    printLoopStats();
+    
+    return 0;
+}
+
+static void handleEvent(const SDL_Event *event, bool *running)
+{
+    switch (event->type)
+    {
+        case SDL_QUIT:
+            saveGame();
+            *running = false;
+            break;
+            
+        case SDL_KEYDOWN:
+            
+            if (getWinner() != 0 &&
+                event->key.keysym.sym == SDLK_RETURN)
             {
-                for (int y = currentPos.y + getIntSign(nextPos.y - currentPos.y);
-                     y < BOARD_SIZE && y >= 0 && y != nextPos.y;
-                     y += getIntSign(nextPos.y - currentPos.y))
-                {
-                    if (GAME_BOARD[currentPos.x][y] != 0)
-                    {
-                        return false;
-                    }
-                }
+                reset();
             }
-            else if (nextPos.y == currentPos.y)
+            else if (getWinner() == 0 &&
+                     event->key.keysym.sym == SDLK_SPACE)
             {
-                for (int x = currentPos.x + getIntSign(nextPos.x - currentPos.x);
-                     x < BOARD_SIZE && x >= 0 && x != nextPos.x;
-                     x += getIntSign(nextPos.x - currentPos.x))
-                {
-                    if (GAME_BOARD[x][currentPos.y] != 0)
-                    {
-                        return false;
-                    }
-                }
+                makeComputerMove();
             }
-            else
+            
+            break;
+            
+        case SDL_MOUSEMOTION:
+            moveMouseBox(event->motion.x, event->motion.y);
+            break;
+            
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            // Clicks come from the event rather than from polling the
+            // mouse, so one made while the loop sleeps isn't lost.
+            moveMouseBox(event->button.x, event->button.y);
+            
+            if (event->type == SDL_MOUSEBUTTONDOWN && getWinner() == 0)
             {
-                return false;
+                handleMouseButton(&event->button);
             }
-        }
-        
-        return true;
-    }, "queen.png");
-    
-    createPiece("King", [](Vector2i currentPos, Vector2i nextPos) -> bool {
-        // Castling still needs to be implemented.
-        int xDiff = nextPos.x - currentPos.x;
-        int yDiff = nextPos.y - currentPos.y;
-        
-        if (abs(xDiff) > 1 || abs(yDiff) > 1)
-        {
-            return false;
-        }
-        
-        return true;
-    }, "king.png");
+            
+            break;
+            
+        case SDL_WINDOWEVENT:
+            // Exposed, resized, restored: the window's contents may be gone.
+            redrawNeeded = true;
+            break;
+            
+        case SDL_RENDER_TARGETS_RESET:
+            // Some backends throw target textures' contents away when the
+            // device is reset.
+            createBoardLayer(gRenderer);
+            redrawNeeded = true;
+            break;
+            
+        default:
+            break;
+    }
 }
 
-static void initBoard()
+// Whether nothing will change without an event: the last pass drew nothing,
+// no frame is waiting to be drawn and the computer has no move to make.
+static bool isIdle(bool drewLastPass)
 {
-    // Black first row.
-    int row = 0;
-    GAME_BOARD[0][row] = idForNameAndColor("Rook", COLOR_BLACK);
-    GAME_BOARD[1][row] = idForNameAndColor("Knight", COLOR_BLACK);
-    GAME_BOARD[2][row] = idForNameAndColor("Bishop", COLOR_BLACK);
-    GAME_BOARD[3][row] = idForNameAndColor("Queen", COLOR_BLACK);
-    GAME_BOARD[4][row] = idForNameAndColor("King", COLOR_BLACK);
-    blackKingPosition = { 4, row };
-    GAME_BOARD[5][row] = idForNameAndColor("Bishop", COLOR_BLACK);
-    GAME_BOARD[6][row] = idForNameAndColor("Knight", COLOR_BLACK);
-    GAME_BOARD[7][row] = idForNameAndColor("Rook", COLOR_BLACK);
-    // Black second row.
-    row = 1;
-    GAME_BOARD[0][row] = idForNameAndColor("Pawn", COLOR_BLACK);
-    GAME_BOARD[1][row] = idForNameAndColor("Pawn", COLOR_BLACK);
-    GAME_BOARD[2][row] = idForNameAndColor("Pawn", COLOR_BLACK);
-    GAME_BOARD[3][row] = idForNameAndColor("Pawn", COLOR_BLACK);
-    GAME_BOARD[4][row] = idForNameAndColor("Pawn", COLOR_BLACK);
-    GAME_BOARD[5][row] = idForNameAndColor("Pawn", COLOR_BLACK);
-    GAME_BOARD[6][row] = idForNameAndColor("Pawn", COLOR_BLACK);
-    GAME_BOARD[7][row] = idForNameAndColor("Pawn", COLOR_BLACK);
+    bool computerToMove = getWinner() == 0 &&
+                          computerColor != 0 &&
+                          isColorsTurn(computerColor);
     
-    // White first row.
-    row = BOARD_SIZE - 1;
-    GAME_BOARD[0][row] = idForNameAndColor("Rook", COLOR_WHITE);
-    GAME_BOARD[1][row] = idForNameAndColor("Knight", COLOR_WHITE);
-    GAME_BOARD[2][row] = idForNameAndColor("Bishop", COLOR_WHITE);
-    GAME_BOARD[3][row] = idForNameAndColor("Queen", COLOR_WHITE);
-    GAME_BOARD[4][row] = idForNameAndColor("King", COLOR_WHITE);
-    whiteKingPosition = { 4, row };
-    GAME_BOARD[5][row] = idForNameAndColor("Bishop", COLOR_WHITE);
-    GAME_BOARD[6][row] = idForNameAndColor("Knight", COLOR_WHITE);
-    GAME_BOARD[7][row] = idForNameAndColor("Rook", COLOR_WHITE);
-    // White second row.
-    row = BOARD_SIZE - 2;
-    GAME_BOARD[0][row] = idForNameAndColor("Pawn", COLOR_WHITE);
-    GAME_BOARD[1][row] = idForNameAndColor("Pawn", COLOR_WHITE);
-    GAME_BOARD[2][row] = idForNameAndColor("Pawn", COLOR_WHITE);
-    GAME_BOARD[3][row] = idForNameAndColor("Pawn", COLOR_WHITE);
-    GAME_BOARD[4][row] = idForNameAndColor("Pawn", COLOR_WHITE);
-    GAME_BOARD[5][row] = idForNameAndColor("Pawn", COLOR_WHITE);
-    GAME_BOARD[6][row] = idForNameAndColor("Pawn", COLOR_WHITE);
-    GAME_BOARD[7][row] = idForNameAndColor("Pawn", COLOR_WHITE);
+    return !drewLastPass &&
+           !redrawNeeded &&
+           !computerToMove &&
+           !framesDiffer(currentFrame(), lastFrame);
 }
 
 static void update()
 {
-    if (winner == 0)
+    if (getWinner() == 0 &&
+        computerColor != 0 &&
+        isColorsTurn(computerColor))
     {
-        updateMouseBox();
+        makeComputerMove();
     }
     
     checkEndGame();
 }
 
-static void updateMouseBox()
+// Snaps the mouse box to the cell under the pointer.
+static void moveMouseBox(int x, int y)
+{
+    mouseBox.x = x / mouseBox.w * mouseBox.w;
+    mouseBox.y = y / mouseBox.h * mouseBox.h;
+}
+
+// A left click selects a piece or plays the selected one to the clicked
+// square; a right click on a piece drops the selection.
+static void handleMouseButton(const SDL_MouseButtonEvent *button)
 {
-    bool lastFramePressed = mouseState & SDL_BUTTON_LMASK;
-    
-    mouseState = SDL_GetMouseState(&mouseBox.x, &mouseBox.y);
-    mouseBox.x /= mouseBox.w;
-    mouseBox.x *= mouseBox.w;
-    mouseBox.y /= mouseBox.h;
-    mouseBox.y *= mouseBox.h;
-    
     Vector2i mouseBoxSquarePosition = getMouseBoxSquarePosition();
     
-    if (mouseState & SDL_BUTTON_LMASK &&
-        !lastFramePressed)
+    if (button->button == SDL_BUTTON_LEFT)
     {
         if (pieceAtPosition(mouseBoxSquarePosition) &&
             !pieceSelected &&
@@ -520,64 +480,20 @@ static void updateMouseBox()
         else if (pieceSelected)
         {
             setMoveSelectedAtPosition(mouseBoxSquarePosition);
-            ChessPiece selected = getPieceAtPosition(selectedPiecePosition);
             
-            if (!isKingInCheck(currentTurn))
-            {
-                if (selectedPiecePosition.x != selectedMovePosition.x ||
-                    selectedPiecePosition.y != selectedMovePosition.y)
-                {
-                    if (pieceCanMove(selected,
-                                     selectedPiecePosition,
-                                     selectedMovePosition))
-                    {
-                        movePiece(selected,
-                                  selectedPiecePosition,
-                                  selectedMovePosition);
-                        switchTurns();
-                        
-                        clearSelections();
-                    }
-                }
-            }
-            else
-            {
-                if (isKingInCheckMate(currentTurn))
-                {
-                    if (currentTurn == COLOR_WHITE)
-                    {
-                        winner = COLOR_BLACK;
-                    }
-                    else
-                    {
-                        winner = COLOR_WHITE;
-                    }
-                }
-                
-                if (nextMoveTakesColorOutOfCheck(currentTurn,
-                                                 selectedPiecePosition,
-                                                 selectedMovePosition))
-                {
-                    clearSelections();
-                }
-            }
+            // The bit test is the whole check: the move is known to be
+            // legal, so castling, en passant and promotion work by click too.
+            int square = squareForPosition(selectedMovePosition);
             
-            if (isKingInCheck(currentTurn) &&
-                isKingInCheckMate(currentTurn))
+            if ((selectedDestinations & squareBit(square)) &&
+                playMove(selectedMoves[square]))
             {
-                if (currentTurn == COLOR_WHITE)
-                {
-                    winner = COLOR_BLACK;
-                }
-                else
-                {
-                    winner = COLOR_WHITE;
-                }
+                clearSelections();
             }
         }
     }
     
-    if (mouseState & SDL_BUTTON_RMASK)
+    if (button->button == SDL_BUTTON_RIGHT)
     {
         if (pieceAtPosition(mouseBoxSquarePosition) &&
             pieceSelected)
@@ -587,24 +503,118 @@ static void updateMouseBox()
     }
 }
 
+static FrameState currentFrame()
+{
+    FrameState frame;
+    frame.positionKey = getGamePosition()->key;
+    frame.plies = getGameMoveCount();
+    frame.winner = getWinner();
+    frame.pieceSelected = pieceSelected;
+    frame.moveSelected = moveSelected;
+    frame.selectedPiecePosition = selectedPiecePosition;
+    frame.selectedMovePosition = selectedMovePosition;
+    frame.mouseBoxX = mouseBox.x;
+    frame.mouseBoxY = mouseBox.y;
+    
+    return frame;
+}
+
+static bool framesDiffer(const FrameState &frame, const FrameState &other)
+{
+    return frame.positionKey != other.positionKey ||
+           frame.plies != other.plies ||
+           frame.winner != other.winner ||
+           frame.pieceSelected != other.pieceSelected ||
+           frame.moveSelected != other.moveSelected ||
+           frame.selectedPiecePosition.x != other.selectedPiecePosition.x ||
+           frame.selectedPiecePosition.y != other.selectedPiecePosition.y ||
+           frame.selectedMovePosition.x != other.selectedMovePosition.x ||
+           frame.selectedMovePosition.y != other.selectedMovePosition.y ||
+           frame.mouseBoxX != other.mouseBoxX ||
+           frame.mouseBoxY != other.mouseBoxY;
+}
+
 static void render(SDL_Renderer *renderer)
 {
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
     SDL_RenderClear(renderer);
     
-    renderBoard(renderer);
+    if (boardLayer != nullptr)
+    {
+        SDL_RenderCopy(renderer, boardLayer, nullptr, nullptr);
+    }
+    else
+    {
+        renderBoard(renderer);
+    }
+    
     renderPieces(renderer);
+    renderMoveHints(renderer);
     renderMouseBox(renderer);
     
     SDL_RenderPresent(renderer);
 }
 
+// A dot in the middle of every square the selected piece can move to.
+static void renderMoveHints(SDL_Renderer *renderer)
+{
+    SDL_Rect hints[SQUARE_COUNT];
+    int hintCount = 0;
+    Bitboard destinations = pieceSelected ? selectedDestinations : 0;
+    
+    while (destinations != 0)
+    {
+        Vector2i position = positionForSquare(popLowestSquare(&destinations));
+        
+        hints[hintCount++] = {
+            CELL_WIDTH * position.x + CELL_WIDTH / 3,
+            CELL_HEIGHT * position.y + CELL_HEIGHT / 3,
+            CELL_WIDTH / 3,
+            CELL_HEIGHT / 3
+        };
+    }
+    
+    if (hintCount > 0)
+    {
+        SDL_SetRenderDrawColor(renderer, 0, 128, 0, 120);
+        SDL_RenderFillRects(renderer, hints, hintCount);
+    }
+}
+
 static void renderMouseBox(SDL_Renderer *renderer)
 {
     SDL_SetRenderDrawColor(renderer, 255, 255, 0, 100);
     SDL_RenderFillRect(renderer, &mouseBox);
 }
 
+// Creates boardLayer the first time and (re)draws the board into it.
+static void createBoardLayer(SDL_Renderer *renderer)
+{
+    if (boardLayer == nullptr)
+    {
+        boardLayer = SDL_CreateTexture(renderer,
+                                       SDL_PIXELFORMAT_ARGB8888,
+                                       SDL_TEXTUREACCESS_TARGET,
+                                       WINDOW_WIDTH,
+                                       WINDOW_HEIGHT);
+    }
+    
+    if (boardLayer == nullptr)
+    {
+        return;
+    }
+    
+    if (SDL_SetRenderTarget(renderer, boardLayer) != 0)
+    {
+        SDL_DestroyTexture(boardLayer);
+        boardLayer = nullptr;
+        return;
+    }
+    
+    renderBoard(renderer);
+    SDL_SetRenderTarget(renderer, nullptr);
+}
+
 static void renderBoard(SDL_Renderer *renderer)
 {
     for (int row = 0; row < BOARD_SIZE; row++)
@@ -643,173 +653,226 @@ static void renderBoard(SDL_Renderer *renderer)
     }
 }
 
+// Only occupied squares are drawn, and with SDL 2.0.18 or later they all go
+// to the renderer in one call.
 static void renderPieces(SDL_Renderer *renderer)
 {
-    for (int row = 0; row < BOARD_SIZE; row++)
-    {
-        for (int col = 0; col < BOARD_SIZE; col++)
+    const Position *position = getGamePosition();
+    Bitboard occupied = position->occupied;
+    
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    // Two triangles per square: top left, top right, bottom right, then top
+    // left, bottom right, bottom left.
+    static const int CORNERS[6] = { 0, 1, 2, 0, 2, 3 };
+    
+    SDL_Vertex vertices[SQUARE_COUNT * 4];
+    int indices[SQUARE_COUNT * 6];
+    int vertexCount = 0;
+    int indexCount = 0;
+#endif
+    
+    while (occupied != 0)
+    {
+        int square = popLowestSquare(&occupied);
+        Vector2i boardPosition = positionForSquare(square);
+        SDL_Rect srcRect = atlasRectForId(position->board[square]);
+        SDL_Rect squareRect = {
+            CELL_WIDTH * boardPosition.x,
+            CELL_HEIGHT * boardPosition.y,
+            CELL_WIDTH,
+            CELL_HEIGHT
+        };
+        
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        for (int corner = 0; corner < 4; corner++)
         {
-            int pieceId = GAME_BOARD[row][col];
-            ChessPiece piece = possiblePieces[abs(pieceId)];
-            
-            if (pieceId > 0)
-            {
-                SDL_SetTextureColorMod(piece.texture, 0, 0, 0);
-            }
-            else
-            {
-                SDL_SetTextureColorMod(piece.texture, 255, 255, 255);
-            }
+            int right = (corner == 1 || corner == 2);
+            int bottom = (corner >= 2);
+            SDL_Vertex *vertex = &vertices[vertexCount + corner];
             
-            int squareWidth = WINDOW_WIDTH / BOARD_SIZE;
-            
-            Vector2i rectPos = {
-                squareWidth * row,
-                squareWidth * col
-            };
-            
-            SDL_Rect squareRect = {
-                rectPos.x,
-                rectPos.y,
-                squareWidth,
-                squareWidth
-            };
-            
-            SDL_Rect srcRect = {
-                0, 0,
-                TEXTURE_WIDTH,
-                TEXTURE_HEIGHT
-            };
-            
-            SDL_RenderCopy(renderer, piece.texture, &srcRect, &squareRect);
-            
-            Vector2i renderingPosition = { row, col };
-            
-            if (selectedPiecePosition.x == renderingPosition.x &&
-                selectedPiecePosition.y == renderingPosition.y &&
-                pieceSelected)
-            {
-                SDL_SetRenderDrawColor(renderer, 0, 255, 0, 100);
-                SDL_RenderFillRect(renderer, &squareRect);
-            }
-            
-            if (selectedMovePosition.x == renderingPosition.x &&
-                selectedMovePosition.y == renderingPosition.y &&
-                moveSelected)
-            {
-                SDL_SetRenderDrawColor(renderer, 0, 0, 255, 100);
-                SDL_RenderFillRect(renderer, &squareRect);
-            }
+            vertex->position.x = (float)(squareRect.x + right * squareRect.w);
+            vertex->position.y = (float)(squareRect.y + bottom * squareRect.h);
+            vertex->color = { 255, 255, 255, 255 };
+            vertex->tex_coord.x = (float)(srcRect.x + right * srcRect.w) / ATLAS_WIDTH;
+            vertex->tex_coord.y = (float)(srcRect.y + bottom * srcRect.h) / ATLAS_HEIGHT;
+        }
+        
+        for (int index = 0; index < 6; index++)
+        {
+            indices[indexCount++] = vertexCount + CORNERS[index];
         }
+        
+        vertexCount += 4;
+#else
+        SDL_RenderCopy(renderer, pieceAtlas, &srcRect, &squareRect);
+#endif
     }
-}
-
-static int addPossiblePiece(ChessPiece piece)
-{
-    if (possiblePieces.size() == 0)
+    
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    SDL_RenderGeometry(renderer, pieceAtlas, vertices, vertexCount, indices, indexCount);
+#endif
+    
+    if (pieceSelected)
     {
-        ChessPiece nullPiece = {
-            0,
-            "null",
-            [](Vector2i currentPos, Vector2i nextPos) ->bool {
-                return false;
-            }
+        SDL_Rect selectedRect = {
+            CELL_WIDTH * selectedPiecePosition.x,
+            CELL_HEIGHT * selectedPiecePosition.y,
+            CELL_WIDTH,
+            CELL_HEIGHT
         };
         
-        possiblePieces.push_back(nullPiece);
+        SDL_SetRenderDrawColor(renderer, 0, 255, 0, 100);
+        SDL_RenderFillRect(renderer, &selectedRect);
     }
     
-    piece.id = (int)possiblePieces.size();
-    possiblePieces.push_back(piece);
-    
-    return piece.id;
-}
-
-static void createPiece(std::string name,
-                        ValidMoveFunction function,
-                        std::string texturePath)
-{
-    addPossiblePiece({
-        0,
-        name,
-        function,
-        textureForPath(gRenderer, texturePath)
-    });
+    if (moveSelected)
+    {
+        SDL_Rect moveRect = {
+            CELL_WIDTH * selectedMovePosition.x,
+            CELL_HEIGHT * selectedMovePosition.y,
+            CELL_WIDTH,
+            CELL_HEIGHT
+        };
+        
+        SDL_SetRenderDrawColor(renderer, 0, 0, 255, 100);
+        SDL_RenderFillRect(renderer, &moveRect);
+    }
 }
 
-static int idForNameAndColor(std::string name, int color)
+// Packs the piece images into pieceAtlas.  The images are of white pieces;
+// the black row is the same images with the color taken out, which is what
+// a color mod of 0, 0, 0 used to do to them every frame.
+static void loadPieceTextures(SDL_Renderer *renderer)
 {
-    for (int pieceIndex = 0;
-         pieceIndex < possiblePieces.size();
-         pieceIndex++)
+    const std::vector<ChessPiece> &pieces = getPossiblePieces();
+    SDL_Surface *atlas = SDL_CreateRGBSurface(0,
+                                              ATLAS_WIDTH,
+                                              ATLAS_HEIGHT,
+                                              32,
+                                              ATLAS_MASKS[0],
+                                              ATLAS_MASKS[1],
+                                              ATLAS_MASKS[2],
+                                              ATLAS_MASKS[3]);
+    
+    if (atlas == nullptr)
+    {
+        exitWithSdlError("the piece atlas");
+    }
+    
+    // The null piece has no image.
+    for (size_t id = 1; id < pieces.size(); id++)
+    {
+        SDL_Surface *surface = surfaceForPath(pieces[id].imagePath);
+        SDL_Rect srcRect = { 0, 0, TEXTURE_WIDTH, TEXTURE_HEIGHT };
+        
+        // Copy the pixels, alpha and all, rather than blending them onto the
+        // empty atlas.
+        SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
+        
+        for (int color = COLOR_WHITE; color <= COLOR_BLACK; color += 2)
+        {
+            SDL_Rect destRect = atlasRectForId((int)id * color);
+            SDL_BlitSurface(surface, &srcRect, atlas, &destRect);
+        }
+        
+        SDL_FreeSurface(surface);
+    }
+    
+    if (SDL_MUSTLOCK(atlas))
+    {
+        SDL_LockSurface(atlas);
+    }
+    
+    for (int y = TEXTURE_HEIGHT; y < ATLAS_HEIGHT; y++)
     {
-        if (name == possiblePieces[pieceIndex].name)
+        Uint8 *pixel = (Uint8 *)atlas->pixels + y * atlas->pitch;
+        
+        // Red, green, blue, alpha in memory on every platform.
+        for (int x = 0; x < ATLAS_WIDTH; x++, pixel += 4)
         {
-            return pieceIndex * color;
+            pixel[0] = 0;
+            pixel[1] = 0;
+            pixel[2] = 0;
         }
     }
     
-    return INT32_MAX;
+    if (SDL_MUSTLOCK(atlas))
+    {
+        SDL_UnlockSurface(atlas);
+    }
+    
+    pieceAtlas = SDL_CreateTextureFromSurface(renderer, atlas);
+    SDL_FreeSurface(atlas);
+    
+    if (pieceAtlas == nullptr)
+    {
+        exitWithSdlError("the piece atlas");
+    }
+    
+    SDL_SetTextureBlendMode(pieceAtlas, SDL_BLENDMODE_BLEND);
 }
 
-static SDL_Texture *textureForPath(SDL_Renderer *renderer, std::string path)
+// The image at path, converted to the atlas format so it can be packed.
+static SDL_Surface *surfaceForPath(std::string path)
 {
     std::string prepath = "Resources/Images/";
     SDL_RWops *textureRWops = SDL_RWFromFile((prepath + path).c_str(), "rb");
     
     if (textureRWops == nullptr)
     {
-        std::cout << "Unable to load " << path << std::endl;
-        std::cout << SDL_GetError() << std::endl;
-        SDL_Quit();
-        IMG_Quit();
-        exit(1);
+        exitWithSdlError(path);
     }
     
-    SDL_Surface *textureSurface = IMG_LoadPNG_RW(textureRWops);
+    SDL_Surface *loaded = IMG_LoadPNG_RW(textureRWops);
     
-    if (textureSurface == nullptr)
+    if (loaded == nullptr)
     {
-        std::cout << "Unable to load " << path << std::endl;
-        std::cout << SDL_GetError() << std::endl;
-        SDL_Quit();
-        IMG_Quit();
-        exit(1);
+        exitWithSdlError(path);
     }
     
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, textureSurface);
+    SDL_Surface *surface = SDL_ConvertSurfaceFormat(loaded, ATLAS_FORMAT, 0);
+    SDL_FreeSurface(loaded);
     
-    if (texture == nullptr)
+    if (surface == nullptr)
     {
-        std::cout << "Unable to load " << path << std::endl;
-        std::cout << SDL_GetError() << std::endl;
-        SDL_Quit();
-        IMG_Quit();
-        exit(1);
+        exitWithSdlError(path);
     }
     
-    return texture;
+    return surface;
 }
 
-static Vector2i getMouseBoxSquarePosition()
+// Where pieceId's image is in the atlas; ids are negative for white.
+static SDL_Rect atlasRectForId(int pieceId)
 {
     return {
-        mouseBox.x / mouseBox.w,
-        mouseBox.y / mouseBox.h 
+        (abs(pieceId) - 1) * TEXTURE_WIDTH,
+        (pieceId > 0) ? TEXTURE_HEIGHT : 0,
+        TEXTURE_WIDTH,
+        TEXTURE_HEIGHT
     };
 }
 
-static ChessPiece getPieceAtPosition(Vector2i position)
+static void exitWithSdlError(std::string path)
 {
-    int pieceId = GAME_BOARD[position.x][position.y];
-    ChessPiece piece = possiblePieces[abs(pieceId)];
-    
-    return piece;
+    std::cout << "Unable to load " << path << std::endl;
+    std::cout << SDL_GetError() << std::endl;
+    SDL_Quit();
+    IMG_Quit();
+    exit(1);
+}
+
+static Vector2i getMouseBoxSquarePosition()
+{
+    return {
+        mouseBox.x / mouseBox.w,
+        mouseBox.y / mouseBox.h 
+    };
 }
 
 static void setPieceSelectedAtPosition(Vector2i position)
 {
     selectedPiecePosition = position;
+    selectedDestinations = legalMovesFrom(position, selectedMoves);
     pieceSelected = true;
 }
 
@@ -823,374 +886,130 @@ static void clearSelections()
 {
     pieceSelected = false;
     moveSelected = false;
+    selectedDestinations = 0;
 }
 
-static bool pieceCanMove(ChessPiece piece, Vector2i position, Vector2i nextPosition)
-{
-    int currentPieceId = GAME_BOARD[position.x][position.y];
-    int nextPieceId = GAME_BOARD[nextPosition.x][nextPosition.y];
-    
-    return (possiblePieces[piece.id].canMoveToPosition(position, nextPosition) &&
-            (getIntSign(currentPieceId) != getIntSign(nextPieceId) ||
-            nextPieceId == 0));
-}
+// Code is from
+// http://stackoverflow.com/questions/14997165/fastest-way-to-get-a-positive-modulo-in-c-c
 
-static void movePiece(ChessPiece piece, Vector2i position, Vector2i nextPosition)
+static void checkEndGame()
 {
-    int pieceId = GAME_BOARD[position.x][position.y];
-    GAME_BOARD[position.x][position.y] = 0;
+    int winner = getWinner();
     
-    // In this case the color doesn't actually matter.
-    if (abs(pieceId) == idForNameAndColor("King",
-                                         COLOR_BLACK))
+    if (winner != 0)
     {
-        if (currentTurn == COLOR_WHITE)
+        if (winner == COLOR_WHITE)
         {
-            whiteKingPosition = selectedMovePosition;
+            std::cout << "Game over, white wins" << std::endl;
+        }
+        else if (winner == COLOR_BLACK)
+        {
+            std::cout << "Game over, black wins" << std::endl;
         }
         else
         {
-            blackKingPosition = selectedMovePosition;
+            std::cout << "Game over, stalemate" << std::endl;
         }
+        
+        std::cout << "Press enter to restart game" << std::endl;
+        saveGame();
     }
-    
-    if (GAME_BOARD[nextPosition.x][nextPosition.y] != 0)
-    {
-        // Give piece to current player.
-        // ...
-        takePiece(currentTurn, nextPosition);
-    }
-    
-    GAME_BOARD[nextPosition.x][nextPosition.y] = pieceId;
-}
-
-static int getIntSign(int num)
-{
-    if (num < 0)
-    {
-        return -1;
-    }
-    
-    return 1;
-}
-
-static void switchTurns()
-{
-    currentTurn = (currentTurn == COLOR_WHITE) ? COLOR_BLACK : COLOR_WHITE;
-    printGameState();
-}
-
-static bool isColorsTurn(int color)
-{
-    return (currentTurn == color);
 }
 
-static int getIdAtPosition(Vector2i position)
-{
-    return GAME_BOARD[position.x][position.y];
-}
-
-static int getColorAtPosition(Vector2i position)
-{
-    return getIntSign(getIdAtPosition(position));
-}
-
-static void takePiece(int color, Vector2i takePosition)
+static void reset()
 {
-    if (isColorsTurn(color))
-    {
-        int takeId = GAME_BOARD[takePosition.x][takePosition.y];
-        GAME_BOARD[takePosition.x][takePosition.y] = 0;
-        
-        switch (color)
-        {
-            case COLOR_WHITE:
-                whitesTakenPieces.push_back(takeId);
-                break;
-                
-            case COLOR_BLACK:
-                blacksTakenPieces.push_back(takeId);
-                break;
-        }
-    }
+    resetGame();
+    clearSelections();
+    gameSaved = false;
 }
 
-static void printGameState()
+// Plays from the book while it has a move, and otherwise blocks for up to
+// COMPUTER_MOVE_TIME_MS while the engine thinks.
+static void makeComputerMove()
 {
-    std::string turnString;
+    Move bookMove = pickBookMove(getGamePosition(), bookRandom());
     
-    if (currentTurn == COLOR_WHITE)
-    {
-        turnString = "White";
-    }
-    else
+    if (bookMove != NULL_MOVE)
     {
-        turnString = "Black";
+        playMove(bookMove);
+        clearSelections();
+        return;
     }
     
-    std::cout << "Current Turn: " << turnString << std::endl;
+    SearchLimits limits = {
+        0,
+        COMPUTER_MOVE_TIME_MS,
+        (int)std::thread::hardware_concurrency()
+    };
+    Move move = searchPosition(getGamePosition(), limits, [](const SearchReport &report) {
+        std::cout << formatSearchReport(report) << std::endl;
+    }, nullptr);
     
-    std::cout << "White's taken pieces:" << std::endl;
-    printTakenPieces(whitesTakenPieces);
-    std::cout << "Black's taken pieces:" << std::endl;
-    if (blacksTakenPieces.size() > 0)
+    if (move != NULL_MOVE)
     {
-        printTakenPieces(blacksTakenPieces);
+        playMove(move);
+        clearSelections();
     }
-    std::cout << std::endl;
 }
 
-static void printTakenPieces(std::vector<int> takenPieces)
+static void saveGame()
 {
-    for (int pieceIndex = 0;
-         pieceIndex < takenPieces.size();
-         pieceIndex++)
+    if (recordPath == nullptr || gameSaved || getGameMoveCount() == 0)
     {
-        std::string pieceName = getPieceNameForId(abs(takenPieces[pieceIndex]));
-        std::cout << " - " << pieceName << std::endl;
-    }
-}
-
-static std::string getPieceNameForId(int id)
-{
-    return possiblePieces[id].name;
-}
-
-// Code is from
-// http://stackoverflow.com/questions/14997165/fastest-way-to-get-a-positive-modulo-in-c-c
-static inline int positiveMod(int i, int n)
-{
-    return (i % n + n) % n;
-}
-
-static bool positionIsVulnerable(int color, Vector2i position)
-{
-    if (position.x < 0 || position.x >= BOARD_SIZE ||
-        position.y < 0 || position.y >= BOARD_SIZE)
-    {
-        return false;
-    }
-    
-    int pieceId = getIdAtPosition(position);
-    
-    // Let's brute force it.  There are only 64 spaces to try each turn so this
-    // isn't too bad.
-    for (int row = 0; row < BOARD_SIZE; row++)
-    {
-        for (int col = 0; col < BOARD_SIZE; col++)
-        {
-            Vector2i currentPosition = { row, col };
-            int currentId = getIdAtPosition(currentPosition);
-            
-            if (currentId == 0 ||
-                getIntSign(currentId) == color ||
-                currentId == pieceId)
-            {
-                continue;
-            }
-            
-            int absId = abs(currentId);
-            
-            if (possiblePieces[absId].canMoveToPosition(currentPosition,
-                                                        position))
-            {
-                return true;
-            }
-        }
+        return;
     }
     
-    return false;
-}
-
-static bool isKingInCheck(int color)
-{
-    Vector2i kingPosition;
-    
-    if (color == COLOR_WHITE)
-    {
-        kingPosition = whiteKingPosition;
-    }
-    else
-    {
-        kingPosition = blackKingPosition;
-    }
+    gameSaved = true;
     
-    return positionIsVulnerable(color, kingPosition);
-}
-
-static bool isKingInCheckMate(int color)
-{
-    Vector2i kPos;
+    GameWriter writer;
     
-    if (color == COLOR_WHITE)
+    if (!openGameWriter(recordPath, &writer))
     {
-        kPos = whiteKingPosition;
-    }
-    else
-    {
-        kPos = blackKingPosition;
+        std::cout << "Unable to record the game in " << recordPath << std::endl;
+        return;
     }
     
-    int kId = getIdAtPosition(kPos);
-    GAME_BOARD[kPos.x][kPos.y] = 0;
+    GameRecord record;
+    record.number = (uint32_t)writer.games;
+    record.winner = (getWinner() == GAME_DRAWN) ? 0 : getWinner();
+    record.reason = (getWinner() == 0) ? GAME_END_OTHER :
+                    (getWinner() == GAME_DRAWN) ? GAME_END_STALEMATE :
+                    GAME_END_CHECKMATE;
+    record.moves = getGameMoves();
     
-    bool ans = ((positionIsVulnerable(color, kPos) ||
-                 pieceAtPosition(kPos) ||
-                 outOfBounds(kPos)) &&
-                (positionIsVulnerable(color, { kPos.x, kPos.y + 1 }) ||
-                 pieceAtPosition({ kPos.x, kPos.y + 1 }) ||
-                 outOfBounds({ kPos.x, kPos.y + 1 })) &&
-                (positionIsVulnerable(color, { kPos.x, kPos.y - 1 }) ||
-                 pieceAtPosition({ kPos.x, kPos.y - 1 }) ||
-                 outOfBounds({ kPos.x, kPos.y - 1 })) &&
-                (positionIsVulnerable(color, { kPos.x - 1, kPos.y }) ||
-                 pieceAtPosition({ kPos.x - 1, kPos.y }) ||
-                 outOfBounds({ kPos.x - 1, kPos.y })) &&
-                (positionIsVulnerable(color, { kPos.x + 1, kPos.y }) ||
-                 pieceAtPosition({ kPos.x + 1, kPos.y }) ||
-                 outOfBounds({ kPos.x + 1, kPos.y })) &&
-                (positionIsVulnerable(color, { kPos.x + 1, kPos.y + 1 }) ||
-                 pieceAtPosition({ kPos.x + 1, kPos.y + 1 }) ||
-                 outOfBounds({ kPos.x + 1, kPos.y + 1 })) &&
-                (positionIsVulnerable(color, { kPos.x - 1, kPos.y - 1 }) ||
-                 pieceAtPosition({ kPos.x - 1, kPos.y - 1 }) ||
-                 outOfBounds({ kPos.x - 1, kPos.y - 1 })) &&
-                (positionIsVulnerable(color, { kPos.x + 1, kPos.y - 1 }) ||
-                 pieceAtPosition({ kPos.x + 1, kPos.y - 1 }) ||
-                 outOfBounds({ kPos.x + 1, kPos.y - 1 })) &&
-                (positionIsVulnerable(color, { kPos.x - 1, kPos.y + 1 }) ||
-                 pieceAtPosition({ kPos.x - 1, kPos.y + 1 }) ||
-                 outOfBounds({ kPos.x - 1, kPos.y + 1 })) &&
-                !canBeTakenOutOfCheck(color));
+    std::string startFen = formatFen(getGameStart());
     
-    GAME_BOARD[kPos.x][kPos.y] = kId;
-    
-    // 64 * 9 == 576 loops per call.
-    return ans;
-}
-
-static void checkEndGame()
-{
-    if (winner != 0)
+    if (startFen != START_FEN)
     {
-        if (winner == COLOR_WHITE)
-        {
-            std::cout << "Game over, white wins" << std::endl;
-        }
-        else
-        {
-            std::cout << "Game over, black wins" << std::endl;
-        }
-        
-        std::cout << "Press enter to restart game" << std::endl;
+        record.startFen = startFen;
     }
-}
-
-static void reset()
-{
-    for (int row = 0; row < BOARD_SIZE; row++)
+    
+    if (!writeGameRecord(&writer, record))
     {
-        for (int col = 0; col < BOARD_SIZE; col++)
-        {
-            GAME_BOARD[row][col] = 0;
-        }
+        std::cout << "Unable to record the game in " << recordPath << std::endl;
     }
     
-    winner = 0;
-    clearSelections();
-    currentTurn = COLOR_WHITE;
-    initBoard();
+    closeGameWriter(&writer);
 }
 
-static bool outOfBounds(Vector2i position)
+static double millisecondsNow()
 {
-    return (position.x < 0 || position.x >= BOARD_SIZE ||
-            position.y < 0 || position.y >= BOARD_SIZE);
+    return SDL_GetPerformanceCounter() * 1000.0 / SDL_GetPerformanceFrequency();
 }
 
-static bool canBeTakenOutOfCheck(int color)
+static void printLoopStats()
 {
-    Vector2i kPos;
-    
-    if (color == COLOR_WHITE)
-    {
-        kPos = whiteKingPosition;
-    }
-    else
-    {
-        kPos = blackKingPosition;
-    }
+    uint64_t frames = std::max(loopStats.framesRendered, (uint64_t)1);
+    uint64_t updates = std::max(loopStats.updates, (uint64_t)1);
     
-    if (kPos.x < 0 || kPos.x >= BOARD_SIZE ||
-        kPos.y < 0 || kPos.y >= BOARD_SIZE)
-    {
-        return false;
-    }
-    
-    // Let's brute force it.  There are only 64 spaces to try each turn so this
-    // isn't too bad.
-    for (int row = 0; row < BOARD_SIZE; row++)
-    {
-        for (int col = 0; col < BOARD_SIZE; col++)
-        {
-            Vector2i currentPosition = { row, col };
-            int currentId = getIdAtPosition(currentPosition);
-            
-            if (currentId == 0 ||
-                getIntSign(currentId) == color)
-            {
-                continue;
-            }
-            
-            // NEED TO CHECK FOR BLOCKS GOING TO BED
-            
-            int absId = abs(currentId);
-            
-            if (possiblePieces[absId].canMoveToPosition(currentPosition,
-                                                        kPos))
-            {
-                if (positionIsVulnerable(-color, currentPosition))
-                {
-                    if (nextMoveTakesColorOutOfCheck(color, kPos, currentPosition))
-                    {
-                        return true;
-                    }
-                }
-                
-                return false;
-            }
-        }
-    }
-    
-    return true;
-}
-
-static bool nextMoveTakesColorOutOfCheck(int color,
-                                         Vector2i currentPosition,
-                                         Vector2i nextPosition)
-{
-    ChessPiece selected = getPieceAtPosition(currentPosition);
-    
-    if (pieceCanMove(selected,
-                     currentPosition,
-                     nextPosition))
-    {
-        movePiece(selected,
-                  currentPosition,
-                  nextPosition);
-        
-        if (isKingInCheck(color))
-        {
-            movePiece(selected, nextPosition, currentPosition);
-            return false;
-        }
-        
-        switchTurns();
-    }
-    else
-    {
-        return false;
-    }
-
-    return true;
+    std::cout << "Frames rendered: " << loopStats.framesRendered
+              << ", skipped: " << loopStats.framesSkipped << std::endl;
+    std::cout << "Render: " << loopStats.renderMs / frames << " ms average, "
+              << loopStats.maxRenderMs << " ms worst" << std::endl;
+    std::cout << "Updates: " << loopStats.updates
+              << " (" << loopStats.droppedUpdates << " dropped), "
+              << loopStats.updateMs / updates << " ms average, "
+              << loopStats.maxUpdateMs << " ms worst" << std::endl;
+    std::cout << "Idle: " << (uint64_t)loopStats.idleMs << " ms in "
+              << loopStats.idleWaits << " waits for events" << std::endl;
 }
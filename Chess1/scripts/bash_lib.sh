@@ -6,6 +6,7 @@ SOURCE=
 LIB=
 LIBPATH=
 INCLUDE=
+BUILD_DIR=../build
 
 AddFlag() {
     CFLAGS+=("$1")
@@ -29,6 +30,12 @@ AddLib() {
     AddInclude $2
 }
 
+# Links against a static library built by CompileLibrary.
+AddLocalLib() {
+    LIB+=("-l$1")
+    LIBPATH+=("-L$BUILD_DIR")
+}
+
 SetObjectName() {
     OBJECT=$1
 }
@@ -38,10 +45,30 @@ EchoAndRun() {
     $1
 }
 
+# CompileLibrary name file.cpp... builds $BUILD_DIR/lib<name>.a
+CompileLibrary() {
+    local name=$1
+    local objects=()
+    shift
+    mkdir -p $BUILD_DIR
+    for file in "$@"; do
+        local object=$BUILD_DIR/${file%.cpp}.o
+        g++ $(printf "%s " "${CFLAGS[@]}") -c ../$file -o $object $(printf "%s " "${INCLUDE[@]}") || exit 1
+        objects+=("$object")
+    done
+    rm -f $BUILD_DIR/lib$name.a
+    ar rcs $BUILD_DIR/lib$name.a "${objects[@]}"
+}
+
+# Compile file.cpp... links the given sources (every .cpp if none are given)
+# into ../$OBJECT.
 Compile() {
-    for file in *.cpp; do
+    SOURCE=()
+    if [ $# -eq 0 ]; then
+        set -- *.cpp
+    fi
+    for file in "$@"; do
         AddFile $file;
     done
-    g++ $(printf "%s " "${CFLAGS[@]}") -std=c++11 -g $(printf "%s " "${SOURCE[@]}") -o ../$OBJECT $(printf "%s " "${LIB[@]}") $(printf "%s " "${LIBPATH[@]}") $(printf "%s " "${INCLUDE[@]}")
+    g++ $(printf "%s " "${CFLAGS[@]}") -std=c++14 -g $(printf "%s " "${SOURCE[@]}") -o ../$OBJECT $(printf "%s " "${LIB[@]}") $(printf "%s " "${LIBPATH[@]}") $(printf "%s " "${INCLUDE[@]}")
 }
-
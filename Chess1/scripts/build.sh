@@ -2,8 +2,16 @@
 
 . bash_lib.sh
 
-AddFlag -std=c++11
+AddFlag -std=c++14
 AddFlag -g
+AddFlag -pthread
+
+# The rules engine and the headless modes.  No SDL in here.
+CompileLibrary chess1core Bitboard.cpp Position.cpp MoveGen.cpp Evaluate.cpp Search.cpp TranspositionTable.cpp Rules.cpp Commands.cpp ThreadPool.cpp SelfPlay.cpp Uci.cpp Epd.cpp MappedFile.cpp Pgn.cpp Book.cpp Tablebase.cpp Syzygy.cpp GameRecord.cpp GameHost.cpp GameServer.cpp LoadClient.cpp Nnue.cpp
+AddLocalLib chess1core
+
+SetObjectName chess1-headless
+Compile HeadlessMain.cpp
 
 AddLib SDL2 /usr/local/Cellar/sdl2/2.0.4
 AddLib SDL2_ttf /usr/local/Cellar/sdl2_ttf/2.0.14
@@ -11,4 +19,5 @@ AddLib SDL2_image /usr/local/Cellar/sdl2_image/2.0.1_1
 AddInclude /usr/local/Cellar/nlohmann_json/2.0.9
 AddIncludeRaw /usr/local/Cellar/sdl2/2.0.4/include/SDL2
 
-Compile
+SetObjectName main
+Compile main.cpp